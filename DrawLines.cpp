@@ -3,6 +3,7 @@
 #include "ColorProgram.hpp"
 
 #include "gl_errors.hpp"
+#include "gl_state.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
@@ -25,7 +26,7 @@ static Load< void > setup_buffers(LoadTagDefault, [](){
 		glGenVertexArrays(1, &vertex_buffer_for_color_program);
 
 		//set vertex_buffer_for_color_program as the current vertex array object:
-		glBindVertexArray(vertex_buffer_for_color_program);
+		gl_bind_vertex_array(vertex_buffer_for_color_program);
 
 		//set vertex_buffer as the source of glVertexAttribPointer() commands:
 		glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
@@ -56,7 +57,7 @@ static Load< void > setup_buffers(LoadTagDefault, [](){
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 		//done setting up vertex array object, so unbind it:
-		glBindVertexArray(0);
+		gl_bind_vertex_array(0);
 	}
 
 	GL_ERRORS(); //PARANOIA: make sure nothing strange happened during setup
@@ -143,22 +144,18 @@ DrawLines::~DrawLines() {
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	//set color_program as current program:
-	glUseProgram(color_program->program);
+	gl_use_program(color_program->program);
 
 	//upload OBJECT_TO_CLIP to the proper uniform location:
 	glUniformMatrix4fv(color_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip));
 
 	//use the mapping vertex_buffer_for_color_program to fetch vertex data:
-	glBindVertexArray(vertex_buffer_for_color_program);
+	gl_bind_vertex_array(vertex_buffer_for_color_program);
 
 	//run the OpenGL pipeline:
 	glDrawArrays(GL_LINES, 0, GLsizei(attribs.size()));
 
-	//reset vertex array to none:
-	glBindVertexArray(0);
-
-	//reset current program to none:
-	glUseProgram(0);
+	//n.b. vertex array and program are left bound (see gl_state.hpp)
 }
 
 
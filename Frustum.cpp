@@ -0,0 +1,178 @@
+#include "Frustum.hpp"
+
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+Frustum Frustum::from_clip(glm::mat4 const &clip_from_world) {
+	//rows of the matrix (glm stores columns):
+	glm::vec4 row[4];
+	for (uint32_t r = 0; r < 4; ++r) {
+		row[r] = glm::vec4(clip_from_world[0][r], clip_from_world[1][r], clip_from_world[2][r], clip_from_world[3][r]);
+	}
+
+	//a point is inside the clip volume when -w <= x,y,z <= w:
+	Frustum ret;
+	ret.planes[0] = row[3] + row[0]; //left
+	ret.planes[1] = row[3] - row[0]; //right
+	ret.planes[2] = row[3] + row[1]; //bottom
+	ret.planes[3] = row[3] - row[1]; //top
+	ret.planes[4] = row[3] + row[2]; //near
+	ret.planes[5] = row[3] - row[2]; //far
+	return ret;
+}
+
+void BoxList::push(glm::mat4x3 const &world_from_local, glm::vec3 const &min, glm::vec3 const &max) {
+	if (!(min.x <= max.x && min.y <= max.y && min.z <= max.z)) {
+		//unbounded: an enormous box centered at the origin is never outside any plane.
+		// (FLT_MAX rather than infinity so that 0 * extent stays 0 and not NaN)
+		cx.emplace_back(0.0f); cy.emplace_back(0.0f); cz.emplace_back(0.0f);
+		ex.emplace_back(FLT_MAX); ey.emplace_back(FLT_MAX); ez.emplace_back(FLT_MAX);
+		return;
+	}
+
+	glm::vec3 center = world_from_local * glm::vec4(0.5f * (max + min), 1.0f);
+
+	//world-space half-extent of a transformed box is |M| * local half-extent (Arvo):
+	glm::vec3 half = 0.5f * (max - min);
+	glm::vec3 extent =
+		  glm::abs(world_from_local[0]) * half.x
+		+ glm::abs(world_from_local[1]) * half.y
+		+ glm::abs(world_from_local[2]) * half.z;
+
+	cx.emplace_back(center.x); cy.emplace_back(center.y); cz.emplace_back(center.z);
+	ex.emplace_back(extent.x); ey.emplace_back(extent.y); ez.emplace_back(extent.z);
+}
+
+void BoxList::clear() {
+	cx.clear(); cy.clear(); cz.clear();
+	ex.clear(); ey.clear(); ez.clear();
+}
+
+void BoxList::reserve(size_t count) {
+	cx.reserve(count); cy.reserve(count); cz.reserve(count);
+	ex.reserve(count); ey.reserve(count); ez.reserve(count);
+}
+
+uint32_t cull_boxes(Frustum const &frustum, BoxList const &boxes, std::vector< uint8_t > *visible_) {
+	assert(visible_);
+	auto &visible = *visible_;
+
+	size_t count = boxes.size();
+	visible.assign(count, 0);
+
+	uint32_t total = 0;
+	size_t i = 0;
+
+#ifdef FRUSTUM_USE_SSE
+	//four boxes at a time:
+	__m128 const sign_mask = _mm_set1_ps(-0.0f);
+	__m128 const zero = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4) {
+		__m128 cx = _mm_loadu_ps(&boxes.cx[i]);
+		__m128 cy = _mm_loadu_ps(&boxes.cy[i]);
+		__m128 cz = _mm_loadu_ps(&boxes.cz[i]);
+		__m128 ex = _mm_loadu_ps(&boxes.ex[i]);
+		__m128 ey = _mm_loadu_ps(&boxes.ey[i]);
+		__m128 ez = _mm_loadu_ps(&boxes.ez[i]);
+
+		__m128 outside = _mm_setzero_ps();
+		for (auto const &plane : frustum.planes) {
+			__m128 nx = _mm_set1_ps(plane.x);
+			__m128 ny = _mm_set1_ps(plane.y);
+			__m128 nz = _mm_set1_ps(plane.z);
+			__m128 d = _mm_set1_ps(plane.w);
+
+			//signed distance of center (times |n|):
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_add_ps(_mm_mul_ps(nz, cz), d));
+			//projected radius of box onto plane normal:
+			__m128 radius = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_andnot_ps(sign_mask, nx), ex),
+				_mm_mul_ps(_mm_andnot_ps(sign_mask, ny), ey)),
+				_mm_mul_ps(_mm_andnot_ps(sign_mask, nz), ez));
+
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dist, radius), zero));
+		}
+
+		int mask = _mm_movemask_ps(outside);
+		for (uint32_t j = 0; j < 4; ++j) {
+			if (!(mask & (1 << j))) {
+				visible[i + j] = 1;
+				total += 1;
+			}
+		}
+	}
+#endif
+
+	//remaining boxes (or all boxes, if no SIMD path):
+	for (; i < count; ++i) {
+		bool outside = false;
+		for (auto const &plane : frustum.planes) {
+			float dist = plane.x * boxes.cx[i] + plane.y * boxes.cy[i] + plane.z * boxes.cz[i] + plane.w;
+			float radius = std::abs(plane.x) * boxes.ex[i] + std::abs(plane.y) * boxes.ey[i] + std::abs(plane.z) * boxes.ez[i];
+			if (dist + radius < 0.0f) {
+				outside = true;
+				break;
+			}
+		}
+		if (!outside) {
+			visible[i] = 1;
+			total += 1;
+		}
+	}
+
+	return total;
+}
+
+uint32_t cull_meshlets(Frustum const &frustum, glm::vec3 const &eye, bool cull_back_facing, Meshlet const *meshlets, uint32_t count, std::vector< glm::uvec2 > *ranges_,
+	bool (*keep)(void const *keep_context, Meshlet const &meshlet), void const *keep_context) {
+	assert(ranges_);
+	auto &ranges = *ranges_;
+
+	//plane normal lengths, so sphere radii can be compared with (unnormalized) plane distances:
+	float lengths[6];
+	for (uint32_t p = 0; p < 6; ++p) {
+		lengths[p] = glm::length(glm::vec3(frustum.planes[p]));
+	}
+
+	uint32_t total = 0;
+	for (uint32_t m = 0; m < count; ++m) {
+		Meshlet const &meshlet = meshlets[m];
+
+		bool outside = false;
+		for (uint32_t p = 0; p < 6; ++p) {
+			glm::vec4 const &plane = frustum.planes[p];
+			if (glm::dot(glm::vec3(plane), meshlet.center) + plane.w < -meshlet.radius * lengths[p]) {
+				outside = true;
+				break;
+			}
+		}
+		if (outside) continue;
+
+		//every triangle faces away from 'eye' if, for every normal n in the cone and every point x in the sphere, dot(x - eye, n) >= 0;
+		// with a = the component of (center - eye) along the axis and b = the component across it, the smallest value is a cos - b sin - radius:
+		if (cull_back_facing && meshlet.cone_cos > 0.0f) {
+			glm::vec3 to = meshlet.center - eye;
+			float a = glm::dot(to, meshlet.cone_axis);
+			float b = std::sqrt(std::max(0.0f, glm::dot(to, to) - a * a));
+			float cone_sin = std::sqrt(std::max(0.0f, 1.0f - meshlet.cone_cos * meshlet.cone_cos));
+			if (a * meshlet.cone_cos - b * cone_sin >= meshlet.radius) continue;
+		}
+
+		if (keep && !keep(keep_context, meshlet)) continue;
+
+		if (!ranges.empty() && ranges.back().x + ranges.back().y == meshlet.start) {
+			ranges.back().y += meshlet.count;
+		} else {
+			ranges.emplace_back(meshlet.start, meshlet.count);
+		}
+		total += 1;
+	}
+
+	return total;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+/*
+ * Helpers for view-frustum culling of axis-aligned bounding boxes
+ *  (and of meshlets -- small clusters of a mesh's triangles -- see below).
+ *
+ * Nothing in here touches OpenGL, so these can be used (and tested) without
+ * a GL context:
+ *
+ *  Frustum frustum = Frustum::from_clip(clip_from_world);
+ *  BoxList boxes;
+ *  boxes.push(world_from_local, mesh.min, mesh.max);
+ *  std::vector< uint8_t > visible;
+ *  uint32_t count = cull_boxes(frustum, boxes, &visible);
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct Frustum {
+	//planes stored as (nx, ny, nz, d) with dot(n, p) + d >= 0 for points p inside the frustum:
+	// (planes are *not* normalized; this doesn't matter for inside/outside tests)
+	glm::vec4 planes[6];
+
+	//extract planes from a clip_from_world matrix (see Gribb & Hartmann, "Fast Extraction of Viewing Frustum Planes"):
+	// (works with infinite perspective matrices -- the far plane just never rejects anything)
+	static Frustum from_clip(glm::mat4 const &clip_from_world);
+};
+
+//World-space boxes stored as structure-of-arrays (centers and half-extents),
+// which lets cull_boxes() test several boxes at once:
+struct BoxList {
+	std::vector< float > cx, cy, cz; //box centers
+	std::vector< float > ex, ey, ez; //box half-extents
+
+	//add a local-space [min,max] box, transformed to world space by world_from_local:
+	// (if min > max the box is treated as unbounded and will never be culled)
+	void push(glm::mat4x3 const &world_from_local, glm::vec3 const &min, glm::vec3 const &max);
+
+	void clear();
+	void reserve(size_t count);
+	size_t size() const { return cx.size(); }
+};
+
+//test every box in 'boxes' against 'frustum':
+// sets (*visible)[i] to 1 if box i (possibly) intersects the frustum, 0 if it is entirely outside.
+// returns the number of visible boxes.
+uint32_t cull_boxes(Frustum const &frustum, BoxList const &boxes, std::vector< uint8_t > *visible);
+
+//A meshlet is a run of a mesh's triangles (as written by optimize-meshes --meshlets, in the 'mlt0' chunk)
+// with bounds that let whole runs be skipped when they are off-screen or facing away from the camera:
+struct Meshlet {
+	uint32_t start, count; //range of elements (or vertices, for non-indexed meshes); same units as Mesh::start/count
+	glm::vec3 center; //object-space bounding sphere
+	float radius;
+	glm::vec3 cone_axis; //every triangle's (unit) normal is within acos(cone_cos) of cone_axis
+	float cone_cos; //(<= 0 when the normals are too spread out for the cone to reject anything)
+};
+static_assert(sizeof(Meshlet) == 40, "Meshlet is packed.");
+
+//test meshlets against 'frustum' and, if 'cull_back_facing', against the viewpoint 'eye' (both in the meshlets' object space):
+// appends the element ranges of meshlets that may be visible to *ranges as (start, count), merging ranges that touch.
+// meshlets that pass both tests are also skipped if 'keep' is given and keep(keep_context, meshlet) returns false (e.g., for occlusion tests).
+// (a plain function pointer, since this runs for every meshlet drawable every frame)
+// returns the number of meshlets that may be visible.
+uint32_t cull_meshlets(Frustum const &frustum, glm::vec3 const &eye, bool cull_back_facing, Meshlet const *meshlets, uint32_t count, std::vector< glm::uvec2 > *ranges,
+	bool (*keep)(void const *keep_context, Meshlet const &meshlet) = nullptr, void const *keep_context = nullptr);
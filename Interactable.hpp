@@ -1,10 +1,12 @@
 #pragma once
 
 #include "Scene.hpp"
+#include "MeshBVH.hpp"
 #include <iostream>
 
 struct Interactable {
     Scene::Drawable *drawable;   
+    MeshBVH const *bvh = nullptr; //(optional) drawable's triangles, for picking with rays
     glm::vec3 offset = glm::vec3(0.f, 0.f, -.25f);
 
     float interact_angle = glm::radians(10.f);
@@ -0,0 +1,184 @@
+#include "LightClusters.hpp"
+
+#include "gl_errors.hpp"
+#include "gl_state.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+static_assert(sizeof(LightClusters::Block) == 3 * 16, "LightClusters::Block matches std140 layout.");
+
+LightClusters::LightClusters(uint32_t tiles_x_, uint32_t tiles_y_, uint32_t slices_) : tiles_x(std::max(1u, tiles_x_)), tiles_y(std::max(1u, tiles_y_)), slices(std::max(1u, slices_)) {
+	cluster_data.assign(tiles_x * tiles_y * slices, glm::uvec2(0));
+	block.VIEW_DEPTH = glm::vec4(0.0f);
+	block.CLUSTER_SCALE = glm::vec4(0.0f);
+	block.CLUSTER_COUNTS = glm::ivec4(tiles_x, tiles_y, slices, 0);
+}
+
+LightClusters::~LightClusters() {
+	if (block_buffer != 0) {
+		glDeleteBuffers(1, &block_buffer);
+		glDeleteBuffers(3, buffers);
+		glDeleteTextures(3, textures);
+		gl_state_invalidate(); //(the textures may still be bound)
+	}
+}
+
+void LightClusters::build(Scene const &scene, Scene::Camera const &camera, glm::uvec2 const &drawable_size) {
+	assert(camera.transform);
+
+	light_data.clear();
+	index_data.clear();
+	cluster_data.assign(tiles_x * tiles_y * slices, glm::uvec2(0));
+	global_lights = 0;
+	clustered_lights = 0;
+	max_cluster_lights = 0;
+
+	auto append = [&](Scene::Light const &light, float type, glm::mat4x3 const &world_from_light, float range) {
+		light_data.emplace_back(world_from_light[3], type);
+		light_data.emplace_back(-glm::normalize(world_from_light[2]), std::cos(0.5f * light.spot_fov));
+		light_data.emplace_back(light.energy, range);
+	};
+
+	//lights that reach everywhere go first:
+	for (auto const &light : scene.lights) {
+		if (light.type == Scene::Light::Hemisphere) append(light, 1.0f, light.transform->make_world_from_local(), 0.0f);
+		else if (light.type == Scene::Light::Directional) append(light, 3.0f, light.transform->make_world_from_local(), 0.0f);
+		else continue;
+		global_lights += 1;
+	}
+
+	//depth slices are spaced exponentially from the near plane to slice_far (the first and last extend to zero and infinity):
+	glm::mat4x3 view_from_world = camera.transform->make_local_from_world();
+	float near = std::max(camera.near, 1e-6f);
+	float slice_scale = float(slices) / std::log(std::max(slice_far / near, 1.0001f));
+	float slice_bias = -std::log(near) * slice_scale;
+	auto slice_of = [&](float depth) {
+		float s = std::floor(std::log(std::max(depth, 1e-6f)) * slice_scale + slice_bias);
+		return uint32_t(std::clamp(s, 0.0f, float(slices - 1)));
+	};
+
+	//perspective scale factors (normalized device x is x * x_scale / depth):
+	float y_scale = 1.0f / std::tan(0.5f * camera.fovy);
+	float x_scale = y_scale / camera.aspect;
+
+	//tiles [*lo, *hi] (of 'tiles' across normalized device coordinates [-1,1]) that a view-space sphere can touch; false if none:
+	// (the boundary at normalized device coordinate t is the plane scale * a + t * z = 0 through the eye; positive distances are to its right)
+	auto tile_span = [](float scale, float a, float z, float radius, uint32_t tiles, uint32_t *lo, uint32_t *hi) {
+		auto distance = [&](uint32_t boundary) {
+			float t = 2.0f * float(boundary) / float(tiles) - 1.0f;
+			return (scale * a + t * z) / std::sqrt(scale * scale + t * t);
+		};
+		*lo = 0;
+		while (*lo < tiles && distance(*lo + 1) > radius) *lo += 1;
+		if (*lo == tiles || distance(*lo) < -radius) return false;
+		*hi = tiles - 1;
+		while (*hi > *lo && distance(*hi) < -radius) *hi -= 1;
+		return true;
+	};
+
+	struct Span {
+		uint32_t light; //index in light_data / LightTexels
+		uint32_t x0, x1, y0, y1, s0, s1; //inclusive
+	};
+	std::vector< Span > spans;
+
+	for (auto const &light : scene.lights) {
+		if (light.type != Scene::Light::Point && light.type != Scene::Light::Spot) continue;
+
+		//energy falls off as 1 / distance^2 (past distance 1), so it is below 'threshold' past sqrt(energy / threshold):
+		float brightest = std::max(light.energy.r, std::max(light.energy.g, light.energy.b));
+		if (!(brightest > 0.0f)) continue;
+		float range = std::sqrt(std::max(1.0f, brightest / threshold));
+		if (light.distance > 0.0f) range = std::min(range, light.distance);
+
+		glm::mat4x3 world_from_light = light.transform->make_world_from_local();
+		glm::vec3 center = view_from_world * glm::vec4(world_from_light[3], 1.0f);
+		float depth = -center.z;
+		if (depth + range < near) continue; //(entirely behind the near plane)
+
+		Span span;
+		if (!tile_span(x_scale, center.x, center.z, range, tiles_x, &span.x0, &span.x1)) continue;
+		if (!tile_span(y_scale, center.y, center.z, range, tiles_y, &span.y0, &span.y1)) continue;
+		span.s0 = slice_of(depth - range);
+		span.s1 = slice_of(depth + range);
+
+		span.light = uint32_t(light_data.size() / LightTexels);
+		append(light, light.type == Scene::Light::Spot ? 2.0f : 0.0f, world_from_light, range);
+		spans.emplace_back(span);
+	}
+	clustered_lights = uint32_t(spans.size());
+
+	//count lights per cluster, then lay out the index list and fill it:
+	auto for_each_cluster = [&](Span const &span, auto const &fn) {
+		for (uint32_t s = span.s0; s <= span.s1; ++s) {
+			for (uint32_t y = span.y0; y <= span.y1; ++y) {
+				for (uint32_t x = span.x0; x <= span.x1; ++x) {
+					fn(cluster(x, y, s));
+				}
+			}
+		}
+	};
+	for (auto const &span : spans) {
+		for_each_cluster(span, [&](uint32_t c) { cluster_data[c].y += 1; });
+	}
+	uint32_t total = 0;
+	for (auto &c : cluster_data) {
+		c.x = total;
+		total += c.y;
+		max_cluster_lights = std::max(max_cluster_lights, c.y);
+		c.y = 0; //(counted up again while filling)
+	}
+	index_data.resize(total);
+	for (auto const &span : spans) {
+		for_each_cluster(span, [&](uint32_t c) {
+			index_data[cluster_data[c].x + cluster_data[c].y] = span.light;
+			cluster_data[c].y += 1;
+		});
+	}
+
+	//parameters for the shaders:
+	block.VIEW_DEPTH = -glm::vec4(view_from_world[0][2], view_from_world[1][2], view_from_world[2][2], view_from_world[3][2]);
+	block.CLUSTER_SCALE = glm::vec4(
+		float(tiles_x) / float(std::max(1u, drawable_size.x)),
+		float(tiles_y) / float(std::max(1u, drawable_size.y)),
+		slice_scale,
+		slice_bias
+	);
+	block.CLUSTER_COUNTS = glm::ivec4(tiles_x, tiles_y, slices, global_lights);
+}
+
+void LightClusters::upload() {
+	if (block_buffer == 0) {
+		glGenBuffers(1, &block_buffer);
+		glGenBuffers(3, buffers);
+		glGenTextures(3, textures);
+		GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+		for (uint32_t i = 0; i < 3; ++i) {
+			gl_bind_texture(LightsTextureUnit + i, GL_TEXTURE_BUFFER, textures[i]);
+			glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+		}
+	}
+
+	//(glBufferData with a fresh size+data orphans last frame's storage; empty lists get one unused element, so every texture has storage)
+	auto fill = [](GLuint buffer, void const *data, size_t size, size_t element_size) {
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		glBufferData(GL_TEXTURE_BUFFER, std::max(size, element_size), size ? data : nullptr, GL_STREAM_DRAW);
+	};
+	fill(buffers[0], light_data.data(), light_data.size() * sizeof(glm::vec4), sizeof(glm::vec4));
+	fill(buffers[1], cluster_data.data(), cluster_data.size() * sizeof(glm::uvec2), sizeof(glm::uvec2));
+	fill(buffers[2], index_data.data(), index_data.size() * sizeof(uint32_t), sizeof(uint32_t));
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, block_buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), &block, GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, LightsBlockBinding, block_buffer);
+
+	for (uint32_t i = 0; i < 3; ++i) {
+		gl_bind_texture(LightsTextureUnit + i, GL_TEXTURE_BUFFER, textures[i]);
+	}
+
+	GL_ERRORS();
+}
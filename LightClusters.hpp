@@ -0,0 +1,93 @@
+#pragma once
+
+/*
+ * Clustered lighting: every frame, the scene's lights are binned on the CPU into a grid
+ *  of view-frustum cells ("froxels": screen tiles x exponentially-spaced depth slices),
+ *  so that each fragment shades only the lights that can reach its cell -- shading cost
+ *  then depends on how many lights overlap, not on how many the scene has.
+ *
+ * Hemisphere and directional lights reach everywhere, so they are kept in a short "global"
+ *  list applied to every fragment instead of being binned.
+ *
+ * LitColorTextureProgram's clustered variants (see lit_color_texture_clustered_pipeline)
+ *  read the result:
+ *
+ *  light_clusters.build(scene, camera, drawable_size); //CPU only
+ *  light_clusters.upload(); //uploads and binds the 'Lights' block and light textures
+ *  scene.draw(camera);
+ *
+ * Lights are in world space (i.e., the light space of Scene::draw(Camera const &)), and
+ *  fragments find their tile from gl_FragCoord, so the viewport should cover the whole
+ *  'drawable_size' passed to build().
+ */
+
+#include "GL.hpp"
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct LightClusters {
+	LightClusters(uint32_t tiles_x = 16, uint32_t tiles_y = 9, uint32_t slices = 24);
+	~LightClusters();
+
+	//(owns OpenGL objects, so can't be copied)
+	LightClusters(LightClusters const &) = delete;
+	LightClusters &operator=(LightClusters const &) = delete;
+
+	//bin the lights of 'scene' for drawing from 'camera' into a 'drawable_size'-pixel viewport:
+	// (no OpenGL calls, so this can be run -- and tested -- without a context)
+	void build(Scene const &scene, Scene::Camera const &camera, glm::uvec2 const &drawable_size);
+
+	//upload the most recent build() and bind it for the clustered programs:
+	// (the 'Lights' block to LightsBlockBinding, the textures to the units below; makes OpenGL objects on first call)
+	void upload();
+
+	//parameters (used by the next build()):
+	float slice_far = 100.0f; //depth at which the last slice begins (it extends to infinity); slices start at the camera's near plane
+	float threshold = 1.0f / 256.0f; //point and spot lights are ignored where their (unshadowed) energy falls below this
+
+	//where the clustered programs expect things:
+	enum : uint32_t { LightsBlockBinding = Scene::ObjectBlockBinding + 1 };
+	enum : uint32_t {
+		LightsTextureUnit = Scene::Drawable::Pipeline::InstanceTextureUnit + 1, //RGBA32F, LightTexels per light
+		ClustersTextureUnit, //RG32UI, (first index, count) per cluster
+		IndicesTextureUnit, //R32UI, light indices
+	};
+	enum : uint32_t { LightTexels = 3 };
+
+	//statistics from the most recent build():
+	uint32_t global_lights = 0; //lights applied everywhere
+	uint32_t clustered_lights = 0; //point and spot lights that touch at least one cluster
+	uint32_t max_cluster_lights = 0; //most lights in any one cluster
+
+	//-- internals --
+
+	uint32_t tiles_x, tiles_y, slices;
+
+	//per light (global lights first):
+	// texel 0: world position, type (0 = point, 1 = hemisphere, 2 = spot, 3 = directional -- as in LIGHT_TYPE)
+	// texel 1: world direction (the light's -z axis), spot cutoff (cosine of half the cone angle)
+	// texel 2: energy, range (0 = unlimited)
+	std::vector< glm::vec4 > light_data;
+
+	//per cluster, (first index in index_data, count); clusters are ordered by slice, then tile row, then tile column:
+	std::vector< glm::uvec2 > cluster_data;
+	std::vector< uint32_t > index_data;
+
+	//std140 layout of the 'Lights' uniform block:
+	struct Block {
+		glm::vec4 VIEW_DEPTH; //depth in front of the camera of world point p is dot(VIEW_DEPTH.xyz, p) + VIEW_DEPTH.w
+		glm::vec4 CLUSTER_SCALE; //tile is gl_FragCoord.xy * CLUSTER_SCALE.xy; slice is log(depth) * CLUSTER_SCALE.z + CLUSTER_SCALE.w
+		glm::ivec4 CLUSTER_COUNTS; //tiles_x, tiles_y, slices, global lights
+	} block;
+
+	//index of the cluster holding a tile and slice:
+	uint32_t cluster(uint32_t tile_x, uint32_t tile_y, uint32_t slice) const { return (slice * tiles_y + tile_y) * tiles_x + tile_x; }
+
+	GLuint block_buffer = 0;
+	GLuint buffers[3] = {0, 0, 0}; //lights, clusters, indices
+	GLuint textures[3] = {0, 0, 0}; //(buffer textures viewing the above)
+};
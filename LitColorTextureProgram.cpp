@@ -2,8 +2,12 @@
 
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
+#include "gl_state.hpp"
+#include "LightClusters.hpp"
+#include "Mesh.hpp"
 
 Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
+Scene::Drawable::Pipeline lit_color_texture_clustered_pipeline;
 
 Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> LitColorTextureProgram const * {
 	LitColorTextureProgram *ret = new LitColorTextureProgram();
@@ -11,70 +15,108 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	//----- build the pipeline template -----
 	lit_color_texture_program_pipeline.program = ret->program;
 
-	lit_color_texture_program_pipeline.CLIP_FROM_OBJECT_mat4 = ret->CLIP_FROM_OBJECT_mat4;
-	lit_color_texture_program_pipeline.LIGHT_FROM_OBJECT_mat4x3 = ret->LIGHT_FROM_OBJECT_mat4x3;
-	lit_color_texture_program_pipeline.LIGHT_FROM_NORMAL_mat3 = ret->LIGHT_FROM_NORMAL_mat3;
+	//transforms come from the 'Object' uniform block:
+	lit_color_texture_program_pipeline.object_block = true;
+
+	lit_color_texture_program_pipeline.instanced_program = ret->instanced_program;
+	lit_color_texture_program_pipeline.INSTANCE_BASE_int = ret->instanced_uniforms.INSTANCE_BASE_int;
 
 	/* This will be used later if/when we build a light loop into the Scene:
-	lit_color_texture_program_pipeline.LIGHT_TYPE_int = ret->LIGHT_TYPE_int;
-	lit_color_texture_program_pipeline.LIGHT_LOCATION_vec3 = ret->LIGHT_LOCATION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_DIRECTION_vec3 = ret->LIGHT_DIRECTION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_ENERGY_vec3 = ret->LIGHT_ENERGY_vec3;
-	lit_color_texture_program_pipeline.LIGHT_CUTOFF_float = ret->LIGHT_CUTOFF_float;
+	lit_color_texture_program_pipeline.LIGHT_TYPE_int = ret->uniforms.LIGHT_TYPE_int;
+	lit_color_texture_program_pipeline.LIGHT_LOCATION_vec3 = ret->uniforms.LIGHT_LOCATION_vec3;
+	lit_color_texture_program_pipeline.LIGHT_DIRECTION_vec3 = ret->uniforms.LIGHT_DIRECTION_vec3;
+	lit_color_texture_program_pipeline.LIGHT_ENERGY_vec3 = ret->uniforms.LIGHT_ENERGY_vec3;
+	lit_color_texture_program_pipeline.LIGHT_CUTOFF_float = ret->uniforms.LIGHT_CUTOFF_float;
 	*/
 
 	//make a 1-pixel white texture to bind by default:
 	GLuint tex;
 	glGenTextures(1, &tex);
 
-	glBindTexture(GL_TEXTURE_2D, tex);
+	gl_bind_texture(0, GL_TEXTURE_2D, tex);
 	std::vector< glm::u8vec4 > tex_data(1, glm::u8vec4(0xff));
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, tex_data.data());
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	gl_bind_texture(0, GL_TEXTURE_2D, 0);
 
 
 	lit_color_texture_program_pipeline.textures[0].texture = tex;
 	lit_color_texture_program_pipeline.textures[0].target = GL_TEXTURE_2D;
 
+	//the clustered template is the same, but with the clustered programs:
+	lit_color_texture_clustered_pipeline = lit_color_texture_program_pipeline;
+	lit_color_texture_clustered_pipeline.program = ret->clustered_program;
+	lit_color_texture_clustered_pipeline.instanced_program = ret->clustered_instanced_program;
+	lit_color_texture_clustered_pipeline.INSTANCE_BASE_int = ret->clustered_instanced_uniforms.INSTANCE_BASE_int;
+
 	return ret;
 });
 
 LitColorTextureProgram::LitColorTextureProgram() {
 	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
-	program = gl_compile_program(
-		//vertex shader:
-		"#version 330\n"
-		"uniform mat4 CLIP_FROM_OBJECT;\n"
-		"uniform mat4x3 LIGHT_FROM_OBJECT;\n"
-		"uniform mat3 LIGHT_FROM_NORMAL;\n"
-		"in vec4 Position;\n"
-		"in vec3 Normal;\n"
-		"in vec4 Color;\n"
-		"in vec2 TexCoord;\n"
+	//The vertex shader is shared by the regular and instanced variants of the program;
+	// the regular variant reads its transforms from the 'Object' uniform block,
+	// the instanced variant fetches its transforms from the INSTANCES buffer texture (both layouts described in Scene.cpp).
+	//Attribute locations are explicit so that both variants can share vertex array objects.
+	std::string vertex_shader_body =
+		"#ifdef INSTANCED\n"
+		"uniform samplerBuffer INSTANCES;\n"
+		"uniform int INSTANCE_BASE;\n"
+		"#else\n"
+		"layout(std140) uniform Object {\n"
+		"	mat4 CLIP_FROM_OBJECT;\n"
+		"	mat4x3 LIGHT_FROM_OBJECT;\n"
+		"	mat3 LIGHT_FROM_NORMAL;\n"
+		"};\n"
+		"#endif\n"
+		"layout(location = 0) in vec4 Position;\n"
+		"layout(location = 1) in vec3 Normal;\n"
+		"layout(location = 2) in vec4 Color;\n"
+		"layout(location = 3) in vec2 TexCoord;\n"
 		"out vec3 position;\n"
 		"out vec3 normal;\n"
 		"out vec4 color;\n"
 		"out vec2 texCoord;\n"
 		"void main() {\n"
+		"#ifdef INSTANCED\n"
+		"	int base = INSTANCE_BASE + 10 * gl_InstanceID;\n"
+		"	mat4 CLIP_FROM_OBJECT = mat4(texelFetch(INSTANCES, base+0), texelFetch(INSTANCES, base+1), texelFetch(INSTANCES, base+2), texelFetch(INSTANCES, base+3));\n"
+		"	mat4x3 LIGHT_FROM_OBJECT = transpose(mat3x4(texelFetch(INSTANCES, base+4), texelFetch(INSTANCES, base+5), texelFetch(INSTANCES, base+6)));\n"
+		"	mat3 LIGHT_FROM_NORMAL = mat3(texelFetch(INSTANCES, base+7).xyz, texelFetch(INSTANCES, base+8).xyz, texelFetch(INSTANCES, base+9).xyz);\n"
+		"#endif\n"
 		"	gl_Position = CLIP_FROM_OBJECT * Position;\n"
 		"	position = LIGHT_FROM_OBJECT * Position;\n"
 		"	normal = LIGHT_FROM_NORMAL * Normal;\n"
 		"	color = Color;\n"
 		"	texCoord = TexCoord;\n"
 		"}\n"
-	,
-		//fragment shader:
-		"#version 330\n"
+	;
+	static_assert(Scene::InstanceStride == 10, "shader assumes 10 texels per instance");
+
+	//The fragment shader is shared in the same way:
+	// the single-light variants are lit by the LIGHT_* uniforms;
+	// the clustered variants (CLUSTERED defined) by every light LightClusters::upload() bound for the fragment's cluster.
+	std::string fragment_shader_body =
 		"uniform sampler2D TEX;\n"
+		"#ifdef CLUSTERED\n"
+		"layout(std140) uniform Lights {\n"
+		"	vec4 VIEW_DEPTH;\n"
+		"	vec4 CLUSTER_SCALE;\n"
+		"	ivec4 CLUSTER_COUNTS;\n"
+		"};\n"
+		"uniform samplerBuffer LIGHTS;\n"
+		"uniform usamplerBuffer CLUSTERS;\n"
+		"uniform usamplerBuffer LIGHT_INDICES;\n"
+		"#else\n"
 		"uniform int LIGHT_TYPE;\n"
 		"uniform vec3 LIGHT_LOCATION;\n"
 		"uniform vec3 LIGHT_DIRECTION;\n"
 		"uniform vec3 LIGHT_ENERGY;\n"
 		"uniform float LIGHT_CUTOFF;\n"
+		"#endif\n"
 		"in vec3 position;\n"
 		"in vec3 normal;\n"
 		"in vec4 color;\n"
@@ -83,28 +125,61 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"float random(vec2 st) { //from https://thebookofshaders.com/10/\n"
 		"	return fract(sin(dot(st, vec2(12.9898, 78.233)))*43758.5453123);\n"
 		"}\n"
-		"void main() {\n"
-		"	vec3 n = normalize(normal);\n"
+		//light arriving at 'position' along normal 'n' (point and spot lights with a range fade out smoothly before it):
+		"vec3 light(vec3 n, int type, vec3 location, vec3 direction, vec3 energy, float cutoff, float range) {\n"
 		"	vec3 e;\n"
-		"	if (LIGHT_TYPE == 0) { //point light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
+		"	if (type == 0) { //point light \n"
+		"		vec3 l = (location - position);\n"
 		"		float dis2 = dot(l,l);\n"
 		"		l = normalize(l);\n"
 		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 1) { //hemi light \n"
-		"		e = (dot(n,-LIGHT_DIRECTION) * 0.5 + 0.5) * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 2) { //spot light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
+		"		e = nl * energy;\n"
+		"	} else if (type == 1) { //hemi light \n"
+		"		e = (dot(n,-direction) * 0.5 + 0.5) * energy;\n"
+		"	} else if (type == 2) { //spot light \n"
+		"		vec3 l = (location - position);\n"
 		"		float dis2 = dot(l,l);\n"
 		"		l = normalize(l);\n"
 		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		float c = dot(l,-LIGHT_DIRECTION);\n"
-		"		nl *= smoothstep(LIGHT_CUTOFF,mix(LIGHT_CUTOFF,1.0,0.1), c);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else { //(LIGHT_TYPE == 3) //directional light \n"
-		"		e = max(0.0, dot(n,-LIGHT_DIRECTION)) * LIGHT_ENERGY;\n"
+		"		float c = dot(l,-direction);\n"
+		"		nl *= smoothstep(cutoff,mix(cutoff,1.0,0.1), c);\n"
+		"		e = nl * energy;\n"
+		"	} else { //(type == 3) //directional light \n"
+		"		e = max(0.0, dot(n,-direction)) * energy;\n"
+		"	}\n"
+		"	if (range > 0.0) {\n"
+		"		vec3 l = (location - position);\n"
+		"		float f = dot(l,l) / (range * range);\n"
+		"		float w = clamp(1.0 - f * f, 0.0, 1.0);\n"
+		"		e *= w * w;\n"
+		"	}\n"
+		"	return e;\n"
+		"}\n"
+		"#ifdef CLUSTERED\n"
+		"vec3 scene_light(vec3 n, int index) {\n"
+		"	vec4 a = texelFetch(LIGHTS, 3 * index + 0);\n"
+		"	vec4 b = texelFetch(LIGHTS, 3 * index + 1);\n"
+		"	vec4 c = texelFetch(LIGHTS, 3 * index + 2);\n"
+		"	return light(n, int(a.w), a.xyz, b.xyz, c.rgb, b.w, c.w);\n"
+		"}\n"
+		"#endif\n"
+		"void main() {\n"
+		"	vec3 n = normalize(normal);\n"
+		"#ifdef CLUSTERED\n"
+		"	vec3 e = vec3(0.0);\n"
+		"	for (int i = 0; i < CLUSTER_COUNTS.w; ++i) {\n"
+		"		e += scene_light(n, i);\n"
+		"	}\n"
+		"	float depth = dot(VIEW_DEPTH.xyz, position) + VIEW_DEPTH.w;\n"
+		"	ivec3 cell = ivec3(ivec2(gl_FragCoord.xy * CLUSTER_SCALE.xy), int(floor(log(max(depth, 1e-6)) * CLUSTER_SCALE.z + CLUSTER_SCALE.w)));\n"
+		"	cell = clamp(cell, ivec3(0), CLUSTER_COUNTS.xyz - 1);\n"
+		"	uvec2 range = texelFetch(CLUSTERS, (cell.z * CLUSTER_COUNTS.y + cell.y) * CLUSTER_COUNTS.x + cell.x).xy;\n"
+		"	for (uint i = 0u; i < range.y; ++i) {\n"
+		"		e += scene_light(n, int(texelFetch(LIGHT_INDICES, int(range.x + i)).x));\n"
 		"	}\n"
+		"#else\n"
+		"	vec3 e = light(n, LIGHT_TYPE, LIGHT_LOCATION, LIGHT_DIRECTION, LIGHT_ENERGY, LIGHT_CUTOFF, 0.0);\n"
+		"#endif\n"
 		"	vec4 albedo = texture(TEX, texCoord) * color;\n"
 		"	fragColor = vec4(e*albedo.rgb, albedo.a);\n"
 		/* DEBUG: check color output linearity:
@@ -121,40 +196,88 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"	}\n"
 		*/
 		"}\n"
-	);
+	;
 	//As you can see above, adjacent strings in C/C++ are concatenated.
 	// this is very useful for writing long shader programs inline.
 
+	program = gl_compile_program("#version 330\n" + vertex_shader_body, "#version 330\n" + fragment_shader_body);
+	instanced_program = gl_compile_program("#version 330\n#define INSTANCED\n" + vertex_shader_body, "#version 330\n" + fragment_shader_body);
+	clustered_program = gl_compile_program("#version 330\n" + vertex_shader_body, "#version 330\n#define CLUSTERED\n" + fragment_shader_body);
+	clustered_instanced_program = gl_compile_program("#version 330\n#define INSTANCED\n" + vertex_shader_body, "#version 330\n#define CLUSTERED\n" + fragment_shader_body);
+
 	//look up the locations of vertex attributes:
 	Position_vec4 = glGetAttribLocation(program, "Position");
 	Normal_vec3 = glGetAttribLocation(program, "Normal");
 	Color_vec4 = glGetAttribLocation(program, "Color");
 	TexCoord_vec2 = glGetAttribLocation(program, "TexCoord");
 
-	//look up the locations of uniforms:
-	CLIP_FROM_OBJECT_mat4 = glGetUniformLocation(program, "CLIP_FROM_OBJECT");
-	LIGHT_FROM_OBJECT_mat4x3 = glGetUniformLocation(program, "LIGHT_FROM_OBJECT");
-	LIGHT_FROM_NORMAL_mat3 = glGetUniformLocation(program, "LIGHT_FROM_NORMAL");
-
-	LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
-	LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
-	LIGHT_DIRECTION_vec3 = glGetUniformLocation(program, "LIGHT_DIRECTION");
-	LIGHT_ENERGY_vec3 = glGetUniformLocation(program, "LIGHT_ENERGY");
-	LIGHT_CUTOFF_float = glGetUniformLocation(program, "LIGHT_CUTOFF");
+	//connect the transform uniform block to the binding point Scene::draw() fills:
+	glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Object"), Scene::ObjectBlockBinding);
 
+	//look up the locations of uniforms in each variant:
+	auto look_up_uniforms = [](GLuint p) {
+		Uniforms ret;
+		ret.LIGHT_TYPE_int = glGetUniformLocation(p, "LIGHT_TYPE");
+		ret.LIGHT_LOCATION_vec3 = glGetUniformLocation(p, "LIGHT_LOCATION");
+		ret.LIGHT_DIRECTION_vec3 = glGetUniformLocation(p, "LIGHT_DIRECTION");
+		ret.LIGHT_ENERGY_vec3 = glGetUniformLocation(p, "LIGHT_ENERGY");
+		ret.LIGHT_CUTOFF_float = glGetUniformLocation(p, "LIGHT_CUTOFF");
+		ret.INSTANCE_BASE_int = glGetUniformLocation(p, "INSTANCE_BASE");
+		return ret;
+	};
+	uniforms = look_up_uniforms(program);
+	instanced_uniforms = look_up_uniforms(instanced_program);
+	clustered_uniforms = look_up_uniforms(clustered_program);
+	clustered_instanced_uniforms = look_up_uniforms(clustered_instanced_program);
 
 	GLuint TEX_sampler2D = glGetUniformLocation(program, "TEX");
 
 	//set TEX to always refer to texture binding zero:
-	glUseProgram(program); //bind program -- glUniform* calls refer to this program now
+	gl_use_program(program); //bind program -- glUniform* calls refer to this program now
 
 	glUniform1i(TEX_sampler2D, 0); //set TEX to sample from GL_TEXTURE0
 
-	glUseProgram(0); //unbind program -- glUniform* calls refer to ??? now
+	gl_use_program(0); //unbind program -- glUniform* calls refer to ??? now
+
+	//same for the instanced variant:
+	gl_use_program(instanced_program);
+
+	glUniform1i(glGetUniformLocation(instanced_program, "TEX"), 0); //set TEX to sample from GL_TEXTURE0
+	glUniform1i(glGetUniformLocation(instanced_program, "INSTANCES"), Scene::Drawable::Pipeline::InstanceTextureUnit);
+
+	gl_use_program(0);
+
+	//the clustered variants read transforms the same way, and lights from LightClusters:
+	glUniformBlockBinding(clustered_program, glGetUniformBlockIndex(clustered_program, "Object"), Scene::ObjectBlockBinding);
+
+	for (GLuint p : {clustered_program, clustered_instanced_program}) {
+		glUniformBlockBinding(p, glGetUniformBlockIndex(p, "Lights"), LightClusters::LightsBlockBinding);
+
+		gl_use_program(p);
+
+		glUniform1i(glGetUniformLocation(p, "TEX"), 0); //set TEX to sample from GL_TEXTURE0
+		glUniform1i(glGetUniformLocation(p, "LIGHTS"), LightClusters::LightsTextureUnit);
+		glUniform1i(glGetUniformLocation(p, "CLUSTERS"), LightClusters::ClustersTextureUnit);
+		glUniform1i(glGetUniformLocation(p, "LIGHT_INDICES"), LightClusters::IndicesTextureUnit);
+	}
+
+	gl_use_program(clustered_instanced_program);
+	glUniform1i(glGetUniformLocation(clustered_instanced_program, "INSTANCES"), Scene::Drawable::Pipeline::InstanceTextureUnit);
+
+	gl_use_program(0);
 }
 
 LitColorTextureProgram::~LitColorTextureProgram() {
+	for (GLuint p : { program, instanced_program, clustered_program, clustered_instanced_program }) {
+		MeshBuffer::forget_program(p);
+	}
 	glDeleteProgram(program);
 	program = 0;
+	glDeleteProgram(instanced_program);
+	instanced_program = 0;
+	glDeleteProgram(clustered_program);
+	clustered_program = 0;
+	glDeleteProgram(clustered_instanced_program);
+	clustered_instanced_program = 0;
 }
 
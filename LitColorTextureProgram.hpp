@@ -17,18 +17,37 @@ struct LitColorTextureProgram {
 	GLuint Color_vec4 = -1U;
 	GLuint TexCoord_vec2 = -1U;
 
-	//Uniform (per-invocation variable) locations:
-	GLuint CLIP_FROM_OBJECT_mat4 = -1U;
-	GLuint LIGHT_FROM_OBJECT_mat4x3 = -1U;
-	GLuint LIGHT_FROM_NORMAL_mat3 = -1U;
-
-	//lighting:
-	GLuint LIGHT_TYPE_int = -1U;
-	GLuint LIGHT_LOCATION_vec3 = -1U;
-	GLuint LIGHT_DIRECTION_vec3 = -1U;
-	GLuint LIGHT_ENERGY_vec3 = -1U;
-	GLuint LIGHT_CUTOFF_float = -1U;
-	
+	//Uniform block (bound to Scene::ObjectBlockBinding):
+	// Object { mat4 CLIP_FROM_OBJECT; mat4x3 LIGHT_FROM_OBJECT; mat3 LIGHT_FROM_NORMAL; }
+
+	//Instanced variant (used by Scene::draw for drawables that share a mesh):
+	// same attributes, fragment shader, and lighting uniforms;
+	// transforms come from a buffer texture instead of uniforms.
+	GLuint instanced_program = 0;
+
+	//Clustered variants (regular and instanced), lit by every light in a LightClusters instead of the LIGHT_* uniforms:
+	// same attributes and transforms as the variants above; lights come from the 'Lights' block and textures bound by LightClusters::upload().
+	GLuint clustered_program = 0;
+	GLuint clustered_instanced_program = 0;
+
+	//Uniform (per-invocation variable) locations, looked up in each variant:
+	// (-1U where that variant doesn't have the uniform)
+	struct Uniforms {
+		//lighting (not in the clustered variants):
+		GLuint LIGHT_TYPE_int = -1U;
+		GLuint LIGHT_LOCATION_vec3 = -1U;
+		GLuint LIGHT_DIRECTION_vec3 = -1U;
+		GLuint LIGHT_ENERGY_vec3 = -1U;
+		GLuint LIGHT_CUTOFF_float = -1U;
+
+		//texel index of the first instance's data (only in the instanced variants):
+		GLuint INSTANCE_BASE_int = -1U;
+	};
+	Uniforms uniforms; //in 'program'
+	Uniforms instanced_uniforms; //in 'instanced_program'
+	Uniforms clustered_uniforms; //in 'clustered_program'
+	Uniforms clustered_instanced_uniforms; //in 'clustered_instanced_program'
+
 	//Textures:
 	//TEXTURE0 - texture that is accessed by TexCoord
 };
@@ -38,3 +57,6 @@ extern Load< LitColorTextureProgram > lit_color_texture_program;
 //For convenient scene-graph setup, copy this object:
 // NOTE: by default, has texture bound to 1-pixel white texture -- so it's okay to use with vertex-color-only meshes.
 extern Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
+
+//...or this one, for drawables lit by LightClusters (see LightClusters.hpp):
+extern Scene::Drawable::Pipeline lit_color_texture_clustered_pipeline;
@@ -1,20 +1,193 @@
 #include "Load.hpp"
 
-#include <array>
-#include <list>
+#include <algorithm>
 #include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace {
-	std::array< std::list< std::function< void() > >, MaxLoadTag > &get_load_lists() {
-		static std::array< std::list< std::function< void() > >, MaxLoadTag > load_lists;
-		return load_lists;
+	struct LoadJob {
+		LoadTag tag;
+		void const *key; //(nullptr if nothing can depend on this load)
+		LoadOn on = LoadOn::Main;
+		LoadPolicy policy = LoadPolicy::Eager;
+		bool listed = false; //if true, runs after 'after'; otherwise, after every load with an earlier tag (and listed loads with the same tag)
+		std::vector< LoadDependency > after;
+		std::function< void() > fn;
+
+		//scheduling:
+		uint32_t waiting = 0; //loads that have to finish before this one starts
+		std::vector< LoadJob * > then; //loads waiting on this one
+		uint32_t chain = 0; //longest run of loads waiting (transitively) on this one; longer chains start first
+
+		//lazy loads (guarded by Lazy::mutex):
+		enum class State : uint8_t { Idle, Queued, Running, Done, Failed } state = State::Idle;
+		std::exception_ptr error;
+		std::vector< LoadJob * > lazy_after; //the lazy loads in 'after'
+	};
+
+	//(deque, so pointers to jobs stay valid as more are added)
+	std::deque< LoadJob > &get_load_jobs() {
+		static std::deque< LoadJob > load_jobs;
+		return load_jobs;
+	}
+
+	//lazy loads are kept after call_load_functions() and run, when asked for, by a background thread:
+	struct Lazy {
+		std::mutex mutex;
+		std::condition_variable changed; //signalled when a load is queued or finishes
+		std::unordered_map< void const *, LoadJob * > by_key;
+		bool started = false; //true once call_load_functions() is done; queued loads wait until then
+		std::deque< LoadJob * > queue; //in order; a load's lazy dependencies are always queued before it
+		std::thread thread;
+		bool stopping = false;
+
+		~Lazy() {
+			if (thread.joinable()) {
+				{
+					std::lock_guard< std::mutex > lock(mutex);
+					stopping = true;
+				}
+				changed.notify_all();
+				thread.join();
+			}
+		}
+
+		//print why 'job' failed:
+		static void report_failure(LoadJob *job) {
+			try {
+				std::rethrow_exception(job->error);
+			} catch (std::exception &e) {
+				std::cerr << "Lazy load failed: " << e.what() << std::endl;
+			} catch (...) {
+				std::cerr << "Lazy load failed." << std::endl;
+			}
+		}
+
+		//run 'job' on this thread (called with 'lock' held; returns with it held):
+		void run(LoadJob *job, std::unique_lock< std::mutex > &lock) {
+			job->state = LoadJob::State::Running;
+			std::exception_ptr error;
+			for (LoadJob *before : job->lazy_after) {
+				if (before->state == LoadJob::State::Failed) error = before->error;
+			}
+			bool threw = false; //(loads that fail because a load they need failed aren't reported again)
+			if (!error) {
+				lock.unlock();
+				try {
+					job->fn();
+				} catch (...) {
+					error = std::current_exception();
+					threw = true;
+				}
+				lock.lock();
+			}
+			job->state = (error ? LoadJob::State::Failed : LoadJob::State::Done);
+			job->error = error;
+			if (threw) {
+				//(reported here, since nothing may ever wait on a background load -- its ready() just stays false)
+				report_failure(job);
+			}
+			changed.notify_all();
+		}
+
+		//queue 'job' (and the lazy loads it needs) for the background thread:
+		void queue_job(LoadJob *job) {
+			if (job->state != LoadJob::State::Idle) return;
+			for (LoadJob *before : job->lazy_after) queue_job(before);
+			job->state = LoadJob::State::Queued;
+			queue.emplace_back(job);
+			if (!thread.joinable()) {
+				thread = std::thread([this](){
+					std::unique_lock< std::mutex > lock(mutex);
+					while (true) {
+						changed.wait(lock, [this](){ return stopping || (started && !queue.empty()); });
+						if (stopping) break;
+						LoadJob *next = queue.front();
+						queue.pop_front();
+						run(next, lock);
+					}
+				});
+			}
+			changed.notify_all();
+		}
+
+		LoadJob *find(void const *key) {
+			auto f = by_key.find(key);
+			if (f == by_key.end()) throw std::runtime_error("Lazy load was never registered.");
+			return f->second;
+		}
+	};
+
+	Lazy &get_lazy() {
+		static Lazy lazy;
+		return lazy;
 	}
 }
 
-void add_load_function(LoadTag tag, std::function< void() > const &fn) {
-	auto &load_lists = get_load_lists();
-	assert(tag < load_lists.size());
-	load_lists[tag].emplace_back(fn);
+void add_load_function(LoadTag tag, std::function< void() > const &fn, void const *key) {
+	assert(tag < MaxLoadTag);
+	LoadJob &job = get_load_jobs().emplace_back();
+	job.tag = tag;
+	job.key = key;
+	job.fn = fn;
+}
+
+void add_load_function(LoadTag tag, void const *key, LoadOn on, std::vector< LoadDependency > const &after, std::function< void() > const &fn, LoadPolicy policy) {
+	assert(tag < MaxLoadTag);
+	LoadJob &job = get_load_jobs().emplace_back();
+	job.tag = tag;
+	job.key = key;
+	job.on = on;
+	job.policy = policy;
+	job.listed = true;
+	job.after = after;
+	job.fn = fn;
+}
+
+void prefetch_load(void const *key) {
+	Lazy &lazy = get_lazy();
+	std::lock_guard< std::mutex > lock(lazy.mutex);
+	LoadJob *job = lazy.find(key);
+	if (job->on == LoadOn::Worker) lazy.queue_job(job);
+	//(LoadOn::Main loads wait for their first use)
+}
+
+bool lazy_load_failed(void const *key) {
+	Lazy &lazy = get_lazy();
+	std::lock_guard< std::mutex > lock(lazy.mutex);
+	auto f = lazy.by_key.find(key);
+	//(lazy loads that eager loads need were loaded eagerly, and would have failed in call_load_functions())
+	if (f == lazy.by_key.end()) return false;
+	return f->second->state == LoadJob::State::Failed;
+}
+
+void wait_for_load(void const *key) {
+	Lazy &lazy = get_lazy();
+	std::unique_lock< std::mutex > lock(lazy.mutex);
+	if (!lazy.started) {
+		throw std::runtime_error("A lazy load was used during call_load_functions() -- list it in the 'after' of the load that uses it.");
+	}
+
+	//make sure 'job' is done, running it here if it's a LoadOn::Main load:
+	std::function< void(LoadJob *) > finish = [&](LoadJob *job) {
+		if (job->on == LoadOn::Main) {
+			for (LoadJob *before : job->lazy_after) finish(before);
+			if (job->state == LoadJob::State::Idle) lazy.run(job, lock);
+		} else {
+			lazy.queue_job(job);
+		}
+		lazy.changed.wait(lock, [job](){ return job->state == LoadJob::State::Done || job->state == LoadJob::State::Failed; });
+	};
+	LoadJob *job = lazy.find(key);
+	finish(job);
+	if (job->state == LoadJob::State::Failed) std::rethrow_exception(job->error);
 }
 
 void call_load_functions() {
@@ -22,11 +195,214 @@ void call_load_functions() {
 	assert(!has_been_called && "call_load_functions should only be called *once*");
 	has_been_called = true;
 
-	auto &load_lists = get_load_lists();
-	for (auto &fn_list : load_lists) {
-		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
-			fn_list.pop_front(); //remove from list
+	auto &all_jobs = get_load_jobs();
+
+	std::unordered_map< void const *, LoadJob * > by_key;
+	for (auto &job : all_jobs) {
+		if (job.key) by_key.emplace(job.key, &job);
+	}
+	auto find = [&by_key](LoadDependency const &dep) {
+		auto f = by_key.find(dep.load);
+		if (f == by_key.end()) {
+			throw std::runtime_error("A load depends on a Load<> that was never registered.");
+		}
+		return f->second;
+	};
+
+	//lazy loads that eager loads depend on are loaded eagerly:
+	std::function< void(LoadJob *) > make_eager = [&](LoadJob *job) {
+		for (auto const &dep : job->after) {
+			LoadJob *before = find(dep);
+			if (before->policy == LoadPolicy::Lazy) {
+				before->policy = LoadPolicy::Eager;
+				make_eager(before);
+			}
+		}
+	};
+	for (auto &job : all_jobs) {
+		if (job.policy == LoadPolicy::Eager) make_eager(&job);
+	}
+
+	std::vector< LoadJob * > jobs; //(the eager ones)
+	for (auto &job : all_jobs) {
+		if (job.policy == LoadPolicy::Eager) jobs.emplace_back(&job);
+	}
+
+	{ //build the dependency graph:
+		auto add_edge = [](LoadJob *before, LoadJob *job) {
+			before->then.emplace_back(job);
+			job->waiting += 1;
+		};
+		for (size_t j = 0; j < jobs.size(); ++j) {
+			LoadJob &job = *jobs[j];
+			if (job.listed) {
+				for (auto const &dep : job.after) {
+					add_edge(find(dep), &job);
+				}
+			} else {
+				//unlisted loads keep the old ordering -- after every load with an earlier tag, and after the unlisted loads before them with the same tag:
+				for (size_t b = 0; b < jobs.size(); ++b) {
+					LoadJob &before = *jobs[b];
+					if (before.tag < job.tag || (before.tag == job.tag && !before.listed && b < j)) add_edge(&before, &job);
+				}
+			}
+		}
+
+		//unlisted loads also run after the listed loads with their tag...
+		// ...except for listed loads that already wait (maybe indirectly) on them, which must run after instead:
+		auto waits_on = [](LoadJob *job, LoadJob *before) {
+			std::vector< LoadJob * > todo{before};
+			std::unordered_set< LoadJob * > seen{before};
+			while (!todo.empty()) {
+				LoadJob *at = todo.back();
+				todo.pop_back();
+				if (at == job) return true;
+				for (LoadJob *next : at->then) {
+					if (seen.emplace(next).second) todo.emplace_back(next);
+				}
+			}
+			return false;
+		};
+		for (LoadJob *job : jobs) {
+			if (job->listed) continue;
+			for (LoadJob *before : jobs) {
+				if (before->listed && before->tag == job->tag && !waits_on(before, job)) add_edge(before, job);
+			}
+		}
+
+		//find chain lengths in reverse topological order (and, while at it, check that there is such an order):
+		std::vector< LoadJob * > sorted;
+		std::unordered_map< LoadJob *, uint32_t > waiting;
+		for (LoadJob *job : jobs) {
+			waiting[job] = job->waiting;
+			if (job->waiting == 0) sorted.emplace_back(job);
+		}
+		for (size_t i = 0; i < sorted.size(); ++i) {
+			for (LoadJob *next : sorted[i]->then) {
+				if (--waiting[next] == 0) sorted.emplace_back(next);
+			}
+		}
+		if (sorted.size() != jobs.size()) {
+			throw std::runtime_error("Loads depend on each other in a cycle.");
+		}
+		for (auto job = sorted.rbegin(); job != sorted.rend(); ++job) {
+			for (LoadJob *next : (*job)->then) {
+				(*job)->chain = std::max((*job)->chain, next->chain + 1);
+			}
+		}
+	}
+
+	{ //check lazy loads' lists, and keep them for later:
+		Lazy &lazy = get_lazy();
+		std::lock_guard< std::mutex > lock(lazy.mutex);
+		for (auto &job : all_jobs) {
+			if (job.policy != LoadPolicy::Lazy) continue;
+			for (auto const &dep : job.after) {
+				LoadJob *before = find(dep);
+				if (before->policy != LoadPolicy::Lazy) continue;
+				if (job.on == LoadOn::Worker && before->on == LoadOn::Main) {
+					throw std::runtime_error("A lazy LoadOn::Worker load depends on a lazy LoadOn::Main load, which can't run in the background.");
+				}
+				job.lazy_after.emplace_back(before);
+			}
+			lazy.by_key.emplace(job.key, &job);
+		}
+		//(lazy loads only wait on other lazy loads -- their eager loads are done before any of them start -- so a cycle among them can only be lazy loads listing each other:)
+		std::unordered_map< LoadJob *, uint8_t > visiting; //1 = on the current path, 2 = checked
+		std::function< void(LoadJob *) > check = [&](LoadJob *job) {
+			uint8_t &mark = visiting[job];
+			if (mark == 2) return;
+			if (mark == 1) throw std::runtime_error("Loads depend on each other in a cycle.");
+			mark = 1;
+			for (LoadJob *before : job->lazy_after) check(before);
+			visiting[job] = 2;
+		};
+		for (auto const &[key, job] : lazy.by_key) check(job);
+	}
+
+	//run everything, marshalling Main loads to this thread and handing Worker loads to a pool:
+	std::mutex mutex;
+	std::condition_variable changed; //signalled when a load becomes ready, finishes, or fails
+	std::vector< LoadJob * > ready_main, ready_worker;
+	size_t remaining = jobs.size();
+	std::exception_ptr failure;
+
+	for (LoadJob *job : jobs) {
+		if (job->waiting == 0) (job->on == LoadOn::Main ? ready_main : ready_worker).emplace_back(job);
+	}
+
+	//take the ready load with the longest chain (earliest registered, among equals):
+	auto take = [](std::vector< LoadJob * > &ready) {
+		auto best = ready.begin();
+		for (auto r = ready.begin(); r != ready.end(); ++r) {
+			if ((*r)->chain > (*best)->chain) best = r;
+		}
+		LoadJob *job = *best;
+		ready.erase(best);
+		return job;
+	};
+
+	//run 'job' (called with 'lock' held; returns with it held):
+	auto run = [&](LoadJob *job, std::unique_lock< std::mutex > &lock) {
+		lock.unlock();
+		std::exception_ptr error;
+		try {
+			job->fn();
+		} catch (...) {
+			error = std::current_exception();
+		}
+		lock.lock();
+		remaining -= 1;
+		if (error) {
+			if (!failure) failure = error;
+		} else {
+			for (LoadJob *next : job->then) {
+				next->waiting -= 1;
+				if (next->waiting == 0) (next->on == LoadOn::Main ? ready_main : ready_worker).emplace_back(next);
+			}
+		}
+		changed.notify_all();
+	};
+
+	size_t worker_jobs = std::count_if(jobs.begin(), jobs.end(), [](LoadJob const *job) { return job->on == LoadOn::Worker; });
+	size_t worker_count = std::min< size_t >(worker_jobs, std::max(1u, std::thread::hardware_concurrency()) - 1);
+	if (worker_jobs > 0 && worker_count == 0) worker_count = 1;
+
+	std::vector< std::thread > workers;
+	for (size_t w = 0; w < worker_count; ++w) {
+		workers.emplace_back([&](){
+			std::unique_lock< std::mutex > lock(mutex);
+			while (true) {
+				changed.wait(lock, [&](){ return failure || remaining == 0 || !ready_worker.empty(); });
+				if (failure || ready_worker.empty()) break;
+				run(take(ready_worker), lock);
+			}
+		});
+	}
+
+	{ //this thread runs Main loads as they become ready:
+		std::unique_lock< std::mutex > lock(mutex);
+		while (true) {
+			changed.wait(lock, [&](){ return failure || remaining == 0 || !ready_main.empty(); });
+			if (failure || remaining == 0) break;
+			run(take(ready_main), lock);
+		}
+	}
+
+	for (auto &worker : workers) {
+		worker.join();
+	}
+
+	if (failure) std::rethrow_exception(failure);
+
+	{ //eager loads are done (and their functions aren't needed anymore); lazy loads may start:
+		Lazy &lazy = get_lazy();
+		std::lock_guard< std::mutex > lock(lazy.mutex);
+		for (LoadJob *job : jobs) {
+			job->state = LoadJob::State::Done;
+			job->fn = nullptr;
 		}
+		lazy.started = true;
 	}
+	get_lazy().changed.notify_all();
 }
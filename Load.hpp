@@ -20,11 +20,40 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. Meshes] before looking up individual elements within them.)
  *
+ * Loads may instead list the other loads they use; they then start as soon as those are done
+ *  (regardless of tags), and -- if they don't touch OpenGL -- run on a worker thread, in parallel with
+ *  everything else:
+ *
+ * Load< Scene > main_scene(LoadTagDefault, LoadOn::Worker, {main_meshes}, []() -> Scene const * {
+ *     return new Scene(data_path("main.scene"), ...uses main_meshes...);
+ * });
+ *
+ * (loads without a list run on the OpenGL thread after every load with an earlier tag, as before,
+ *  and after the listed loads with their own tag -- unless those list them)
+ *
+ * Loads that aren't needed right away can be made lazy, so they don't hold up startup (or cost
+ *  anything in programs that never use them):
+ *
+ * Load< Sound::Sample > music(LoadPolicy::Lazy, LoadOn::Worker, {}, []() -> Sound::Sample const * { ... });
+ *
+ * //later -- start loading in the background:
+ * music.prefetch();
+ * //...and check without waiting:
+ * if (music.ready()) Sound::play(*music);
+ * //(if loading throws, the exception is printed, music.failed() becomes true, and *music rethrows it)
+ *
+ * Dereferencing a lazy load that isn't ready waits for it (starting it, if needed).
+ * (lazy LoadOn::Main loads can't run in the background, so they run at first dereference, which must be on the main thread)
+ * (an eager load that lists a lazy load in 'after' makes it eager)
+ *
  */
 
+#include <atomic>
 #include <functional>
+#include <initializer_list>
 #include <stdexcept>
 #include <cstdint>
+#include <vector>
 
 
 enum LoadTag : uint32_t {
@@ -34,12 +63,48 @@ enum LoadTag : uint32_t {
 	MaxLoadTag //<-- just used to track # of load tags
 };
 
+//Which thread a load runs on:
+enum class LoadOn : uint8_t {
+	Main, //the thread calling call_load_functions() (i.e., the one with the OpenGL context)
+	Worker, //any thread (only for loads that don't touch OpenGL)
+};
+
+//When a load runs:
+enum class LoadPolicy : uint8_t {
+	Eager, //during call_load_functions()
+	Lazy, //once used (see above)
+};
+
+template< typename T >
+struct Load;
+
+//A load that another load waits for (constructed from the Load<> itself):
+// (only the address is kept, so the Load<> may be in another file and not constructed yet)
+struct LoadDependency {
+	template< typename T >
+	LoadDependency(Load< T > const &load_) : load(&load_) { }
+	void const *load;
+};
+
 //Add a function to an internal list of loading functions:
 // (only call *before* "call_load_functions()")
-void add_load_function(LoadTag tag, std::function< void() > const &fn);
+// ('key' identifies the load to other loads' LoadDependency -- generally the address of the Load<>)
+void add_load_function(LoadTag tag, std::function< void() > const &fn, void const *key = nullptr);
+
+//Add a function that runs on thread 'on' once the loads in 'after' are done:
+// (the tag is still used to order loads without lists -- those run after every load with the same or an earlier tag)
+void add_load_function(LoadTag tag, void const *key, LoadOn on, std::vector< LoadDependency > const &after, std::function< void() > const &fn, LoadPolicy policy = LoadPolicy::Eager);
+
+//Lazy loads (by key): start one in the background, if it hasn't been started:
+void prefetch_load(void const *key);
+//...or start it if needed, then wait for it to finish (rethrows if it failed):
+void wait_for_load(void const *key);
+//...or check whether it finished by throwing (or because a load it needs did; never waits):
+// (the exception is also printed to std::cerr when the load fails)
+bool lazy_load_failed(void const *key);
 
 //Call all loading functions:
-// (loading functions may throw exceptions if they fail.)
+// (loading functions may throw exceptions if they fail; the first exception is rethrown once running loads finish.)
 // (only call *once*)
 void call_load_functions();
 
@@ -52,21 +117,55 @@ template< typename T >
 struct Load {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
 	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >) : value(nullptr) {
-		add_load_function(tag, [this,load_fn](){
-			this->value = load_fn();
-			if (!(this->value)) {
-				throw std::runtime_error("Loading failed.");
-			}
-		});
+		add_load_function(tag, wrap(load_fn), this);
+	}
+
+	//...or to call it on thread 'on' once the loads in 'after' are done (see above):
+	Load(LoadTag tag, LoadOn on, std::initializer_list< LoadDependency > after, const std::function< T const *() > &load_fn) : value(nullptr) {
+		add_load_function(tag, this, on, after, wrap(load_fn));
+	}
+
+	//...or, for lazy loads, once it is used (see above):
+	Load(LoadPolicy policy, LoadOn on, std::initializer_list< LoadDependency > after, const std::function< T const *() > &load_fn) : value(nullptr), lazy(policy == LoadPolicy::Lazy) {
+		add_load_function(LoadTagDefault, this, on, after, wrap(load_fn), policy);
 	}
 
 	//Make a "Load< T >" behave like a "T const *":
-	explicit operator bool() { return value != nullptr; }
-	operator T const *() { return value; }
-	T const &operator*() { return *value; }
-	T const *operator->() { return value; }
+	// (for lazy loads, these wait for the load to finish)
+	explicit operator bool() { return get() != nullptr; }
+	operator T const *() { return get(); }
+	T const &operator*() { return *get(); }
+	T const *operator->() { return get(); }
+
+	//start a lazy load in the background (does nothing for loads that have been started):
+	void prefetch() { if (lazy) prefetch_load(this); }
+	//has the load finished? (never waits)
+	// (a lazy load that throws never becomes ready; check failed() to stop waiting on it)
+	bool ready() const { return done.load(std::memory_order_acquire); }
+	//did a lazy load fail? (never waits; dereferencing it rethrows the exception)
+	bool failed() const { return lazy && !ready() && lazy_load_failed(this); }
+
+	T const *get() {
+		if (lazy && !done.load(std::memory_order_acquire)) wait_for_load(this);
+		return value;
+	}
 
 	T const *value;
+
+private:
+	bool lazy = false;
+	std::atomic< bool > done = false; //set (after 'value') once loading has finished
+
+	std::function< void() > wrap(std::function< T const *() > const &load_fn) {
+		return [this,load_fn](){
+			T const *loaded = load_fn();
+			if (!loaded) {
+				throw std::runtime_error("Loading failed.");
+			}
+			this->value = loaded;
+			this->done.store(true, std::memory_order_release);
+		};
+	}
 };
 
 
@@ -76,7 +175,10 @@ template< >
 struct Load< void > {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
 	Load( LoadTag tag, const std::function< void() > &load_fn) {
-		add_load_function(tag, load_fn);
+		add_load_function(tag, load_fn, this);
+	}
+	Load(LoadTag tag, LoadOn on, std::initializer_list< LoadDependency > after, const std::function< void() > &load_fn) {
+		add_load_function(tag, this, on, after, load_fn);
 	}
 };
 
@@ -31,6 +31,7 @@ if (maek.OS === "windows") {
 		`/I${NEST_LIBS}/SDL3/include`,
 		`/I${NEST_LIBS}/glm/include`,
 		`/I${NEST_LIBS}/libpng/include`,
+		`/I${NEST_LIBS}/zlib/include`,
 		`/I${NEST_LIBS}/opusfile/include`,
 		`/I${NEST_LIBS}/libopus/include`,
 		`/I${NEST_LIBS}/libogg/include`,
@@ -58,6 +59,7 @@ if (maek.OS === "windows") {
 		`-I${NEST_LIBS}/SDL3/include`, `-D_THREAD_SAFE`,
 		`-I${NEST_LIBS}/glm/include`,
 		`-I${NEST_LIBS}/libpng/include`,
+		`-I${NEST_LIBS}/zlib/include`,
 		`-I${NEST_LIBS}/opusfile/include`,
 		`-I${NEST_LIBS}/libopus/include`,
 		`-I${NEST_LIBS}/libogg/include`
@@ -78,6 +80,7 @@ if (maek.OS === "windows") {
 		`-I${NEST_LIBS}/SDL3/include`, `-D_THREAD_SAFE`,
 		`-I${NEST_LIBS}/glm/include`,
 		`-I${NEST_LIBS}/libpng/include`,
+		`-I${NEST_LIBS}/zlib/include`,
 		`-I${NEST_LIBS}/opusfile/include`,
 		`-I${NEST_LIBS}/libopus/include`,
 		`-I${NEST_LIBS}/libogg/include`
@@ -151,16 +154,26 @@ const game_names = [
 
 const common_names = [
 	maek.CPP('data_path.cpp'),
+	maek.CPP('mapped_file.cpp'),
+	maek.CPP('data_file.cpp'),
+	maek.CPP('string_intern.cpp'),
+	maek.CPP('parallel_for.cpp'),
 	maek.CPP('PathFont.cpp'),
 	maek.CPP('PathFont-font.cpp'),
 	maek.CPP('DrawLines.cpp'),
 	maek.CPP('ColorProgram.cpp'),
 	maek.CPP('Scene.cpp'),
+	maek.CPP('Frustum.cpp'),
 	maek.CPP('Mesh.cpp'),
+	maek.CPP('MeshBVH.cpp'),
+	maek.CPP('StaticBatch.cpp'),
+	maek.CPP('Occlusion.cpp'),
+	maek.CPP('LightClusters.cpp'),
 	maek.CPP('load_save_png.cpp'),
 	maek.CPP('gl_compile_program.cpp'),
 	maek.CPP('Mode.cpp'),
 	maek.CPP('GL.cpp'),
+	maek.CPP('gl_state.cpp'),
 	maek.CPP('Load.cpp')
 ];
 
@@ -176,6 +189,41 @@ const show_scene_names = [
 	maek.CPP('ShowSceneMode.cpp')
 ];
 
+//offline tool (no window or OpenGL needed, so it doesn't use common_names):
+const optimize_meshes_names = [
+	maek.CPP('optimize-meshes.cpp'),
+	maek.CPP('mesh_simplify.cpp')
+];
+
+//offline tool that packs dist/ into dist/assets.pak (see data_file.hpp):
+const pack_assets_names = [
+	maek.CPP('pack-assets.cpp')
+];
+
+//headless tests (they never open a window or use OpenGL, so they run anywhere; each exits nonzero if a check fails -- see tests/check.hpp):
+const test_frustum_names = [
+	maek.CPP('tests/test-frustum.cpp')
+];
+const test_occlusion_names = [
+	maek.CPP('tests/test-occlusion.cpp')
+];
+const test_light_clusters_names = [
+	maek.CPP('tests/test-light-clusters.cpp')
+];
+//(reads the game's scene files through data_path(), so is built into dist/, next to them)
+const test_scene_versions_names = [
+	maek.CPP('tests/test-scene-versions.cpp')
+];
+
+//headless benchmarks (also no window or OpenGL; each prints its timings):
+// (ones that read the game's data through data_path() are built into dist/, next to it)
+const bench_scene_copy_names = [
+	maek.CPP('tests/bench-scene-copy.cpp')
+];
+const bench_occlusion_names = [
+	maek.CPP('tests/bench-occlusion.cpp')
+];
+
 //the '[exeFile =] LINK(objFiles, exeFileBase, [, options])' links an array of objects into an executable:
 // objFiles: array of objects to link
 // exeFileBase: name of executable file to produce
@@ -183,9 +231,17 @@ const show_scene_names = [
 const game_exe = maek.LINK([...game_names, ...common_names], 'dist/game');
 const show_meshes_exe = maek.LINK([...show_meshes_names, ...common_names], 'scenes/show-meshes');
 const show_scene_exe = maek.LINK([...show_scene_names, ...common_names], 'scenes/show-scene');
+const optimize_meshes_exe = maek.LINK([...optimize_meshes_names], 'scenes/optimize-meshes');
+const pack_assets_exe = maek.LINK([...pack_assets_names], 'scenes/pack-assets');
+const test_frustum_exe = maek.LINK([...test_frustum_names, ...common_names], 'tests/test-frustum');
+const test_occlusion_exe = maek.LINK([...test_occlusion_names, ...common_names], 'tests/test-occlusion');
+const test_light_clusters_exe = maek.LINK([...test_light_clusters_names, ...common_names], 'tests/test-light-clusters');
+const test_scene_versions_exe = maek.LINK([...test_scene_versions_names, ...common_names], 'dist/test-scene-versions');
+const bench_scene_copy_exe = maek.LINK([...bench_scene_copy_names, ...common_names], 'dist/bench-scene-copy');
+const bench_occlusion_exe = maek.LINK([...bench_occlusion_names, ...common_names], 'tests/bench-occlusion');
 
 //set the default target to the game (and copy the readme files):
-maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, ...copies];
+maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, optimize_meshes_exe, pack_assets_exe, test_frustum_exe, test_occlusion_exe, test_light_clusters_exe, test_scene_versions_exe, bench_scene_copy_exe, bench_occlusion_exe, ...copies];
 
 //Note that tasks that produce ':abstract targets' are never cached.
 // This is similar to how .PHONY targets behave in make.
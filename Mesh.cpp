@@ -1,20 +1,131 @@
 #include "Mesh.hpp"
+#include "data_file.hpp"
 #include "read_write_chunk.hpp"
+#include "gl_state.hpp"
+#include "string_intern.hpp"
+#include "parallel_for.hpp"
 
 #include <glm/glm.hpp>
 
 #include <stdexcept>
-#include <fstream>
+#include <span>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <set>
 #include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+#include <mutex>
 
-MeshBuffer::MeshBuffer(std::string const &filename) {
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESH_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+//Bounds computation for files without a 'bnd0' chunk:
+
+//min/max of float positions (first three floats of each 'stride'-byte vertex) in vertices [begin,end):
+static void scan_box(char const *vertices, size_t stride, uint32_t begin, uint32_t end, glm::vec3 *min_, glm::vec3 *max_) {
+	glm::vec3 &min = *min_;
+	glm::vec3 &max = *max_;
+#ifdef MESH_USE_SSE
+	//loads (x,y,z,next float), so needs a vertex at least 16 bytes long; the fourth lane is ignored:
+	if (stride >= 16 && begin < end) {
+		__m128 lo = _mm_loadu_ps(reinterpret_cast< float const * >(vertices + begin * stride));
+		__m128 hi = lo;
+		for (uint32_t v = begin + 1; v < end; ++v) {
+			__m128 p = _mm_loadu_ps(reinterpret_cast< float const * >(vertices + v * stride));
+			lo = _mm_min_ps(lo, p);
+			hi = _mm_max_ps(hi, p);
+		}
+		float l[4], h[4];
+		_mm_storeu_ps(l, lo);
+		_mm_storeu_ps(h, hi);
+		min = glm::min(min, glm::vec3(l[0], l[1], l[2]));
+		max = glm::max(max, glm::vec3(h[0], h[1], h[2]));
+		return;
+	}
+#endif
+	for (uint32_t v = begin; v < end; ++v) {
+		glm::vec3 p;
+		std::memcpy(&p, vertices + v * stride, sizeof(p));
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+}
+
+//largest squared distance from 'center' of float positions in vertices [begin,end):
+static float scan_radius2(char const *vertices, size_t stride, uint32_t begin, uint32_t end, glm::vec3 const &center) {
+	float radius2 = 0.0f;
+#ifdef MESH_USE_SSE
+	if (stride >= 16 && begin < end) {
+		__m128 c = _mm_setr_ps(center.x, center.y, center.z, 0.0f);
+		__m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+		__m128 best = _mm_setzero_ps();
+		for (uint32_t v = begin; v < end; ++v) {
+			__m128 d = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(reinterpret_cast< float const * >(vertices + v * stride)), c), xyz);
+			d = _mm_mul_ps(d, d);
+			//horizontal sum (into every lane):
+			d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+			d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+			best = _mm_max_ps(best, d);
+		}
+		return _mm_cvtss_f32(best);
+	}
+#endif
+	for (uint32_t v = begin; v < end; ++v) {
+		glm::vec3 p;
+		std::memcpy(&p, vertices + v * stride, sizeof(p));
+		glm::vec3 d = p - center;
+		radius2 = std::max(radius2, glm::dot(d, d));
+	}
+	return radius2;
+}
+
+//streamed buffers with data still to upload, oldest first:
+static std::mutex streaming_mutex;
+static std::vector< MeshBuffer::Stream * > streaming;
+
+//every constructed MeshBuffer, so forget_program() can drop their vaos for a deleted program:
+// (only touched from the thread with the OpenGL context, like the vaos themselves)
+static std::vector< MeshBuffer const * > live_buffers;
+
+MeshBuffer::MeshBuffer(std::string const &filename, Upload upload, Raycast raycast, CPUData cpu_data) {
 	glGenBuffers(1, &buffer);
 
-	std::ifstream file(filename, std::ios::binary);
+	//send vertex data to 'buffer' (or, when streaming, just allocate it and keep the data for stream_mesh_buffers()):
+	auto upload_vertices = [&](void const *bytes, size_t size, GLsizei stride) {
+		char const *begin = reinterpret_cast< char const * >(bytes);
+		if (cpu_data == CPUData::Keep) {
+			vertex_data.assign(begin, begin + size);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		if (upload == Upload::Streamed) {
+			glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STATIC_DRAW);
+			stream = std::make_unique< Stream >();
+			//(streams straight from vertex_data when that is kept anyway, so the file's vertices are only held once)
+			if (cpu_data == CPUData::Keep) {
+				stream->data = vertex_data.data();
+			} else {
+				stream->pending.assign(begin, begin + size);
+				stream->data = stream->pending.data();
+			}
+			stream->size = size;
+			stream->stride = stride;
+			stream->buffer = buffer;
+		} else {
+			glBufferData(GL_ARRAY_BUFFER, size, bytes, GL_STATIC_DRAW);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	};
+
+	//(from the asset archive, if it has the file; chunks are used in place where their data is aligned, so no copies)
+	DataFile file(filename);
+	char const *at = file.data;
+	char const *end = file.data + file.size;
 
 	GLuint total = 0;
 
@@ -25,16 +136,49 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		glm::vec2 TexCoord;
 	};
 	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
-	std::vector< Vertex > data;
+	std::span< Vertex const > data;
+	std::vector< Vertex > data_copy; //(only used for unaligned chunks; see read_chunk_view)
+
+	//compact vertex format ('pnq0' chunk, instead of 'pnct'):
+	struct QuantizedVertex {
+		int16_t Position[4]; //xyz quantized to the mesh's bounds (see 'qnt0' below); w unused (keeps Normal aligned)
+		uint32_t Normal; //signed-normalized 2_10_10_10_REV (w unused)
+		glm::u8vec4 Color;
+		uint16_t TexCoord[2]; //half floats
+	};
+	static_assert(sizeof(QuantizedVertex) == 4*2+4+4*1+2*2, "QuantizedVertex is packed.");
+	std::span< QuantizedVertex const > quantized;
+	std::vector< QuantizedVertex > quantized_copy;
+
+	//(chunk header magic tells which format the file uses)
+	auto peek_magic = [&at, &end]() {
+		if (end - at < 4) return std::string();
+		return std::string(at, 4);
+	};
+
+	bool compact = false; //set if file uses the compact format
 
 	//read + upload data chunk:
-	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
-		read_chunk(file, "pnct", &data);
+	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct" && peek_magic() == "pnq0") {
+		compact = true;
+		quantized = read_chunk_view(&at, end, "pnq0", &quantized_copy);
 
 		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		upload_vertices(quantized.data(), quantized.size() * sizeof(QuantizedVertex), sizeof(QuantizedVertex));
+
+		total = GLuint(quantized.size()); //store total for later checks on index
+
+		//store attrib locations:
+		// (positions are *not* normalized -- the 1/32767 is folded into Mesh::position_scale, which is exact on every GL version)
+		Position = Attrib(3, GL_SHORT, GL_FALSE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Position));
+		Normal = Attrib(4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Normal));
+		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Color));
+		TexCoord = Attrib(2, GL_HALF_FLOAT, GL_FALSE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, TexCoord));
+	} else if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
+		data = read_chunk_view(&at, end, "pnct", &data_copy);
+
+		//upload data:
+		upload_vertices(data.data(), data.size() * sizeof(Vertex), sizeof(Vertex));
 
 		total = GLuint(data.size()); //store total for later checks on index
 
@@ -47,19 +191,72 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		throw std::runtime_error("Unknown file type '" + filename + "'");
 	}
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	std::vector< char > strings_copy;
+	std::span< char const > strings = read_chunk_view(&at, end, "str0", &strings_copy);
 
 	{ //read index chunk, add to meshes:
+		//the index is either 'idx0' (meshes are ranges of vertices drawn in order)
+		// or 'idx1' followed by 'ele0' (meshes are ranges of 32-bit element indices into welded vertices):
+		bool indexed = (peek_magic() == "idx1");
+
 		struct IndexEntry {
 			uint32_t name_begin, name_end;
 			uint32_t vertex_begin, vertex_end;
+			uint32_t element_begin = 0, element_end = 0; //(idx1 only)
 		};
-		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
 
 		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+		std::span< uint32_t const > elements;
+		std::vector< uint32_t > elements_copy;
+		if (indexed) {
+			static_assert(sizeof(IndexEntry) == 24, "Index entry should be packed");
+			std::span< IndexEntry const > index1 = read_chunk_view(&at, end, "idx1", &index);
+			if (index1.data() != index.data()) index.assign(index1.begin(), index1.end());
+			elements = read_chunk_view(&at, end, "ele0", &elements_copy);
 
+			for (uint32_t e : elements) {
+				if (e >= total) {
+					throw std::runtime_error("element chunk refers to out-of-range vertex");
+				}
+			}
+
+			glGenBuffers(1, &index_buffer);
+			//(uploaded through the array buffer binding since the element array binding belongs to whatever vao is bound)
+			glBindBuffer(GL_ARRAY_BUFFER, index_buffer);
+			glBufferData(GL_ARRAY_BUFFER, elements.size() * sizeof(uint32_t), elements.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			if (cpu_data == CPUData::Keep) element_data.assign(elements.begin(), elements.end());
+		} else {
+			struct IndexEntry0 {
+				uint32_t name_begin, name_end;
+				uint32_t vertex_begin, vertex_end;
+			};
+			static_assert(sizeof(IndexEntry0) == 16, "Index entry should be packed");
+			std::vector< IndexEntry0 > index0_copy;
+			std::span< IndexEntry0 const > index0 = read_chunk_view(&at, end, "idx0", &index0_copy);
+			index.reserve(index0.size());
+			for (auto const &entry : index0) {
+				index.emplace_back(IndexEntry{ entry.name_begin, entry.name_end, entry.vertex_begin, entry.vertex_end });
+			}
+		}
+
+		//compact vertex files then have a 'qnt0' chunk with position dequantization for each index entry:
+		struct Dequantize {
+			glm::vec3 scale;
+			glm::vec3 offset;
+		};
+		static_assert(sizeof(Dequantize) == 4*3*2, "Dequantize is packed.");
+		std::span< Dequantize const > dequantize;
+		std::vector< Dequantize > dequantize_copy;
+		if (compact) {
+			dequantize = read_chunk_view(&at, end, "qnt0", &dequantize_copy);
+			if (dequantize.size() != index.size()) {
+				throw std::runtime_error("dequantization chunk doesn't match index");
+			}
+		}
+
+		std::vector< std::pair< std::string_view, Mesh > > loaded;
+		loaded.reserve(index.size());
 		for (auto const &entry : index) {
 			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
 				throw std::runtime_error("index entry has out-of-range name begin/end");
@@ -67,84 +264,499 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
 				throw std::runtime_error("index entry has out-of-range vertex start/count");
 			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
+			if (!(entry.element_begin <= entry.element_end && entry.element_end <= elements.size())) {
+				throw std::runtime_error("index entry has out-of-range element start/count");
+			}
+			std::string_view name = intern_string(std::string_view(strings.data() + entry.name_begin, entry.name_end - entry.name_begin));
 			Mesh mesh;
 			mesh.type = GL_TRIANGLES;
-			mesh.start = entry.vertex_begin;
-			mesh.count = entry.vertex_end - entry.vertex_begin;
-			for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
-				mesh.min = glm::min(mesh.min, data[v].Position);
-				mesh.max = glm::max(mesh.max, data[v].Position);
+			if (indexed) {
+				mesh.start = entry.element_begin;
+				mesh.count = entry.element_end - entry.element_begin;
+				mesh.index_type = GL_UNSIGNED_INT;
+				for (uint32_t e = entry.element_begin; e < entry.element_end; ++e) {
+					mesh.vertex_end = std::max(mesh.vertex_end, elements[e] + 1);
+				}
+			} else {
+				mesh.start = entry.vertex_begin;
+				mesh.count = entry.vertex_end - entry.vertex_begin;
+				mesh.vertex_end = entry.vertex_end;
 			}
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
-			if (!inserted) {
-				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+			if (stream) mesh.resident_vertices = &stream->resident_vertices;
+			if (!dequantize.empty()) {
+				Dequantize const &dq = dequantize[&entry - &index[0]];
+				mesh.position_scale = dq.scale;
+				mesh.position_offset = dq.offset;
 			}
+			//(bounds are filled in below)
+			loaded.emplace_back(name, mesh);
+		}
+
+		//files may have precomputed bounds ('bnd0': box and sphere per index entry):
+		struct BoundsEntry {
+			glm::vec3 min, max;
+			glm::vec3 sphere_center;
+			float sphere_radius;
+		};
+		static_assert(sizeof(BoundsEntry) == 4*3*3+4, "BoundsEntry is packed.");
+		if (peek_magic() == "bnd0") {
+			std::vector< BoundsEntry > bounds_copy;
+			std::span< BoundsEntry const > bounds = read_chunk_view(&at, end, "bnd0", &bounds_copy);
+			if (bounds.size() != index.size()) {
+				throw std::runtime_error("bounds chunk doesn't match index");
+			}
+			for (size_t i = 0; i < loaded.size(); ++i) {
+				loaded[i].second.min = bounds[i].min;
+				loaded[i].second.max = bounds[i].max;
+				loaded[i].second.sphere_center = bounds[i].sphere_center;
+				loaded[i].second.sphere_radius = bounds[i].sphere_radius;
+			}
+		} else {
+			//otherwise, scan the vertices -- in pieces of at most ScanVertices, so that big meshes are spread over threads:
+			// (for indexed meshes, vertex range is the mesh's welded vertices)
+			constexpr uint32_t ScanVertices = 16384;
+			struct Piece {
+				size_t mesh;
+				uint32_t begin, end;
+				glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+				glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+				float radius2 = 0.0f;
+			};
+			std::vector< Piece > pieces;
+			for (size_t i = 0; i < index.size(); ++i) {
+				for (uint32_t begin = index[i].vertex_begin; begin < index[i].vertex_end; begin += ScanVertices) {
+					pieces.emplace_back();
+					pieces.back().mesh = i;
+					pieces.back().begin = begin;
+					pieces.back().end = std::min(index[i].vertex_end, begin + ScanVertices);
+				}
+			}
+
+			//positions as floats in object space:
+			// (compact positions are scanned as integers and dequantized per piece, since the map is affine)
+			auto piece_box = [&](Piece &piece) {
+				if (!compact) {
+					scan_box(reinterpret_cast< char const * >(data.data()), sizeof(Vertex), piece.begin, piece.end, &piece.min, &piece.max);
+					return;
+				}
+				glm::ivec3 lo = glm::ivec3(std::numeric_limits< int >::max());
+				glm::ivec3 hi = glm::ivec3(std::numeric_limits< int >::min());
+				for (uint32_t v = piece.begin; v < piece.end; ++v) {
+					int16_t const *q = quantized[v].Position;
+					glm::ivec3 p = glm::ivec3(q[0], q[1], q[2]);
+					lo = glm::min(lo, p);
+					hi = glm::max(hi, p);
+				}
+				Dequantize const &dq = dequantize[piece.mesh];
+				glm::vec3 a = dq.offset + dq.scale * glm::vec3(lo);
+				glm::vec3 b = dq.offset + dq.scale * glm::vec3(hi);
+				piece.min = glm::min(a, b);
+				piece.max = glm::max(a, b);
+			};
+			auto piece_radius2 = [&](Piece &piece) {
+				glm::vec3 center = loaded[piece.mesh].second.sphere_center;
+				if (!compact) {
+					piece.radius2 = scan_radius2(reinterpret_cast< char const * >(data.data()), sizeof(Vertex), piece.begin, piece.end, center);
+					return;
+				}
+				Dequantize const &dq = dequantize[piece.mesh];
+				for (uint32_t v = piece.begin; v < piece.end; ++v) {
+					int16_t const *q = quantized[v].Position;
+					glm::vec3 d = dq.offset + dq.scale * glm::vec3(q[0], q[1], q[2]) - center;
+					piece.radius2 = std::max(piece.radius2, glm::dot(d, d));
+				}
+			};
+
+			//box first (sphere is centered on the box):
+			parallel_for(pieces.size(), [&](size_t p) { piece_box(pieces[p]); }, pieces.size() / 4);
+			for (auto const &piece : pieces) {
+				Mesh &mesh = loaded[piece.mesh].second;
+				mesh.min = glm::min(mesh.min, piece.min);
+				mesh.max = glm::max(mesh.max, piece.max);
+			}
+			for (auto &name_mesh : loaded) {
+				Mesh &mesh = name_mesh.second;
+				if (mesh.min.x <= mesh.max.x) mesh.sphere_center = 0.5f * (mesh.min + mesh.max);
+			}
+
+			parallel_for(pieces.size(), [&](size_t p) { piece_radius2(pieces[p]); }, pieces.size() / 4);
+			for (auto const &piece : pieces) {
+				Mesh &mesh = loaded[piece.mesh].second;
+				mesh.sphere_radius = std::max(mesh.sphere_radius, std::sqrt(piece.radius2));
+			}
+		}
+
+		//files may also have meshlets ('mlt0'; see Frustum.hpp), sorted by start:
+		if (peek_magic() == "mlt0") {
+			//(copied, since meshes point at them after the file is gone)
+			std::vector< Meshlet > meshlets_copy;
+			std::span< Meshlet const > file_meshlets = read_chunk_view(&at, end, "mlt0", &meshlets_copy);
+			meshlets.assign(file_meshlets.begin(), file_meshlets.end());
+			for (size_t i = 1; i < meshlets.size(); ++i) {
+				if (meshlets[i].start < meshlets[i-1].start + meshlets[i-1].count) {
+					throw std::runtime_error("meshlet chunk isn't sorted");
+				}
+			}
+			//meshes use the meshlets that tile their range exactly (any gap or overhang means the meshlets don't belong to that mesh):
+			for (auto &name_mesh : loaded) {
+				Mesh &mesh = name_mesh.second;
+				auto first = std::lower_bound(meshlets.begin(), meshlets.end(), mesh.start, [](Meshlet const &m, GLuint start) {
+					return m.start < start;
+				});
+				GLuint at = mesh.start;
+				auto last = first;
+				while (last != meshlets.end() && last->start == at && at + last->count <= mesh.start + mesh.count) {
+					at += last->count;
+					++last;
+				}
+				if (at == mesh.start + mesh.count && last != first) {
+					mesh.meshlets = &*first;
+					mesh.meshlet_count = uint32_t(last - first);
+				}
+			}
+		}
+
+		//triangle BVHs for ray queries, if requested (one per index entry, built in parallel):
+		std::vector< MeshBVH > loaded_bvhs;
+		if (raycast == Raycast::Enabled) {
+			loaded_bvhs.resize(index.size());
+			parallel_for(index.size(), [&](size_t i) {
+				IndexEntry const &entry = index[i];
+
+				//object-space position of vertex 'v':
+				auto position = [&](uint32_t v) {
+					if (!compact) return data[v].Position;
+					int16_t const *q = quantized[v].Position;
+					return dequantize[i].offset + dequantize[i].scale * glm::vec3(q[0], q[1], q[2]);
+				};
+
+				//gather the vertices the mesh uses and its triangles (relative to them):
+				std::vector< glm::vec3 > positions;
+				std::vector< uint32_t > triangles;
+				if (indexed) {
+					if (entry.element_begin == entry.element_end) return;
+					auto [lo, hi] = std::minmax_element(elements.begin() + entry.element_begin, elements.begin() + entry.element_end);
+					for (uint32_t v = *lo; v <= *hi; ++v) positions.emplace_back(position(v));
+					triangles.reserve(entry.element_end - entry.element_begin);
+					for (uint32_t e = entry.element_begin; e < entry.element_end; ++e) triangles.emplace_back(elements[e] - *lo);
+				} else {
+					for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
+						positions.emplace_back(position(v));
+						triangles.emplace_back(v - entry.vertex_begin);
+					}
+				}
+				triangles.resize(triangles.size() - triangles.size() % 3); //(ignore any partial triangle, as glDraw* would)
+				loaded_bvhs[i] = MeshBVH(positions, triangles);
+			});
+		}
+
+		//sort by name (stable, so that the first of any same-named meshes is the one kept):
+		std::vector< uint32_t > order(loaded.size());
+		for (uint32_t i = 0; i < uint32_t(order.size()); ++i) order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			return loaded[a].first < loaded[b].first;
+		});
+		meshes.reserve(loaded.size());
+		mesh_names.reserve(loaded.size());
+		if (!loaded_bvhs.empty()) bvhs.reserve(loaded.size());
+		for (uint32_t i : order) {
+			auto const &[name, mesh] = loaded[i];
+			if (!mesh_names.empty() && mesh_names.back() == name) {
+				std::cerr << "WARNING: mesh name '" << name << "' in filename '" << filename << "' collides with existing mesh." << std::endl;
+				continue;
+			}
+			mesh_names.emplace_back(name);
+			meshes.emplace_back(mesh);
+			if (!loaded_bvhs.empty()) bvhs.emplace_back(std::move(loaded_bvhs[i]));
 		}
 	}
 
-	if (file.peek() != EOF) {
+	//build name hash table (kept at most half full so probe sequences stay short):
+	{
+		size_t slots = 1;
+		while (slots < 2 * mesh_names.size()) slots *= 2;
+		name_slots.assign(slots, 0);
+		for (uint32_t m = 0; m < uint32_t(mesh_names.size()); ++m) {
+			size_t i = std::hash< std::string_view >()(mesh_names[m]) & (slots - 1);
+			while (name_slots[i] != 0) i = (i + 1) & (slots - 1);
+			name_slots[i] = m + 1;
+		}
+	}
+
+	//skip any whole chunks this loader doesn't use (e.g., ones optimize-meshes passed through), without checking their contents:
+	while (end - at >= 8) {
+		char const *before = at;
+		try {
+			size_t size = 0;
+			skip_chunk(&at, end, peek_magic(), 1, &size, ChunkCRC::Skip);
+		} catch (std::runtime_error &) {
+			at = before;
+			break;
+		}
+	}
+
+	if (at != end) {
 		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
 	}
 
+	//only start streaming once construction can't throw anymore:
+	if (stream) {
+		std::lock_guard< std::mutex > lock(streaming_mutex);
+		streaming.emplace_back(stream.get());
+	}
+	live_buffers.emplace_back(this);
+
 	/* //DEBUG:
 	std::cout << "File '" << filename << "' contained meshes";
-	for (auto const &m : meshes) {
-		if (&m.second == &meshes.rbegin()->second && meshes.size() > 1) std::cout << " and";
-		std::cout << " '" << m.first << "'";
-		if (&m.second != &meshes.rbegin()->second) std::cout << ",";
+	for (uint32_t m = 0; m < size(); ++m) {
+		if (m + 1 == size() && size() > 1) std::cout << " and";
+		std::cout << " '" << mesh_names[m] << "'";
+		if (m + 1 != size()) std::cout << ",";
 	}
 	std::cout << std::endl;
 	*/
 }
 
-const Mesh &MeshBuffer::lookup(std::string const &name) const {
-	auto f = meshes.find(name);
-	if (f == meshes.end()) {
-		throw std::runtime_error("Looking up mesh '" + name + "' that doesn't exist.");
+MeshBuffer::~MeshBuffer() {
+	if (stream) {
+		std::lock_guard< std::mutex > lock(streaming_mutex);
+		streaming.erase(std::remove(streaming.begin(), streaming.end(), stream.get()), streaming.end());
+	}
+	live_buffers.erase(std::remove(live_buffers.begin(), live_buffers.end(), this), live_buffers.end());
+
+	for (auto const &[program, vao] : program_vaos) {
+		glDeleteVertexArrays(1, &vao);
+	}
+	program_vaos.clear();
+	if (index_buffer != 0) glDeleteBuffers(1, &index_buffer);
+	index_buffer = 0;
+	glDeleteBuffers(1, &buffer);
+	buffer = 0;
+	gl_state_invalidate(); //(one of the vaos may still be bound)
+}
+
+size_t stream_mesh_buffers(size_t byte_budget) {
+	//each glBufferSubData call is at most this large, so no single call stalls for long:
+	constexpr size_t ChunkBytes = size_t(1) << 18;
+
+	std::lock_guard< std::mutex > lock(streaming_mutex);
+
+	size_t total = 0;
+	while (!streaming.empty()) {
+		MeshBuffer::Stream &stream = *streaming.front();
+		size_t stride = size_t(stream.stride);
+
+		//whole vertices only, and always at least one (so any nonzero budget makes progress):
+		// (total can pass byte_budget after that one forced vertex, so the remaining budget is clamped at zero)
+		size_t remaining = (total >= byte_budget ? 0 : byte_budget - total);
+		size_t bytes = std::min({ ChunkBytes, remaining, stream.size - stream.uploaded });
+		bytes -= bytes % stride;
+		if (bytes == 0 && total == 0 && byte_budget > 0) bytes = std::min(stride, stream.size - stream.uploaded);
+		if (bytes == 0 && stream.uploaded < stream.size) break; //out of budget
+
+		if (bytes > 0) {
+			glBindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+			glBufferSubData(GL_ARRAY_BUFFER, stream.uploaded, bytes, stream.data + stream.uploaded);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			stream.uploaded += bytes;
+			stream.resident_vertices = GLuint(stream.uploaded / stride);
+			total += bytes;
+		}
+
+		if (stream.uploaded == stream.size) {
+			//done with this buffer:
+			stream.pending = std::vector< char >();
+			stream.data = nullptr;
+			streaming.erase(streaming.begin());
+		}
 	}
-	return f->second;
+	return total;
+}
+
+const Mesh &MeshBuffer::lookup(std::string_view name) const {
+	return meshes[lookup_id(name).index];
+}
+
+MeshId MeshBuffer::find(std::string_view name) const {
+	MeshId ret;
+	if (name_slots.empty()) return ret;
+	size_t slots = name_slots.size();
+	size_t i = std::hash< std::string_view >()(name) & (slots - 1);
+	while (uint32_t slot = name_slots[i]) {
+		if (mesh_names[slot - 1] == name) {
+			ret.index = slot - 1;
+			break;
+		}
+		i = (i + 1) & (slots - 1);
+	}
+	return ret;
+}
+
+MeshId MeshBuffer::find_lod(MeshId id, uint32_t level) const {
+	return find(std::string(name(id)) + ".LOD" + std::to_string(level));
+}
+
+MeshId MeshBuffer::lookup_id(std::string_view name) const {
+	MeshId id = find(name);
+	if (!id.valid()) {
+		throw std::runtime_error("Looking up mesh '" + std::string(name) + "' that doesn't exist.");
+	}
+	return id;
+}
+
+void MeshBuffer::read_triangles(MeshId id, std::vector< glm::vec3 > *positions_, std::vector< uint32_t > *triangles_) const {
+	assert(positions_);
+	assert(triangles_);
+	auto &positions = *positions_;
+	auto &triangles = *triangles_;
+	positions.clear();
+	triangles.clear();
+
+	Mesh const &mesh = (*this)[id];
+	if (vertex_data.empty()) {
+		throw std::runtime_error("Reading triangles of mesh '" + std::string(name(id)) + "' from a buffer that didn't keep its data (see MeshBuffer::CPUData::Keep).");
+	}
+	if (mesh.type != GL_TRIANGLES) {
+		throw std::runtime_error("Reading triangles of mesh '" + std::string(name(id)) + "', which isn't made of triangles.");
+	}
+
+	//object-space position of vertex 'v' (the loader only makes float and compact positions):
+	auto position = [&](uint32_t v) {
+		char const *at = vertex_data.data() + size_t(v) * Position.stride + Position.offset;
+		if (Position.type == GL_FLOAT) {
+			glm::vec3 p;
+			std::memcpy(&p, at, sizeof(p));
+			return p;
+		} else {
+			assert(Position.type == GL_SHORT);
+			int16_t q[3];
+			std::memcpy(q, at, sizeof(q));
+			return mesh.position_offset + mesh.position_scale * glm::vec3(q[0], q[1], q[2]);
+		}
+	};
+
+	//gather the vertices the mesh uses and its triangles (relative to them):
+	if (mesh.index_type != GL_NONE) {
+		if (mesh.count == 0) return;
+		auto first = element_data.begin() + mesh.start;
+		auto [lo, hi] = std::minmax_element(first, first + mesh.count);
+		for (uint32_t v = *lo; v <= *hi; ++v) positions.emplace_back(position(v));
+		triangles.reserve(mesh.count);
+		for (auto e = first; e != first + mesh.count; ++e) triangles.emplace_back(*e - *lo);
+	} else {
+		for (uint32_t v = mesh.start; v < mesh.start + mesh.count; ++v) {
+			positions.emplace_back(position(v));
+			triangles.emplace_back(v - mesh.start);
+		}
+	}
+	triangles.resize(triangles.size() - triangles.size() % 3); //(ignore any partial triangle, as glDraw* would)
+}
+
+//Where a program wants each of the MeshBuffer attributes, for one vertex layout:
+// (looked up and checked once per program and layout, then shared by every MeshBuffer with that layout;
+//  program destructors call MeshBuffer::forget_program(), so a reused program name never finds stale locations or vaos)
+namespace {
+	struct ProgramLayout {
+		GLuint program = 0;
+		MeshBuffer::Attrib attribs[4]; //Position, Normal, Color, TexCoord
+		GLint locations[4] = {-1, -1, -1, -1}; //-1 for attributes the program doesn't read
+	};
+}
+static std::vector< ProgramLayout > program_layouts;
+
+void MeshBuffer::forget_program(GLuint program) {
+	program_layouts.erase(std::remove_if(program_layouts.begin(), program_layouts.end(), [&](ProgramLayout const &l) {
+		return l.program == program;
+	}), program_layouts.end());
+
+	//vaos made for the program were set up with its locations, so they go too:
+	for (MeshBuffer const *mb : live_buffers) {
+		auto &program_vaos = mb->program_vaos;
+		for (auto const &[made_for, vao] : program_vaos) {
+			if (made_for == program) glDeleteVertexArrays(1, &vao);
+		}
+		program_vaos.erase(std::remove_if(program_vaos.begin(), program_vaos.end(), [&](std::pair< GLuint, GLuint > const &pv) {
+			return pv.first == program;
+		}), program_vaos.end());
+	}
+	gl_state_invalidate(); //(one of the vaos may still be bound)
 }
 
 GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
+	//already made one for this program?
+	for (auto const &[made_for, vao] : program_vaos) {
+		if (made_for == program) return vao;
+	}
+
+	GLuint vao = make_vao(program, buffer, index_buffer, Position, Normal, Color, TexCoord);
+	program_vaos.emplace_back(program, vao);
+	return vao;
+}
+
+GLuint MeshBuffer::make_vao(GLuint program, GLuint buffer, GLuint index_buffer, Attrib const &Position, Attrib const &Normal, Attrib const &Color, Attrib const &TexCoord) {
+	MeshBuffer::Attrib const *attribs[4] = { &Position, &Normal, &Color, &TexCoord };
+	static char const *names[4] = { "Position", "Normal", "Color", "TexCoord" };
+
+	//find attribute locations for this program + layout, querying the program only the first time:
+	ProgramLayout const *layout = nullptr;
+	for (auto const &l : program_layouts) {
+		if (l.program == program && l.attribs[0] == Position && l.attribs[1] == Normal && l.attribs[2] == Color && l.attribs[3] == TexCoord) {
+			layout = &l;
+			break;
+		}
+	}
+	if (!layout) {
+		ProgramLayout l;
+		l.program = program;
+
+		//Try to bind all attributes in this buffer:
+		std::set< GLuint > bound;
+		for (uint32_t a = 0; a < 4; ++a) {
+			l.attribs[a] = *attribs[a];
+			if (attribs[a]->size == 0) continue; //don't bind empty attribs
+			GLint location = glGetAttribLocation(program, names[a]);
+			if (location == -1) continue; //can't bind missing attribs
+			l.locations[a] = location;
+			bound.insert(location);
+		}
+
+		//Check that all active attributes were bound:
+		GLint active = 0;
+		glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &active);
+		assert(active >= 0 && "Doesn't makes sense to have negative active attributes.");
+		for (GLuint i = 0; i < GLuint(active); ++i) {
+			GLchar name[100];
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveAttrib(program, i, 100, NULL, &size, &type, name);
+			name[99] = '\0';
+			GLint location = glGetAttribLocation(program, name);
+			if (!bound.count(GLuint(location))) {
+				throw std::runtime_error("ERROR: active attribute '" + std::string(name) + "' in program is not bound.");
+			}
+		}
+
+		program_layouts.emplace_back(l);
+		layout = &program_layouts.back();
+	}
+
 	//create a new vertex array object:
 	GLuint vao = 0;
 	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	gl_bind_vertex_array(vao);
 
-	//Try to bind all attributes in this buffer:
-	std::set< GLuint > bound;
 	glBindBuffer(GL_ARRAY_BUFFER, buffer);
-	auto bind_attribute = [&](char const *name, MeshBuffer::Attrib const &attrib) {
-		if (attrib.size == 0) return; //don't bind empty attribs
-		GLint location = glGetAttribLocation(program, name);
-		if (location == -1) return; //can't bind missing attribs
+	for (uint32_t a = 0; a < 4; ++a) {
+		if (layout->locations[a] == -1) continue;
+		GLuint location = GLuint(layout->locations[a]);
+		MeshBuffer::Attrib const &attrib = *attribs[a];
 		glVertexAttribPointer(location, attrib.size, attrib.type, attrib.normalized, attrib.stride, (GLbyte *)0 + attrib.offset);
 		glEnableVertexAttribArray(location);
-		bound.insert(location);
-	};
-	bind_attribute("Position", Position);
-	bind_attribute("Normal", Normal);
-	bind_attribute("Color", Color);
-	bind_attribute("TexCoord", TexCoord);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
-
-	//Check that all active attributes were bound:
-	GLint active = 0;
-	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &active);
-	assert(active >= 0 && "Doesn't makes sense to have negative active attributes.");
-	for (GLuint i = 0; i < GLuint(active); ++i) {
-		GLchar name[100];
-		GLint size = 0;
-		GLenum type = 0;
-		glGetActiveAttrib(program, i, 100, NULL, &size, &type, name);
-		name[99] = '\0';
-		GLint location = glGetAttribLocation(program, name);
-		if (!bound.count(GLuint(location))) {
-			throw std::runtime_error("ERROR: active attribute '" + std::string(name) + "' in program is not bound.");
-		}
 	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	//(element array binding is part of the vao's state, so this stays attached after unbinding the vao)
+	if (index_buffer != 0) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+	gl_bind_vertex_array(0);
 
 	return vao;
 }
@@ -7,48 +7,186 @@
  *  a single OpenGL array buffer. Individual meshes can be looked up by name
  *  using the MeshBuffer::lookup() function.
  *
+ * When code refers to the same mesh many times, resolve its name once with
+ *  MeshBuffer::find() (or lookup_id()) and keep the resulting MeshId, which
+ *  is a plain integer that is cheap to compare, hash, and store.
+ *
+ * A MeshBuffer constructed with MeshBuffer::Upload::Streamed allocates its
+ *  vertex buffer immediately but fills it over several frames, as the main
+ *  loop calls stream_mesh_buffers(); each mesh becomes drawable once its
+ *  vertices have arrived (see Mesh::resident_vertices).
+ *
+ * A MeshBuffer constructed with MeshBuffer::Raycast::Enabled also keeps a
+ *  triangle BVH for each mesh on the CPU (see MeshBVH.hpp), for picking and
+ *  line-of-sight queries that need more precision than bounding boxes.
+ *
+ * A MeshBuffer constructed with MeshBuffer::CPUData::Keep also keeps its
+ *  vertex and element data in memory, so drawables using it can be merged
+ *  into static batches (see StaticBatch.hpp) and its meshes can be read
+ *  back with MeshBuffer::read_triangles() (e.g., as occluders; see Occlusion.hpp).
+ *
  */
 
 #include "GL.hpp"
+#include "MeshBVH.hpp"
+#include "Frustum.hpp"
 #include <glm/glm.hpp>
-#include <map>
+#include <cstdint>
 #include <limits>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 
 struct Mesh {
 	//Meshes are vertex ranges (and primitive types) in their MeshBuffer:
 
 	GLenum type = GL_TRIANGLES; //type of primitives in mesh
-	GLuint start = 0; //index of first vertex
-	GLuint count = 0; //count of vertices
+	GLuint start = 0; //index of first vertex (or, for indexed meshes, of first element in MeshBuffer::index_buffer)
+	GLuint count = 0; //count of vertices (or, for indexed meshes, of elements)
+	GLenum index_type = GL_NONE; //type of elements for indexed meshes (drawn with glDrawElements); GL_NONE otherwise
+
+	//for meshes stored in the compact vertex format, object-space positions are position_offset + position_scale * (stored position):
+	// (Scene::Drawable::set_mesh copies these to the drawable's pipeline, which applies them when drawing)
+	glm::vec3 position_scale = glm::vec3(1.0f);
+	glm::vec3 position_offset = glm::vec3(0.0f);
 
 	//Bounding box.
 	//useful for debug visualization and (perhaps, eventually) collision detection:
 	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
 	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+	//Bounding sphere (sphere_radius < 0 if the mesh has no vertices):
+	//useful for cheap culling / level-of-detail tests:
+	glm::vec3 sphere_center = glm::vec3(0.0f);
+	float sphere_radius = -1.0f;
+
+	//For meshes in a streamed MeshBuffer, vertices arrive over several frames; the mesh can be drawn once *resident_vertices >= vertex_end:
+	// (Scene::Drawable::set_mesh copies these to the drawable's pipeline, which skips drawing until then; resident_vertices is nullptr for buffers that were uploaded all at once)
+	GLuint const *resident_vertices = nullptr;
+	GLuint vertex_end = 0; //one past the highest vertex the mesh uses
+
+	//For meshes from files with a 'mlt0' chunk (see optimize-meshes --meshlets), the meshlets that exactly cover [start, start+count):
+	// (Scene::Drawable::set_mesh copies these to the drawable, which culls them individually; they point into the MeshBuffer)
+	Meshlet const *meshlets = nullptr;
+	uint32_t meshlet_count = 0;
+};
+
+//Handle to a mesh within a particular MeshBuffer:
+// (ids index the buffer's meshes in name order, so they are only meaningful for the buffer that made them)
+struct MeshId {
+	uint32_t index = -1U;
+
+	bool valid() const { return index != -1U; }
+	bool operator==(MeshId const &) const = default;
+	bool operator<(MeshId const &other) const { return index < other.index; }
 };
 
 struct MeshBuffer {
+	//how vertex data gets to the GPU:
+	enum class Upload {
+		Immediate, //all at once, during construction
+		Streamed, //over several frames, by stream_mesh_buffers()
+	};
+
+	//whether to keep CPU-side triangle BVHs for ray queries (costs memory and load time):
+	enum class Raycast {
+		Disabled,
+		Enabled,
+	};
+
+	//whether to keep a copy of the vertex and element data on the CPU (costs memory):
+	enum class CPUData {
+		Discard,
+		Keep,
+	};
+
 	//construct from a file:
 	// note: will throw if file fails to read.
-	MeshBuffer(std::string const &filename);
+	MeshBuffer(std::string const &filename, Upload upload = Upload::Immediate, Raycast raycast = Raycast::Disabled, CPUData cpu_data = CPUData::Discard);
+	~MeshBuffer();
+
+	//(meshes point into the buffer's streaming state, so buffers can't be copied)
+	MeshBuffer(MeshBuffer const &) = delete;
+	MeshBuffer &operator=(MeshBuffer const &) = delete;
 
 	//look up a particular mesh by name:
 	// note: will throw if mesh not found.
-	const Mesh &lookup(std::string const &name) const;
-	
+	const Mesh &lookup(std::string_view name) const;
+
+	//resolve a name to a MeshId:
+	MeshId find(std::string_view name) const; //returns an invalid MeshId if mesh not found
+	MeshId lookup_id(std::string_view name) const; //throws if mesh not found
+
+	//simplified versions of a mesh are stored as 'name.LOD1', 'name.LOD2', ... (see optimize-meshes --lods):
+	MeshId find_lod(MeshId id, uint32_t level) const; //returns an invalid MeshId if there is no such level
+
+	//access meshes by id:
+	// (ids run from 0 to size()-1, in name order)
+	uint32_t size() const { return uint32_t(meshes.size()); }
+	Mesh const &operator[](MeshId id) const { return meshes.at(id.index); }
+	std::string_view name(MeshId id) const { return mesh_names.at(id.index); } //(interned; see string_intern.hpp)
+
+	//have a mesh's vertices been uploaded yet? (always true for Upload::Immediate buffers)
+	bool resident(Mesh const &mesh) const { return !mesh.resident_vertices || *mesh.resident_vertices >= mesh.vertex_end; }
+	bool resident(MeshId id) const { return resident((*this)[id]); }
+
+	//triangle BVH for a mesh, in object space (nullptr unless constructed with Raycast::Enabled):
+	// (triangles are numbered in draw order; compact meshes' BVHs use dequantized positions)
+	MeshBVH const *bvh(MeshId id) const { return bvhs.empty() ? nullptr : &bvhs.at(id.index); }
+
+	//object-space positions (dequantized, for compact meshes) and triangles (three indices into 'positions' each) of a mesh:
+	// (e.g., to make an Occluder; throws unless constructed with CPUData::Keep, or if the mesh isn't GL_TRIANGLES)
+	void read_triangles(MeshId id, std::vector< glm::vec3 > *positions, std::vector< uint32_t > *triangles) const;
+
 	//build a vertex array object that links this vbo to attributes to a program:
 	// note: will throw if program defines attributes not contained in this buffer
+	// (each program gets one vao per buffer, made on the first call and returned by later calls; the buffer owns it, so don't delete it)
 	GLuint make_vao_for_program(GLuint program) const;
 
 	//This is the OpenGL vertex buffer object containing the mesh data:
 	GLuint buffer = 0;
 
+	//...and the buffer holding element indices, if the file contains indexed meshes (otherwise 0):
+	// (make_vao_for_program() attaches this to the vao as its element array buffer)
+	GLuint index_buffer = 0;
+
 	//-- internals ---
 
-	//used by the lookup() function:
-	std::map< std::string, Mesh > meshes;
+	//upload state for Upload::Streamed buffers (nullptr otherwise):
+	// (lives on the heap so Mesh::resident_vertices can point at it)
+	struct Stream {
+		char const *data = nullptr; //vertex data to upload (points into 'pending', or into 'vertex_data' with CPUData::Keep)
+		size_t size = 0; //bytes at 'data'
+		std::vector< char > pending; //copy of the vertex data when it isn't kept in 'vertex_data'; freed once it is all uploaded
+		size_t uploaded = 0; //bytes of 'data' already in 'buffer'
+		GLsizei stride = 0; //bytes per vertex (uploads are whole vertices)
+		GLuint buffer = 0;
+		GLuint resident_vertices = 0; //== uploaded / stride
+	};
+	std::unique_ptr< Stream > stream;
+
+	//copies of what was uploaded to 'buffer' (in the layout given by the Attribs below) and 'index_buffer', if constructed with CPUData::Keep (otherwise empty):
+	std::vector< char > vertex_data;
+	std::vector< uint32_t > element_data;
+
+	//meshes and their (interned) names, sorted by name; MeshId::index indexes these:
+	std::vector< Mesh > meshes;
+	std::vector< std::string_view > mesh_names;
+
+	//(program, vao) pairs already made by make_vao_for_program():
+	mutable std::vector< std::pair< GLuint, GLuint > > program_vaos;
+
+	//all meshlets in the file (Mesh::meshlets point into this):
+	std::vector< Meshlet > meshlets;
+
+	//per-mesh BVHs (indexed like 'meshes'), or empty if not constructed with Raycast::Enabled:
+	std::vector< MeshBVH > bvhs;
+
+	//used by find(): open-addressed hash table on name (power-of-two size) holding index + 1, or 0 for empty:
+	std::vector< uint32_t > name_slots;
 
 	//These 'Attrib' structures describe the location of various attributes within the buffer (in exactly format wanted by glVertexAttribPointer). They are set when the file is loaded and are used by the "make_vao_for_program" call:
 	struct Attrib {
@@ -61,10 +199,24 @@ struct MeshBuffer {
 		Attrib() = default;
 		Attrib(GLint size_, GLenum type_, GLboolean normalized_, GLsizei stride_, GLsizei offset_)
 		: size(size_), type(type_), normalized(normalized_), stride(stride_), offset(offset_) { }
+
+		bool operator==(Attrib const &) const = default;
 	};
 
 	Attrib Position;
 	Attrib Normal;
 	Attrib Color;
 	Attrib TexCoord;
+
+	//the vao-making part of make_vao_for_program(), for other buffers laid out with Attribs (e.g., static batches):
+	// (makes a new vao every call; the caller owns it)
+	static GLuint make_vao(GLuint program, GLuint buffer, GLuint index_buffer, Attrib const &Position, Attrib const &Normal, Attrib const &Color, Attrib const &TexCoord);
+
+	//forget the attribute locations make_vao() cached for 'program', and delete every MeshBuffer's vao for it:
+	// (call this when deleting a program that vaos were made for, since OpenGL may reuse its name for a different program)
+	static void forget_program(GLuint program);
 };
+
+//Upload up to 'byte_budget' bytes of pending vertex data from streamed MeshBuffers (oldest buffers first):
+// call once per frame (with the OpenGL context current); returns the number of bytes uploaded.
+size_t stream_mesh_buffers(size_t byte_budget);
@@ -0,0 +1,389 @@
+#include "MeshBVH.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESH_BVH_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+//build parameters:
+static constexpr uint32_t Bins = 12; //SAH candidate splits per axis, minus one
+static constexpr uint32_t LeafTriangles = 4; //always stop splitting at (or below) this many triangles
+static constexpr uint32_t MaxLeafTriangles = 16; //...and never stop above this many, unless the triangles can't be separated
+static constexpr float TraversalCost = 1.0f; //cost of visiting a node, relative to testing one packet
+static constexpr uint32_t MaxDepth = 48; //always stop splitting here (keeps the traversal stack small)
+
+namespace {
+	struct Bounds {
+		glm::vec3 min = glm::vec3( FLT_MAX);
+		glm::vec3 max = glm::vec3(-FLT_MAX);
+		void enclose(glm::vec3 const &p) {
+			min = glm::min(min, p);
+			max = glm::max(max, p);
+		}
+		void enclose(Bounds const &b) {
+			min = glm::min(min, b.min);
+			max = glm::max(max, b.max);
+		}
+		float area() const {
+			glm::vec3 e = glm::max(max - min, glm::vec3(0.0f));
+			return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+		}
+	};
+
+	struct Triangle {
+		Bounds bounds;
+		glm::vec3 centroid;
+		uint32_t index;
+	};
+
+	//number of packets needed for 'n' triangles:
+	uint32_t packet_count(uint32_t n) {
+		return (n + 3) / 4;
+	}
+}
+
+MeshBVH::MeshBVH(std::vector< glm::vec3 > const &positions, std::vector< uint32_t > const &indices) {
+	if (indices.size() % 3 != 0) {
+		throw std::runtime_error("MeshBVH: index count (" + std::to_string(indices.size()) + ") is not a multiple of three.");
+	}
+	if (indices.empty()) return;
+
+	std::vector< Triangle > triangles;
+	triangles.reserve(indices.size() / 3);
+	for (uint32_t i = 0; i + 2 < indices.size(); i += 3) {
+		Triangle tri;
+		for (uint32_t c = 0; c < 3; ++c) {
+			if (indices[i+c] >= positions.size()) {
+				throw std::runtime_error("MeshBVH: index (" + std::to_string(indices[i+c]) + ") out of range for " + std::to_string(positions.size()) + " positions.");
+			}
+			tri.bounds.enclose(positions[indices[i+c]]);
+		}
+		tri.centroid = 0.5f * (tri.bounds.min + tri.bounds.max);
+		tri.index = i / 3;
+		triangles.emplace_back(tri);
+	}
+
+	//top-down build; each split appends both children so they end up adjacent:
+	struct Task {
+		uint32_t node;
+		uint32_t begin, end; //range in 'triangles'
+		uint32_t depth;
+	};
+	std::vector< Task > todo;
+	nodes.reserve(2 * packet_count(uint32_t(triangles.size())));
+	nodes.emplace_back();
+	todo.emplace_back(Task{0, 0, uint32_t(triangles.size()), 0});
+
+	//leaves, in the order they were made (packets are written afterward):
+	std::vector< Task > leaves;
+
+	while (!todo.empty()) {
+		Task task = todo.back();
+		todo.pop_back();
+
+		uint32_t count = task.end - task.begin;
+
+		Bounds bounds, centroids;
+		for (uint32_t t = task.begin; t < task.end; ++t) {
+			bounds.enclose(triangles[t].bounds);
+			centroids.enclose(triangles[t].centroid);
+		}
+		nodes[task.node].min = bounds.min;
+		nodes[task.node].max = bounds.max;
+
+		auto make_leaf = [&]() {
+			nodes[task.node].count = count; //fixed up to a packet count below
+			leaves.emplace_back(task);
+		};
+
+		if (count <= LeafTriangles || task.depth >= MaxDepth) {
+			make_leaf();
+			continue;
+		}
+
+		//binned SAH -- find the cheapest split plane over all three axes:
+		float best_cost = FLT_MAX;
+		int best_axis = -1;
+		uint32_t best_bin = 0;
+		for (int axis = 0; axis < 3; ++axis) {
+			float lo = centroids.min[axis];
+			float extent = centroids.max[axis] - lo;
+			if (!(extent > 0.0f)) continue;
+			float scale = float(Bins) / extent;
+
+			std::array< Bounds, Bins > bin_bounds;
+			std::array< uint32_t, Bins > bin_counts{};
+			for (uint32_t t = task.begin; t < task.end; ++t) {
+				uint32_t b = std::min(Bins - 1, uint32_t((triangles[t].centroid[axis] - lo) * scale));
+				bin_bounds[b].enclose(triangles[t].bounds);
+				bin_counts[b] += 1;
+			}
+
+			//sweep from the right to get costs of everything above each plane:
+			std::array< float, Bins > right_cost{};
+			Bounds right;
+			uint32_t right_count = 0;
+			for (uint32_t b = Bins - 1; b > 0; --b) {
+				right.enclose(bin_bounds[b]);
+				right_count += bin_counts[b];
+				right_cost[b] = right.area() * float(packet_count(right_count));
+			}
+
+			//...then from the left, combining:
+			Bounds left;
+			uint32_t left_count = 0;
+			for (uint32_t b = 0; b + 1 < Bins; ++b) {
+				left.enclose(bin_bounds[b]);
+				left_count += bin_counts[b];
+				if (left_count == 0 || left_count == count) continue;
+				float cost = left.area() * float(packet_count(left_count)) + right_cost[b + 1];
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_axis = axis;
+					best_bin = b;
+				}
+			}
+		}
+
+		//all centroids coincide -- nothing to split on:
+		if (best_axis < 0) {
+			make_leaf();
+			continue;
+		}
+
+		float area = bounds.area();
+		float split_cost = TraversalCost + (area > 0.0f ? best_cost / area : 0.0f);
+		float leaf_cost = float(packet_count(count));
+		if (count <= MaxLeafTriangles && leaf_cost <= split_cost) {
+			make_leaf();
+			continue;
+		}
+
+		//partition around the chosen plane (same bin computation as above, so the split is exact):
+		float lo = centroids.min[best_axis];
+		float scale = float(Bins) / (centroids.max[best_axis] - lo);
+		auto mid = std::partition(triangles.begin() + task.begin, triangles.begin() + task.end, [&](Triangle const &tri) {
+			return std::min(Bins - 1, uint32_t((tri.centroid[best_axis] - lo) * scale)) <= best_bin;
+		});
+		uint32_t split = uint32_t(mid - triangles.begin());
+		assert(split > task.begin && split < task.end);
+
+		uint32_t children = uint32_t(nodes.size());
+		nodes[task.node].first = children;
+		nodes[task.node].count = 0;
+		nodes.emplace_back();
+		nodes.emplace_back();
+		todo.emplace_back(Task{children + 1, split, task.end, task.depth + 1});
+		todo.emplace_back(Task{children, task.begin, split, task.depth + 1});
+	}
+
+	//write leaf triangles into packets:
+	for (Task const &leaf : leaves) {
+		Node &node = nodes[leaf.node];
+		node.first = uint32_t(packets.size());
+		node.count = packet_count(leaf.end - leaf.begin);
+		for (uint32_t t = leaf.begin; t < leaf.end; t += 4) {
+			Packet packet;
+			for (uint32_t lane = 0; lane < 4; ++lane) {
+				glm::vec3 v0(0.0f), e1(0.0f), e2(0.0f);
+				uint32_t index = -1U;
+				if (t + lane < leaf.end) {
+					index = triangles[t + lane].index;
+					v0 = positions[indices[3*index+0]];
+					e1 = positions[indices[3*index+1]] - v0;
+					e2 = positions[indices[3*index+2]] - v0;
+				}
+				for (uint32_t c = 0; c < 3; ++c) {
+					packet.v0[c][lane] = v0[c];
+					packet.e1[c][lane] = e1[c];
+					packet.e2[c][lane] = e2[c];
+				}
+				packet.triangle[lane] = index;
+			}
+			packets.emplace_back(packet);
+		}
+	}
+}
+
+//slab test; returns entry distance or FLT_MAX on a miss:
+static inline float enter_box(MeshBVH::Node const &node, glm::vec3 const &origin, glm::vec3 const &inv_direction, float t_max) {
+	glm::vec3 t0 = (node.min - origin) * inv_direction;
+	glm::vec3 t1 = (node.max - origin) * inv_direction;
+	glm::vec3 t_near = glm::min(t0, t1);
+	glm::vec3 t_far = glm::max(t0, t1);
+	float t_enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f));
+	float t_exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, t_max));
+	return (t_enter <= t_exit ? t_enter : FLT_MAX);
+}
+
+template< bool AnyHit >
+bool MeshBVH::traverse(glm::vec3 const &origin, glm::vec3 const &direction, float t_max, Hit *hit) const {
+	if (nodes.empty()) return false;
+
+	//(division by zero is fine here: infinities make the slab test do the right thing for axis-aligned rays)
+	glm::vec3 inv_direction = 1.0f / direction;
+
+	float best_t = t_max;
+	uint32_t best_packet = -1U;
+	uint32_t best_lane = 0;
+	float best_u = 0.0f, best_v = 0.0f;
+
+	//(each level of the tree adds at most one entry, and the build stops at MaxDepth)
+	uint32_t stack[MaxDepth + 2];
+	uint32_t stack_size = 0;
+
+	if (enter_box(nodes[0], origin, inv_direction, best_t) == FLT_MAX) return false;
+	stack[stack_size++] = 0;
+
+	while (stack_size) {
+		Node const &node = nodes[stack[--stack_size]];
+
+		if (node.count == 0) {
+			//visit nearer child first:
+			float t_a = enter_box(nodes[node.first], origin, inv_direction, best_t);
+			float t_b = enter_box(nodes[node.first + 1], origin, inv_direction, best_t);
+			uint32_t a = node.first, b = node.first + 1;
+			if (t_b < t_a) {
+				std::swap(t_a, t_b);
+				std::swap(a, b);
+			}
+			if (t_b != FLT_MAX) stack[stack_size++] = b;
+			if (t_a != FLT_MAX) stack[stack_size++] = a;
+			assert(stack_size <= MaxDepth + 2);
+			continue;
+		}
+
+		for (uint32_t p = node.first; p < node.first + node.count; ++p) {
+			Packet const &packet = packets[p];
+#ifdef MESH_BVH_USE_SSE
+			//Moller-Trumbore, four triangles at a time:
+			__m128 const dx = _mm_set1_ps(direction.x);
+			__m128 const dy = _mm_set1_ps(direction.y);
+			__m128 const dz = _mm_set1_ps(direction.z);
+
+			__m128 e1x = _mm_loadu_ps(packet.e1[0]), e1y = _mm_loadu_ps(packet.e1[1]), e1z = _mm_loadu_ps(packet.e1[2]);
+			__m128 e2x = _mm_loadu_ps(packet.e2[0]), e2y = _mm_loadu_ps(packet.e2[1]), e2z = _mm_loadu_ps(packet.e2[2]);
+
+			//p = d x e2
+			__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+			__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+			__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+
+			__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+			__m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+			//s = o - v0
+			__m128 sx = _mm_sub_ps(_mm_set1_ps(origin.x), _mm_loadu_ps(packet.v0[0]));
+			__m128 sy = _mm_sub_ps(_mm_set1_ps(origin.y), _mm_loadu_ps(packet.v0[1]));
+			__m128 sz = _mm_sub_ps(_mm_set1_ps(origin.z), _mm_loadu_ps(packet.v0[2]));
+
+			__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv_det);
+
+			//q = s x e1
+			__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+			__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+			__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+
+			__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+			__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+
+			//(comparisons are false for NaN, so degenerate and padding lanes drop out here too)
+			__m128 const zero = _mm_setzero_ps();
+			__m128 mask = _mm_cmpneq_ps(det, zero);
+			mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+			mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+			mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+			mask = _mm_and_ps(mask, _mm_cmpge_ps(t, zero));
+			mask = _mm_and_ps(mask, _mm_cmple_ps(t, _mm_set1_ps(best_t)));
+
+			int bits = _mm_movemask_ps(mask);
+			if (!bits) continue;
+			if constexpr (AnyHit) return true;
+
+			alignas(16) float ts[4], us[4], vs[4];
+			_mm_store_ps(ts, t);
+			_mm_store_ps(us, u);
+			_mm_store_ps(vs, v);
+			for (uint32_t lane = 0; lane < 4; ++lane) {
+				if ((bits & (1 << lane)) && ts[lane] <= best_t) {
+					best_t = ts[lane];
+					best_u = us[lane];
+					best_v = vs[lane];
+					best_packet = p;
+					best_lane = lane;
+				}
+			}
+#else
+			for (uint32_t lane = 0; lane < 4; ++lane) {
+				if (packet.triangle[lane] == -1U) continue;
+				glm::vec3 v0(packet.v0[0][lane], packet.v0[1][lane], packet.v0[2][lane]);
+				glm::vec3 e1(packet.e1[0][lane], packet.e1[1][lane], packet.e1[2][lane]);
+				glm::vec3 e2(packet.e2[0][lane], packet.e2[1][lane], packet.e2[2][lane]);
+
+				glm::vec3 pv = glm::cross(direction, e2);
+				float det = glm::dot(e1, pv);
+				if (det == 0.0f) continue;
+				float inv_det = 1.0f / det;
+				glm::vec3 s = origin - v0;
+				float u = glm::dot(s, pv) * inv_det;
+				if (!(u >= 0.0f)) continue;
+				glm::vec3 q = glm::cross(s, e1);
+				float v = glm::dot(direction, q) * inv_det;
+				if (!(v >= 0.0f && u + v <= 1.0f)) continue;
+				float t = glm::dot(e2, q) * inv_det;
+				if (!(t >= 0.0f && t <= best_t)) continue;
+				if constexpr (AnyHit) return true;
+				best_t = t;
+				best_u = u;
+				best_v = v;
+				best_packet = p;
+				best_lane = lane;
+			}
+#endif
+		}
+	}
+
+	if (best_packet == -1U) return false;
+	if (hit) {
+		hit->t = best_t;
+		hit->triangle = packets[best_packet].triangle[best_lane];
+		hit->barycentric = glm::vec2(best_u, best_v);
+	}
+	return true;
+}
+
+bool MeshBVH::raycast(glm::vec3 const &origin, glm::vec3 const &direction, float t_max, Hit *hit) const {
+	return traverse< false >(origin, direction, t_max, hit);
+}
+
+bool MeshBVH::occluded(glm::vec3 const &origin, glm::vec3 const &direction, float t_max) const {
+	return traverse< true >(origin, direction, t_max, nullptr);
+}
+
+//bring a world-space ray into object space; since the transform is affine, t values are unchanged:
+static void object_ray(glm::mat4x3 const &world_from_object, glm::vec3 const &origin, glm::vec3 const &direction, glm::vec3 *origin_, glm::vec3 *direction_) {
+	glm::mat3 linear = glm::mat3(world_from_object);
+	glm::mat3 inv_linear = glm::inverse(linear);
+	*origin_ = inv_linear * (origin - world_from_object[3]);
+	*direction_ = inv_linear * direction;
+}
+
+bool MeshBVH::raycast(glm::mat4x3 const &world_from_object, glm::vec3 const &origin, glm::vec3 const &direction, float t_max, Hit *hit) const {
+	glm::vec3 o, d;
+	object_ray(world_from_object, origin, direction, &o, &d);
+	return raycast(o, d, t_max, hit);
+}
+
+bool MeshBVH::occluded(glm::mat4x3 const &world_from_object, glm::vec3 const &origin, glm::vec3 const &direction, float t_max) const {
+	glm::vec3 o, d;
+	object_ray(world_from_object, origin, direction, &o, &d);
+	return occluded(o, d, t_max);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+/*
+ * A MeshBVH is a bounding volume hierarchy over one mesh's triangles, kept on the CPU
+ *  for ray queries (picking, line-of-sight):
+ *
+ *  MeshBVH::Hit hit;
+ *  if (bvh.raycast(world_from_object, eye, forward, 10.0f, &hit)) {
+ *      //hit.t is the distance along 'forward' (in units of |forward|)
+ *  }
+ *
+ * The tree is built with the surface area heuristic (binned), and leaves hold triangles
+ *  in packets of four so ray/triangle tests run four at a time (SSE, where available).
+ *
+ * MeshBuffers constructed with MeshBuffer::Raycast::Enabled build one per mesh (see Mesh.hpp).
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct MeshBVH {
+	//build from object-space vertex positions and a triangle list (three indices per triangle) into them:
+	MeshBVH(std::vector< glm::vec3 > const &positions, std::vector< uint32_t > const &indices);
+	MeshBVH() = default;
+
+	struct Hit {
+		float t = 0.0f; //hit point is origin + t * direction
+		uint32_t triangle = -1U; //index of triangle (in the 'indices' passed to the constructor)
+		glm::vec2 barycentric = glm::vec2(0.0f); //weights of the triangle's second and third vertex at the hit point
+	};
+
+	//closest hit with t in [0, t_max], if any (object space):
+	bool raycast(glm::vec3 const &origin, glm::vec3 const &direction, float t_max, Hit *hit) const;
+	//...in world space, through an object's transform (t is still measured along the world-space direction):
+	bool raycast(glm::mat4x3 const &world_from_object, glm::vec3 const &origin, glm::vec3 const &direction, float t_max, Hit *hit) const;
+
+	//is there any hit with t in [0, t_max]? (cheaper than raycast(); useful for line-of-sight)
+	bool occluded(glm::vec3 const &origin, glm::vec3 const &direction, float t_max) const;
+	bool occluded(glm::mat4x3 const &world_from_object, glm::vec3 const &origin, glm::vec3 const &direction, float t_max) const;
+
+	bool empty() const { return nodes.empty(); }
+
+	//-- internals ---
+
+	//nodes, root first:
+	// count == 0 means children at first and first + 1; otherwise packets [first, first + count)
+	struct Node {
+		glm::vec3 min;
+		uint32_t first = 0;
+		glm::vec3 max;
+		uint32_t count = 0;
+	};
+	static_assert(sizeof(Node) == 32, "Node is packed.");
+	std::vector< Node > nodes;
+
+	//four triangles, stored lane-wise as a first vertex and two edges (Moller-Trumbore form):
+	// (unused lanes in a leaf's last packet are degenerate and never hit)
+	struct Packet {
+		float v0[3][4];
+		float e1[3][4];
+		float e2[3][4];
+		uint32_t triangle[4]; //-1U for unused lanes
+	};
+	std::vector< Packet > packets;
+
+	template< bool AnyHit >
+	bool traverse(glm::vec3 const &origin, glm::vec3 const &direction, float t_max, Hit *hit) const;
+};
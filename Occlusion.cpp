@@ -0,0 +1,312 @@
+#include "Occlusion.hpp"
+#include "parallel_for.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+static constexpr float Far = std::numeric_limits< float >::infinity();
+
+OcclusionBuffer::OcclusionBuffer(uint32_t width_, uint32_t height_, uint32_t threads_) {
+	tiles_x = std::max(1u, (width_ + TileWidth - 1) / TileWidth);
+	tiles_y = std::max(1u, (height_ + TileHeight - 1) / TileHeight);
+	width = tiles_x * TileWidth;
+	height = tiles_y * TileHeight;
+	blocks_x = (tiles_x + BlockTiles - 1) / BlockTiles;
+	blocks_y = (tiles_y + BlockTiles - 1) / BlockTiles;
+
+	threads = threads_;
+	if (threads == 0) threads = uint32_t(std::min(size_t(4), parallel_for_threads()));
+	threads = std::max(1u, threads);
+
+	tiles.resize(tiles_x * tiles_y);
+	tile_depth.resize(tiles_x * tiles_y);
+	block_depth.resize(blocks_x * blocks_y);
+	clear();
+}
+
+void OcclusionBuffer::clear() {
+	std::fill(tiles.begin(), tiles.end(), Tile{ Far, -Far, 0 });
+	std::fill(tile_depth.begin(), tile_depth.end(), Far);
+	std::fill(block_depth.begin(), block_depth.end(), Far);
+	setups.clear();
+	triangles = 0;
+}
+
+void OcclusionBuffer::add(glm::mat4 const &clip_from_object, Occluder const &occluder) {
+	//transform every vertex once:
+	clip.clear();
+	clip.reserve(occluder.positions.size());
+	for (auto const &p : occluder.positions) {
+		clip.emplace_back(clip_from_object * glm::vec4(p, 1.0f));
+	}
+
+	for (size_t t = 0; t + 2 < occluder.triangles.size(); t += 3) {
+		glm::vec4 const &a = clip.at(occluder.triangles[t+0]);
+		glm::vec4 const &b = clip.at(occluder.triangles[t+1]);
+		glm::vec4 const &c = clip.at(occluder.triangles[t+2]);
+
+		//skip triangles entirely outside one of the side planes:
+		if (a.x >  a.w && b.x >  b.w && c.x >  c.w) continue;
+		if (a.x < -a.w && b.x < -b.w && c.x < -c.w) continue;
+		if (a.y >  a.w && b.y >  b.w && c.y >  c.w) continue;
+		if (a.y < -a.w && b.y < -b.w && c.y < -c.w) continue;
+
+		//clip to the near plane (z >= -w) and draw the result as a fan:
+		float da = a.z + a.w, db = b.z + b.w, dc = c.z + c.w;
+		if (da >= 0.0f && db >= 0.0f && dc >= 0.0f) {
+			setup(a, b, c);
+			continue;
+		}
+		if (da < 0.0f && db < 0.0f && dc < 0.0f) continue;
+
+		glm::vec4 polygon[4];
+		uint32_t corners = 0;
+		glm::vec4 const *in[3] = { &a, &b, &c };
+		float d[3] = { da, db, dc };
+		for (uint32_t i = 0; i < 3; ++i) {
+			uint32_t j = (i + 1) % 3;
+			if (d[i] >= 0.0f) polygon[corners++] = *in[i];
+			if ((d[i] >= 0.0f) != (d[j] >= 0.0f)) {
+				polygon[corners++] = glm::mix(*in[i], *in[j], d[i] / (d[i] - d[j]));
+			}
+		}
+		for (uint32_t i = 2; i < corners; ++i) {
+			setup(polygon[0], polygon[i-1], polygon[i]);
+		}
+	}
+}
+
+void OcclusionBuffer::setup(glm::vec4 const &a, glm::vec4 const &b, glm::vec4 const &c) {
+	//to pixels (and depth):
+	auto to_screen = [this](glm::vec4 const &v) {
+		float inv_w = 1.0f / v.w;
+		return glm::vec3(
+			(v.x * inv_w * 0.5f + 0.5f) * float(width),
+			(v.y * inv_w * 0.5f + 0.5f) * float(height),
+			v.z * inv_w
+		);
+	};
+	glm::vec3 v[3] = { to_screen(a), to_screen(b), to_screen(c) };
+
+	//both windings are drawn (occluders may be mirrored, or open), so make it counterclockwise:
+	float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+	if (!(std::abs(area) > 1e-6f)) return; //(also skips NaN)
+	if (area < 0.0f) {
+		std::swap(v[1], v[2]);
+		area = -area;
+	}
+
+	Setup tri;
+
+	//pixel centers covered by the bounding box, then the tiles they are in:
+	float min_x = std::min({v[0].x, v[1].x, v[2].x});
+	float max_x = std::max({v[0].x, v[1].x, v[2].x});
+	float min_y = std::min({v[0].y, v[1].y, v[2].y});
+	float max_y = std::max({v[0].y, v[1].y, v[2].y});
+	float px0 = std::max(0.0f, std::ceil(min_x - 0.5f));
+	float px1 = std::min(float(width) - 1.0f, std::floor(max_x - 0.5f));
+	float py0 = std::max(0.0f, std::ceil(min_y - 0.5f));
+	float py1 = std::min(float(height) - 1.0f, std::floor(max_y - 0.5f));
+	if (!(px0 <= px1 && py0 <= py1)) return;
+	tri.tile_min_x = uint32_t(px0) / TileWidth;
+	tri.tile_max_x = uint32_t(px1) / TileWidth;
+	tri.tile_min_y = uint32_t(py0) / TileHeight;
+	tri.tile_max_y = uint32_t(py1) / TileHeight;
+
+	//edge i runs from v[i] to v[i+1]; the inside is to its left:
+	for (uint32_t i = 0; i < 3; ++i) {
+		glm::vec3 const &p = v[i];
+		glm::vec3 const &q = v[(i + 1) % 3];
+		tri.edge[i][0] = p.y - q.y;
+		tri.edge[i][1] = q.x - p.x;
+		tri.edge[i][2] = -(tri.edge[i][0] * p.x + tri.edge[i][1] * p.y);
+	}
+
+	//depth plane through the three vertices:
+	glm::vec3 e1 = v[1] - v[0];
+	glm::vec3 e2 = v[2] - v[0];
+	tri.depth[0] = (e1.z * e2.y - e2.z * e1.y) / area;
+	tri.depth[1] = (e2.z * e1.x - e1.z * e2.x) / area;
+	tri.depth[2] = v[0].z - tri.depth[0] * v[0].x - tri.depth[1] * v[0].y;
+	tri.depth_min = std::min({v[0].z, v[1].z, v[2].z});
+	tri.depth_max = std::max({v[0].z, v[1].z, v[2].z});
+
+	setups.emplace_back(tri);
+}
+
+void OcclusionBuffer::rasterize(Setup const &tri, uint32_t row_begin, uint32_t row_end) {
+	uint32_t ty0 = std::max(tri.tile_min_y, row_begin);
+	uint32_t ty1 = std::min(tri.tile_max_y + 1, row_end);
+
+#ifdef OCCLUSION_USE_SSE
+	//edge values at the four pixel offsets (0,1,2,3) of a row, relative to the row's first pixel:
+	__m128 step[3];
+	for (uint32_t e = 0; e < 3; ++e) {
+		float a = tri.edge[e][0];
+		step[e] = _mm_setr_ps(0.0f, a, 2.0f * a, 3.0f * a);
+	}
+#endif
+
+	for (uint32_t ty = ty0; ty < ty1; ++ty) {
+		float y = float(ty * TileHeight) + 0.5f;
+		for (uint32_t tx = tri.tile_min_x; tx <= tri.tile_max_x; ++tx) {
+			Tile &tile = tiles[ty * tiles_x + tx];
+			//already at least as close as anything this triangle could add?
+			if (tri.depth_min >= tile.far0) continue;
+
+			float x = float(tx * TileWidth) + 0.5f;
+
+			//coverage of the tile's 32 pixel centers:
+			uint32_t mask = 0;
+#ifdef OCCLUSION_USE_SSE
+			__m128 left[3], right[3]; //edge values at pixels 0-3 and 4-7 of the current row
+			__m128 down[3]; //change from one row to the next
+			for (uint32_t e = 0; e < 3; ++e) {
+				float base = tri.edge[e][0] * x + tri.edge[e][1] * y + tri.edge[e][2];
+				left[e] = _mm_add_ps(_mm_set1_ps(base), step[e]);
+				right[e] = _mm_add_ps(left[e], _mm_set1_ps(4.0f * tri.edge[e][0]));
+				down[e] = _mm_set1_ps(tri.edge[e][1]);
+			}
+			__m128 zero = _mm_setzero_ps();
+			for (uint32_t r = 0; r < TileHeight; ++r) {
+				__m128 in_left = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(left[0], zero), _mm_cmpge_ps(left[1], zero)), _mm_cmpge_ps(left[2], zero));
+				__m128 in_right = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(right[0], zero), _mm_cmpge_ps(right[1], zero)), _mm_cmpge_ps(right[2], zero));
+				uint32_t row = uint32_t(_mm_movemask_ps(in_left)) | (uint32_t(_mm_movemask_ps(in_right)) << 4);
+				mask |= row << (r * TileWidth);
+				for (uint32_t e = 0; e < 3; ++e) {
+					left[e] = _mm_add_ps(left[e], down[e]);
+					right[e] = _mm_add_ps(right[e], down[e]);
+				}
+			}
+#else
+			for (uint32_t r = 0; r < TileHeight; ++r) {
+				for (uint32_t c = 0; c < TileWidth; ++c) {
+					float px = x + float(c);
+					float py = y + float(r);
+					bool inside = true;
+					for (uint32_t e = 0; e < 3; ++e) {
+						inside = inside && (tri.edge[e][0] * px + tri.edge[e][1] * py + tri.edge[e][2] >= 0.0f);
+					}
+					if (inside) mask |= 1u << (r * TileWidth + c);
+				}
+			}
+#endif
+			if (mask == 0) continue;
+
+			//farthest depth of the triangle over the tile (the plane is linear, so it's at a corner):
+			float far_x = tri.depth[0] > 0.0f ? x + float(TileWidth - 1) : x;
+			float far_y = tri.depth[1] > 0.0f ? y + float(TileHeight - 1) : y;
+			float depth = std::min(tri.depth[0] * far_x + tri.depth[1] * far_y + tri.depth[2], tri.depth_max);
+			if (depth >= tile.far0) continue;
+
+			//merge into the working layer -- unless the triangle is so much closer than it that a fresh layer will do better:
+			if (tile.far1 - depth > tile.far0 - tile.far1) {
+				tile.far1 = -Far;
+				tile.mask = 0;
+			}
+			tile.far1 = std::max(tile.far1, depth);
+			tile.mask |= mask;
+
+			//a full working layer replaces the reference layer:
+			if (tile.mask == 0xffffffffu) {
+				tile.far0 = std::min(tile.far0, tile.far1);
+				tile.far1 = -Far;
+				tile.mask = 0;
+			}
+		}
+	}
+}
+
+void OcclusionBuffer::finish() {
+	triangles = uint32_t(setups.size());
+
+	//each thread rasterizes every triangle into its own band of tile rows:
+	// (so each tile sees triangles in the same order no matter how many threads there are)
+	uint32_t bands = std::min(threads, tiles_y);
+	if (setups.size() < 64) bands = 1; //(not worth waking pool threads)
+	auto band = [this, bands](uint32_t b) {
+		uint32_t row_begin = tiles_y * b / bands;
+		uint32_t row_end = tiles_y * (b + 1) / bands;
+		for (auto const &tri : setups) {
+			if (tri.tile_max_y < row_begin || tri.tile_min_y >= row_end) continue;
+			rasterize(tri, row_begin, row_end);
+		}
+	};
+	//(on parallel_for's pool, so no threads are started per frame)
+	parallel_for(bands, [&band](size_t b) { band(uint32_t(b)); }, bands);
+
+	//hierarchical depth:
+	for (size_t i = 0; i < tiles.size(); ++i) {
+		tile_depth[i] = tiles[i].far0;
+	}
+	for (uint32_t by = 0; by < blocks_y; ++by) {
+		for (uint32_t bx = 0; bx < blocks_x; ++bx) {
+			float depth = -Far;
+			for (uint32_t ty = by * BlockTiles; ty < std::min(tiles_y, (by + 1) * BlockTiles); ++ty) {
+				for (uint32_t tx = bx * BlockTiles; tx < std::min(tiles_x, (bx + 1) * BlockTiles); ++tx) {
+					depth = std::max(depth, tile_depth[ty * tiles_x + tx]);
+				}
+			}
+			block_depth[by * blocks_x + bx] = depth;
+		}
+	}
+}
+
+bool OcclusionBuffer::visible(glm::mat4 const &clip_from_object, glm::vec3 const &min, glm::vec3 const &max) const {
+	if (!(min.x <= max.x && min.y <= max.y && min.z <= max.z)) return true;
+
+	//screen rectangle and closest depth of the box's corners:
+	glm::vec4 base = clip_from_object * glm::vec4(min, 1.0f);
+	glm::vec4 dx = clip_from_object[0] * (max.x - min.x);
+	glm::vec4 dy = clip_from_object[1] * (max.y - min.y);
+	glm::vec4 dz = clip_from_object[2] * (max.z - min.z);
+
+	glm::vec2 lo = glm::vec2( Far);
+	glm::vec2 hi = glm::vec2(-Far);
+	float depth = Far;
+	for (uint32_t corner = 0; corner < 8; ++corner) {
+		glm::vec4 c = base;
+		if (corner & 1) c += dx;
+		if (corner & 2) c += dy;
+		if (corner & 4) c += dz;
+		if (!(c.z >= -c.w) || !(c.w > 0.0f)) return true; //(crosses the near plane)
+		glm::vec3 p = glm::vec3(c) / c.w;
+		lo = glm::min(lo, glm::vec2(p));
+		hi = glm::max(hi, glm::vec2(p));
+		depth = std::min(depth, p.z);
+	}
+
+	//pixels the rectangle touches:
+	float px0 = std::floor((lo.x * 0.5f + 0.5f) * float(width));
+	float px1 = std::floor((hi.x * 0.5f + 0.5f) * float(width));
+	float py0 = std::floor((lo.y * 0.5f + 0.5f) * float(height));
+	float py1 = std::floor((hi.y * 0.5f + 0.5f) * float(height));
+	px0 = std::max(px0, 0.0f);
+	py0 = std::max(py0, 0.0f);
+	px1 = std::min(px1, float(width) - 1.0f);
+	py1 = std::min(py1, float(height) - 1.0f);
+	if (!(px0 <= px1 && py0 <= py1)) return true; //(off-screen -- that's for frustum culling to decide)
+
+	uint32_t tx0 = uint32_t(px0) / TileWidth, tx1 = uint32_t(px1) / TileWidth;
+	uint32_t ty0 = uint32_t(py0) / TileHeight, ty1 = uint32_t(py1) / TileHeight;
+
+	//hidden only if every tile it touches has occluders closer than its closest point:
+	for (uint32_t by = ty0 / BlockTiles; by <= ty1 / BlockTiles; ++by) {
+		for (uint32_t bx = tx0 / BlockTiles; bx <= tx1 / BlockTiles; ++bx) {
+			if (block_depth[by * blocks_x + bx] < depth) continue; //(whole block is closer)
+			for (uint32_t ty = std::max(ty0, by * BlockTiles); ty <= std::min(ty1, by * BlockTiles + BlockTiles - 1); ++ty) {
+				for (uint32_t tx = std::max(tx0, bx * BlockTiles); tx <= std::min(tx1, bx * BlockTiles + BlockTiles - 1); ++tx) {
+					if (!(tile_depth[ty * tiles_x + tx] < depth)) return true;
+				}
+			}
+		}
+	}
+	return false;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+/*
+ * Software occlusion culling: a small depth buffer on the CPU into which designated
+ *  occluders (big, simple meshes -- walls, buildings) are rasterized, so that drawables
+ *  hidden behind them can be skipped before anything is sent to OpenGL.
+ *
+ * In the style of masked occlusion culling (Hasselgren, Andersson, and Akenine-Moller, 2016):
+ *  the buffer is made of 8x4-pixel tiles, each with a 32-bit coverage mask and two depths
+ *  (the farthest depth of a layer covering the whole tile, and of a partial "working" layer
+ *  that replaces it once the mask fills up), so no per-pixel depths are kept. Coverage masks
+ *  are computed four pixels at a time (SSE, where available), and horizontal bands of tiles
+ *  are rasterized on separate threads (from parallel_for's pool).
+ *
+ * Nothing in here touches OpenGL, so it can be used (and tested, and timed) without a GL context:
+ *
+ *  OcclusionBuffer occlusion;
+ *  occlusion.clear();
+ *  occlusion.add(clip_from_world * glm::mat4(world_from_object), occluder);
+ *  occlusion.finish(); //rasterizes, then builds the hierarchical depth
+ *  if (occlusion.visible(clip_from_world * glm::mat4(world_from_local), min, max)) { ...draw... }
+ *
+ * Occluders are assumed to be inside the things they stand for (so a drawable never hides
+ *  itself); Scene::draw renders the occluders of drawables that pass frustum culling.
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+//A triangle mesh to draw into an OcclusionBuffer:
+// (e.g., from MeshBuffer::read_triangles -- or something simpler, as long as it is inside the mesh it stands for)
+struct Occluder {
+	std::vector< glm::vec3 > positions; //object space
+	std::vector< uint32_t > triangles; //three indices into 'positions' per triangle
+};
+
+struct OcclusionBuffer {
+	//size in pixels (rounded up to whole 8x4 tiles); 'threads' == 0 means one per core (up to four):
+	OcclusionBuffer(uint32_t width = 256, uint32_t height = 144, uint32_t threads = 0);
+
+	//start a new frame (forgets all occluders):
+	void clear();
+
+	//queue an occluder's triangles (transformed and clipped to the near plane right away; rasterized by finish()):
+	void add(glm::mat4 const &clip_from_object, Occluder const &occluder);
+
+	//rasterize queued triangles, then build the hierarchical depth used by visible():
+	void finish();
+
+	//could any of the [min,max] box (object space) be in front of the occluders? (call after finish())
+	// (boxes that cross the near plane, or that are empty, are always visible)
+	bool visible(glm::mat4 const &clip_from_object, glm::vec3 const &min, glm::vec3 const &max) const;
+
+	//triangles rasterized by the most recent finish() (after clipping):
+	uint32_t triangles = 0;
+
+	//-- internals --
+
+	uint32_t width, height; //in pixels
+	uint32_t tiles_x, tiles_y; //in tiles
+	uint32_t threads;
+
+	enum : uint32_t { TileWidth = 8, TileHeight = 4 };
+	enum : uint32_t { BlockTiles = 4 }; //hierarchical depth: blocks of BlockTiles x BlockTiles tiles
+
+	//depths are clip z / w (so smaller is closer); "far" is +infinity:
+	struct Tile {
+		float far0; //every pixel has an occluder at least this close...
+		float far1; //...and the pixels in 'mask' have one at least this close (-infinity while 'mask' is empty)
+		uint32_t mask; //bit (y * TileWidth + x) for the pixel at (x,y) in the tile
+	};
+	std::vector< Tile > tiles; //row-major
+	std::vector< float > tile_depth; //far0 of each tile, row-major (level 0)
+	std::vector< float > block_depth; //largest tile_depth in each block (level 1)
+	uint32_t blocks_x, blocks_y;
+
+	//set-up triangle, in pixels (x right, y up; pixel (x,y) is sampled at (x + 0.5, y + 0.5)):
+	struct Setup {
+		float edge[3][3]; //(a, b, c) with a * x + b * y + c >= 0 inside
+		float depth[3]; //depth plane: depth = a * x + b * y + c
+		float depth_min, depth_max; //over the vertices
+		uint32_t tile_min_x, tile_min_y, tile_max_x, tile_max_y; //tile bounds (inclusive)
+	};
+	std::vector< Setup > setups;
+
+	std::vector< glm::vec4 > clip; //add()'s transformed vertices (kept so its allocation is reused)
+
+	void setup(glm::vec4 const &a, glm::vec4 const &b, glm::vec4 const &c);
+	void rasterize(Setup const &tri, uint32_t row_begin, uint32_t row_end);
+};
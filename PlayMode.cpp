@@ -4,64 +4,108 @@
 
 #include "DrawLines.hpp"
 #include "Mesh.hpp"
+#include "StaticBatch.hpp"
 #include "Load.hpp"
 #include "gl_errors.hpp"
+#include "gl_state.hpp"
 #include "data_path.hpp"
 
 #include "SoundManager.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <limits>
+#include <map>
 #include <random>
+#include <set>
 
 GLuint hexapod_meshes_for_lit_color_texture_program = 0;
 
-Load< MeshBuffer > oil_rig_meshes(LoadTagDefault, []() -> MeshBuffer const * {
-	MeshBuffer const *ret = new MeshBuffer(data_path("oil_rig.pnct"));
+Load< MeshBuffer > oil_rig_meshes(LoadTagDefault, LoadOn::Main, {lit_color_texture_program}, []() -> MeshBuffer const * {
+	//(streamed, so the level appears as its vertices arrive instead of holding up the first frame)
+	//(with BVHs, so levers can be picked by their actual geometry)
+	//(and with a CPU copy of the vertices, for oil_rig_batches and oil_rig_occluders below)
+	MeshBuffer const *ret = new MeshBuffer(data_path("oil_rig.pnct"), MeshBuffer::Upload::Streamed, MeshBuffer::Raycast::Enabled, MeshBuffer::CPUData::Keep);
 	hexapod_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
 	return ret;
 });
 
-std::map< std::string, std::pair < const Mesh *, Scene::Transform * >> levers_mesh_transform;
-std::vector< Scene::Drawable > hint_drawables;
-std::map< std::string, std::vector< const Mesh * > > hint_meshes;
-Load< Scene > oil_rig_scene(LoadTagDefault, []() -> Scene const * {
-	return new Scene(data_path("oil_rig.scene"), [&](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
-		Mesh const &mesh = oil_rig_meshes->lookup(mesh_name);
-		std::cout << mesh_name << std::endl;
-
-		if (mesh_name.find("lever") != std::string::npos) {
-			levers_mesh_transform[mesh_name].first = &mesh;
-			levers_mesh_transform[mesh_name].second = transform;
-		} 
-		else if (mesh_name.find("hintloc") != std::string::npos) {
-			hint_drawables.emplace_back(transform);
-		}
-		else if (mesh_name.find("card") != std::string::npos) {
-			size_t idx = std::stoull(mesh_name.substr(mesh_name.size() - 1, 1));
-			std::string color = mesh_name.substr(5, mesh_name.size() - 7);
-
-			if (hint_meshes.find(color) == hint_meshes.end()) {
-				hint_meshes[color].resize(5);
+//drawables of these meshes hide much of the level, so PlayMode draws them into its occlusion buffer (see Occlusion.hpp):
+// (as the file's simplified 'name.occluder' mesh if it has one, otherwise as the mesh itself)
+std::set< std::string, std::less<> > const occluder_meshes = { "building" };
+std::map< std::string, Occluder > oil_rig_occluders;
+//(no OpenGL calls, so this runs on a worker thread while other loads continue)
+Load< Scene > oil_rig_scene(LoadTagDefault, LoadOn::Worker, {oil_rig_meshes, lit_color_texture_program}, []() -> Scene const * {
+	//what to do with each mesh is decided from its name the first time it shows up, then remembered by MeshId:
+	// (levers, hint locations, and cards are placed by PlayMode itself -- see "setup levers" below)
+	enum class MeshRole : uint8_t { Unknown, PlacedByPlayMode, Drawable };
+	std::vector< MeshRole > mesh_roles(oil_rig_meshes->size(), MeshRole::Unknown);
+
+	std::unique_ptr< Scene > ret = std::make_unique< Scene >();
+	ret->load_batched(data_path("oil_rig.scene"), [&](Scene &scene, std::vector< Scene::MeshRef > const &refs){
+		for (auto const &ref : refs) {
+			Scene::Transform *transform = ref.transform;
+			std::string_view mesh_name = ref.mesh_name;
+			MeshId id = oil_rig_meshes->lookup_id(mesh_name);
+			Mesh const &mesh = (*oil_rig_meshes)[id];
+
+			MeshRole &role = mesh_roles[id.index];
+			if (role == MeshRole::Unknown) {
+				if (mesh_name.find("lever") != std::string::npos
+				 || mesh_name.find("hintloc") != std::string::npos
+				 || mesh_name.find("card") != std::string::npos) {
+					role = MeshRole::PlacedByPlayMode;
+				} else {
+					role = MeshRole::Drawable;
+				}
 			}
-			hint_meshes[color][idx - 1] = &mesh;
 
-		}
-		else {
-			scene.drawables.emplace_back(transform);
-			Scene::Drawable &drawable = scene.drawables.back();
+			if (role == MeshRole::Drawable) {
+				scene.drawables.emplace_back(transform);
+				Scene::Drawable &drawable = scene.drawables.back();
 
-			drawable.pipeline = lit_color_texture_program_pipeline;
+				drawable.pipeline = lit_color_texture_clustered_pipeline;
+				drawable.pipeline.edit().vao = hexapod_meshes_for_lit_color_texture_program;
+				drawable.set_mesh(mesh);
 
-			drawable.pipeline.vao = hexapod_meshes_for_lit_color_texture_program;
-			drawable.pipeline.type = mesh.type;
-			drawable.pipeline.start = mesh.start;
-			drawable.pipeline.count = mesh.count;
+				if (occluder_meshes.count(mesh_name)) {
+					auto [at, added] = oil_rig_occluders.try_emplace(std::string(mesh_name));
+					if (added) {
+						MeshId stand_in = oil_rig_meshes->find(std::string(mesh_name) + ".occluder");
+						oil_rig_meshes->read_triangles(stand_in.valid() ? stand_in : id, &at->second.positions, &at->second.triangles);
+					}
+					drawable.occluder = &at->second;
+				}
+
+				//simplified versions, for when the drawable is small on screen:
+				for (uint32_t l = 0; l < Scene::Drawable::MaxLODs; ++l) {
+					MeshId lod = oil_rig_meshes->find_lod(id, l + 1);
+					if (!lod.valid()) break;
+					drawable.lods[l].start = (*oil_rig_meshes)[lod].start;
+					drawable.lods[l].count = (*oil_rig_meshes)[lod].count;
+					drawable.lods[l].max_screen_size = Scene::Drawable::default_lod_screen_size(l + 1);
+					drawable.lod_count = l + 1;
+				}
+			}
 		}
 	});
+	return ret.release();
+});
+
+//the level's geometry never moves, so it is merged into a few big world-space draws (see StaticBatch.hpp):
+// (drawables with LODs are left alone, so they still get simplified with distance, as are occluders, which batches don't keep)
+// (makes OpenGL buffers, so runs on the main thread)
+Load< StaticBatches > oil_rig_batches(LoadTagDefault, LoadOn::Main, {oil_rig_scene, oil_rig_meshes}, []() -> StaticBatches const * {
+	StaticBatches const *ret = new StaticBatches(*oil_rig_scene, *oil_rig_meshes, hexapod_meshes_for_lit_color_texture_program, [](Scene::Drawable const &drawable) {
+		return drawable.lod_count == 0 && !drawable.occluder;
+	});
+	std::cout << "Merged " << ret->merged_count << " static drawables into " << ret->drawables.size() << " batches (" << ret->vertex_count << " vertices)." << std::endl;
+	return ret;
 });
 
-Load< std::vector< Sound::Sample >> footsteps_samples(LoadTagDefault, []() -> std::vector< Sound::Sample > const * {
+//sample banks are decoded on worker threads, in parallel with each other and with the level:
+// (all but the siren -- which starts playing as soon as PlayMode is made -- are lazy; PlayMode prefetches them, and they play once ready)
+Load< std::vector< Sound::Sample >> footsteps_samples(LoadPolicy::Lazy, LoadOn::Worker, {}, []() -> std::vector< Sound::Sample > const * {
 	std::vector< std::string > paths = { 
 		"footsteps-01.wav", "footsteps-02.wav", "footsteps-03.wav",
 		"footsteps-04.wav", "footsteps-05.wav", "footsteps-06.wav" };
@@ -75,7 +119,7 @@ Load< std::vector< Sound::Sample >> footsteps_samples(LoadTagDefault, []() -> st
 	return footsteps;
 });
 
-Load< std::vector< Sound::Sample >> wind_samples(LoadTagDefault, []() -> std::vector< Sound::Sample > const * {
+Load< std::vector< Sound::Sample >> wind_samples(LoadPolicy::Lazy, LoadOn::Worker, {}, []() -> std::vector< Sound::Sample > const * {
 	std::vector< std::string > paths = { 
 		"wind-01.wav", "wind-02.wav", "wind-03.wav", "wind-04.wav"};
 	auto wind = new std::vector< Sound::Sample >();
@@ -88,7 +132,7 @@ Load< std::vector< Sound::Sample >> wind_samples(LoadTagDefault, []() -> std::ve
 	return wind;
 });
 
-Load< std::vector< Sound::Sample >> water_samples(LoadTagDefault, []() -> std::vector< Sound::Sample > const * {
+Load< std::vector< Sound::Sample >> water_samples(LoadPolicy::Lazy, LoadOn::Worker, {}, []() -> std::vector< Sound::Sample > const * {
 	std::vector< std::string > paths = { 
 		"water-01.wav", "water-02.wav", "water-03.wav",
 		"water-04.wav", "water-05.wav", "water-06.wav",
@@ -105,7 +149,7 @@ Load< std::vector< Sound::Sample >> water_samples(LoadTagDefault, []() -> std::v
 	return water;
 });
 
-Load< std::vector< Sound::Sample >> rig_samples(LoadTagDefault, []() -> std::vector< Sound::Sample > const * {
+Load< std::vector< Sound::Sample >> rig_samples(LoadPolicy::Lazy, LoadOn::Worker, {}, []() -> std::vector< Sound::Sample > const * {
 	std::vector< std::string > paths = { 
 		"falling_metal.wav", "pressure_release-01.wav", "pressure_release-02.wav"};
 	auto rig = new std::vector< Sound::Sample >();
@@ -118,7 +162,7 @@ Load< std::vector< Sound::Sample >> rig_samples(LoadTagDefault, []() -> std::vec
 	return rig;
 });
 
-Load< std::vector< Sound::Sample >> siren_samples(LoadTagDefault, []() -> std::vector< Sound::Sample > const * {
+Load< std::vector< Sound::Sample >> siren_samples(LoadTagDefault, LoadOn::Worker, {}, []() -> std::vector< Sound::Sample > const * {
 	std::vector< std::string > paths = { 
 		"siren_screech_loop.wav", "siren_song_loop.wav"};
 	auto siren = new std::vector< Sound::Sample >();
@@ -204,11 +248,29 @@ void PlayMode::Siren::update(float elapsed) {
 }
 
 PlayMode::PlayMode() : scene(*oil_rig_scene) {
+	//draw the level's static geometry from its batches:
+	oil_rig_batches->apply(&scene);
+
+	//skip drawing what the building hides:
+	scene.occlusion = std::make_unique< OcclusionBuffer >();
+
+	//the level is lit by its own lamps and by a dim sky light:
+	// (drawn with lit_color_texture_clustered_pipeline, which gets every light in the scene from light_clusters)
+	scene.transforms.emplace_back();
+	scene.lights.emplace_back(&scene.transforms.back());
+	scene.lights.back().type = Scene::Light::Hemisphere; //(pointing down its -z axis)
+	scene.lights.back().energy = glm::vec3(0.05f);
 
 	//get pointer to camera for convenience:
 	if (scene.cameras.size() != 1) throw std::runtime_error("Expecting scene to have exactly one camera, but it has " + std::to_string(scene.cameras.size()));
 	camera = &scene.cameras.front();
 
+	//start decoding sounds that aren't needed right away:
+	footsteps_samples.prefetch();
+	wind_samples.prefetch();
+	water_samples.prefetch();
+	rig_samples.prefetch();
+
 	{
 		player.transform.position = glm::vec3(0.f, 0.f, 0.f);
 		camera->transform->parent = &player.transform;
@@ -226,27 +288,29 @@ PlayMode::PlayMode() : scene(*oil_rig_scene) {
 
 
 	// setup levers
+	// (the level has transforms 'Lever_1' ... 'Lever_5' for the meshes 'lever.001' ... 'lever.005')
 	{
 		for (size_t i = 0; i < 5; i++) {
-			auto pair = levers_mesh_transform["lever.00" + std::to_string(i + 1)];
-			
-			scene.drawables.emplace_back(new Scene::Transform());
+			std::string index = std::to_string(i + 1);
+			Scene::Transform *transform = scene.find_transform("Lever_" + index);
+			if (!transform) throw std::runtime_error("Expecting the level to have a transform named 'Lever_" + index + "'.");
+			MeshId id = oil_rig_meshes->lookup_id("lever.00" + index);
+
+			scene.drawables.emplace_back(transform);
 			levers.emplace_back();
 			auto *lever = &levers.back();
 
 			lever->drawable = &scene.drawables.back();
+			lever->bvh = oil_rig_meshes->bvh(id);
 
-			*(lever->drawable->transform) = *(pair.second);
-			lever->drawable->pipeline = lit_color_texture_program_pipeline;
-
-			lever->drawable->pipeline.vao = hexapod_meshes_for_lit_color_texture_program;
-			lever->drawable->pipeline.start = pair.first->start; 
-			lever->drawable->pipeline.count = pair.first->count; 
-			lever->drawable->pipeline.type = pair.first->type; 
+			lever->drawable->pipeline = lit_color_texture_clustered_pipeline;
+			lever->drawable->pipeline.edit().vao = hexapod_meshes_for_lit_color_texture_program;
+			lever->drawable->set_mesh((*oil_rig_meshes)[id]);
 		}
 	}
 
 	// generate solution and populate hints
+	// (each lever's hint is a card 'card_<color>_<1-5>' placed at one of the level's 'hintloc_*' transforms)
 	{
 		std::random_device rd;
 		std::mt19937 rng{ rd() };
@@ -257,15 +321,19 @@ PlayMode::PlayMode() : scene(*oil_rig_scene) {
 		}
 
 		std::vector< std::string > colors = { "red", "green", "blue", "orange", "purple" };
-		std::shuffle(hint_drawables.begin(), hint_drawables.end(), rng);
+		std::vector< Scene::Transform * > hint_locations = scene.find_transforms_with_prefix("hintloc_");
+		if (hint_locations.size() < levers.size()) {
+			throw std::runtime_error("Expecting the level to have at least " + std::to_string(levers.size()) + " 'hintloc_' transforms, but it has " + std::to_string(hint_locations.size()) + ".");
+		}
+		std::shuffle(hint_locations.begin(), hint_locations.end(), rng);
 		for (size_t i = 0; i < levers.size(); i++) {
-			hint_drawables[i].pipeline = lit_color_texture_program_pipeline;
-			hint_drawables[i].pipeline.vao = hexapod_meshes_for_lit_color_texture_program;
-			hint_drawables[i].pipeline.start = hint_meshes[colors[i]][solution[i]]->start;
-			hint_drawables[i].pipeline.count = hint_meshes[colors[i]][solution[i]]->count;
-			hint_drawables[i].pipeline.type = hint_meshes[colors[i]][solution[i]]->type;
+			Mesh const &card = (*oil_rig_meshes)[oil_rig_meshes->lookup_id("card_" + colors[i] + "_" + std::to_string(solution[i] + 1))];
 
-			scene.drawables.emplace_back(hint_drawables[i]);
+			scene.drawables.emplace_back(hint_locations[i]);
+			Scene::Drawable &hint = scene.drawables.back();
+			hint.pipeline = lit_color_texture_clustered_pipeline;
+			hint.pipeline.edit().vao = hexapod_meshes_for_lit_color_texture_program;
+			hint.set_mesh(card);
 		}
 	}
 	
@@ -336,6 +404,9 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 		} else if (evt.key.key == SDLK_R) {
 			Sound::stop_all_samples();
 			return false;
+		} else if (evt.key.key == SDLK_TAB) {
+			show_stats = !show_stats;
+			return true;
 		}
 	} else if (evt.type == SDL_EVENT_KEY_UP) {
 		if (evt.key.key == SDLK_A) {
@@ -525,7 +596,7 @@ void PlayMode::update(float elapsed) {
 			play_footsteps = true;
 		}
 
-		if (play_footsteps) SoundManager::play_sfx(footsteps_samples, (lshift.pressed ? .3f : .4f), elapsed, 0.f, .5f * sound_muffler);
+		if (play_footsteps && footsteps_samples.ready()) SoundManager::play_sfx(footsteps_samples, (lshift.pressed ? .3f : .4f), elapsed, 0.f, .5f * sound_muffler);
 	}
 
 	glm::vec3 forward = glm::vec3(
@@ -533,8 +604,22 @@ void PlayMode::update(float elapsed) {
 		sin_pitch * cos_yaw,
 		-cos_pitch
 	);
+	glm::vec3 eye = player.transform.make_world_from_local() * glm::vec4(camera->transform->position, 1.f);
+	//distance along the view ray to a lever's geometry, if within reach (infinity otherwise, or if the lever has no BVH):
+	auto lever_ray_distance = [&](Lever const &lever) {
+		MeshBVH::Hit hit;
+		if (lever.bvh && lever.bvh->raycast(lever.drawable->transform->make_world_from_local(), eye, forward, player.INTERACT_RANGE, &hit)) {
+			return hit.t;
+		}
+		return std::numeric_limits< float >::infinity();
+	};
+
 	{ // check if player is hoving for purpose of pop-up
 		for (auto &lever : levers) {
+			if (lever_ray_distance(lever) <= player.INTERACT_RANGE) {
+				player.is_hovering = true;
+				break;
+			}
 			glm::vec3 to = ((lever.drawable->transform->make_world_from_local() * glm::vec4(lever.drawable->transform->position, 1.f) + lever.offset) 
 				- player.transform.make_world_from_local() * glm::vec4(camera->transform->position, 1.f));
 		
@@ -554,8 +639,21 @@ void PlayMode::update(float elapsed) {
 		static bool interacted = false;
 		if (interact.pressed && !interacted && player.get_enchanted() < player.MIN_TO_ENCHANT_STATUS) {
 			Lever *closest = nullptr;
+
+			//prefer the nearest lever under the crosshair:
+			float closest_t = std::numeric_limits< float >::infinity();
+			for (auto &lever : levers) {
+				float t = lever_ray_distance(lever);
+				if (t < closest_t) {
+					closest_t = t;
+					closest = &lever;
+				}
+			}
+
+			//...otherwise fall back to the (looser) cone around each lever:
 			float closest_resp = 100.f;
 			for (auto &lever : levers) {
+				if (closest_t <= player.INTERACT_RANGE) break;
 				glm::vec3 to = ((lever.drawable->transform->make_world_from_local() * glm::vec4(lever.drawable->transform->position, 1.f) + lever.offset) 
 					- player.transform.make_world_from_local() * glm::vec4(camera->transform->position, 1.f));
 
@@ -599,15 +697,15 @@ void PlayMode::update(float elapsed) {
 
 		float angle = angle_dist(rng);
 		float radius = radius_dist(rng);
-		SoundManager::play_sfx_3D(rig_samples, 15.f, elapsed, 7.5f * glm::vec3(std::cosf(angle), radius / 17.5f, std::sinf(angle)), 1000.f, 11.f, .1f * sound_muffler);
+		if (rig_samples.ready()) SoundManager::play_sfx_3D(rig_samples, 15.f, elapsed, 7.5f * glm::vec3(std::cosf(angle), radius / 17.5f, std::sinf(angle)), 1000.f, 11.f, .1f * sound_muffler);
 
 		angle = angle_dist(rng);
 		radius = radius_dist(rng);
-		SoundManager::play_sfx_3D(wind_samples, 12.f, elapsed, 35.f * glm::vec3(std::cosf(angle), radius / 35.f * 3.f, std::sinf(angle)), 1000.f, 10.f, .5f * sound_muffler);
+		if (wind_samples.ready()) SoundManager::play_sfx_3D(wind_samples, 12.f, elapsed, 35.f * glm::vec3(std::cosf(angle), radius / 35.f * 3.f, std::sinf(angle)), 1000.f, 10.f, .5f * sound_muffler);
 		
 		angle = angle_dist(rng);
 		radius = radius_dist(rng);
-		SoundManager::play_sfx_3D(water_samples, 1.f, elapsed, radius * glm::vec3(std::cosf(angle), -5.f, std::sinf(angle)), 1000.f, 2.f, .1f * sound_muffler);
+		if (water_samples.ready()) SoundManager::play_sfx_3D(water_samples, 1.f, elapsed, radius * glm::vec3(std::cosf(angle), -5.f, std::sinf(angle)), 1000.f, 2.f, .1f * sound_muffler);
 	}
 
 	//reset button press counters:
@@ -624,13 +722,9 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	//update camera aspect ratio for drawable:
 	camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
-	//set up light type and position for lit_color_texture_program:
-	// TODO: consider using the Light(s) in the scene to do this
-	glUseProgram(lit_color_texture_program->program);
-	glUniform1i(lit_color_texture_program->LIGHT_TYPE_int, 1);
-	glUniform3fv(lit_color_texture_program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f,-1.0f)));
-	glUniform3fv(lit_color_texture_program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(.05f, .05f, 0.05f)));
-	glUseProgram(0);
+	//sort the scene's lights into clusters for the clustered lit_color_texture_program variants:
+	light_clusters.build(scene, *camera, drawable_size);
+	light_clusters.upload();
 
 	glClearColor(0.00125f, 0.0f, 0.0025f, 1.0f);
 	glClearDepth(1.0f); //1.0 is actually the default value to clear the depth buffer to, but FYI you can change it.
@@ -662,6 +756,28 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 			glm::vec3(H * .9f, 0.0f, 0.0f), glm::vec3(0.0f, H * .9f, 0.0f),
 			glm::u8vec4(0xff, 0xff, 0xff, 0x00));
 
+		if (show_stats) {
+			Scene::DrawStats const &draw = scene.draw_stats;
+			GLStateStats const &gl = gl_state_frame_stats();
+			std::string stats[2] = {
+				"visible " + std::to_string(draw.visible) + " culled " + std::to_string(draw.culled)
+					+ " occluded " + std::to_string(draw.occluded) + " streaming " + std::to_string(draw.streaming)
+					+ " simplified " + std::to_string(draw.simplified) + " draws " + std::to_string(draw.draw_calls),
+				"meshlets " + std::to_string(draw.meshlets_drawn) + " drawn " + std::to_string(draw.meshlets_culled) + " culled"
+					+ " - gl calls " + std::to_string(gl.issued) + " issued " + std::to_string(gl.skipped) + " skipped",
+			};
+			constexpr float S = 0.05f;
+			for (uint32_t i = 0; i < 2; ++i) {
+				glm::vec3 at = glm::vec3(-aspect + 0.1f * S, 1.0f - (i + 1.1f) * S, 0.0f);
+				lines.draw_text(stats[i], at,
+					glm::vec3(S * .9f, 0.0f, 0.0f), glm::vec3(0.0f, S * .9f, 0.0f),
+					glm::u8vec4(0x00, 0x00, 0x00, 0x00));
+				lines.draw_text(stats[i], at + glm::vec3(ofs, ofs, 0.0f),
+					glm::vec3(S * .9f, 0.0f, 0.0f), glm::vec3(0.0f, S * .9f, 0.0f),
+					glm::u8vec4(0xff, 0xff, 0xff, 0x00));
+			}
+		}
+
 		static size_t frame = 0;
 		static bool flip = false;
 		if (frame == 0) {
@@ -1,6 +1,7 @@
 #include "Mode.hpp"
 
 #include "Scene.hpp"
+#include "LightClusters.hpp"
 #include "Sound.hpp"
 
 #include "Collision.hpp"
@@ -31,6 +32,9 @@ struct PlayMode : Mode {
 	//local copy of the game scene (so code can change it during gameplay):
 	Scene scene;
 
+	//the scene's lights, sorted each frame for the cells of the view they reach:
+	LightClusters light_clusters;
+
 	// if time allows, potentially maintain structure to register and play sfx
 	// std::map< std::string, std::vector< Sound::Sample *>> sfx;
 
@@ -97,4 +101,7 @@ struct PlayMode : Mode {
 	std::vector< size_t > solution;
 
 	float MIN_MUFFLED_SOUND_COEFF = .2f;
+
+	//TAB toggles an overlay of the scene's draw stats and the GL state cache's counts for the last frame:
+	bool show_stats = false;
 };
@@ -1,11 +1,20 @@
 #include "Scene.hpp"
 
+#include "Frustum.hpp"
+#include "Mesh.hpp"
+#include "Load.hpp"
 #include "gl_errors.hpp"
+#include "gl_state.hpp"
+#include "data_file.hpp"
 #include "read_write_chunk.hpp"
+#include "string_intern.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
-#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
 
 //-------------------------
 
@@ -73,12 +82,124 @@ glm::mat4x3 Scene::Transform::make_local_from_world() const {
 
 //-------------------------
 
+void Scene::Drawable::set_mesh(Mesh const &mesh) {
+	Pipeline &p = pipeline.edit();
+	p.type = mesh.type;
+	p.start = mesh.start;
+	p.count = mesh.count;
+	p.index_type = mesh.index_type;
+	p.position_scale = mesh.position_scale;
+	p.position_offset = mesh.position_offset;
+	p.resident_vertices = mesh.resident_vertices;
+	p.vertex_end = mesh.vertex_end;
+
+	min = mesh.min;
+	max = mesh.max;
+	meshlets = mesh.meshlets;
+	meshlet_count = mesh.meshlet_count;
+	lod_count = 0;
+}
+
+//-------------------------
+
 glm::mat4 Scene::Camera::make_projection() const {
 	return glm::infinitePerspective( fovy, aspect, near );
 }
 
 //-------------------------
 
+//All per-object transforms for a draw() call are streamed to the GPU in one upload to a buffer shared by all scenes:
+// [instance data texels (read through instance_texture)][Object uniform blocks (read with glBindBufferRange)]
+static GLuint transform_buffer = 0;
+static GLuint instance_texture = 0; //buffer texture viewing transform_buffer
+static GLint instance_buffer_texels = 0; //maximum number of texels in the buffer texture
+static GLint uniform_buffer_alignment = 256; //required alignment for glBindBufferRange offsets
+
+static Load< void > setup_transform_buffer(LoadTagDefault, [](){
+	glGenBuffers(1, &transform_buffer);
+
+	glGenTextures(1, &instance_texture);
+	gl_bind_texture(0, GL_TEXTURE_BUFFER, instance_texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, transform_buffer);
+	gl_bind_texture(0, GL_TEXTURE_BUFFER, 0);
+
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &instance_buffer_texels);
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_buffer_alignment);
+
+	GL_ERRORS();
+});
+
+//std140 layout of the 'Object' uniform block (see Scene::ObjectBlockBinding):
+struct ObjectBlock {
+	glm::mat4 CLIP_FROM_OBJECT;
+	glm::vec4 LIGHT_FROM_OBJECT[4]; //mat4x3 columns are padded to vec4 in std140
+	glm::vec4 LIGHT_FROM_NORMAL[3]; //mat3 columns are padded to vec4 in std140
+};
+static_assert(sizeof(ObjectBlock) == 64 + 64 + 48, "ObjectBlock matches std140 layout.");
+
+//round 'value' up to a multiple of 'alignment':
+static size_t round_up(size_t value, size_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+//byte offset of element 'start' in an element buffer holding indices of type 'index_type' (as glDrawElements wants it):
+static GLvoid const *index_offset(GLenum index_type, GLuint start) {
+	size_t size = 4;
+	if (index_type == GL_UNSIGNED_SHORT) size = 2;
+	else if (index_type == GL_UNSIGNED_BYTE) size = 1;
+	return reinterpret_cast< GLvoid const * >(size_t(start) * size);
+}
+
+//Per-instance data, as read by instanced programs (e.g., LitColorTextureProgram::instanced_program):
+// texels [0,4) -- CLIP_FROM_OBJECT (columns)
+// texels [4,7) -- LIGHT_FROM_OBJECT (rows)
+// texels [7,10) -- LIGHT_FROM_NORMAL (columns, .w unused)
+
+//The three per-object transforms every drawing path sends to programs:
+struct ObjectTransforms {
+	glm::mat4 clip_from_object;
+	glm::mat4x3 light_from_object;
+	glm::mat3 light_from_normal;
+};
+
+static ObjectTransforms make_object_transforms(glm::mat4 const &clip_from_world, glm::mat4x3 const &light_from_world, glm::mat4x3 const &world_from_object, Scene::Drawable::Pipeline const &pipeline) {
+	ObjectTransforms ret;
+	glm::mat4x3 light_from_object = light_from_world * glm::mat4(world_from_object);
+	//normals are never quantized, so they use the object transform as-is:
+	ret.light_from_normal = glm::inverse(glm::transpose(glm::mat3(light_from_object)));
+
+	//positions are first dequantized (a no-op for float positions):
+	glm::mat4 object_from_vertex = glm::mat4(
+		glm::vec4(pipeline.position_scale.x, 0.0f, 0.0f, 0.0f),
+		glm::vec4(0.0f, pipeline.position_scale.y, 0.0f, 0.0f),
+		glm::vec4(0.0f, 0.0f, pipeline.position_scale.z, 0.0f),
+		glm::vec4(pipeline.position_offset, 1.0f)
+	);
+	ret.clip_from_object = clip_from_world * glm::mat4(world_from_object) * object_from_vertex;
+	ret.light_from_object = light_from_object * object_from_vertex;
+	return ret;
+}
+
+static void append_instance(ObjectTransforms const &transforms, std::vector< glm::vec4 > *instance_data_) {
+	assert(instance_data_);
+	auto &instance_data = *instance_data_;
+
+	glm::mat4 const &clip_from_object = transforms.clip_from_object;
+	glm::mat3 const &light_from_normal = transforms.light_from_normal;
+	glm::mat3x4 light_from_object_rows = glm::transpose(transforms.light_from_object);
+
+	instance_data.emplace_back(clip_from_object[0]);
+	instance_data.emplace_back(clip_from_object[1]);
+	instance_data.emplace_back(clip_from_object[2]);
+	instance_data.emplace_back(clip_from_object[3]);
+	instance_data.emplace_back(light_from_object_rows[0]);
+	instance_data.emplace_back(light_from_object_rows[1]);
+	instance_data.emplace_back(light_from_object_rows[2]);
+	instance_data.emplace_back(light_from_normal[0], 0.0f);
+	instance_data.emplace_back(light_from_normal[1], 0.0f);
+	instance_data.emplace_back(light_from_normal[2], 0.0f);
+	static_assert(Scene::InstanceStride == 10, "append_instance writes InstanceStride texels");
+}
 
 void Scene::draw(Camera const &camera) const {
 	assert(camera.transform);
@@ -89,10 +210,23 @@ void Scene::draw(Camera const &camera) const {
 
 void Scene::draw(glm::mat4 const &clip_from_world, glm::mat4x3 const &light_from_world) const {
 
-	//Iterate through all drawables, sending each one to OpenGL:
+	draw_stats.streaming = 0;
+
+	//Gather drawables that can actually be drawn, along with their world-space bounds:
+	// (all the working vectors live in draw_scratch, so they keep their storage from frame to frame)
+	auto &candidates = draw_scratch.candidates;
+	auto &candidate_world_from_object = draw_scratch.candidate_world_from_object;
+	BoxList &candidate_bounds = draw_scratch.candidate_bounds;
+	candidates.clear();
+	candidate_world_from_object.clear();
+	candidate_bounds.clear();
+	candidates.reserve(drawables.size());
+	candidate_world_from_object.reserve(drawables.size());
+	candidate_bounds.reserve(drawables.size());
+
 	for (auto const &drawable : drawables) {
 		//Reference to drawable's pipeline for convenience:
-		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+		Scene::Drawable::Pipeline const &pipeline = *drawable.pipeline;
 
 		//skip any drawables without a shader program set:
 		if (pipeline.program == 0) continue;
@@ -100,67 +234,361 @@ void Scene::draw(glm::mat4 const &clip_from_world, glm::mat4x3 const &light_from
 		if (pipeline.vao == 0) continue;
 		//skip any drawables that don't contain any vertices:
 		if (pipeline.count == 0) continue;
+		//skip any drawables whose vertices are still being streamed in:
+		if (pipeline.resident_vertices && *pipeline.resident_vertices < pipeline.vertex_end) {
+			draw_stats.streaming += 1;
+			continue;
+		}
 
+		//the object-to-world matrix is used for culling and in all three of the transform uniforms:
+		assert(drawable.transform); //drawables *must* have a transform
+		glm::mat4x3 world_from_object = drawable.transform->make_world_from_local();
 
-		//Set shader program:
-		glUseProgram(pipeline.program);
+		candidates.emplace_back(&drawable);
+		candidate_world_from_object.emplace_back(world_from_object);
+		candidate_bounds.push(world_from_object, drawable.min, drawable.max);
+	}
 
-		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+	//Skip drawables whose bounds are entirely outside the view frustum:
+	auto &visible = draw_scratch.visible;
+	draw_stats.visible = cull_boxes(Frustum::from_clip(clip_from_world), candidate_bounds, &visible);
+	draw_stats.culled = uint32_t(candidates.size()) - draw_stats.visible;
+
+	//Skip drawables hidden behind the occluders of visible drawables:
+	draw_stats.occluded = 0;
+	if (occlusion) {
+		occlusion->clear();
+		for (size_t i = 0; i < candidates.size(); ++i) {
+			if (!visible[i] || !candidates[i]->occluder) continue;
+			occlusion->add(clip_from_world * glm::mat4(candidate_world_from_object[i]), *candidates[i]->occluder);
+		}
+		occlusion->finish();
+
+		if (occlusion->triangles != 0) {
+			for (size_t i = 0; i < candidates.size(); ++i) {
+				if (!visible[i] || candidates[i]->occluder) continue;
+				if (occlusion->visible(clip_from_world * glm::mat4(candidate_world_from_object[i]), candidates[i]->min, candidates[i]->max)) continue;
+				visible[i] = 0;
+				draw_stats.occluded += 1;
+			}
+			draw_stats.visible -= draw_stats.occluded;
+		}
+	}
 
-		//Configure program uniforms:
+	//Pick each visible drawable's level of detail from its size on screen:
+	// (a sphere of radius r around world point c covers r * |clip y row| / (clip w of c) of the viewport height,
+	//  since the viewport spans 2 in normalized device coordinates -- for perspective projections, that's r / (w * tan(fovy / 2)))
+	auto &ranges = draw_scratch.ranges;
+	ranges.assign(candidates.size(), DrawRange{ 0, 0 });
+	draw_stats.simplified = 0;
+	{
+		glm::vec4 clip_y_row = glm::vec4(clip_from_world[0][1], clip_from_world[1][1], clip_from_world[2][1], clip_from_world[3][1]);
+		glm::vec4 clip_w_row = glm::vec4(clip_from_world[0][3], clip_from_world[1][3], clip_from_world[2][3], clip_from_world[3][3]);
+		float y_scale = glm::length(glm::vec3(clip_y_row));
+
+		for (size_t i = 0; i < candidates.size(); ++i) {
+			if (!visible[i]) continue;
+			Drawable const &drawable = *candidates[i];
+			ranges[i] = DrawRange{ drawable.pipeline->start, drawable.pipeline->count };
+
+			if (drawable.lod_count == 0) continue;
+			if (!(drawable.min.x <= drawable.max.x && drawable.min.y <= drawable.max.y && drawable.min.z <= drawable.max.z)) continue;
+
+			glm::mat4x3 const &world_from_object = candidate_world_from_object[i];
+			glm::vec3 center = world_from_object * glm::vec4(0.5f * (drawable.min + drawable.max), 1.0f);
+			float scale = std::max(glm::length(world_from_object[0]), std::max(glm::length(world_from_object[1]), glm::length(world_from_object[2])));
+			float radius = 0.5f * glm::length(drawable.max - drawable.min) * scale;
+			float w = glm::dot(clip_w_row, glm::vec4(center, 1.0f));
+			if (w <= radius) continue; //(bounds reach the camera; always full detail)
+			float screen_size = radius * y_scale / w;
+
+			for (uint32_t l = 0; l < std::min(drawable.lod_count, uint32_t(Drawable::MaxLODs)); ++l) {
+				if (screen_size > drawable.lods[l].max_screen_size) break;
+				ranges[i] = DrawRange{ drawable.lods[l].start, drawable.lods[l].count };
+			}
+			if (ranges[i].start != drawable.pipeline->start || ranges[i].count != drawable.pipeline->count) draw_stats.simplified += 1;
+		}
+	}
 
-		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 world_from_object = drawable.transform->make_world_from_local();
+	//Split visible drawables into those that can be drawn instanced and those that must be drawn one-by-one:
+	auto &singles = draw_scratch.singles;
+	auto &instanceable = draw_scratch.instanceable;
+	singles.clear();
+	instanceable.clear();
+	for (size_t i = 0; i < candidates.size(); ++i) {
+		if (!visible[i]) continue;
+		Scene::Drawable::Pipeline const &pipeline = *candidates[i]->pipeline;
+		//instancing needs an instanced program, and can't handle per-drawable custom uniforms:
+		if (pipeline.instanced_program != 0 && !pipeline.set_uniforms) {
+			instanceable.emplace_back(i);
+		} else {
+			singles.emplace_back(i);
+		}
+	}
+
+	//Group instanceable drawables that share program, attributes, vertex range (after LOD selection), and textures:
+	auto candidate_less = [&](size_t ia, size_t ib) {
+		Scene::Drawable::Pipeline const &a = *candidates[ia]->pipeline;
+		Scene::Drawable::Pipeline const &b = *candidates[ib]->pipeline;
+		if (a.instanced_program != b.instanced_program) return a.instanced_program < b.instanced_program;
+		if (a.vao != b.vao) return a.vao < b.vao;
+		if (a.type != b.type) return a.type < b.type;
+		if (ranges[ia].start != ranges[ib].start) return ranges[ia].start < ranges[ib].start;
+		if (ranges[ia].count != ranges[ib].count) return ranges[ia].count < ranges[ib].count;
+		if (a.index_type != b.index_type) return a.index_type < b.index_type;
+		if (a.cull_back_faces != b.cull_back_faces) return b.cull_back_faces;
+		for (uint32_t t = 0; t < Drawable::Pipeline::TextureCount; ++t) {
+			if (a.textures[t].texture != b.textures[t].texture) return a.textures[t].texture < b.textures[t].texture;
+			if (a.textures[t].target != b.textures[t].target) return a.textures[t].target < b.textures[t].target;
+		}
+		return false;
+	};
+	std::stable_sort(instanceable.begin(), instanceable.end(), candidate_less);
+
+	auto &groups = draw_scratch.groups;
+	auto &transform_data = draw_scratch.transform_data;
+	groups.clear();
+	transform_data.clear();
+
+	for (size_t begin = 0; begin < instanceable.size(); ) {
+		size_t end = begin + 1;
+		while (end < instanceable.size()
+		 && !candidate_less(instanceable[begin], instanceable[end])) {
+			++end;
+		}
 
-		//CLIP_FROM_OBJECT takes vertices from object space to clip space:
-		if (pipeline.CLIP_FROM_OBJECT_mat4 != -1U) {
+		//lone drawables and groups that wouldn't fit in the instance buffer are drawn the regular way:
+		if (end - begin < 2 || transform_data.size() + (end - begin) * InstanceStride > size_t(instance_buffer_texels)) {
+			singles.insert(singles.end(), instanceable.begin() + begin, instanceable.begin() + end);
+			begin = end;
+			continue;
+		}
+
+		groups.emplace_back();
+		groups.back().first = candidates[instanceable[begin]];
+		groups.back().order = instanceable[begin];
+		groups.back().range = ranges[instanceable[begin]];
+		groups.back().base = GLint(transform_data.size());
+		groups.back().count = GLsizei(end - begin);
+
+		for (size_t g = begin; g < end; ++g) {
+			append_instance(make_object_transforms(clip_from_world, light_from_world, candidate_world_from_object[instanceable[g]], *candidates[instanceable[g]]->pipeline), &transform_data);
+		}
+
+		begin = end;
+	}
+	std::sort(singles.begin(), singles.end()); //(keep one-by-one drawables in scene order)
+
+	//Append Object uniform blocks for the one-by-one drawables whose programs read them:
+	size_t const block_stride = round_up(round_up(sizeof(ObjectBlock), size_t(uniform_buffer_alignment)), sizeof(glm::vec4));
+	size_t const blocks_begin = round_up(round_up(transform_data.size() * sizeof(glm::vec4), size_t(uniform_buffer_alignment)), sizeof(glm::vec4));
+	auto &single_block_offsets = draw_scratch.single_block_offsets; //byte offset in transform_buffer of each single's block
+	single_block_offsets.assign(singles.size(), 0);
+	{
+		size_t offset = blocks_begin;
+		for (size_t s = 0; s < singles.size(); ++s) {
+			if (!candidates[singles[s]]->pipeline->object_block) continue;
+			single_block_offsets[s] = offset;
+			offset += block_stride;
+		}
+		transform_data.resize(offset / sizeof(glm::vec4), glm::vec4(0.0f));
+		for (size_t s = 0; s < singles.size(); ++s) {
+			if (!candidates[singles[s]]->pipeline->object_block) continue;
+			ObjectTransforms transforms = make_object_transforms(clip_from_world, light_from_world, candidate_world_from_object[singles[s]], *candidates[singles[s]]->pipeline);
+
+			ObjectBlock block;
+			block.CLIP_FROM_OBJECT = transforms.clip_from_object;
+			for (uint32_t c = 0; c < 4; ++c) block.LIGHT_FROM_OBJECT[c] = glm::vec4(transforms.light_from_object[c], 0.0f);
+			for (uint32_t c = 0; c < 3; ++c) block.LIGHT_FROM_NORMAL[c] = glm::vec4(transforms.light_from_normal[c], 0.0f);
+
+			std::memcpy(reinterpret_cast< char * >(transform_data.data()) + single_block_offsets[s], &block, sizeof(block));
+		}
+	}
+
+	//Upload all per-object transforms at once:
+	// (glBufferData with a fresh size+data orphans last draw's storage, so there's no waiting on the GPU)
+	if (!transform_data.empty()) {
+		glBindBuffer(GL_UNIFORM_BUFFER, transform_buffer);
+		glBufferData(GL_UNIFORM_BUFFER, transform_data.size() * sizeof(glm::vec4), transform_data.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	//Viewpoint for meshlet back-face tests -- the world point clip_from_world sends to clip (0,0,z,0):
+	// (it's at infinity for orthographic projections, which get no back-face tests)
+	glm::vec4 eye_h = glm::inverse(clip_from_world) * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+	bool have_eye = std::abs(eye_h.w) > 1e-6f * glm::length(glm::vec3(eye_h));
+	glm::vec3 eye = have_eye ? glm::vec3(eye_h) / eye_h.w : glm::vec3(0.0f);
+
+	//GL_CULL_FACE follows each drawable's pipeline.cull_back_faces (and is left off afterward):
+	bool culling_faces = false;
+	auto set_face_culling = [&](bool cull) {
+		if (cull == culling_faces) return;
+		if (cull) glEnable(GL_CULL_FACE);
+		else glDisable(GL_CULL_FACE);
+		culling_faces = cull;
+	};
+
+	draw_stats.meshlets_drawn = 0;
+	draw_stats.meshlets_culled = 0;
+	uint32_t meshlets_hidden = 0; //singles skipped because none of their meshlets were visible
+	auto &meshlet_ranges = draw_scratch.meshlet_ranges;
+	auto &multi_counts = draw_scratch.multi_counts;
+	auto &multi_firsts = draw_scratch.multi_firsts;
+	auto &multi_offsets = draw_scratch.multi_offsets;
+
+	//Send a drawable that isn't instanced to OpenGL:
+	auto draw_single = [&](size_t s) {
+		Drawable const &drawable = *candidates[singles[s]];
+		glm::mat4x3 const &world_from_object = candidate_world_from_object[singles[s]];
+
+		//Reference to drawable's pipeline for convenience:
+		Scene::Drawable::Pipeline const &pipeline = *drawable.pipeline;
+
+		//Drawables drawn at full detail can skip meshlets that can't be seen:
+		DrawRange const &range = ranges[singles[s]];
+		bool use_meshlets = drawable.meshlet_count != 0 && range.start == pipeline.start && range.count == pipeline.count;
+		if (use_meshlets) {
+			meshlet_ranges.clear();
 			glm::mat4 clip_from_object = clip_from_world * glm::mat4(world_from_object);
-			glUniformMatrix4fv(pipeline.CLIP_FROM_OBJECT_mat4, 1, GL_FALSE, glm::value_ptr(clip_from_object));
+			glm::vec3 object_eye = glm::inverse(glm::mat4(world_from_object)) * glm::vec4(eye, 1.0f);
+			//(mirrored transforms flip which side OpenGL considers the front, so they get no back-face tests)
+			bool cull_back_facing = pipeline.cull_back_faces && have_eye && glm::determinant(glm::mat3(world_from_object)) > 0.0f;
+			//(meshlets' bounding spheres are tested as boxes against the occlusion buffer, if there is anything in it)
+			struct OcclusionTest {
+				OcclusionBuffer const *occlusion;
+				glm::mat4 const *clip_from_object;
+			} occlusion_test{ occlusion.get(), &clip_from_object };
+			bool (*unoccluded)(void const *, Meshlet const &) = nullptr;
+			if (occlusion && occlusion->triangles != 0 && !drawable.occluder) {
+				unoccluded = [](void const *context, Meshlet const &meshlet) {
+					OcclusionTest const &test = *static_cast< OcclusionTest const * >(context);
+					return test.occlusion->visible(*test.clip_from_object, meshlet.center - glm::vec3(meshlet.radius), meshlet.center + glm::vec3(meshlet.radius));
+				};
+			}
+			uint32_t drawn = cull_meshlets(Frustum::from_clip(clip_from_object), object_eye, cull_back_facing, drawable.meshlets, drawable.meshlet_count, &meshlet_ranges, unoccluded, &occlusion_test);
+			draw_stats.meshlets_drawn += drawn;
+			draw_stats.meshlets_culled += drawable.meshlet_count - drawn;
+			if (drawn == 0) {
+				meshlets_hidden += 1;
+				return;
+			}
 		}
 
-		//the object-to-light matrix is used in the next two uniforms:
-		glm::mat4x3 light_from_object = light_from_world * glm::mat4(world_from_object);
+		set_face_culling(pipeline.cull_back_faces);
+
+		//Set shader program:
+		gl_use_program(pipeline.program);
+
+		//Set attribute sources:
+		gl_bind_vertex_array(pipeline.vao);
 
-		//CLIP_FROM_OBJECT takes vertices from object space to light space:
-		if (pipeline.LIGHT_FROM_OBJECT_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(pipeline.LIGHT_FROM_OBJECT_mat4x3, 1, GL_FALSE, glm::value_ptr(light_from_object));
+		//Configure program uniforms:
+
+		//programs using the Object block get all three transforms from the already-uploaded buffer:
+		if (pipeline.object_block) {
+			glBindBufferRange(GL_UNIFORM_BUFFER, ObjectBlockBinding, transform_buffer, single_block_offsets[s], sizeof(ObjectBlock));
 		}
 
-		//LIGHT_FROM_NORMAL takes normals from object space to light space:
-		if (pipeline.LIGHT_FROM_NORMAL_mat3 != -1U) {
-			glm::mat3 light_from_normal = glm::inverse(glm::transpose(glm::mat3(light_from_object)));
-			glUniformMatrix3fv(pipeline.LIGHT_FROM_NORMAL_mat3, 1, GL_FALSE, glm::value_ptr(light_from_normal));
+		//(only computed if the program reads any of them as plain uniforms)
+		if (pipeline.CLIP_FROM_OBJECT_mat4 != -1U || pipeline.LIGHT_FROM_OBJECT_mat4x3 != -1U || pipeline.LIGHT_FROM_NORMAL_mat3 != -1U) {
+			ObjectTransforms transforms = make_object_transforms(clip_from_world, light_from_world, world_from_object, pipeline);
+
+			//CLIP_FROM_OBJECT takes vertices from object space to clip space:
+			if (pipeline.CLIP_FROM_OBJECT_mat4 != -1U) {
+				glUniformMatrix4fv(pipeline.CLIP_FROM_OBJECT_mat4, 1, GL_FALSE, glm::value_ptr(transforms.clip_from_object));
+			}
+
+			//CLIP_FROM_OBJECT takes vertices from object space to light space:
+			if (pipeline.LIGHT_FROM_OBJECT_mat4x3 != -1U) {
+				glUniformMatrix4x3fv(pipeline.LIGHT_FROM_OBJECT_mat4x3, 1, GL_FALSE, glm::value_ptr(transforms.light_from_object));
+			}
+
+			//LIGHT_FROM_NORMAL takes normals from object space to light space:
+			if (pipeline.LIGHT_FROM_NORMAL_mat3 != -1U) {
+				glUniformMatrix3fv(pipeline.LIGHT_FROM_NORMAL_mat3, 1, GL_FALSE, glm::value_ptr(transforms.light_from_normal));
+			}
 		}
 
 		//set any requested custom uniforms:
 		if (pipeline.set_uniforms) pipeline.set_uniforms();
 
 		//set up textures:
+		// (left bound after drawing; the state cache skips re-binding them for the next drawable,
+		//  and unused slots get 0 so they never show the previous drawable's texture)
 		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
+			gl_bind_texture(i, pipeline.textures[i].target, pipeline.textures[i].texture);
+		}
+
+		//draw the object (or its visible meshlets, as one multi-draw):
+		if (use_meshlets && meshlet_ranges.size() > 1) {
+			multi_counts.clear();
+			multi_firsts.clear();
+			multi_offsets.clear();
+			for (auto const &r : meshlet_ranges) {
+				multi_counts.emplace_back(GLsizei(r.y));
+				multi_firsts.emplace_back(GLint(r.x));
+				multi_offsets.emplace_back(index_offset(pipeline.index_type, r.x));
+			}
+			if (pipeline.index_type != GL_NONE) {
+				glMultiDrawElements(pipeline.type, multi_counts.data(), pipeline.index_type, multi_offsets.data(), GLsizei(meshlet_ranges.size()));
+			} else {
+				glMultiDrawArrays(pipeline.type, multi_firsts.data(), multi_counts.data(), GLsizei(meshlet_ranges.size()));
+			}
+		} else {
+			DrawRange draw_range = use_meshlets ? DrawRange{ meshlet_ranges[0].x, meshlet_ranges[0].y } : range;
+			if (pipeline.index_type != GL_NONE) {
+				glDrawElements(pipeline.type, draw_range.count, pipeline.index_type, index_offset(pipeline.index_type, draw_range.start));
+			} else {
+				glDrawArrays(pipeline.type, draw_range.start, draw_range.count);
 			}
 		}
+	};
+
+	//Draw a group of identical drawables with a single instanced draw call:
+	auto draw_group = [&](InstanceGroup const &group) {
+		gl_bind_texture(Drawable::Pipeline::InstanceTextureUnit, GL_TEXTURE_BUFFER, instance_texture);
 
-		//draw the object:
-		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+		Scene::Drawable::Pipeline const &pipeline = *group.first->pipeline;
 
-		//un-bind textures:
+		set_face_culling(pipeline.cull_back_faces);
+		gl_use_program(pipeline.instanced_program);
+		gl_bind_vertex_array(pipeline.vao);
+
+		glUniform1i(pipeline.INSTANCE_BASE_int, group.base);
+
+		//set up textures (as above, unused slots get 0):
 		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
-			}
+			gl_bind_texture(i, pipeline.textures[i].target, pipeline.textures[i].texture);
 		}
-		glActiveTexture(GL_TEXTURE0);
 
+		//draw all the copies:
+		if (pipeline.index_type != GL_NONE) {
+			glDrawElementsInstanced(pipeline.type, group.range.count, pipeline.index_type, index_offset(pipeline.index_type, group.range.start), group.count);
+		} else {
+			glDrawArraysInstanced(pipeline.type, group.range.start, group.range.count, group.count);
+		}
+	};
+
+	//Draw in scene order, with each group where its first member is in the list:
+	// (so drawables that depend on what was drawn before them -- e.g., blended ones -- still see it)
+	std::sort(groups.begin(), groups.end(), [](InstanceGroup const &a, InstanceGroup const &b) {
+		return a.order < b.order;
+	});
+	for (size_t s = 0, g = 0; s < singles.size() || g < groups.size(); ) {
+		if (g < groups.size() && (s == singles.size() || groups[g].order < singles[s])) {
+			draw_group(groups[g]);
+			++g;
+		} else {
+			draw_single(s);
+			++s;
+		}
 	}
 
-	glUseProgram(0);
-	glBindVertexArray(0);
+	set_face_culling(false);
+
+	draw_stats.draw_calls = uint32_t(singles.size() - meshlets_hidden + groups.size());
+
+	//n.b. program, vertex array, and textures are left bound; code that draws afterward should also go through gl_state.hpp
 
 	GL_ERRORS();
 }
@@ -169,10 +597,78 @@ void Scene::draw(glm::mat4 const &clip_from_world, glm::mat4x3 const &light_from
 void Scene::load(std::string const &filename,
 	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
 
-	std::ifstream file(filename, std::ios::binary);
+	load_batched(filename, [&on_drawable](Scene &scene, std::vector< MeshRef > const &meshes) {
+		if (!on_drawable) return;
+		for (auto const &m : meshes) {
+			auto before = scene.drawables.empty() ? scene.drawables.end() : std::prev(scene.drawables.end());
+			on_drawable(scene, m.transform, std::string(m.mesh_name));
+
+			//give any new drawables for this transform the file's bounds (if it has them and the callback didn't set any):
+			auto added = (before == scene.drawables.end() ? scene.drawables.begin() : std::next(before));
+			for (auto d = added; d != scene.drawables.end(); ++d) {
+				if (d->transform == m.transform && !(d->min.x <= d->max.x)) {
+					d->min = m.min;
+					d->max = m.max;
+				}
+			}
+		}
+	});
+}
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+void Scene::load_batched(std::string const &filename,
+	std::function< void(Scene &, std::vector< MeshRef > const &) > const &on_meshes) {
+
+	DataFile file(filename); //(from the asset archive, if it has the scene)
+	char const *at = file.data;
+	char const *end = file.data + file.size;
+
+	//v2 files start with a table of contents giving the location of each chunk;
+	// v1 files are just the required chunks, in a fixed order:
+	struct TocEntry {
+		char magic[4];
+		uint32_t offset; //from start of file to chunk header
+		uint32_t size; //of chunk data (not including header)
+	};
+	static_assert(sizeof(TocEntry) == 4 + 4 + 4, "TocEntry is packed.");
+	ChunkView< TocEntry > toc;
+	bool has_toc = (file.size >= 4 && std::string_view(file.data, 4) == "toc0");
+	if (has_toc) {
+		toc = view_chunk< TocEntry >(&at, end, "toc0");
+	}
+
+	//anything after the last chunk read is passed to load_extra():
+	char const *extra_begin = at;
+
+	auto get_chunk = [&](auto *view, std::string const &magic, bool optional) {
+		using T = typename std::remove_pointer_t< decltype(view) >::value_type;
+		if (!has_toc) {
+			if (optional) return; //(v1 files have no optional chunks)
+			*view = view_chunk< T >(&at, end, magic);
+			extra_begin = at;
+			return;
+		}
+		for (size_t i = 0; i < toc.size(); ++i) {
+			TocEntry entry = toc[i];
+			if (std::string_view(entry.magic, 4) != magic) continue;
+			if (entry.offset > file.size) {
+				throw std::runtime_error("scene file '" + filename + "' lists chunk '" + magic + "' past the end of the file");
+			}
+			char const *chunk = file.data + entry.offset;
+			*view = view_chunk< T >(&chunk, end, magic);
+			if (view->size() * sizeof(T) != entry.size) {
+				throw std::runtime_error("scene file '" + filename + "' lists the wrong size for chunk '" + magic + "'");
+			}
+			extra_begin = std::max(extra_begin, chunk);
+			return;
+		}
+		if (!optional) {
+			throw std::runtime_error("scene file '" + filename + "' is missing chunk '" + magic + "'");
+		}
+	};
+
+	ChunkView< char > names;
+	get_chunk(&names, "str0", false);
+	std::string_view str0(names.bytes, names.size());
 
 	struct HierarchyEntry {
 		uint32_t parent;
@@ -183,8 +679,8 @@ void Scene::load(std::string const &filename,
 		glm::vec3 scale;
 	};
 	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
-	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
+	ChunkView< HierarchyEntry > hierarchy;
+	get_chunk(&hierarchy, "xfh0", false);
 
 	struct MeshEntry {
 		uint32_t transform;
@@ -192,8 +688,8 @@ void Scene::load(std::string const &filename,
 		uint32_t name_end;
 	};
 	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
+	ChunkView< MeshEntry > meshes;
+	get_chunk(&meshes, "msh0", false);
 
 	struct CameraEntry {
 		uint32_t transform;
@@ -202,8 +698,8 @@ void Scene::load(std::string const &filename,
 		float clip_near, clip_far;
 	};
 	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-	std::vector< CameraEntry > loaded_cameras;
-	read_chunk(file, "cam0", &loaded_cameras);
+	ChunkView< CameraEntry > loaded_cameras;
+	get_chunk(&loaded_cameras, "cam0", false);
 
 	struct LightEntry {
 		uint32_t transform;
@@ -214,17 +710,43 @@ void Scene::load(std::string const &filename,
 		float fov;
 	};
 	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-	std::vector< LightEntry > loaded_lights;
-	read_chunk(file, "lmp0", &loaded_lights);
+	ChunkView< LightEntry > loaded_lights;
+	get_chunk(&loaded_lights, "lmp0", false);
 
+	//(v2 only) precomputed bounds for each msh0 entry:
+	struct BoundsEntry {
+		glm::vec3 min, max; //object space
+		glm::vec3 world_min, world_max; //world space, as exported
+	};
+	static_assert(sizeof(BoundsEntry) == 4*3*4, "BoundsEntry is packed.");
+	ChunkView< BoundsEntry > bounds;
+	get_chunk(&bounds, "bnd0", true);
+	if (!bounds.empty() && bounds.size() != meshes.size()) {
+		throw std::runtime_error("scene file '" + filename + "' has " + std::to_string(bounds.size()) + " bounds for " + std::to_string(meshes.size()) + " meshes");
+	}
+
+	//(v2 only) bounding volume hierarchy over the world-space bounds, and the msh0 entries its leaves hold:
+	struct IndexNode {
+		glm::vec3 min, max;
+		uint32_t first, count; //same meaning as StaticNode, but leaves are ranges of 'leaves'
+	};
+	static_assert(sizeof(IndexNode) == 4*3*2 + 4 + 4, "IndexNode is packed.");
+	ChunkView< IndexNode > index;
+	get_chunk(&index, "bvh0", true);
+	ChunkView< uint32_t > leaves;
+	get_chunk(&leaves, "bvl0", true);
+	if (!index.empty() && (bounds.empty() || leaves.size() != meshes.size())) {
+		throw std::runtime_error("scene file '" + filename + "' has a spatial index without bounds for each mesh");
+	}
 
 	//--------------------------------
-	//Now that file is loaded, create transforms for hierarchy entries:
+	//Now that chunks are located, create transforms for hierarchy entries:
 
 	std::vector< Transform * > hierarchy_transforms;
 	hierarchy_transforms.reserve(hierarchy.size());
 
-	for (auto const &h : hierarchy) {
+	for (size_t i = 0; i < hierarchy.size(); ++i) {
+		HierarchyEntry h = hierarchy[i];
 		transforms.emplace_back();
 		Transform *t = &transforms.back();
 		if (h.parent != -1U) {
@@ -234,8 +756,8 @@ void Scene::load(std::string const &filename,
 			t->parent = hierarchy_transforms[h.parent];
 		}
 
-		if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
-			t->name = std::string(names.begin() + h.name_begin, names.begin() + h.name_end);
+		if (h.name_begin <= h.name_end && h.name_end <= str0.size()) {
+			t->name = intern_string(str0.substr(h.name_begin, h.name_end - h.name_begin));
 		} else {
 				throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name indices");
 		}
@@ -248,26 +770,68 @@ void Scene::load(std::string const &filename,
 	}
 	assert(hierarchy_transforms.size() == hierarchy.size());
 
-	for (auto const &m : meshes) {
+	std::vector< MeshRef > mesh_refs;
+	mesh_refs.reserve(meshes.size());
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		MeshEntry m = meshes[i];
 		if (m.transform >= hierarchy_transforms.size()) {
 			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid transform index (" + std::to_string(m.transform) + ")");
 		}
-		if (!(m.name_begin <= m.name_end && m.name_end <= names.size())) {
+		if (!(m.name_begin <= m.name_end && m.name_end <= str0.size())) {
 			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid name indices");
 		}
-		std::string name = std::string(names.begin() + m.name_begin, names.begin() + m.name_end);
+		mesh_refs.emplace_back(MeshRef{
+			hierarchy_transforms[m.transform],
+			str0.substr(m.name_begin, m.name_end - m.name_begin)
+		});
+		if (!bounds.empty()) {
+			BoundsEntry b = bounds[i];
+			mesh_refs.back().min = b.min;
+			mesh_refs.back().max = b.max;
+		}
+	}
 
-		if (on_drawable) {
-			on_drawable(*this, hierarchy_transforms[m.transform], name);
+	if (!bounds.empty()) {
+		//the index can only be kept if these are the scene's only static bounds (it has a single root):
+		if (!static_bounds.empty()) static_index.clear();
+		bool keep_index = static_bounds.empty() && !index.empty();
+
+		//bounds go in leaf order (so each leaf's meshes are a range), or in file order if there's no index to keep:
+		std::vector< bool > listed(meshes.size(), false);
+		static_bounds.reserve(static_bounds.size() + bounds.size());
+		for (size_t l = 0; l < meshes.size(); ++l) {
+			uint32_t i = (keep_index ? leaves[l] : uint32_t(l));
+			if (i >= meshes.size() || listed[i]) {
+				throw std::runtime_error("scene file '" + filename + "' has a spatial index that doesn't list each mesh once");
+			}
+			listed[i] = true;
+			BoundsEntry b = bounds[i];
+			static_bounds.emplace_back(StaticBounds{ mesh_refs[i].transform, b.min, b.max, b.world_min, b.world_max });
+		}
+
+		if (keep_index) {
+			static_index.reserve(index.size());
+			for (size_t i = 0; i < index.size(); ++i) {
+				IndexNode n = index[i];
+				//children must come after their parent, so the tree can't have cycles:
+				if (n.count == 0 ? !(n.first > i && n.first + 1 < index.size()) : !(n.first + n.count <= leaves.size())) {
+					throw std::runtime_error("scene file '" + filename + "' contains spatial index node with invalid children");
+				}
+				static_index.emplace_back(StaticNode{ n.min, n.max, n.first, n.count });
+			}
 		}
+	}
 
+	if (on_meshes && !mesh_refs.empty()) {
+		on_meshes(*this, mesh_refs);
 	}
 
-	for (auto const &c : loaded_cameras) {
+	for (size_t i = 0; i < loaded_cameras.size(); ++i) {
+		CameraEntry c = loaded_cameras[i];
 		if (c.transform >= hierarchy_transforms.size()) {
 			throw std::runtime_error("scene file '" + filename + "' contains camera entry with invalid transform index (" + std::to_string(c.transform) + ")");
 		}
-		if (std::string(c.type, 4) != "pers") {
+		if (std::string_view(c.type, 4) != "pers") {
 			std::cout << "Ignoring non-perspective camera (" + std::string(c.type, 4) + ") stored in file." << std::endl;
 			continue;
 		}
@@ -278,7 +842,8 @@ void Scene::load(std::string const &filename,
 		//N.b. far plane is ignored because cameras use infinite perspective matrices.
 	}
 
-	for (auto const &l : loaded_lights) {
+	for (size_t i = 0; i < loaded_lights.size(); ++i) {
+		LightEntry l = loaded_lights[i];
 		if (l.transform >= hierarchy_transforms.size()) {
 			throw std::runtime_error("scene file '" + filename + "' contains lamp entry with invalid transform index (" + std::to_string(l.transform) + ")");
 		}
@@ -299,17 +864,19 @@ void Scene::load(std::string const &filename,
 		light->type = static_cast<Light::Type>(l.type);
 		light->energy = glm::vec3(l.color) / 255.0f * l.energy;
 		light->spot_fov = l.fov / 180.0f * 3.1415926f; //FOV is stored in degrees; convert to radians.
+		light->distance = std::max(0.0f, l.distance);
 	}
 
+	index_transforms();
+
 	//load any extra that a subclass wants:
-	load_extra(file, names, hierarchy_transforms);
+	MemoryStreamBuf rest_buf(extra_begin, end);
+	std::istream rest(&rest_buf);
+	load_extra(rest, str0, hierarchy_transforms);
 
-	if (file.peek() != EOF) {
+	if (rest.peek() != EOF) {
 		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
 	}
-
-
-
 }
 
 //-------------------------
@@ -327,51 +894,173 @@ Scene &Scene::operator=(Scene const &other) {
 	return *this;
 }
 
-void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map_) {
+void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map) {
 
-	std::unordered_map< Transform const *, Transform * > t2t_temp;
-	std::unordered_map< Transform const *, Transform * > &transform_to_transform = *(transform_map_ ? transform_map_ : &t2t_temp);
+	//Copy transforms, remembering the old->new mapping in a flat array:
+	// (one allocation, instead of one node per transform in an unordered_map)
+	std::vector< std::pair< Transform const *, Transform * > > remap;
+	remap.reserve(other.transforms.size());
 
-	transform_to_transform.clear();
-
-	//null transform maps to itself:
-	transform_to_transform.insert(std::make_pair(nullptr, nullptr));
-
-	//Copy transforms and store mapping:
 	transforms.clear();
 	for (auto const &t : other.transforms) {
 		transforms.emplace_back();
-		transforms.back().name = t.name;
-		transforms.back().position = t.position;
-		transforms.back().rotation = t.rotation;
-		transforms.back().scale = t.scale;
-		transforms.back().parent = t.parent; //will update later
-
-		//store mapping between transforms old and new:
-		auto ret = transform_to_transform.insert(std::make_pair(&t, &transforms.back()));
-		assert(ret.second);
+		Transform &copy = transforms.back();
+		copy.name = t.name;
+		copy.position = t.position;
+		copy.rotation = t.rotation;
+		copy.scale = t.scale;
+		copy.parent = t.parent; //will update later
+
+		remap.emplace_back(&t, &copy);
 	}
 
+	//sort by old pointer so lookups are a binary search:
+	auto by_old = [](std::pair< Transform const *, Transform * > const &a, std::pair< Transform const *, Transform * > const &b) {
+		return std::less< Transform const * >()(a.first, b.first);
+	};
+	std::sort(remap.begin(), remap.end(), by_old);
+
+	auto lookup = [&](Transform const *old) -> Transform * {
+		//null transform maps to itself:
+		if (old == nullptr) return nullptr;
+		auto f = std::lower_bound(remap.begin(), remap.end(), std::make_pair(old, (Transform *)nullptr), by_old);
+		if (f == remap.end() || f->first != old) {
+			throw std::runtime_error("Scene::set: object references a transform that isn't part of the scene being copied.");
+		}
+		return f->second;
+	};
+
 	//update transform parents:
 	for (auto &t : transforms) {
-		t.parent = transform_to_transform.at(t.parent);
+		t.parent = lookup(t.parent);
 	}
 
 	//copy other's drawables, updating transform pointers:
 	drawables = other.drawables;
 	for (auto &d : drawables) {
-		d.transform = transform_to_transform.at(d.transform);
+		d.transform = lookup(d.transform);
 	}
 
 	//copy other's cameras, updating transform pointers:
 	cameras = other.cameras;
 	for (auto &c : cameras) {
-		c.transform = transform_to_transform.at(c.transform);
+		c.transform = lookup(c.transform);
 	}
 
 	//copy other's lights, updating transform pointers:
 	lights = other.lights;
 	for (auto &l : lights) {
-		l.transform = transform_to_transform.at(l.transform);
+		l.transform = lookup(l.transform);
+	}
+
+	//copy other's static bounds, updating transform pointers:
+	static_bounds = other.static_bounds;
+	for (auto &b : static_bounds) {
+		b.transform = lookup(b.transform);
+	}
+	static_index = other.static_index;
+
+	//copy other's name index, updating transform pointers:
+	// (names and order are the same in the copy, so nothing needs re-sorting or re-hashing)
+	transforms_by_name.resize(other.transforms_by_name.size());
+	for (size_t i = 0; i < transforms_by_name.size(); ++i) {
+		transforms_by_name[i] = lookup(other.transforms_by_name[i]);
+	}
+	transform_name_slots.resize(other.transform_name_slots.size());
+	for (size_t i = 0; i < transform_name_slots.size(); ++i) {
+		transform_name_slots[i] = lookup(other.transform_name_slots[i]);
+	}
+
+	//only build the (more expensive) hash map if the caller asked for it:
+	if (transform_map) {
+		transform_map->clear();
+		transform_map->reserve(remap.size() + 1);
+		transform_map->insert(std::make_pair(nullptr, nullptr));
+		for (auto const &r : remap) {
+			transform_map->insert(r);
+		}
+	}
+}
+
+//-------------------------
+
+void Scene::index_transforms() {
+	transforms_by_name.clear();
+	for (auto &t : transforms) {
+		if (!t.name.empty()) transforms_by_name.emplace_back(&t);
+	}
+	//(stable so that, among transforms with the same name, the first in the scene comes first)
+	std::stable_sort(transforms_by_name.begin(), transforms_by_name.end(), [](Transform const *a, Transform const *b) {
+		return a->name.view() < b->name.view();
+	});
+
+	//hash table is kept at most half full so probe sequences stay short:
+	size_t slots = 1;
+	while (slots < 2 * transforms_by_name.size()) slots *= 2;
+	transform_name_slots.assign(slots, nullptr);
+
+	for (Transform *t : transforms_by_name) {
+		size_t i = std::hash< std::string_view >()(t->name.view()) & (slots - 1);
+		while (transform_name_slots[i] && transform_name_slots[i]->name != t->name) {
+			i = (i + 1) & (slots - 1);
+		}
+		if (!transform_name_slots[i]) transform_name_slots[i] = t;
+	}
+}
+
+Scene::Transform *Scene::find_transform(std::string_view name) const {
+	if (transform_name_slots.empty()) return nullptr;
+	size_t slots = transform_name_slots.size();
+	size_t i = std::hash< std::string_view >()(name) & (slots - 1);
+	while (Transform *t = transform_name_slots[i]) {
+		if (t->name.view() == name) return t;
+		i = (i + 1) & (slots - 1);
+	}
+	return nullptr;
+}
+
+std::vector< Scene::Transform * > Scene::find_transforms_with_prefix(std::string_view prefix) const {
+	auto begin = std::lower_bound(transforms_by_name.begin(), transforms_by_name.end(), prefix, [](Transform const *t, std::string_view const &p) {
+		return t->name.view() < p;
+	});
+	auto end = begin;
+	while (end != transforms_by_name.end() && (*end)->name.view().starts_with(prefix)) ++end;
+	return std::vector< Transform * >(begin, end);
+}
+
+//-------------------------
+
+void Scene::query_static(glm::vec3 const &min, glm::vec3 const &max, std::vector< Transform * > *out_) const {
+	assert(out_);
+	auto &out = *out_;
+
+	auto overlaps = [&](glm::vec3 const &b_min, glm::vec3 const &b_max) {
+		return b_min.x <= max.x && min.x <= b_max.x
+		    && b_min.y <= max.y && min.y <= b_max.y
+		    && b_min.z <= max.z && min.z <= b_max.z;
+	};
+
+	if (static_index.empty()) {
+		//no index; check everything:
+		for (auto const &b : static_bounds) {
+			if (overlaps(b.min, b.max)) out.emplace_back(b.transform);
+		}
+		return;
+	}
+
+	std::vector< uint32_t > todo;
+	todo.emplace_back(0);
+	while (!todo.empty()) {
+		StaticNode const &node = static_index[todo.back()];
+		todo.pop_back();
+		if (!overlaps(node.min, node.max)) continue;
+		if (node.count == 0) {
+			todo.emplace_back(node.first + 1);
+			todo.emplace_back(node.first);
+		} else {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				if (overlaps(static_bounds[i].min, static_bounds[i].max)) out.emplace_back(static_bounds[i].transform);
+			}
+		}
 	}
 }
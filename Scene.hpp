@@ -11,21 +11,31 @@
  */
 
 #include "GL.hpp"
+#include "Frustum.hpp"
+#include "Occlusion.hpp"
+#include "copy_on_write.hpp"
+#include "string_intern.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <functional>
 #include <list>
+#include <limits>
 #include <memory>
-#include <functional>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 
+struct Mesh; //(see Mesh.hpp)
+
 struct Scene {
 	struct Transform {
 		//Transform names are useful for debugging and looking up locations in a loaded scene:
-		std::string name;
+		// (see string_intern.hpp; e.g., transform.name = intern_string("Lever_1");)
+		InternedString name;
 
 		//The core function of a transform is to store a transformation in the world:
 		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -65,20 +75,92 @@ struct Scene {
 			GLuint start = 0; //first vertex to draw; passed to glDrawArrays
 			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
 
+			//for indexed meshes, set to the type of the indices (e.g., GL_UNSIGNED_INT) in the element buffer attached to 'vao':
+			// then 'start' and 'count' select a range of indices, and drawing uses glDrawElements.
+			GLenum index_type = GL_NONE;
+
+			//dequantization for compact vertex formats: object-space position = position_offset + position_scale * (stored position)
+			// (applied by draw() to the position transforms; normals are left alone)
+			glm::vec3 position_scale = glm::vec3(1.0f);
+			glm::vec3 position_offset = glm::vec3(0.0f);
+
+			//for meshes from a streamed MeshBuffer (copy from Mesh): draw() skips this drawable until *resident_vertices >= vertex_end.
+			GLuint const *resident_vertices = nullptr;
+			GLuint vertex_end = 0;
+
+			//draw with back faces culled (draw() turns GL_CULL_FACE on for this drawable, and off again for drawables without it):
+			// (this also lets draw() skip meshlets whose triangles all face away from the camera)
+			bool cull_back_faces = false;
+
 			//uniforms:
+			//if 'object_block' is set, the program reads CLIP_FROM_OBJECT, LIGHT_FROM_OBJECT, and LIGHT_FROM_NORMAL from
+			// an std140 uniform block bound to ObjectBlockBinding, filled by draw() from one per-draw upload:
+			bool object_block = false;
+			//otherwise, draw() sets whichever of these uniform locations are valid:
 			GLuint CLIP_FROM_OBJECT_mat4 = -1U; //uniform location for object to clip space matrix
 			GLuint LIGHT_FROM_OBJECT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
 			GLuint LIGHT_FROM_NORMAL_mat3 = -1U; //uniform location for normal to light space (== world space) matrix
 
 			std::function< void() > set_uniforms; //(optional) function to set any other useful uniforms
 
-			//texture objects to bind for the first TextureCount textures:
+			//(optional) instanced variant of 'program':
+			// when set, draw() will draw visible drawables that share a pipeline and vertex range with one glDrawArraysInstanced call.
+			// (drawables with set_uniforms are never instanced, since their uniforms may differ; a group is drawn where its first member is in scene order)
+			// the instanced program must read per-instance transforms from the buffer texture on unit InstanceTextureUnit (layout: see Scene.cpp)
+			// and must use the same attribute locations as 'program' (so it can share 'vao').
+			GLuint instanced_program = 0;
+			GLuint INSTANCE_BASE_int = -1U; //uniform location (in instanced_program) for the texel index of the first instance's data
+
+			//texture objects to bind for the first TextureCount textures (0 to bind nothing on that unit):
 			enum : uint32_t { TextureCount = 4 };
 			struct TextureInfo {
 				GLuint texture = 0;
 				GLenum target = GL_TEXTURE_2D;
 			} textures[TextureCount];
-		} pipeline;
+
+			//texture unit holding the per-instance data buffer texture when drawing with instanced_program:
+			enum : uint32_t { InstanceTextureUnit = TextureCount };
+		};
+		//shared (copy-on-write) so that copying a scene doesn't copy every pipeline:
+		// read with drawable.pipeline->program; change with drawable.pipeline.edit().program = ...
+		CopyOnWrite< Pipeline > pipeline;
+
+		//local-space bounding box of the drawable's vertices (e.g., copied from Mesh::min/max):
+		// used by draw() to skip drawables outside the view frustum.
+		// (the default, empty box means "bounds unknown; never cull")
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+		//(optional) simplified versions of the drawable's mesh, finest first (e.g., 'mesh.LOD1' ... from optimize-meshes --lods):
+		// draw() computes the drawable's screen size -- its bounding box's bounding sphere diameter as a fraction of viewport height --
+		// and draws the coarsest lods[i] with screen size <= lods[i].max_screen_size in place of pipeline.start/count.
+		// (LODs share everything else -- vertex array, primitive type, index type, dequantization -- with the pipeline; drawables without bounds never use them)
+		struct LOD {
+			GLuint start = 0;
+			GLuint count = 0;
+			float max_screen_size = 0.0f;
+		};
+		enum : uint32_t { MaxLODs = 3 };
+		LOD lods[MaxLODs];
+		uint32_t lod_count = 0;
+
+		//screen size at or below which LOD 'level' (1-based) is used by default -- 1/4 for LOD1, halving with each level:
+		static float default_lod_screen_size(uint32_t level) { return 0.5f / float(1u << level); }
+
+		//(optional) meshlets exactly covering pipeline.start/count, in object space (e.g., copied from Mesh::meshlets):
+		// when the drawable is drawn at full detail and not instanced, draw() skips meshlets outside the view frustum
+		// (or facing away, with pipeline.cull_back_faces) and draws the rest with one glMultiDrawElements / glMultiDrawArrays call.
+		Meshlet const *meshlets = nullptr;
+		uint32_t meshlet_count = 0;
+
+		//(optional) simple stand-in for the drawable's mesh, in object space, that is entirely inside it:
+		// when the scene has an occlusion buffer, draw() renders the occluders of drawables in the view frustum into it first,
+		// then skips drawables (and meshlets) that they hide. (drawables with occluders are never hidden themselves)
+		Occluder const *occluder = nullptr;
+
+		//draw 'mesh': copies its vertex range, primitive and index types, dequantization, and streaming state to the pipeline,
+		// and its bounds and meshlets to the drawable; clears any LODs. (the pipeline's program and vao are left alone)
+		void set_mesh(Mesh const &mesh);
 	};
 
 	struct Camera {
@@ -114,13 +196,19 @@ struct Scene {
 
 		//Spotlight specific:
 		float spot_fov = glm::radians(45.0f); //spot cone fov (in radians)
+
+		//Point and spot lights: distance beyond which the light can be ignored (0 for "until it fades out"):
+		// (from the lamp's custom distance in Blender; used by LightClusters)
+		float distance = 0.0f;
 	};
 
 	//Scenes, of course, may have many of the above objects:
-	std::list< Transform > transforms;
-	std::list< Drawable > drawables;
-	std::list< Camera > cameras;
-	std::list< Light > lights;
+	// (the lists' nodes come from a per-scene pool, so loading or copying a scene allocates in large chunks, not once per object)
+	std::pmr::unsynchronized_pool_resource node_pool;
+	std::pmr::list< Transform > transforms{&node_pool};
+	std::pmr::list< Drawable > drawables{&node_pool};
+	std::pmr::list< Camera > cameras{&node_pool};
+	std::pmr::list< Light > lights{&node_pool};
 
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
 	void draw(Camera const &camera) const;
@@ -128,16 +216,87 @@ struct Scene {
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
 	void draw(glm::mat4 const &clip_from_world, glm::mat4x3 const &light_from_world = glm::mat4x3(1.0f)) const;
 
+	//statistics from the most recent call to draw() (useful for checking that culling works):
+	struct DrawStats {
+		uint32_t visible = 0; //drawables sent to OpenGL
+		uint32_t culled = 0; //drawables skipped because their bounds were outside the view frustum
+		uint32_t occluded = 0; //drawables skipped because occluders hid their bounds (see 'occlusion')
+		uint32_t streaming = 0; //drawables skipped because their vertices haven't been uploaded yet
+		uint32_t simplified = 0; //visible drawables drawn with one of their LODs
+		uint32_t meshlets_drawn = 0; //meshlets of visible drawables that were drawn...
+		uint32_t meshlets_culled = 0; //...and that were skipped (off-screen, facing away, or occluded)
+		uint32_t draw_calls = 0; //draw calls issued (groups of instanced drawables count once)
+	};
+	mutable DrawStats draw_stats;
+
+	//working storage for draw(), kept from call to call so its vectors' allocations are reused:
+	// (not copied with the scene)
+	struct DrawRange {
+		GLuint start, count;
+	};
+	struct InstanceGroup {
+		Drawable const *first; //pipeline used to draw the group
+		size_t order; //candidate index of the group's first member (the group is drawn there in scene order)
+		DrawRange range; //(shared by the whole group)
+		GLint base; //index of the group's first texel in transform_data
+		GLsizei count; //number of instances
+	};
+	struct DrawScratch {
+		std::vector< Drawable const * > candidates; //drawables that can be drawn...
+		std::vector< glm::mat4x3 > candidate_world_from_object; //...their transforms...
+		BoxList candidate_bounds; //...and world-space bounds
+		std::vector< uint8_t > visible; //per candidate
+		std::vector< DrawRange > ranges; //per candidate, after LOD selection
+		std::vector< size_t > singles, instanceable; //candidate indices
+		std::vector< InstanceGroup > groups;
+		std::vector< glm::vec4 > transform_data; //uploaded to the shared transform buffer
+		std::vector< size_t > single_block_offsets; //per single
+		std::vector< glm::uvec2 > meshlet_ranges;
+		std::vector< GLsizei > multi_counts;
+		std::vector< GLint > multi_firsts;
+		std::vector< GLvoid const * > multi_offsets;
+	};
+	mutable DrawScratch draw_scratch;
+
+	//(optional) software depth buffer for occlusion culling with Drawable::occluder, refilled by every draw():
+	// (not copied with the scene; e.g., scene.occlusion = std::make_unique< OcclusionBuffer >();)
+	std::unique_ptr< OcclusionBuffer > occlusion;
+
+	//number of RGBA32F texels of per-instance data used by each instance in instanced draws:
+	enum : uint32_t { InstanceStride = 10 };
+
+	//uniform buffer binding point used for the per-drawable 'Object' uniform block:
+	enum : uint32_t { ObjectBlockBinding = 0 };
+
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
 	// throws on file format errors
+	// (this makes a std::string per mesh reference; load_batched() below avoids that, and is what the game and tools use)
 	void load(std::string const &filename,
 		std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable = nullptr
 	);
 
+	//a mesh reference from a scene file:
+	// (mesh_name points into the mapped file, so is only valid during the on_meshes callback)
+	struct MeshRef {
+		Transform *transform;
+		std::string_view mesh_name;
+		//object-space bounds, if the file has them (v2 'bnd0' chunk); otherwise empty (min > max):
+		// (load() copies these to the callback's drawables if it doesn't set bounds itself)
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+	};
+
+	//same as load(), but the file is mapped and read in place, and all mesh references are passed
+	// to 'on_meshes' in one call (so no per-name strings are made):
+	void load_batched(std::string const &filename,
+		std::function< void(Scene &, std::vector< MeshRef > const &) > const &on_meshes
+	);
+
 	//this function is called to read extra chunks from the scene file after the main chunks are read:
 	// this is useful if you, e.g., subclassing scene to represent a game level/area
-	virtual void load_extra(std::istream &from, std::vector< char > const &str0, std::vector< Transform * > const &xfh0) { }
+	// (str0 points into the mapped file, so copy anything you want to keep)
+	virtual void load_extra(std::istream &from, std::string_view str0, std::vector< Transform * > const &xfh0) { }
 
 	//empty scene:
 	Scene() = default;
@@ -145,9 +304,38 @@ struct Scene {
 	//load a scene:
 	Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable);
 
+	//Precomputed bounds from v2 scene files (both empty for v1 files, or if the exporter didn't write them):
+	struct StaticBounds {
+		Transform *transform;
+		glm::vec3 object_min, object_max; //object-space bounds of the mesh (as passed to the load callback in MeshRef)
+		glm::vec3 min, max; //world-space bounds, as exported (not updated if the transform moves)
+	};
+	std::vector< StaticBounds > static_bounds; //one per mesh in the file(s); in the order of static_index's leaves, if there is one
+	struct StaticNode {
+		glm::vec3 min, max;
+		//leaf: static_bounds[first, first+count); inner node (count == 0): children are static_index[first] and [first+1]
+		uint32_t first, count;
+	};
+	std::vector< StaticNode > static_index; //bounding volume hierarchy over static_bounds; root is node 0
+
+	//append transforms of static meshes whose exported world bounds overlap [min,max]:
+	// (uses static_index if present, otherwise checks every entry of static_bounds)
+	void query_static(glm::vec3 const &min, glm::vec3 const &max, std::vector< Transform * > *out) const;
+
+	//look up transforms by name:
+	// (the index is rebuilt by load() and copied along by set(); call index_transforms() after adding or renaming transforms yourself)
+	Transform *find_transform(std::string_view name) const; //first transform named 'name', or nullptr if none
+	std::vector< Transform * > find_transforms_with_prefix(std::string_view prefix) const; //in name order
+	void index_transforms();
+
+	//the name index itself:
+	std::vector< Transform * > transform_name_slots; //open-addressed hash table on name (power-of-two size)
+	std::vector< Transform * > transforms_by_name; //named transforms, sorted by name (for prefix queries)
+
 	//copy a scene (with proper pointer fixup):
 	Scene(Scene const &); //...as a constructor
 	Scene &operator=(Scene const &); //...as scene = scene
 	//... as a set() function that optionally returns the transform->transform mapping:
+	// (the mapping is only built when asked for; copying without it avoids a hash map allocation per transform)
 	void set(Scene const &, std::unordered_map< Transform const *, Transform * > *transform_map = nullptr);
 };
@@ -23,18 +23,15 @@ ShowMeshesMode::ShowMeshesMode(MeshBuffer const &buffer_) : buffer(buffer_) {
 		scene_drawable = &scene.drawables.back();
 
 		scene_drawable->pipeline = show_meshes_program_pipeline;
-		scene_drawable->pipeline.vao = vao;
+		scene_drawable->pipeline.edit().vao = vao;
 		//these will be updated by the mesh selection code:
-		scene_drawable->pipeline.type = GL_TRIANGLES;
-		scene_drawable->pipeline.start = 0;
-		scene_drawable->pipeline.count = 0;
+		scene_drawable->pipeline.edit().type = GL_TRIANGLES;
+		scene_drawable->pipeline.edit().start = 0;
+		scene_drawable->pipeline.edit().count = 0;
 	}
 
 	//select first mesh in buffer:
-	if (!buffer.meshes.empty()) {
-		current_mesh_name = buffer.meshes.begin()->first;
-	}
-	select_prev_mesh();
+	select_mesh(buffer.size() > 0 ? MeshId{ 0 } : MeshId());
 }
 
 ShowMeshesMode::~ShowMeshesMode() {
@@ -155,55 +152,34 @@ void ShowMeshesMode::draw(glm::uvec2 const &drawable_size) {
 }
 
 void ShowMeshesMode::select_prev_mesh() {
-	auto f = buffer.meshes.find(current_mesh_name);
-	if (f != buffer.meshes.end()) {
-		if (f != buffer.meshes.begin()) --f;
-	}
-
-	if (f != buffer.meshes.end()) {
-		current_mesh_name = f->first;
-		scene_drawable->pipeline.type = f->second.type;
-		scene_drawable->pipeline.start = f->second.start;
-		scene_drawable->pipeline.count = f->second.count;
-		current_mesh_min = f->second.min;
-		current_mesh_max = f->second.max;
+	if (current_mesh.valid() && current_mesh.index > 0) {
+		select_mesh(MeshId{ current_mesh.index - 1 });
 	} else {
-		current_mesh_name = "";
-		scene_drawable->pipeline.type = GL_TRIANGLES;
-		scene_drawable->pipeline.start = 0;
-		scene_drawable->pipeline.count = 0;
-		current_mesh_min = glm::vec3(0.0f);
-		current_mesh_max = glm::vec3(0.0f);
+		select_mesh(current_mesh);
 	}
 }
 
 void ShowMeshesMode::select_next_mesh() {
-	auto f = buffer.meshes.find(current_mesh_name);
-	if (f != buffer.meshes.end()) {
-		++f;
-		if (f == buffer.meshes.end()) --f;
-	}
-	if (f == buffer.meshes.end()) {
-		auto temp = buffer.meshes.rbegin();
-		if (temp != buffer.meshes.rend()) {
-			++temp;
-			f = temp.base();
-			assert(f != buffer.meshes.end());
-		}
+	if (current_mesh.valid() && current_mesh.index + 1 < buffer.size()) {
+		select_mesh(MeshId{ current_mesh.index + 1 });
+	} else if (!current_mesh.valid() && buffer.size() > 0) {
+		select_mesh(MeshId{ buffer.size() - 1 });
+	} else {
+		select_mesh(current_mesh);
 	}
+}
 
-	if (f != buffer.meshes.end()) {
-		current_mesh_name = f->first;
-		scene_drawable->pipeline.type = f->second.type;
-		scene_drawable->pipeline.start = f->second.start;
-		scene_drawable->pipeline.count = f->second.count;
-		current_mesh_min = f->second.min;
-		current_mesh_max = f->second.max;
+void ShowMeshesMode::select_mesh(MeshId id) {
+	current_mesh = id;
+	if (current_mesh.valid()) {
+		Mesh const &mesh = buffer[current_mesh];
+		current_mesh_name = std::string(buffer.name(current_mesh));
+		scene_drawable->set_mesh(mesh);
+		current_mesh_min = mesh.min;
+		current_mesh_max = mesh.max;
 	} else {
 		current_mesh_name = "";
-		scene_drawable->pipeline.type = GL_TRIANGLES;
-		scene_drawable->pipeline.start = 0;
-		scene_drawable->pipeline.count = 0;
+		scene_drawable->set_mesh(Mesh()); //(draws nothing)
 		current_mesh_min = glm::vec3(0.0f);
 		current_mesh_max = glm::vec3(0.0f);
 	}
@@ -2,6 +2,7 @@
 
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
+#include "Mesh.hpp"
 
 Scene::Drawable::Pipeline show_meshes_program_pipeline;
 
@@ -88,6 +89,7 @@ ShowMeshesProgram::ShowMeshesProgram() {
 }
 
 ShowMeshesProgram::~ShowMeshesProgram() {
+	MeshBuffer::forget_program(program);
 	glDeleteProgram(program);
 	program = 0;
 }
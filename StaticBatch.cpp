@@ -0,0 +1,420 @@
+#include "StaticBatch.hpp"
+
+#include "gl_errors.hpp"
+#include "gl_state.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+//IEEE half float to float:
+static float half_to_float(uint16_t h) {
+	uint32_t sign = uint32_t(h & 0x8000u) << 16;
+	uint32_t exponent = (h >> 10) & 0x1fu;
+	uint32_t mantissa = h & 0x3ffu;
+	uint32_t bits;
+	if (exponent == 0x1fu) {
+		bits = sign | 0x7f800000u | (mantissa << 13); //inf / nan
+	} else if (exponent != 0) {
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13); //(rebias 15 -> 127)
+	} else {
+		//zero or subnormal -- exact as a float:
+		float f = std::ldexp(float(mantissa), -24);
+		return sign ? -f : f;
+	}
+	float f;
+	std::memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+//read attribute 'attrib' of vertex 'v' (components it doesn't have are 0, except w, which is 1 -- as in OpenGL):
+static glm::vec4 read_attrib(char const *vertices, MeshBuffer::Attrib const &attrib, uint32_t v) {
+	glm::vec4 ret(0.0f, 0.0f, 0.0f, 1.0f);
+	if (attrib.size == 0) return ret;
+	char const *at = vertices + size_t(v) * size_t(attrib.stride) + size_t(attrib.offset);
+
+	if (attrib.type == GL_INT_2_10_10_10_REV) {
+		uint32_t bits;
+		std::memcpy(&bits, at, sizeof(bits));
+		//(sign-extend each field by shifting it to the top and back)
+		int32_t c[4] = {
+			int32_t(bits << 22) >> 22,
+			int32_t(bits << 12) >> 22,
+			int32_t(bits << 2) >> 22,
+			int32_t(bits) >> 30,
+		};
+		for (int i = 0; i < std::min(attrib.size, 4); ++i) {
+			ret[i] = float(c[i]);
+			if (attrib.normalized) ret[i] = std::max(ret[i] / (i < 3 ? 511.0f : 1.0f), -1.0f);
+		}
+		return ret;
+	}
+
+	for (int i = 0; i < std::min(attrib.size, 4); ++i) {
+		if (attrib.type == GL_FLOAT) {
+			std::memcpy(&ret[i], at + 4 * i, 4);
+		} else if (attrib.type == GL_HALF_FLOAT) {
+			uint16_t h;
+			std::memcpy(&h, at + 2 * i, 2);
+			ret[i] = half_to_float(h);
+		} else if (attrib.type == GL_SHORT) {
+			int16_t s;
+			std::memcpy(&s, at + 2 * i, 2);
+			ret[i] = (attrib.normalized ? std::max(float(s) / 32767.0f, -1.0f) : float(s));
+		} else if (attrib.type == GL_UNSIGNED_SHORT) {
+			uint16_t s;
+			std::memcpy(&s, at + 2 * i, 2);
+			ret[i] = (attrib.normalized ? float(s) / 65535.0f : float(s));
+		} else if (attrib.type == GL_BYTE) {
+			int8_t b = int8_t(at[i]);
+			ret[i] = (attrib.normalized ? std::max(float(b) / 127.0f, -1.0f) : float(b));
+		} else if (attrib.type == GL_UNSIGNED_BYTE) {
+			uint8_t b = uint8_t(at[i]);
+			ret[i] = (attrib.normalized ? float(b) / 255.0f : float(b));
+		} else {
+			throw std::runtime_error("StaticBatches can't read attribute type " + std::to_string(attrib.type) + ".");
+		}
+	}
+	return ret;
+}
+
+//write unit normal 'n' into the Normal attribute of 'vertex' (for the types MeshBuffer uses for normals):
+static void write_normal(char *vertex, MeshBuffer::Attrib const &attrib, glm::vec3 n) {
+	char *at = vertex + size_t(attrib.offset);
+	if (attrib.type == GL_FLOAT) {
+		std::memcpy(at, &n, 4 * size_t(std::min(attrib.size, 3)));
+	} else if (attrib.type == GL_INT_2_10_10_10_REV && attrib.normalized) {
+		uint32_t bits;
+		std::memcpy(&bits, at, sizeof(bits));
+		bits &= 0xc0000000u; //(w is kept)
+		for (uint32_t c = 0; c < 3; ++c) {
+			int32_t q = int32_t(std::round(std::clamp(n[c], -1.0f, 1.0f) * 511.0f));
+			bits |= (uint32_t(q) & 0x3ffu) << (10 * c);
+		}
+		std::memcpy(at, &bits, sizeof(bits));
+	} else {
+		throw std::runtime_error("StaticBatches can't write normals of type " + std::to_string(attrib.type) + ".");
+	}
+}
+
+//can drawables with these pipelines be drawn together? (everything but the vertex range, dequantization, and streaming state must match)
+static bool same_batch(Scene::Drawable::Pipeline const &a, Scene::Drawable::Pipeline const &b) {
+	if (a.program != b.program) return false;
+	if (a.cull_back_faces != b.cull_back_faces) return false;
+	if (a.object_block != b.object_block) return false;
+	if (a.CLIP_FROM_OBJECT_mat4 != b.CLIP_FROM_OBJECT_mat4) return false;
+	if (a.LIGHT_FROM_OBJECT_mat4x3 != b.LIGHT_FROM_OBJECT_mat4x3) return false;
+	if (a.LIGHT_FROM_NORMAL_mat3 != b.LIGHT_FROM_NORMAL_mat3) return false;
+	for (uint32_t t = 0; t < Scene::Drawable::Pipeline::TextureCount; ++t) {
+		if (a.textures[t].texture != b.textures[t].texture) return false;
+		if (a.textures[t].target != b.textures[t].target) return false;
+	}
+	return true;
+}
+
+StaticBatches::StaticBatches(Scene const &scene, MeshBuffer const &meshes, GLuint meshes_vao, std::function< bool(Scene::Drawable const &) > const &is_static) {
+	if (meshes.vertex_data.empty() && !meshes.meshes.empty()) {
+		throw std::runtime_error("StaticBatches needs a MeshBuffer constructed with MeshBuffer::CPUData::Keep.");
+	}
+	//batches use the source buffer's vertex layout, so it has to be one they can write positions and normals in:
+	size_t stride = size_t(std::max(meshes.Position.stride, GLsizei(1)));
+	for (MeshBuffer::Attrib const *attrib : { &meshes.Normal, &meshes.Color, &meshes.TexCoord }) {
+		if (attrib->size != 0 && size_t(attrib->stride) != stride) {
+			throw std::runtime_error("StaticBatches needs a MeshBuffer with interleaved attributes.");
+		}
+	}
+	bool quantized = (meshes.Position.type == GL_SHORT && !meshes.Position.normalized && meshes.Position.size >= 3);
+	if (!quantized && !(meshes.Position.type == GL_FLOAT && meshes.Position.size >= 3) && !meshes.meshes.empty()) {
+		throw std::runtime_error("StaticBatches can't write positions of type " + std::to_string(meshes.Position.type) + ".");
+	}
+	uint32_t source_vertices = uint32_t(meshes.vertex_data.size() / stride);
+
+	//source vertex of element 'e' of a drawable:
+	auto source = [&meshes](Scene::Drawable::Pipeline const &pipeline, uint32_t e) {
+		return (pipeline.index_type == GL_NONE ? pipeline.start + e : meshes.element_data[pipeline.start + e]);
+	};
+
+	//drawables the batches can take -- triangles from 'meshes' with nothing drawable-specific about their uniforms:
+	auto can_merge = [&](Scene::Drawable const &drawable) {
+		Scene::Drawable::Pipeline const &pipeline = *drawable.pipeline;
+		if (pipeline.program == 0 || pipeline.count == 0) return false;
+		if (pipeline.type != GL_TRIANGLES) return false;
+		if (pipeline.set_uniforms) return false;
+		if (pipeline.vao != meshes_vao) return false;
+		if (pipeline.index_type == GL_NONE) {
+			return pipeline.start <= source_vertices && pipeline.count <= source_vertices - pipeline.start;
+		} else {
+			return pipeline.index_type == GL_UNSIGNED_INT && pipeline.start <= meshes.element_data.size() && pipeline.count <= meshes.element_data.size() - pipeline.start;
+		}
+	};
+
+	//world-space bounds of the scene file's meshes (if it had them), so they aren't recomputed from the vertices:
+	// (a drawable can use its transform's bounds if its own object-space bounds are inside the exported ones -- i.e., it draws that mesh)
+	std::unordered_map< Scene::Transform const *, uint32_t > exported;
+	exported.reserve(scene.static_bounds.size());
+	for (uint32_t i = 0; i < scene.static_bounds.size(); ++i) {
+		exported.emplace(scene.static_bounds[i].transform, i);
+	}
+	auto exported_bounds = [&](Scene::Drawable const &drawable) {
+		auto f = exported.find(drawable.transform);
+		if (f == exported.end() || !(drawable.min.x <= drawable.max.x)) return uint32_t(scene.static_bounds.size());
+		Scene::StaticBounds const &b = scene.static_bounds[f->second];
+		for (uint32_t c = 0; c < 3; ++c) {
+			if (drawable.min[c] < b.object_min[c] || drawable.max[c] > b.object_max[c]) return uint32_t(scene.static_bounds.size());
+		}
+		return f->second;
+	};
+
+	//group drawables by pipeline (each group becomes one batch), noting the range of source vertices each one uses:
+	// (for indexed meshes, its welded vertex range)
+	struct Piece {
+		Scene::Drawable const *drawable;
+		uint32_t lo, hi;
+		uint32_t bounds; //index in scene.static_bounds, or static_bounds.size() if the drawable has none
+	};
+	std::vector< std::vector< Piece > > groups;
+	uint32_t total_elements = 0;
+	merged.reserve(scene.drawables.size());
+	for (auto const &drawable : scene.drawables) {
+		bool merge = can_merge(drawable) && is_static(drawable);
+		merged.emplace_back(merge);
+		if (!merge) continue;
+		auto group = std::find_if(groups.begin(), groups.end(), [&](std::vector< Piece > const &g) {
+			return same_batch(*g[0].drawable->pipeline, *drawable.pipeline);
+		});
+		if (group == groups.end()) {
+			groups.emplace_back();
+			group = groups.end() - 1;
+		}
+		Scene::Drawable::Pipeline const &pipeline = *drawable.pipeline;
+		Piece piece{ &drawable, source(pipeline, 0), source(pipeline, 0), exported_bounds(drawable) };
+		for (uint32_t e = 1; e < pipeline.count; ++e) {
+			piece.lo = std::min(piece.lo, source(pipeline, e));
+			piece.hi = std::max(piece.hi, source(pipeline, e));
+		}
+		if (piece.hi >= source_vertices) throw std::runtime_error("StaticBatches: drawable uses a vertex past the end of its MeshBuffer.");
+		group->emplace_back(piece);
+		vertex_count += piece.hi - piece.lo + 1;
+		total_elements += pipeline.count - pipeline.count % 3; //(any partial triangle is ignored, as glDraw* would)
+		merged_count += 1;
+	}
+
+	if (groups.empty()) return;
+
+	//static_bounds are in the order of the scene's spatial index leaves, so putting pieces in that order keeps nearby
+	// drawables together in their batch -- and Scene::draw merges the draw ranges of neighboring meshlets that are both visible:
+	// (pieces without exported bounds stay in scene order, after the rest)
+	for (auto &group : groups) {
+		std::stable_sort(group.begin(), group.end(), [](Piece const &a, Piece const &b) { return a.bounds < b.bounds; });
+	}
+
+	//make the buffers, then fill them in one batch at a time (so only one batch is ever held on the CPU):
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, size_t(vertex_count) * stride, nullptr, GL_STATIC_DRAW);
+	glGenBuffers(1, &index_buffer);
+	//(uploaded through the array buffer binding since the element array binding belongs to whatever vao is bound)
+	glBindBuffer(GL_ARRAY_BUFFER, index_buffer);
+	glBufferData(GL_ARRAY_BUFFER, size_t(total_elements) * sizeof(uint32_t), nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	std::vector< glm::vec3 > positions; //world-space positions of the batch's vertices
+	std::vector< char > vertices; //...and the vertices, in the source layout
+	std::vector< uint32_t > elements;
+	uint32_t vertex_base = 0; //first vertex of the batch in 'buffer'
+	uint32_t element_base = 0; //first element of the batch in 'index_buffer'
+	std::vector< size_t > first_meshlet; //(per batch; meshlets' addresses aren't known until they're all added)
+
+	for (auto const &group : groups) {
+		drawables.emplace_back(&world);
+		Scene::Drawable &batch = drawables.back();
+		batch.pipeline = group[0].drawable->pipeline;
+		Scene::Drawable::Pipeline &batch_pipeline = batch.pipeline.edit();
+		batch_pipeline.start = element_base;
+		batch_pipeline.index_type = GL_UNSIGNED_INT;
+		batch_pipeline.resident_vertices = nullptr;
+		batch_pipeline.vertex_end = 0;
+		batch_pipeline.instanced_program = 0; //(every batch is different)
+		batch_pipeline.INSTANCE_BASE_int = -1U;
+		first_meshlet.emplace_back(meshlets.size());
+		positions.clear();
+		elements.clear();
+
+		for (Piece const &piece : group) {
+			Scene::Drawable const *drawable = piece.drawable;
+			Scene::Drawable::Pipeline const &pipeline = *drawable->pipeline;
+			glm::mat4x3 world_from_local = drawable->transform->make_world_from_local();
+			glm::mat3 normal_from_local = glm::inverse(glm::transpose(glm::mat3(world_from_local)));
+			//(mirroring flips triangles' winding, so it gets flipped back to keep front faces in front)
+			bool mirrored = glm::determinant(glm::mat3(world_from_local)) < 0.0f;
+
+			//move the vertices the drawable uses to world space (finding their bounds, unless the scene file had them):
+			uint32_t base = vertex_base + uint32_t(positions.size());
+			bool has_bounds = (piece.bounds < scene.static_bounds.size());
+			glm::vec3 min = (has_bounds ? scene.static_bounds[piece.bounds].min : glm::vec3( std::numeric_limits< float >::infinity()));
+			glm::vec3 max = (has_bounds ? scene.static_bounds[piece.bounds].max : glm::vec3(-std::numeric_limits< float >::infinity()));
+			for (uint32_t v = piece.lo; v <= piece.hi; ++v) {
+				glm::vec3 stored = glm::vec3(read_attrib(meshes.vertex_data.data(), meshes.Position, v));
+				glm::vec3 position = world_from_local * glm::vec4(pipeline.position_offset + pipeline.position_scale * stored, 1.0f);
+				positions.emplace_back(position);
+				if (has_bounds) continue;
+				min = glm::min(min, position);
+				max = glm::max(max, position);
+			}
+
+			//...and its triangles:
+			uint32_t piece_start = element_base + uint32_t(elements.size());
+			uint32_t triangles = pipeline.count / 3;
+			for (uint32_t t = 0; t < triangles; ++t) {
+				uint32_t a = base + source(pipeline, 3*t+0) - piece.lo;
+				uint32_t b = base + source(pipeline, 3*t+1) - piece.lo;
+				uint32_t c = base + source(pipeline, 3*t+2) - piece.lo;
+				if (mirrored) std::swap(b, c);
+				elements.insert(elements.end(), { a, b, c });
+			}
+			batch.min = glm::min(batch.min, min);
+			batch.max = glm::max(batch.max, max);
+			if (triangles == 0) continue;
+
+			//and meshlets to cull it by -- its own meshlets, moved to world space, if it has them:
+			if (drawable->meshlet_count != 0) {
+				//(cones only survive rotation, mirroring, and uniform scale; anything else spreads normals unevenly)
+				glm::vec3 axes[3] = { world_from_local[0], world_from_local[1], world_from_local[2] };
+				float scale = std::max(glm::length(axes[0]), std::max(glm::length(axes[1]), glm::length(axes[2])));
+				bool similar = true;
+				for (uint32_t i = 0; i < 3; ++i) {
+					for (uint32_t j = 0; j < 3; ++j) {
+						float expected = (i == j ? scale * scale : 0.0f);
+						if (std::abs(glm::dot(axes[i], axes[j]) - expected) > 1e-4f * scale * scale) similar = false;
+					}
+				}
+				for (uint32_t m = 0; m < drawable->meshlet_count; ++m) {
+					Meshlet meshlet = drawable->meshlets[m];
+					meshlet.start = piece_start + (meshlet.start - pipeline.start);
+					meshlet.center = world_from_local * glm::vec4(meshlet.center, 1.0f);
+					meshlet.radius *= scale;
+					glm::vec3 axis = normal_from_local * meshlet.cone_axis;
+					if (similar && glm::dot(axis, axis) > 0.0f) {
+						meshlet.cone_axis = glm::normalize(axis);
+					} else {
+						meshlet.cone_cos = 0.0f;
+					}
+					meshlets.emplace_back(meshlet);
+				}
+			} else {
+				//...or one meshlet (with no cone) for the whole drawable:
+				Meshlet meshlet;
+				meshlet.start = piece_start;
+				meshlet.count = element_base + uint32_t(elements.size()) - piece_start;
+				meshlet.center = 0.5f * (min + max);
+				meshlet.radius = 0.5f * glm::length(max - min);
+				meshlet.cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+				meshlet.cone_cos = 0.0f;
+				meshlets.emplace_back(meshlet);
+			}
+		}
+
+		//quantized positions are re-quantized to the batch's (world-space) bounds, which become its dequantization:
+		glm::vec3 position_scale = glm::vec3(1.0f);
+		glm::vec3 position_offset = glm::vec3(0.0f);
+		if (quantized) {
+			position_offset = 0.5f * (batch.min + batch.max);
+			position_scale = glm::max((0.5f / 32767.0f) * (batch.max - batch.min), glm::vec3(std::numeric_limits< float >::min()));
+		}
+		batch_pipeline.position_scale = position_scale;
+		batch_pipeline.position_offset = position_offset;
+
+		//write the vertices -- copies of the source vertices, with world-space positions and normals:
+		vertices.resize(positions.size() * stride);
+		char *out = vertices.data();
+		for (Piece const &piece : group) {
+			glm::mat3 normal_from_local = glm::inverse(glm::transpose(glm::mat3(piece.drawable->transform->make_world_from_local())));
+			for (uint32_t v = piece.lo; v <= piece.hi; ++v, out += stride) {
+				std::memcpy(out, meshes.vertex_data.data() + size_t(v) * stride, stride);
+
+				glm::vec3 const &position = positions[(out - vertices.data()) / stride];
+				if (quantized) {
+					glm::vec3 q = glm::clamp(glm::round((position - position_offset) / position_scale), glm::vec3(-32767.0f), glm::vec3(32767.0f));
+					int16_t stored[3] = { int16_t(q.x), int16_t(q.y), int16_t(q.z) };
+					std::memcpy(out + meshes.Position.offset, stored, sizeof(stored));
+				} else {
+					std::memcpy(out + meshes.Position.offset, &position, sizeof(position));
+				}
+
+				if (meshes.Normal.size != 0) {
+					glm::vec3 normal = normal_from_local * glm::vec3(read_attrib(meshes.vertex_data.data(), meshes.Normal, v));
+					if (glm::dot(normal, normal) > 0.0f) normal = glm::normalize(normal);
+					write_normal(out, meshes.Normal, normal);
+				}
+			}
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferSubData(GL_ARRAY_BUFFER, size_t(vertex_base) * stride, vertices.size(), vertices.data());
+		glBindBuffer(GL_ARRAY_BUFFER, index_buffer);
+		glBufferSubData(GL_ARRAY_BUFFER, size_t(element_base) * sizeof(uint32_t), elements.size() * sizeof(uint32_t), elements.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		batch_pipeline.count = GLuint(elements.size());
+		batch.lod_count = 0;
+		batch.meshlet_count = uint32_t(meshlets.size() - first_meshlet.back());
+		vertex_base += uint32_t(positions.size());
+		element_base += uint32_t(elements.size());
+	}
+	assert(vertex_base == vertex_count && element_base == total_elements);
+	for (size_t b = 0; b < drawables.size(); ++b) {
+		drawables[b].meshlets = meshlets.data() + first_meshlet[b];
+	}
+
+	//one vao per program (with the source buffer's attributes, so programs see the same ones as before):
+	std::vector< std::pair< GLuint, GLuint > > program_vaos;
+	for (auto &batch : drawables) {
+		auto f = std::find_if(program_vaos.begin(), program_vaos.end(), [&](std::pair< GLuint, GLuint > const &pv) {
+			return pv.first == batch.pipeline->program;
+		});
+		if (f == program_vaos.end()) {
+			program_vaos.emplace_back(batch.pipeline->program, MeshBuffer::make_vao(batch.pipeline->program, buffer, index_buffer, meshes.Position, meshes.Normal, meshes.Color, meshes.TexCoord));
+			vaos.emplace_back(program_vaos.back().second);
+			f = program_vaos.end() - 1;
+		}
+		batch.pipeline.edit().vao = f->second;
+	}
+
+	GL_ERRORS();
+}
+
+StaticBatches::~StaticBatches() {
+	if (!vaos.empty()) glDeleteVertexArrays(GLsizei(vaos.size()), vaos.data());
+	if (buffer != 0) glDeleteBuffers(1, &buffer);
+	if (index_buffer != 0) glDeleteBuffers(1, &index_buffer);
+	gl_state_invalidate(); //(one of the vaos may still be bound)
+}
+
+void StaticBatches::apply(Scene *scene_) const {
+	assert(scene_);
+	Scene &scene = *scene_;
+
+	if (scene.drawables.size() != merged.size()) {
+		throw std::runtime_error("StaticBatches::apply: scene has " + std::to_string(scene.drawables.size()) + " drawables, but the batched scene had " + std::to_string(merged.size()) + ".");
+	}
+
+	size_t i = 0;
+	for (auto d = scene.drawables.begin(); d != scene.drawables.end(); ++i) {
+		if (merged[i]) d = scene.drawables.erase(d);
+		else ++d;
+	}
+
+	if (drawables.empty()) return;
+	scene.transforms.emplace_back(); //(identity)
+	Scene::Transform *transform = &scene.transforms.back();
+	for (auto const &batch : drawables) {
+		scene.drawables.emplace_back(batch);
+		scene.drawables.back().transform = transform;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+/*
+ * Static batching: scene drawables that never move can be transformed to world space
+ *  once, at load time, and merged -- per pipeline -- into one big indexed draw each,
+ *  instead of one draw (and one set of transforms) per drawable.
+ *
+ * Each merged drawable (or, if it has them, each of its meshlets) becomes a world-space
+ *  meshlet of its batch, so Scene::draw still skips the pieces that are off-screen and
+ *  draws the rest with one glMultiDrawElements call.
+ *
+ * If the scene was loaded from a v2 file with precomputed bounds (Scene::static_bounds),
+ *  merged drawables use those world-space bounds instead of finding them from their vertices,
+ *  and are laid out in the order of the file's spatial index, so that nearby drawables are
+ *  next to each other in their batch. (so: make the batches before moving anything)
+ *
+ * //at load time (needs the OpenGL context, and 'meshes' constructed with MeshBuffer::CPUData::Keep;
+ * // 'vao' is the vao the scene's drawables use to draw from 'meshes'):
+ * StaticBatches batches(scene, meshes, vao, [](Scene::Drawable const &drawable) {
+ *     return drawable.lod_count == 0; //(for example)
+ * });
+ *
+ * //then, on the scene or a copy of it:
+ * batches.apply(&scene);
+ *
+ */
+
+#include "Scene.hpp"
+#include "Mesh.hpp"
+
+#include <functional>
+#include <vector>
+
+struct StaticBatches {
+	//merge the drawables in 'scene' that draw triangles from 'meshes' (through 'meshes_vao') and for which is_static() returns true:
+	// (drawables with set_uniforms or other vaos are never merged; merged drawables lose their LODs)
+	// throws if 'meshes' wasn't constructed with MeshBuffer::CPUData::Keep
+	StaticBatches(Scene const &scene, MeshBuffer const &meshes, GLuint meshes_vao, std::function< bool(Scene::Drawable const &) > const &is_static);
+	~StaticBatches();
+
+	//(batches' drawables point into this structure, so it can't be copied)
+	StaticBatches(StaticBatches const &) = delete;
+	StaticBatches &operator=(StaticBatches const &) = delete;
+
+	//replace the merged drawables of 'scene' -- the scene passed to the constructor, or a copy of it -- with the batches:
+	// (copies keep drawables in order, which is how merged drawables are found again; throws if the drawable count differs)
+	// (also adds an identity transform for the batches to 'scene', so the result can still be copied)
+	void apply(Scene *scene) const;
+
+	//one drawable per batch (apply() points copies of these at its new transform):
+	std::vector< Scene::Drawable > drawables;
+	//...and whether each drawable of the original scene (in order) was merged into one of them:
+	std::vector< bool > merged;
+
+	//statistics, for checking that batching did something:
+	uint32_t merged_count = 0; //drawables merged
+	uint32_t vertex_count = 0; //vertices in 'buffer'
+
+	//-- internals --
+
+	//(placeholder transform for 'drawables', which are already in world space)
+	Scene::Transform world;
+
+	//merged vertices (in the source MeshBuffer's layout; compact positions are re-quantized to each batch's bounds) and elements:
+	GLuint buffer = 0;
+	GLuint index_buffer = 0;
+	std::vector< GLuint > vaos; //(one per program)
+
+	//drawables' meshlets point into this:
+	std::vector< Meshlet > meshlets;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+/*
+ * A value that copies share until one of them changes it:
+ *
+ *  CopyOnWrite< Pipeline > a = pipeline;
+ *  CopyOnWrite< Pipeline > b = a; //no Pipeline copy -- just a reference count bump
+ *  draw(*b); //read through * or ->
+ *  b.edit().count = 12; //b gets its own Pipeline here (a is unchanged)
+ *
+ * A default-constructed CopyOnWrite reads as a default-constructed T
+ * without allocating anything.
+ */
+
+#include <memory>
+
+template< typename T >
+struct CopyOnWrite {
+	CopyOnWrite() = default;
+	CopyOnWrite(T const &value) : ptr(std::make_shared< T >(value)) { }
+	CopyOnWrite(T &&value) : ptr(std::make_shared< T >(std::move(value))) { }
+
+	T const &operator*() const { return ptr ? *ptr : default_value(); }
+	T const *operator->() const { return &**this; }
+
+	//writable access; clones the value first if any other copy shares it:
+	T &edit() {
+		if (!ptr || ptr.use_count() > 1) ptr = std::make_shared< T >(**this);
+		return *ptr;
+	}
+
+	//do two handles share the same value? (handy for checking that copies didn't clone)
+	bool shares_with(CopyOnWrite const &other) const { return ptr && ptr == other.ptr; }
+
+private:
+	//(the value itself isn't const -- edit() changes it once no other handle shares it -- but readers only ever get const access)
+	std::shared_ptr< T > ptr;
+	static T const &default_value() {
+		static T const value;
+		return value;
+	}
+};
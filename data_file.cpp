@@ -0,0 +1,116 @@
+#include "data_file.hpp"
+
+#include "data_path.hpp"
+#include "read_write_chunk.hpp"
+
+#include <zlib.h>
+
+#include <filesystem>
+#include <stdexcept>
+#include <string_view>
+
+namespace {
+	//the asset archive, mapped once (on first use) and kept for the life of the program:
+	struct Archive {
+		std::string root; //prefix of filenames that may be in the archive (i.e., data_path(""))
+		std::unique_ptr< MappedFile > file;
+		char const *strings = nullptr;
+		ChunkView< PackEntry > entries;
+		char const *contents = nullptr; //start of dat0 data
+		size_t contents_size = 0;
+
+		std::string_view name(PackEntry const &entry) const {
+			return std::string_view(strings + entry.name_begin, entry.name_end - entry.name_begin);
+		}
+
+		//entry for 'name', if there is one:
+		bool find(std::string_view name_, PackEntry *entry_) const {
+			size_t begin = 0, end = entries.size();
+			while (begin < end) {
+				size_t mid = (begin + end) / 2;
+				PackEntry entry = entries[mid];
+				std::string_view at = name(entry);
+				if (at == name_) {
+					*entry_ = entry;
+					return true;
+				} else if (at < name_) {
+					begin = mid + 1;
+				} else {
+					end = mid;
+				}
+			}
+			return false;
+		}
+	};
+
+	Archive const &get_archive() {
+		static Archive archive = [](){
+			Archive ret;
+			ret.root = data_path("");
+			std::string filename = data_path("assets.pak");
+			std::error_code ec;
+			if (!std::filesystem::is_regular_file(filename, ec)) return ret; //no archive; everything is loose
+
+			ret.file = std::make_unique< MappedFile >(filename);
+			char const *at = ret.file->data;
+			char const *end = ret.file->data + ret.file->size;
+
+			auto strings = view_chunk< char >(&at, end, "str0");
+			ret.strings = strings.bytes;
+			ret.entries = view_chunk< PackEntry >(&at, end, "pak0");
+			//(entries have their own checksums, checked as they are read, so opening the archive doesn't touch all of it)
+			auto contents = view_chunk< char >(&at, end, "dat0", ChunkCRC::Skip);
+			ret.contents = contents.bytes;
+			ret.contents_size = contents.size();
+
+			for (size_t i = 0; i < ret.entries.size(); ++i) {
+				PackEntry entry = ret.entries[i];
+				if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+					throw std::runtime_error("asset archive '" + filename + "' has an entry with an out-of-range name");
+				}
+				if (i > 0 && !(ret.name(ret.entries[i-1]) < ret.name(entry))) {
+					throw std::runtime_error("asset archive '" + filename + "' has entries that aren't sorted by name");
+				}
+				if (!(entry.offset <= ret.contents_size && entry.stored_size <= ret.contents_size - entry.offset)) {
+					throw std::runtime_error("asset archive '" + filename + "' has entry '" + std::string(ret.name(entry)) + "' past the end of its contents");
+				}
+				if (entry.method == PackStored ? entry.stored_size != entry.size : entry.method != PackDeflated) {
+					throw std::runtime_error("asset archive '" + filename + "' has entry '" + std::string(ret.name(entry)) + "' with unknown storage");
+				}
+			}
+			return ret;
+		}();
+		return archive;
+	}
+}
+
+DataFile::DataFile(std::string const &filename) {
+	Archive const &archive = get_archive();
+
+	PackEntry entry;
+	if (archive.file
+	 && filename.compare(0, archive.root.size(), archive.root) == 0
+	 && archive.find(std::string_view(filename).substr(archive.root.size()), &entry)) {
+		archived = true;
+		size = entry.size;
+		char const *stored = archive.contents + entry.offset;
+		if (chunk_crc(stored, entry.stored_size) != entry.crc) {
+			throw std::runtime_error("'" + filename + "' failed its CRC check in the asset archive (archive is corrupt)");
+		}
+		if (entry.method == PackStored) {
+			data = (size ? stored : nullptr);
+		} else {
+			inflated.resize(size);
+			uLongf got = uLongf(size);
+			if (uncompress(reinterpret_cast< Bytef * >(inflated.data()), &got, reinterpret_cast< Bytef const * >(stored), uLong(entry.stored_size)) != Z_OK || got != size) {
+				throw std::runtime_error("Failed to inflate '" + filename + "' from the asset archive.");
+			}
+			data = (size ? inflated.data() : nullptr);
+		}
+		return;
+	}
+
+	mapped = std::make_unique< MappedFile >(filename);
+	data = mapped->data;
+	size = mapped->size;
+}
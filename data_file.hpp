@@ -0,0 +1,89 @@
+#pragma once
+
+/*
+ * DataFile gives read-only access to the contents of a game data file, wherever
+ * that file is actually stored:
+ *
+ *  DataFile file(data_path("level.scene"));
+ *  char const *begin = file.data;
+ *  char const *end = file.data + file.size;
+ *
+ * If the asset archive next to the executable (data_path("assets.pak"), built
+ *  from dist/ by scenes/pack-assets) has an entry for the file, the contents come
+ *  from there -- a view straight into the (once-mapped) archive for stored entries,
+ *  or a freshly inflated buffer for compressed ones. Otherwise the file is mapped
+ *  from disk, as with MappedFile.
+ *
+ * Only paths under data_path("") are looked up in the archive.
+ * NOTE: the archive shadows loose files, so re-run pack-assets (or delete
+ *  assets.pak) after re-exporting anything it contains.
+ *
+ * Pointers into the file are only valid for as long as the DataFile exists.
+ */
+
+#include "mapped_file.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+struct DataFile {
+	//find + read 'filename' (throws std::runtime_error on failure):
+	explicit DataFile(std::string const &filename);
+
+	//(contents may point into a buffer owned by the DataFile, so no copies)
+	DataFile(DataFile const &) = delete;
+	DataFile &operator=(DataFile const &) = delete;
+
+	char const *data = nullptr; //(nullptr for empty files)
+	size_t size = 0;
+
+	bool archived = false; //true if the contents came from the asset archive
+
+private:
+	std::unique_ptr< MappedFile > mapped; //loose files
+	std::vector< char > inflated; //compressed archive entries
+};
+
+//asset archive ('assets.pak') layout, shared with scenes/pack-assets:
+// str0 chunk: entry names (relative to the archive's directory, '/'-separated)
+// pak0 chunk: entries (PackEntry), sorted by name
+// dat0 chunk: entry contents, at PackEntry::offset from the start of the chunk's data
+//  (offsets are multiples of ChunkAlignment, so chunks inside stored entries stay aligned)
+struct PackEntry {
+	uint32_t name_begin, name_end;
+	uint32_t offset; //into dat0 data
+	uint32_t stored_size; //bytes in dat0
+	uint32_t size; //bytes once decompressed
+	uint32_t method; //PackStored or PackDeflated
+	uint32_t crc; //chunk_crc() of the stored bytes (checked when the entry is read)
+};
+static_assert(sizeof(PackEntry) == 28, "PackEntry is packed.");
+constexpr uint32_t PackStored = 0;
+constexpr uint32_t PackDeflated = 1; //zlib stream (compress2() / uncompress())
+
+//streambuf over a range of memory (e.g., a DataFile's contents), so code written against
+// std::istream -- like read_chunk() -- can read without a copy:
+struct MemoryStreamBuf : std::streambuf {
+	MemoryStreamBuf(char const *begin, char const *end) {
+		char *b = const_cast< char * >(begin); //(never written through; istream only reads)
+		setg(b, b, b + (end - begin));
+	}
+
+protected:
+	//(needed for seekg/tellg; the default streambuf can't seek)
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+		if (!(which & std::ios_base::in)) return pos_type(off_type(-1));
+		char *base = (dir == std::ios_base::beg ? eback() : dir == std::ios_base::cur ? gptr() : egptr());
+		if (off < eback() - base || off > egptr() - base) return pos_type(off_type(-1));
+		setg(eback(), base + off, egptr());
+		return pos_type(off_type(gptr() - eback()));
+	}
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+		return seekoff(off_type(pos), std::ios_base::beg, which);
+	}
+};
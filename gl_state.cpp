@@ -0,0 +1,115 @@
+#include "gl_state.hpp"
+
+#include <array>
+#include <cassert>
+
+namespace {
+	//not-yet-known binding (no valid OpenGL name is this large):
+	constexpr GLuint Unknown = ~GLuint(0);
+
+	//texture targets whose bindings are tracked:
+	constexpr std::array< GLenum, 4 > TrackedTargets = {
+		GL_TEXTURE_2D,
+		GL_TEXTURE_BUFFER,
+		GL_TEXTURE_CUBE_MAP,
+		GL_TEXTURE_3D,
+	};
+	constexpr uint32_t TrackedUnits = 16; //(OpenGL 3.3 guarantees at least 16 fragment texture units)
+
+	struct State {
+		GLuint program = 0;
+		GLuint vao = 0;
+		uint32_t active_unit = 0;
+		std::array< std::array< GLuint, TrackedTargets.size() >, TrackedUnits > textures{};
+	};
+
+	State &get_state() {
+		static State state;
+		return state;
+	}
+
+	GLStateStats current_frame;
+	GLStateStats last_frame;
+
+	//index of target in TrackedTargets, or TrackedTargets.size() if it isn't tracked:
+	uint32_t target_index(GLenum target) {
+		for (uint32_t i = 0; i < TrackedTargets.size(); ++i) {
+			if (TrackedTargets[i] == target) return i;
+		}
+		return uint32_t(TrackedTargets.size());
+	}
+
+	void set_active_unit(uint32_t unit) {
+		State &state = get_state();
+		if (state.active_unit == unit) {
+			current_frame.skipped += 1;
+			return;
+		}
+		glActiveTexture(GL_TEXTURE0 + unit);
+		state.active_unit = unit;
+		current_frame.issued += 1;
+	}
+}
+
+void gl_use_program(GLuint program) {
+	State &state = get_state();
+	if (state.program == program) {
+		current_frame.skipped += 1;
+		return;
+	}
+	glUseProgram(program);
+	state.program = program;
+	current_frame.issued += 1;
+}
+
+void gl_bind_vertex_array(GLuint vao) {
+	State &state = get_state();
+	if (state.vao == vao) {
+		current_frame.skipped += 1;
+		return;
+	}
+	glBindVertexArray(vao);
+	state.vao = vao;
+	current_frame.issued += 1;
+}
+
+void gl_bind_texture(uint32_t unit, GLenum target, GLuint texture) {
+	State &state = get_state();
+	uint32_t index = target_index(target);
+	if (unit >= TrackedUnits || index >= TrackedTargets.size()) {
+		//not tracked; always pass through:
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(target, texture);
+		state.active_unit = unit;
+		current_frame.issued += 2;
+		return;
+	}
+
+	if (state.textures[unit][index] == texture) {
+		current_frame.skipped += 1;
+		return;
+	}
+	set_active_unit(unit);
+	glBindTexture(target, texture);
+	state.textures[unit][index] = texture;
+	current_frame.issued += 1;
+}
+
+void gl_state_invalidate() {
+	State &state = get_state();
+	state.program = Unknown;
+	state.vao = Unknown;
+	state.active_unit = Unknown;
+	for (auto &unit : state.textures) {
+		unit.fill(Unknown);
+	}
+}
+
+void gl_state_end_frame() {
+	last_frame = current_frame;
+	current_frame = GLStateStats();
+}
+
+GLStateStats const &gl_state_frame_stats() {
+	return last_frame;
+}
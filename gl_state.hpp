@@ -0,0 +1,34 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <cstdint>
+
+//A thin cache of OpenGL binding state (current program, vertex array, and per-unit texture bindings)
+// used to skip calls that wouldn't change anything.
+//
+//Since the cache only knows about changes made through these functions, rendering code should use
+// them *instead of* glUseProgram / glBindVertexArray / glActiveTexture + glBindTexture.
+// (if you must call those directly, call gl_state_invalidate() afterward)
+
+void gl_use_program(GLuint program);
+void gl_bind_vertex_array(GLuint vao);
+//binds texture to target on texture unit GL_TEXTURE0 + unit:
+// (which unit is active afterward is up to the cache -- it skips glActiveTexture when nothing needs binding)
+void gl_bind_texture(uint32_t unit, GLenum target, GLuint texture);
+
+//forget all cached state (next call to each function will always reach OpenGL):
+// (also call this if you delete a program / vertex array / texture that might still be bound)
+void gl_state_invalidate();
+
+//counts of calls made through the cache:
+struct GLStateStats {
+	uint32_t issued = 0; //calls that reached OpenGL
+	uint32_t skipped = 0; //calls skipped because the state was already set
+};
+
+//call once per frame (after drawing) to finish counting this frame's calls:
+void gl_state_end_frame();
+
+//stats for the most recently finished frame:
+GLStateStats const &gl_state_frame_stats();
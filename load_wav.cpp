@@ -1,4 +1,5 @@
 #include "load_wav.hpp"
+#include "data_file.hpp"
 
 #include <SDL3/SDL.h>
 
@@ -16,7 +17,10 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 	Uint8 *audio_buf = nullptr;
 	Uint32 audio_len = 0;
 
-	if (!SDL_LoadWAV(filename.c_str(), &audio_spec, &audio_buf, &audio_len)) {
+	//(from the asset archive, if it has the file)
+	DataFile file(filename);
+	SDL_IOStream *io = SDL_IOFromConstMem(file.data, file.size);
+	if (!io || !SDL_LoadWAV_IO(io, true, &audio_spec, &audio_buf, &audio_len)) {
 		throw std::runtime_error("Failed to load WAV file '" + filename + "'; SDL says \"" + std::string(SDL_GetError()) + "\"");
 	}
 	SDL_AudioSpec out_spec{ .format=SDL_AUDIO_F32, .channels=1, .freq=AUDIO_RATE };
@@ -13,6 +13,12 @@
 //GL.hpp will include a non-namespace-polluting set of opengl prototypes:
 #include "GL.hpp"
 
+//for per-frame GL state cache stats:
+#include "gl_state.hpp"
+
+//for uploading streamed mesh data a bit at a time:
+#include "Mesh.hpp"
+
 //for screenshots:
 #include "load_save_png.hpp"
 
@@ -188,10 +194,17 @@ int main(int argc, char **argv) {
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
-		
+
+			//first, upload a bit more of any streamed mesh data:
+			// (about 4MB per frame keeps frame times steady on most drivers)
+			stream_mesh_buffers(size_t(4) << 20);
+
 			Mode::current->draw(drawable_size);
 		}
 
+		//finish counting redundant GL calls skipped this frame:
+		gl_state_end_frame();
+
 		//Wait until the recently-drawn frame is shown before doing it all again:
 		SDL_GL_SwapWindow(Mode::window);
 	}
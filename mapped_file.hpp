@@ -0,0 +1,34 @@
+#pragma once
+
+/*
+ * MappedFile gives read-only access to the contents of a whole file by
+ * mapping it into memory (no copy into a buffer, no per-read syscalls):
+ *
+ *  MappedFile file(data_path("level.scene"));
+ *  char const *begin = file.data;
+ *  char const *end = file.data + file.size;
+ *
+ * Pointers into the file are only valid for as long as the MappedFile exists.
+ */
+
+#include <cstddef>
+#include <string>
+
+struct MappedFile {
+	//map 'filename' (throws std::runtime_error on failure):
+	explicit MappedFile(std::string const &filename);
+	~MappedFile();
+
+	//mappings can't be shared:
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	char const *data = nullptr; //(nullptr for empty files)
+	size_t size = 0;
+
+private:
+	#if defined(_WIN32)
+	void *file_handle = nullptr;
+	void *mapping_handle = nullptr;
+	#endif
+};
@@ -0,0 +1,299 @@
+#include "mesh_simplify.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <map>
+#include <queue>
+#include <stdexcept>
+#include <tuple>
+
+namespace {
+	//symmetric 4x4 quadric (sum of squared distances to a set of weighted planes), stored as its 10 unique entries:
+	// (doubles, since errors of nearly-coplanar collapses are differences of large sums)
+	struct Quadric {
+		double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+		double b2 = 0.0, bc = 0.0, bd = 0.0;
+		double c2 = 0.0, cd = 0.0;
+		double d2 = 0.0;
+		double weight = 0.0; //total weight of the planes (so error / weight is a mean squared distance)
+
+		//quadric for the plane dot(n, x) + d = 0 (n unit length), scaled by 'weight':
+		static Quadric plane(glm::dvec3 const &n, double d, double weight) {
+			Quadric q;
+			q.weight = weight;
+			q.a2 = weight * n.x * n.x; q.ab = weight * n.x * n.y; q.ac = weight * n.x * n.z; q.ad = weight * n.x * d;
+			q.b2 = weight * n.y * n.y; q.bc = weight * n.y * n.z; q.bd = weight * n.y * d;
+			q.c2 = weight * n.z * n.z; q.cd = weight * n.z * d;
+			q.d2 = weight * d * d;
+			return q;
+		}
+
+		Quadric &operator+=(Quadric const &o) {
+			a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad;
+			b2 += o.b2; bc += o.bc; bd += o.bd;
+			c2 += o.c2; cd += o.cd;
+			d2 += o.d2;
+			weight += o.weight;
+			return *this;
+		}
+
+		//(weighted) sum of squared distances from p to the planes:
+		double error(glm::dvec3 const &p) const {
+			return a2 * p.x * p.x + 2.0 * ab * p.x * p.y + 2.0 * ac * p.x * p.z + 2.0 * ad * p.x
+			     + b2 * p.y * p.y + 2.0 * bc * p.y * p.z + 2.0 * bd * p.y
+			     + c2 * p.z * p.z + 2.0 * cd * p.z
+			     + d2;
+		}
+	};
+
+	//open boundaries and attribute seams get constraint planes this much stronger than surface planes:
+	constexpr double BoundaryWeight = 10.0;
+
+	//a candidate collapse of point 'from' onto point 'to':
+	struct Collapse {
+		double cost;
+		double distance; //(root-mean-square distance from the combined planes; compared against max_errors)
+		uint32_t from, to;
+		uint32_t from_version, to_version; //(stale if either point has changed since)
+		bool operator<(Collapse const &o) const { return cost > o.cost; } //(priority_queue is a max-heap)
+	};
+}
+
+void simplify_mesh(
+	std::vector< glm::vec3 > const &positions,
+	std::vector< glm::vec3 > const &normals,
+	std::vector< uint32_t > const &indices,
+	std::vector< uint32_t > const &targets,
+	std::vector< float > const &max_errors,
+	std::vector< std::vector< uint32_t > > *lods_) {
+
+	assert(lods_);
+	auto &lods = *lods_;
+	if (normals.size() != positions.size()) throw std::runtime_error("simplify_mesh: positions and normals have different lengths.");
+	if (indices.size() % 3 != 0) throw std::runtime_error("simplify_mesh: index count is not a multiple of three.");
+	for (uint32_t i : indices) {
+		if (i >= positions.size()) throw std::runtime_error("simplify_mesh: index out of range.");
+	}
+	if (max_errors.size() != targets.size()) throw std::runtime_error("simplify_mesh: targets and max_errors have different lengths.");
+	for (size_t t = 1; t < targets.size(); ++t) {
+		if (targets[t] > targets[t-1]) throw std::runtime_error("simplify_mesh: targets must be decreasing.");
+		if (max_errors[t] < max_errors[t-1]) throw std::runtime_error("simplify_mesh: max_errors must be increasing.");
+	}
+
+	//group vertices into points by position:
+	std::vector< uint32_t > point_of(positions.size());
+	std::vector< glm::dvec3 > point_position;
+	std::vector< std::vector< uint32_t > > point_vertices;
+	{
+		std::map< std::tuple< float, float, float >, uint32_t > points;
+		for (uint32_t v = 0; v < uint32_t(positions.size()); ++v) {
+			auto f = points.emplace(std::make_tuple(positions[v].x, positions[v].y, positions[v].z), uint32_t(point_position.size()));
+			if (f.second) {
+				point_position.emplace_back(positions[v]);
+				point_vertices.emplace_back();
+			}
+			point_of[v] = f.first->second;
+			point_vertices[point_of[v]].emplace_back(v);
+		}
+	}
+	uint32_t point_count = uint32_t(point_position.size());
+
+	//triangles (as vertices); ones that are already degenerate (two corners at one point) are dropped:
+	std::vector< std::array< uint32_t, 3 > > triangles;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		std::array< uint32_t, 3 > tri{ indices[i+0], indices[i+1], indices[i+2] };
+		uint32_t a = point_of[tri[0]], b = point_of[tri[1]], c = point_of[tri[2]];
+		if (a == b || b == c || c == a) continue;
+		triangles.emplace_back(tri);
+	}
+	std::vector< bool > alive(triangles.size(), true);
+	uint32_t alive_count = uint32_t(triangles.size());
+
+	//triangles touching each point (may include dead triangles; filtered on use):
+	std::vector< std::vector< uint32_t > > point_triangles(point_count);
+	for (uint32_t t = 0; t < uint32_t(triangles.size()); ++t) {
+		for (uint32_t v : triangles[t]) point_triangles[point_of[v]].emplace_back(t);
+	}
+
+	auto triangle_normal = [&](std::array< uint32_t, 3 > const &tri) {
+		glm::dvec3 const &a = point_position[point_of[tri[0]]];
+		glm::dvec3 const &b = point_position[point_of[tri[1]]];
+		glm::dvec3 const &c = point_position[point_of[tri[2]]];
+		return glm::cross(b - a, c - a); //(length is twice the area)
+	};
+
+	//quadrics:
+	std::vector< Quadric > quadrics(point_count);
+	{
+		//surface planes, weighted by triangle area:
+		for (auto const &tri : triangles) {
+			glm::dvec3 n = triangle_normal(tri);
+			double area2 = glm::length(n);
+			if (area2 == 0.0) continue;
+			n /= area2;
+			Quadric q = Quadric::plane(n, -glm::dot(n, point_position[point_of[tri[0]]]), 0.5 * area2);
+			for (uint32_t v : tri) quadrics[point_of[v]] += q;
+		}
+
+		//edges used by only one triangle (as points: open boundary; as vertices: attribute seam)
+		// get a plane through the edge, perpendicular to the triangle, so they resist moving sideways:
+		std::map< std::pair< uint32_t, uint32_t >, uint32_t > point_edges, vertex_edges;
+		auto edge = [](uint32_t a, uint32_t b) { return std::make_pair(std::min(a, b), std::max(a, b)); };
+		for (auto const &tri : triangles) {
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t a = tri[c], b = tri[(c + 1) % 3];
+				point_edges[edge(point_of[a], point_of[b])] += 1;
+				vertex_edges[edge(a, b)] += 1;
+			}
+		}
+		for (auto const &tri : triangles) {
+			glm::dvec3 n = triangle_normal(tri);
+			if (n == glm::dvec3(0.0)) continue;
+			n = glm::normalize(n);
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t a = tri[c], b = tri[(c + 1) % 3];
+				if (point_edges[edge(point_of[a], point_of[b])] != 1 && vertex_edges[edge(a, b)] != 1) continue;
+				glm::dvec3 pa = point_position[point_of[a]];
+				glm::dvec3 pb = point_position[point_of[b]];
+				double length = glm::length(pb - pa);
+				if (length == 0.0) continue;
+				glm::dvec3 side = glm::normalize(glm::cross(pb - pa, n));
+				Quadric q = Quadric::plane(side, -glm::dot(side, pa), BoundaryWeight * length * length);
+				quadrics[point_of[a]] += q;
+				quadrics[point_of[b]] += q;
+			}
+		}
+	}
+
+	//candidate collapses, cheapest first:
+	std::vector< uint32_t > version(point_count, 0);
+	std::vector< bool > point_alive(point_count, true);
+	std::priority_queue< Collapse > queue;
+	auto push = [&](uint32_t from, uint32_t to) {
+		Quadric q = quadrics[from];
+		q += quadrics[to];
+		double cost = std::max(0.0, q.error(point_position[to]));
+		double distance = (q.weight > 0.0 ? std::sqrt(cost / q.weight) : 0.0);
+		queue.push(Collapse{ cost, distance, from, to, version[from], version[to] });
+	};
+	auto neighbors = [&](uint32_t p) {
+		std::vector< uint32_t > ret;
+		for (uint32_t t : point_triangles[p]) {
+			if (!alive[t]) continue;
+			for (uint32_t v : triangles[t]) {
+				if (point_of[v] != p) ret.emplace_back(point_of[v]);
+			}
+		}
+		std::sort(ret.begin(), ret.end());
+		ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+		return ret;
+	};
+	for (uint32_t p = 0; p < point_count; ++p) {
+		for (uint32_t n : neighbors(p)) push(p, n);
+	}
+
+	lods.assign(targets.size(), std::vector< uint32_t >());
+	size_t next_target = 0;
+	//store the current triangles as the next level:
+	auto record = [&]() {
+		auto &lod = lods[next_target];
+		lod.reserve(3 * alive_count);
+		for (uint32_t t = 0; t < uint32_t(triangles.size()); ++t) {
+			if (alive[t]) lod.insert(lod.end(), triangles[t].begin(), triangles[t].end());
+		}
+		next_target += 1;
+	};
+	while (next_target < targets.size() && alive_count <= targets[next_target]) record();
+
+	std::vector< uint32_t > around; //live triangles around the point being collapsed
+	while (next_target < targets.size() && !queue.empty()) {
+		Collapse collapse = queue.top();
+		queue.pop();
+		uint32_t from = collapse.from, to = collapse.to;
+		if (!point_alive[from] || !point_alive[to]) continue;
+		if (collapse.from_version != version[from] || collapse.to_version != version[to]) continue;
+
+		around.clear();
+		for (uint32_t t : point_triangles[from]) {
+			if (alive[t]) around.emplace_back(t);
+		}
+		std::sort(around.begin(), around.end());
+		around.erase(std::unique(around.begin(), around.end()), around.end());
+
+		//don't collapse if it would flip (or flatten) a triangle that survives it:
+		bool flips = false;
+		for (uint32_t t : around) {
+			auto const &tri = triangles[t];
+			if (point_of[tri[0]] == to || point_of[tri[1]] == to || point_of[tri[2]] == to) continue; //(removed by collapse)
+			glm::dvec3 before = triangle_normal(tri);
+			glm::dvec3 p[3];
+			for (uint32_t c = 0; c < 3; ++c) {
+				p[c] = (point_of[tri[c]] == from ? point_position[to] : point_position[point_of[tri[c]]]);
+			}
+			glm::dvec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+			if (glm::dot(before, after) <= 0.0) {
+				flips = true;
+				break;
+			}
+		}
+		if (flips) continue; //(will be re-queued if the neighborhood changes)
+
+		//levels that can't afford this much error stop here:
+		// (collapses come out roughly in order of error, so nothing later would be cheaper)
+		while (next_target < targets.size() && collapse.distance > max_errors[next_target]) record();
+		if (next_target == targets.size()) break;
+
+		//triangles along the collapsed edge disappear; they also tell which vertex at 'to' each vertex at 'from' becomes:
+		std::map< uint32_t, uint32_t > becomes;
+		for (uint32_t t : around) {
+			auto const &tri = triangles[t];
+			for (uint32_t c = 0; c < 3; ++c) {
+				if (point_of[tri[c]] != from) continue;
+				for (uint32_t o = 0; o < 3; ++o) {
+					if (point_of[tri[o]] == to) becomes.emplace(tri[c], tri[o]);
+				}
+			}
+		}
+		for (uint32_t t : around) {
+			auto &tri = triangles[t];
+			if (point_of[tri[0]] == to || point_of[tri[1]] == to || point_of[tri[2]] == to) {
+				alive[t] = false;
+				alive_count -= 1;
+				continue;
+			}
+			for (uint32_t c = 0; c < 3; ++c) {
+				if (point_of[tri[c]] != from) continue;
+				auto f = becomes.find(tri[c]);
+				if (f == becomes.end()) {
+					//no shared edge says; use the vertex at 'to' with the most similar normal:
+					uint32_t best = point_vertices[to][0];
+					for (uint32_t v : point_vertices[to]) {
+						if (glm::dot(normals[v], normals[tri[c]]) > glm::dot(normals[best], normals[tri[c]])) best = v;
+					}
+					f = becomes.emplace(tri[c], best).first;
+				}
+				tri[c] = f->second;
+			}
+			point_triangles[to].emplace_back(t);
+		}
+
+		point_alive[from] = false;
+		point_triangles[from].clear();
+		quadrics[to] += quadrics[from];
+
+		//collapses involving 'to' now cost more; replace them:
+		// (collapses involving 'from' are skipped when popped, since it is no longer alive)
+		version[to] += 1;
+		for (uint32_t n : neighbors(to)) {
+			push(to, n);
+			push(n, to);
+		}
+
+		while (next_target < targets.size() && alive_count <= targets[next_target]) record();
+	}
+
+	//anything not reached is as simple as it gets:
+	while (next_target < targets.size()) record();
+}
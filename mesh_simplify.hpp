@@ -0,0 +1,37 @@
+#pragma once
+
+/*
+ * Triangle mesh simplification with quadric error metrics
+ *  (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics", 1997).
+ *
+ * Edges are removed by "half-edge" collapses -- one endpoint moves onto the
+ *  other -- so simplified meshes only ever use the input vertices, and can
+ *  share the input's vertex buffer (only the triangle list changes).
+ *
+ * Vertices with identical positions (e.g., either side of a normal or uv seam)
+ *  are treated as a single point when deciding what to collapse, so seams
+ *  don't tear open; open boundaries and seams are weighted to stay put.
+ *
+ * Used by optimize-meshes to build level-of-detail chains.
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+//Simplify the triangle list 'indices' (into 'positions' and 'normals', which must be the same length)
+// until it has at most targets[i] triangles, or until the next collapse would move the surface by more
+// than about max_errors[i] (object-space distance), for each i; results go in (*lods)[i].
+//
+//'targets' must be decreasing and 'max_errors' increasing; since each level continues the same collapse
+// sequence, coarser levels are always simplifications of finer ones. Levels stopped by error (or by
+// collapses that would flip triangles) have more triangles than their targets.
+void simplify_mesh(
+	std::vector< glm::vec3 > const &positions,
+	std::vector< glm::vec3 > const &normals,
+	std::vector< uint32_t > const &indices,
+	std::vector< uint32_t > const &targets,
+	std::vector< float > const &max_errors,
+	std::vector< std::vector< uint32_t > > *lods
+);
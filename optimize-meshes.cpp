@@ -0,0 +1,837 @@
+//optimize-meshes: reorders the triangles (and vertices) of every mesh in a .pnct file
+// for better post-transform vertex cache use and less overdraw, then rewrites the file.
+//
+//Triangle order is produced with Tipsify (Sander, Nehab, and Barczak, "Fast Triangle Reordering
+// for Vertex Locality and Reduced Overdraw", 2007); the clusters it produces are then sorted so that
+// outward-facing clusters (likely occluders) draw first. Vertices are renumbered in order of first use.
+//
+//Files with an 'idx0' index (triangle soup) are welded and written with 'idx1' + 'ele0' (see Mesh.cpp).
+//Per-mesh bounds are (re)computed and written as 'bnd0', so MeshBuffer doesn't need to scan vertices.
+//
+//With '--lods N', each mesh also gets up to N simplified versions (see mesh_simplify.hpp) named
+// 'mesh.LOD1' ... 'mesh.LODN', each with about half the triangles of the one before; these share
+// the mesh's vertices (they are just shorter element ranges) and are picked at runtime by Scene::draw.
+// LODs already in the file are regenerated with '--lods', and otherwise kept (renumbered to match their mesh).
+//
+//With '--meshlets N', each mesh's triangles are also grouped into meshlets of at most N triangles (connected,
+// compact, roughly flat patches), written with their bounding spheres and normal cones as 'mlt0' (see Frustum.hpp),
+// so Scene::draw can skip the ones that are off-screen or facing away. (LODs don't get meshlets.)
+//
+//Reports ACMR (cache misses per triangle) and ATVR (cache misses per vertex) before and after,
+// for a FIFO cache of the given size.
+
+#include "read_write_chunk.hpp"
+#include "mesh_simplify.hpp"
+#include "Frustum.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+//a chunk of the file, kept as raw bytes:
+struct Chunk {
+	std::string magic;
+	std::vector< char > data;
+};
+
+static std::vector< Chunk > read_chunks(std::string const &filename) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) throw std::runtime_error("Failed to open '" + filename + "'.");
+
+	std::vector< Chunk > chunks;
+	while (file.peek() != EOF) {
+		char magic[4];
+		if (!file.read(magic, 4)) throw std::runtime_error("Failed to read chunk header.");
+		file.seekg(-4, std::ios::cur);
+		chunks.emplace_back();
+		chunks.back().magic = std::string(magic, 4);
+		read_chunk(file, chunks.back().magic, &chunks.back().data);
+	}
+	return chunks;
+}
+
+//copy a chunk's bytes out as an array of T:
+template< typename T >
+static std::vector< T > chunk_as(Chunk const &chunk) {
+	if (chunk.data.size() % sizeof(T) != 0) throw std::runtime_error("Chunk '" + chunk.magic + "' has a size that is not a multiple of its element size.");
+	std::vector< T > ret(chunk.data.size() / sizeof(T));
+	if (!ret.empty()) std::memcpy(reinterpret_cast< char * >(ret.data()), chunk.data.data(), chunk.data.size());
+	return ret;
+}
+
+template< typename T >
+static std::vector< char > as_bytes(std::vector< T > const &from) {
+	std::vector< char > ret(from.size() * sizeof(T));
+	if (!ret.empty()) std::memcpy(ret.data(), reinterpret_cast< char const * >(from.data()), ret.size());
+	return ret;
+}
+
+//-------------------------------------------------
+//Cache simulation:
+
+struct CacheStats {
+	uint32_t misses = 0;
+	uint32_t triangles = 0;
+	uint32_t vertices = 0; //distinct vertices referenced
+	float acmr() const { return triangles ? float(misses) / float(triangles) : 0.0f; }
+	float atvr() const { return vertices ? float(misses) / float(vertices) : 0.0f; }
+};
+
+//simulate a FIFO post-transform cache of 'cache_size' entries over (local) 'indices':
+static CacheStats simulate_fifo(std::vector< uint32_t > const &indices, uint32_t vertex_count, uint32_t cache_size) {
+	CacheStats stats;
+	stats.triangles = uint32_t(indices.size() / 3);
+
+	//vertex is in the cache if it was inserted fewer than cache_size insertions ago:
+	std::vector< uint32_t > inserted_at(vertex_count, -1U);
+	uint32_t insertions = 0;
+	for (uint32_t v : indices) {
+		if (inserted_at[v] == -1U) stats.vertices += 1;
+		if (inserted_at[v] == -1U || insertions - inserted_at[v] >= cache_size) {
+			inserted_at[v] = insertions;
+			insertions += 1;
+			stats.misses += 1;
+		}
+	}
+	return stats;
+}
+
+//-------------------------------------------------
+//Tipsify:
+
+//returns triangles (as indices into the original triangle list) in optimized order,
+// and the position in that order where each cluster starts:
+static void tipsify(std::vector< uint32_t > const &indices, uint32_t vertex_count, uint32_t cache_size, std::vector< uint32_t > *order_, std::vector< uint32_t > *cluster_starts_) {
+	assert(order_);
+	assert(cluster_starts_);
+	auto &order = *order_;
+	auto &cluster_starts = *cluster_starts_;
+
+	uint32_t triangle_count = uint32_t(indices.size() / 3);
+
+	//vertex -> triangle adjacency (compressed):
+	std::vector< uint32_t > live(vertex_count, 0); //count of not-yet-emitted triangles using each vertex
+	for (uint32_t i : indices) live[i] += 1;
+	std::vector< uint32_t > adjacency_begin(vertex_count + 1, 0);
+	for (uint32_t v = 0; v < vertex_count; ++v) adjacency_begin[v+1] = adjacency_begin[v] + live[v];
+	std::vector< uint32_t > adjacency(indices.size());
+	{
+		std::vector< uint32_t > fill(adjacency_begin.begin(), adjacency_begin.end() - 1);
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			for (uint32_t c = 0; c < 3; ++c) {
+				adjacency[fill[indices[3*t+c]]++] = t;
+			}
+		}
+	}
+
+	std::vector< uint32_t > cache_time(vertex_count, 0);
+	std::vector< bool > emitted(triangle_count, false);
+	std::vector< uint32_t > dead_end; //recently-used vertices, for restarting when the fan runs dry
+	uint32_t time = cache_size + 1;
+	uint32_t cursor = 0; //for scanning for any vertex with live triangles
+
+	order.clear();
+	order.reserve(triangle_count);
+	cluster_starts.clear();
+
+	uint32_t fanning = vertex_count == 0 ? -1U : 0;
+	bool new_cluster = true;
+	std::vector< uint32_t > candidates;
+	while (fanning != -1U) {
+		candidates.clear();
+
+		//emit all live triangles around the fanning vertex:
+		for (uint32_t a = adjacency_begin[fanning]; a < adjacency_begin[fanning+1]; ++a) {
+			uint32_t t = adjacency[a];
+			if (emitted[t]) continue;
+			if (new_cluster) {
+				cluster_starts.emplace_back(uint32_t(order.size()));
+				new_cluster = false;
+			}
+			order.emplace_back(t);
+			emitted[t] = true;
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t v = indices[3*t+c];
+				dead_end.emplace_back(v);
+				candidates.emplace_back(v);
+				live[v] -= 1;
+				if (time - cache_time[v] > cache_size) {
+					cache_time[v] = time;
+					time += 1;
+				}
+			}
+		}
+
+		//pick the next fanning vertex among this fan's vertices, preferring ones that will still be in the cache:
+		uint32_t best = -1U;
+		int32_t best_priority = -1;
+		for (uint32_t v : candidates) {
+			if (live[v] == 0) continue;
+			int32_t priority = 0;
+			if (int32_t(time - cache_time[v]) + 2 * int32_t(live[v]) <= int32_t(cache_size)) {
+				priority = int32_t(time - cache_time[v]);
+			}
+			if (priority > best_priority) {
+				best = v;
+				best_priority = priority;
+			}
+		}
+
+		if (best == -1U) {
+			//dead end -- restart from a recently used vertex, or failing that, any vertex with live triangles:
+			// (these jumps are where clusters break)
+			new_cluster = true;
+			while (!dead_end.empty()) {
+				uint32_t v = dead_end.back();
+				dead_end.pop_back();
+				if (live[v] > 0) {
+					best = v;
+					break;
+				}
+			}
+			while (best == -1U && cursor < vertex_count) {
+				if (live[cursor] > 0) best = cursor;
+				cursor += 1;
+			}
+		}
+		fanning = best;
+	}
+	assert(order.size() == triangle_count);
+}
+
+//-------------------------------------------------
+
+//Tipsify for vertex cache order, then sort the resulting clusters so that ones facing away from the mesh center
+// (i.e., on the outside; likely occluders) come first. Returns the reordered triangle list:
+static std::vector< uint32_t > reorder_triangles(std::vector< uint32_t > const &indices, std::vector< glm::vec3 > const &positions, uint32_t cache_size, uint32_t *cluster_count) {
+	uint32_t vertex_count = uint32_t(positions.size());
+
+	//vertex cache order:
+	std::vector< uint32_t > order, cluster_starts;
+	tipsify(indices, vertex_count, cache_size, &order, &cluster_starts);
+
+	//overdraw order:
+	glm::vec3 mesh_center = glm::vec3(0.0f);
+	for (auto const &p : positions) mesh_center += p;
+	if (vertex_count) mesh_center /= float(vertex_count);
+
+	struct Cluster {
+		uint32_t begin, end; //range in 'order'
+		float outwardness;
+	};
+	std::vector< Cluster > clusters;
+	for (size_t c = 0; c < cluster_starts.size(); ++c) {
+		Cluster cluster;
+		cluster.begin = cluster_starts[c];
+		cluster.end = (c + 1 < cluster_starts.size() ? cluster_starts[c+1] : uint32_t(order.size()));
+		glm::vec3 center = glm::vec3(0.0f);
+		glm::vec3 normal = glm::vec3(0.0f); //area-weighted
+		for (uint32_t o = cluster.begin; o < cluster.end; ++o) {
+			uint32_t t = order[o];
+			glm::vec3 const &a = positions[indices[3*t+0]];
+			glm::vec3 const &b = positions[indices[3*t+1]];
+			glm::vec3 const &d = positions[indices[3*t+2]];
+			center += (a + b + d) / 3.0f;
+			normal += glm::cross(b - a, d - a);
+		}
+		center /= float(cluster.end - cluster.begin);
+		cluster.outwardness = glm::dot(center - mesh_center, normal);
+		clusters.emplace_back(cluster);
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), [](Cluster const &a, Cluster const &b) {
+		return a.outwardness > b.outwardness;
+	});
+
+	std::vector< uint32_t > reordered;
+	reordered.reserve(indices.size());
+	for (auto const &cluster : clusters) {
+		for (uint32_t o = cluster.begin; o < cluster.end; ++o) {
+			uint32_t t = order[o];
+			reordered.emplace_back(indices[3*t+0]);
+			reordered.emplace_back(indices[3*t+1]);
+			reordered.emplace_back(indices[3*t+2]);
+		}
+	}
+
+	if (cluster_count) *cluster_count = uint32_t(clusters.size());
+	return reordered;
+}
+
+//-------------------------------------------------
+//Meshlets:
+
+//group triangles into meshlets of at most 'max_triangles' triangles, grown one triangle at a time from a seed
+// (the first unused triangle in input order) by adding whichever connected triangle -- sharing a vertex position,
+// so flat-shaded and seamed meshes still count as connected -- is closest to the meshlet's center and normal.
+// (meshlets that run out of connected triangles continue with nearby triangles in input order)
+//Each meshlet keeps its triangles in input order, so cache order mostly survives.
+//Returns the triangles regrouped meshlet-by-meshlet, and the number of triangles in each meshlet:
+static std::vector< uint32_t > build_meshlets(std::vector< uint32_t > const &indices, std::vector< glm::vec3 > const &positions, uint32_t max_triangles, std::vector< uint32_t > *sizes_) {
+	//how much a triangle facing 90 degrees away from the meshlet counts, relative to one that's a meshlet-width away:
+	constexpr float NormalWeight = 1.0f;
+	//how many unused triangles (in input order) to consider when there are no connected ones:
+	constexpr uint32_t Lookahead = 64;
+
+	auto &sizes = *sizes_;
+	sizes.clear();
+	uint32_t triangle_count = uint32_t(indices.size() / 3);
+
+	//vertices at the same position are one point:
+	std::vector< uint32_t > point_of(positions.size());
+	uint32_t point_count = 0;
+	{
+		auto less = [](glm::vec3 const &a, glm::vec3 const &b) {
+			if (a.x != b.x) return a.x < b.x;
+			if (a.y != b.y) return a.y < b.y;
+			return a.z < b.z;
+		};
+		std::map< glm::vec3, uint32_t, decltype(less) > points(less);
+		for (size_t v = 0; v < positions.size(); ++v) {
+			point_of[v] = points.emplace(positions[v], uint32_t(points.size())).first->second;
+		}
+		point_count = uint32_t(points.size());
+	}
+
+	//triangles touching each point:
+	std::vector< uint32_t > point_begin(point_count + 1, 0);
+	for (uint32_t i : indices) point_begin[point_of[i] + 1] += 1;
+	for (uint32_t p = 0; p < point_count; ++p) point_begin[p + 1] += point_begin[p];
+	std::vector< uint32_t > point_triangles(indices.size());
+	{
+		std::vector< uint32_t > fill(point_begin.begin(), point_begin.end() - 1);
+		for (uint32_t i = 0; i < uint32_t(indices.size()); ++i) point_triangles[fill[point_of[indices[i]]]++] = i / 3;
+	}
+
+	//triangle centroids, unit normals (zero for degenerate triangles), and total area:
+	std::vector< glm::vec3 > centroids(triangle_count), normals(triangle_count);
+	float area = 0.0f;
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		glm::vec3 const &a = positions[indices[3*t+0]];
+		glm::vec3 const &b = positions[indices[3*t+1]];
+		glm::vec3 const &c = positions[indices[3*t+2]];
+		centroids[t] = (a + b + c) / 3.0f;
+		glm::vec3 n = glm::cross(b - a, c - a);
+		float len = glm::length(n);
+		normals[t] = (len > 0.0f ? n / len : glm::vec3(0.0f));
+		area += 0.5f * len;
+	}
+	//about how wide a full meshlet is:
+	float width = std::sqrt(area / std::max(1u, triangle_count) * float(max_triangles));
+	if (!(width > 0.0f)) width = 1.0f;
+
+	std::vector< uint8_t > used(triangle_count, 0);
+	std::vector< uint32_t > members, candidates;
+	std::vector< uint32_t > regrouped;
+	regrouped.reserve(indices.size());
+
+	for (uint32_t seed = 0; seed < triangle_count; ++seed) {
+		if (used[seed]) continue;
+
+		members.clear();
+		candidates.clear();
+		glm::vec3 centroid_sum = glm::vec3(0.0f), normal_sum = glm::vec3(0.0f);
+		auto add = [&](uint32_t t) {
+			used[t] = 1;
+			members.emplace_back(t);
+			centroid_sum += centroids[t];
+			normal_sum += normals[t];
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t p = point_of[indices[3*t+c]];
+				for (uint32_t i = point_begin[p]; i < point_begin[p+1]; ++i) {
+					if (!used[point_triangles[i]]) candidates.emplace_back(point_triangles[i]);
+				}
+			}
+		};
+		add(seed);
+
+		while (members.size() < max_triangles) {
+			glm::vec3 center = centroid_sum / float(members.size());
+			float normal_len = glm::length(normal_sum);
+			glm::vec3 axis = (normal_len > 0.0f ? normal_sum / normal_len : glm::vec3(0.0f));
+
+			size_t best = candidates.size();
+			float best_score = std::numeric_limits< float >::infinity();
+			for (size_t i = 0; i < candidates.size(); ) {
+				uint32_t t = candidates[i];
+				if (used[t]) {
+					//(drop candidates that joined since they were found)
+					candidates[i] = candidates.back();
+					candidates.pop_back();
+					continue;
+				}
+				float score = glm::length(centroids[t] - center) / width + NormalWeight * (1.0f - glm::dot(normals[t], axis));
+				if (score < best_score) {
+					best_score = score;
+					best = i;
+				}
+				++i;
+			}
+			if (best < candidates.size()) {
+				add(candidates[best]);
+				continue;
+			}
+
+			//nothing connected is left, so try the next few unused triangles:
+			uint32_t next = -1U;
+			for (uint32_t t = seed + 1, looked = 0; t < triangle_count && looked < Lookahead; ++t) {
+				if (used[t]) continue;
+				looked += 1;
+				float score = glm::length(centroids[t] - center) / width + NormalWeight * (1.0f - glm::dot(normals[t], axis));
+				if (score < best_score) {
+					best_score = score;
+					next = t;
+				}
+			}
+			//(only if it's close enough that the meshlet stays compact)
+			if (next == -1U || glm::length(centroids[next] - center) > width) break;
+			add(next);
+		}
+
+		std::sort(members.begin(), members.end());
+		for (uint32_t t : members) {
+			regrouped.emplace_back(indices[3*t+0]);
+			regrouped.emplace_back(indices[3*t+1]);
+			regrouped.emplace_back(indices[3*t+2]);
+		}
+		sizes.emplace_back(uint32_t(members.size()));
+	}
+
+	return regrouped;
+}
+
+//bounding sphere (around the box center) and normal cone of 'count' triangles starting at triangle 'first':
+static Meshlet meshlet_bounds(std::vector< uint32_t > const &indices, std::vector< glm::vec3 > const &positions, uint32_t first, uint32_t count) {
+	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+	glm::vec3 normal_sum = glm::vec3(0.0f);
+	for (uint32_t t = first; t < first + count; ++t) {
+		glm::vec3 const &a = positions[indices[3*t+0]];
+		glm::vec3 const &b = positions[indices[3*t+1]];
+		glm::vec3 const &c = positions[indices[3*t+2]];
+		min = glm::min(min, glm::min(a, glm::min(b, c)));
+		max = glm::max(max, glm::max(a, glm::max(b, c)));
+		glm::vec3 n = glm::cross(b - a, c - a);
+		float len = glm::length(n);
+		if (len > 0.0f) normal_sum += n / len;
+	}
+
+	Meshlet meshlet;
+	meshlet.start = 0;
+	meshlet.count = 0;
+	meshlet.center = 0.5f * (min + max);
+	meshlet.radius = 0.0f;
+	float normal_len = glm::length(normal_sum);
+	meshlet.cone_axis = (normal_len > 0.0f ? normal_sum / normal_len : glm::vec3(0.0f, 0.0f, 1.0f));
+	meshlet.cone_cos = (normal_len > 0.0f ? 1.0f : -1.0f);
+	for (uint32_t t = first; t < first + count; ++t) {
+		glm::vec3 const &a = positions[indices[3*t+0]];
+		glm::vec3 const &b = positions[indices[3*t+1]];
+		glm::vec3 const &c = positions[indices[3*t+2]];
+		meshlet.radius = std::max(meshlet.radius, std::max(glm::length(a - meshlet.center), std::max(glm::length(b - meshlet.center), glm::length(c - meshlet.center))));
+		glm::vec3 n = glm::cross(b - a, c - a);
+		float len = glm::length(n);
+		//(degenerate triangles have no facing, so they don't widen the cone)
+		if (len > 0.0f) meshlet.cone_cos = std::min(meshlet.cone_cos, glm::dot(n / len, meshlet.cone_axis));
+	}
+	return meshlet;
+}
+
+//-------------------------------------------------
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	std::string in_file, out_file;
+	uint32_t cache_size = 16;
+	uint32_t lod_count = 0;
+	uint32_t meshlet_size = 0;
+	bool usage = false;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--cache-size" && argi + 1 < argc) {
+			argi += 1;
+			cache_size = uint32_t(std::stoul(argv[argi]));
+			if (cache_size < 3) usage = true;
+		} else if (arg == "--lods" && argi + 1 < argc) {
+			argi += 1;
+			lod_count = uint32_t(std::stoul(argv[argi]));
+			if (lod_count > 3) usage = true; //(Scene::Drawable::MaxLODs)
+		} else if (arg == "--meshlets" && argi + 1 < argc) {
+			argi += 1;
+			meshlet_size = uint32_t(std::stoul(argv[argi]));
+			if (meshlet_size < 16 || meshlet_size > 256) usage = true;
+		} else if (in_file == "") {
+			in_file = arg;
+		} else if (out_file == "") {
+			out_file = arg;
+		} else {
+			usage = true;
+		}
+	}
+	if (in_file == "") usage = true;
+	if (usage) {
+		std::cerr << "Usage:\n\t./optimize-meshes <in.pnct> [out.pnct] [--cache-size N] [--lods L] [--meshlets T]\n"
+			"Reorders each mesh's triangles and vertices for vertex cache locality and overdraw; writes to in.pnct if out.pnct is not given.\n"
+			"(ACMR/ATVR are reported for a FIFO cache of N entries; default 16)\n"
+			"With --lods, also generates L (at most 3) simplified versions of each mesh, named 'mesh.LOD1' ... 'mesh.LODL'.\n"
+			"With --meshlets, also splits each mesh into culling clusters of at most T (16-256; 64-128 is typical) triangles." << std::endl;
+		return 1;
+	}
+	if (out_file == "") out_file = in_file;
+
+	std::vector< Chunk > chunks = read_chunks(in_file);
+
+	auto find_chunk = [&](std::string const &magic) -> Chunk * {
+		for (auto &c : chunks) {
+			if (c.magic == magic) return &c;
+		}
+		return nullptr;
+	};
+
+	//vertex data ('pnct' = 36-byte vertices with float positions; 'pnq0' = 20-byte vertices with int16 positions):
+	Chunk *vertex_chunk = find_chunk("pnct");
+	uint32_t stride = 36;
+	if (!vertex_chunk) {
+		vertex_chunk = find_chunk("pnq0");
+		stride = 20;
+	}
+	if (!vertex_chunk) throw std::runtime_error("'" + in_file + "' has no vertex data chunk.");
+	if (vertex_chunk->data.size() % stride != 0) throw std::runtime_error("Vertex data is not a whole number of vertices.");
+	uint32_t total = uint32_t(vertex_chunk->data.size() / stride);
+
+	struct IndexEntry0 {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_begin, vertex_end;
+	};
+	static_assert(sizeof(IndexEntry0) == 16, "Index entry should be packed");
+	struct IndexEntry1 {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_begin, vertex_end;
+		uint32_t element_begin, element_end;
+	};
+	static_assert(sizeof(IndexEntry1) == 24, "Index entry should be packed");
+
+	struct Dequantize {
+		glm::vec3 scale;
+		glm::vec3 offset;
+	};
+	static_assert(sizeof(Dequantize) == 4*3*2, "Dequantize is packed.");
+
+	std::vector< IndexEntry1 > index;
+	std::vector< uint32_t > elements;
+	if (Chunk *idx1 = find_chunk("idx1")) {
+		index = chunk_as< IndexEntry1 >(*idx1);
+		Chunk *ele0 = find_chunk("ele0");
+		if (!ele0) throw std::runtime_error("'" + in_file + "' has 'idx1' but no 'ele0'.");
+		elements = chunk_as< uint32_t >(*ele0);
+	} else if (Chunk *idx0 = find_chunk("idx0")) {
+		//triangle soup; elements are just the vertices in order (welded below):
+		for (auto const &e : chunk_as< IndexEntry0 >(*idx0)) {
+			index.emplace_back(IndexEntry1{ e.name_begin, e.name_end, e.vertex_begin, e.vertex_end, uint32_t(elements.size()), uint32_t(elements.size() + (e.vertex_end - e.vertex_begin)) });
+			for (uint32_t v = e.vertex_begin; v < e.vertex_end; ++v) elements.emplace_back(v);
+		}
+	} else {
+		throw std::runtime_error("'" + in_file + "' has no index chunk.");
+	}
+	std::vector< Dequantize > dequantize;
+	if (Chunk *qnt0 = find_chunk("qnt0")) dequantize = chunk_as< Dequantize >(*qnt0);
+	if (stride == 20 && dequantize.size() != index.size()) throw std::runtime_error("'" + in_file + "' has compact vertices but no matching 'qnt0'.");
+
+	Chunk const *str0 = find_chunk("str0");
+	if (!str0) throw std::runtime_error("'" + in_file + "' has no strings chunk.");
+
+	std::vector< char > const &vertices = vertex_chunk->data;
+	std::vector< char > new_vertices;
+	std::vector< uint32_t > new_elements;
+	std::vector< IndexEntry1 > new_index;
+
+	struct BoundsEntry {
+		glm::vec3 min, max;
+		glm::vec3 sphere_center;
+		float sphere_radius;
+	};
+	static_assert(sizeof(BoundsEntry) == 4*3*3+4, "BoundsEntry is packed.");
+	std::vector< BoundsEntry > new_bounds;
+	std::vector< Dequantize > new_dequantize; //(compact files only)
+	std::vector< char > new_strings; //(rebuilt, since LODs add names)
+	std::vector< Meshlet > new_meshlets;
+
+	//existing LODs never get LODs of their own; they are regenerated when making new ones, and otherwise kept:
+	std::regex const lod_name("(.*)\\.LOD[0-9]+");
+	std::vector< size_t > kept_lods; //index entries of existing LODs to carry over (after their meshes are done)
+
+	//where each mesh's input vertices ended up, so kept LODs can be renumbered to match:
+	struct Renumbered {
+		size_t input; //entry in index
+		size_t output; //entry in new_index (and new_bounds, new_dequantize)
+		std::vector< uint32_t > new_vertex; //input vertex - vertex_begin -> output vertex (-1U if unused)
+	};
+	std::map< std::string, Renumbered > renumbered;
+
+	CacheStats before_total, after_total;
+
+	std::cout << std::fixed << std::setprecision(3);
+	for (size_t m = 0; m < index.size(); ++m) {
+		IndexEntry1 const &entry = index[m];
+		if (!(entry.name_begin <= entry.name_end && entry.name_end <= str0->data.size())
+		 || !(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)
+		 || !(entry.element_begin <= entry.element_end && entry.element_end <= elements.size())
+		 || (entry.element_end - entry.element_begin) % 3 != 0) {
+			throw std::runtime_error("'" + in_file + "' has an out-of-range index entry.");
+		}
+		std::string name(str0->data.begin() + entry.name_begin, str0->data.begin() + entry.name_end);
+		if (std::regex_match(name, lod_name)) {
+			if (lod_count == 0) kept_lods.emplace_back(m);
+			continue;
+		}
+
+		//weld this mesh's vertices (identical bytes -> one vertex) and make mesh-local indices:
+		std::map< std::string, uint32_t > welded;
+		std::vector< uint32_t > local_to_old; //local index -> vertex in input
+		std::vector< uint32_t > indices;
+		for (uint32_t e = entry.element_begin; e < entry.element_end; ++e) {
+			uint32_t v = elements[e];
+			if (v < entry.vertex_begin || v >= entry.vertex_end) {
+				throw std::runtime_error("Mesh '" + name + "' uses vertices outside its own vertex range; not supported.");
+			}
+			std::string key(vertices.data() + size_t(v) * stride, stride);
+			auto f = welded.emplace(key, uint32_t(local_to_old.size()));
+			if (f.second) local_to_old.emplace_back(v);
+			indices.emplace_back(f.first->second);
+		}
+		uint32_t vertex_count = uint32_t(local_to_old.size());
+
+		//object-space positions (for overdraw ordering) and normals (for simplification):
+		std::vector< glm::vec3 > positions(vertex_count);
+		std::vector< glm::vec3 > normals(vertex_count);
+		for (uint32_t l = 0; l < vertex_count; ++l) {
+			char const *vertex = vertices.data() + size_t(local_to_old[l]) * stride;
+			if (stride == 36) {
+				std::memcpy(reinterpret_cast< char * >(&positions[l]), vertex, sizeof(glm::vec3));
+				std::memcpy(reinterpret_cast< char * >(&normals[l]), vertex + 12, sizeof(glm::vec3));
+			} else {
+				int16_t q[3];
+				std::memcpy(q, vertex, sizeof(q));
+				positions[l] = dequantize[m].offset + dequantize[m].scale * glm::vec3(q[0], q[1], q[2]);
+				//(2_10_10_10_REV, signed-normalized)
+				uint32_t n;
+				std::memcpy(&n, vertex + 8, sizeof(n));
+				for (uint32_t c = 0; c < 3; ++c) {
+					int32_t bits = int32_t((n >> (10 * c)) & 0x3ff);
+					if (bits & 0x200) bits -= 0x400;
+					normals[l][c] = std::max(-1.0f, float(bits) / 511.0f);
+				}
+			}
+		}
+
+		//bounds (box, and sphere around the box center):
+		BoundsEntry bounds;
+		bounds.min = glm::vec3( std::numeric_limits< float >::infinity());
+		bounds.max = glm::vec3(-std::numeric_limits< float >::infinity());
+		for (auto const &p : positions) {
+			bounds.min = glm::min(bounds.min, p);
+			bounds.max = glm::max(bounds.max, p);
+		}
+		bounds.sphere_center = vertex_count ? 0.5f * (bounds.min + bounds.max) : glm::vec3(0.0f);
+		bounds.sphere_radius = -1.0f;
+		for (auto const &p : positions) {
+			bounds.sphere_radius = std::max(bounds.sphere_radius, glm::length(p - bounds.sphere_center));
+		}
+
+		CacheStats before = simulate_fifo(indices, vertex_count, cache_size);
+
+		uint32_t cluster_count = 0;
+		std::vector< uint32_t > reordered = reorder_triangles(indices, positions, cache_size, &cluster_count);
+
+		//regroup into meshlets (before renumbering, so vertices end up in meshlet order):
+		std::vector< uint32_t > meshlet_sizes;
+		std::vector< Meshlet > meshlets; //(element ranges filled in when written)
+		if (meshlet_size > 0) {
+			reordered = build_meshlets(reordered, positions, meshlet_size, &meshlet_sizes);
+			for (uint32_t i = 0, first = 0; i < meshlet_sizes.size(); first += meshlet_sizes[i], ++i) {
+				meshlets.emplace_back(meshlet_bounds(reordered, positions, first, meshlet_sizes[i]));
+			}
+		}
+
+		//renumber vertices in order of first use (for vertex fetch locality):
+		std::vector< uint32_t > renumber(vertex_count, -1U);
+		std::vector< uint32_t > new_to_local;
+		new_to_local.reserve(vertex_count);
+		for (uint32_t &i : reordered) {
+			if (renumber[i] == -1U) {
+				renumber[i] = uint32_t(new_to_local.size());
+				new_to_local.emplace_back(i);
+			}
+			i = renumber[i];
+		}
+		assert(new_to_local.size() == vertex_count);
+
+		CacheStats after = simulate_fifo(reordered, vertex_count, cache_size);
+
+		//write out:
+		IndexEntry1 out = entry;
+		out.vertex_begin = uint32_t(new_vertices.size() / stride);
+		for (uint32_t l : new_to_local) {
+			char const *vertex = vertices.data() + size_t(local_to_old[l]) * stride;
+			new_vertices.insert(new_vertices.end(), vertex, vertex + stride);
+		}
+		out.vertex_end = uint32_t(new_vertices.size() / stride);
+		out.element_begin = uint32_t(new_elements.size());
+		for (uint32_t i : reordered) new_elements.emplace_back(out.vertex_begin + i);
+		out.element_end = uint32_t(new_elements.size());
+		for (uint32_t i = 0, first = 0; i < meshlets.size(); first += meshlet_sizes[i], ++i) {
+			meshlets[i].start = out.element_begin + 3 * first;
+			meshlets[i].count = 3 * meshlet_sizes[i];
+			new_meshlets.emplace_back(meshlets[i]);
+		}
+		out.name_begin = uint32_t(new_strings.size());
+		new_strings.insert(new_strings.end(), name.begin(), name.end());
+		out.name_end = uint32_t(new_strings.size());
+		if (lod_count == 0) {
+			Renumbered &r = renumbered[name];
+			r.input = m;
+			r.output = new_index.size();
+			r.new_vertex.assign(entry.vertex_end - entry.vertex_begin, -1U);
+			for (uint32_t e = entry.element_begin; e < entry.element_end; ++e) {
+				uint32_t v = elements[e];
+				r.new_vertex[v - entry.vertex_begin] = out.vertex_begin + renumber[welded.at(std::string(vertices.data() + size_t(v) * stride, stride))];
+			}
+		}
+		new_index.emplace_back(out);
+		new_bounds.emplace_back(bounds);
+		if (stride == 20) new_dequantize.emplace_back(dequantize[m]);
+
+		std::cout << "'" << name << "': " << before.triangles << " triangles, " << (entry.vertex_end - entry.vertex_begin) << " -> " << vertex_count << " vertices;"
+			<< " ACMR " << before.acmr() << " -> " << after.acmr()
+			<< ", ATVR " << before.atvr() << " -> " << after.atvr()
+			<< " (" << cluster_count << " clusters";
+		if (!meshlets.empty()) std::cout << ", " << meshlets.size() << " meshlets";
+		std::cout << ")" << std::endl;
+
+		//simplified versions, sharing this mesh's vertices:
+		if (lod_count > 0) {
+			//each level halves the triangles, within an error budget that doubles per level:
+			// (Scene::Drawable::default_lod_screen_size switches to LOD l when the mesh's bounding sphere is at most 0.5^(l+1)
+			//  of the viewport height, where an error of radius * 2^l / 256 is about one pixel at 1080p)
+			std::vector< uint32_t > targets;
+			std::vector< float > max_errors;
+			for (uint32_t l = 1; l <= lod_count; ++l) {
+				targets.emplace_back(before.triangles >> l);
+				max_errors.emplace_back(std::max(0.0f, bounds.sphere_radius) * float(1 << l) / 256.0f);
+			}
+			std::vector< std::vector< uint32_t > > lods;
+			simplify_mesh(positions, normals, indices, targets, max_errors, &lods);
+
+			uint32_t previous = before.triangles;
+			for (uint32_t l = 0; l < lods.size(); ++l) {
+				uint32_t triangles = uint32_t(lods[l].size() / 3);
+				//(LODs are looked up in sequence, so stop at the first one that isn't any simpler)
+				if (triangles == 0 || triangles >= previous) break;
+				previous = triangles;
+
+				std::vector< uint32_t > lod_reordered = reorder_triangles(lods[l], positions, cache_size, nullptr);
+
+				std::string lod_name = name + ".LOD" + std::to_string(l + 1);
+				IndexEntry1 lod = out; //(same vertex range)
+				lod.name_begin = uint32_t(new_strings.size());
+				new_strings.insert(new_strings.end(), lod_name.begin(), lod_name.end());
+				lod.name_end = uint32_t(new_strings.size());
+				lod.element_begin = uint32_t(new_elements.size());
+				for (uint32_t i : lod_reordered) new_elements.emplace_back(out.vertex_begin + renumber[i]);
+				lod.element_end = uint32_t(new_elements.size());
+				new_index.emplace_back(lod);
+				new_bounds.emplace_back(bounds); //(a bit loose, since simplification only ever removes vertices)
+				if (stride == 20) new_dequantize.emplace_back(dequantize[m]);
+
+				std::cout << "  '" << lod_name << "': " << triangles << " triangles" << std::endl;
+			}
+		}
+
+		before_total.misses += before.misses; before_total.triangles += before.triangles; before_total.vertices += before.vertices;
+		after_total.misses += after.misses; after_total.triangles += after.triangles; after_total.vertices += after.vertices;
+	}
+
+	//carry over existing LODs (when not regenerating them), pointed at their mesh's renumbered vertices:
+	// (their triangle order is kept; it was already optimized when they were made)
+	for (size_t m : kept_lods) {
+		IndexEntry1 const &entry = index[m];
+		std::string name(str0->data.begin() + entry.name_begin, str0->data.begin() + entry.name_end);
+		std::smatch match;
+		std::regex_match(name, match, lod_name);
+		auto f = renumbered.find(match[1].str());
+		if (f == renumbered.end() || index[f->second.input].vertex_begin != entry.vertex_begin || index[f->second.input].vertex_end != entry.vertex_end) {
+			std::cerr << "WARNING: dropping LOD '" << name << "', which doesn't share the vertices of a mesh named '" << match[1].str() << "'." << std::endl;
+			continue;
+		}
+		Renumbered const &r = f->second;
+		IndexEntry1 lod = new_index[r.output]; //(same vertex range)
+		lod.name_begin = uint32_t(new_strings.size());
+		new_strings.insert(new_strings.end(), name.begin(), name.end());
+		lod.name_end = uint32_t(new_strings.size());
+		lod.element_begin = uint32_t(new_elements.size());
+		for (uint32_t e = entry.element_begin; e < entry.element_end; ++e) {
+			uint32_t v = elements[e];
+			uint32_t n = (v >= entry.vertex_begin && v < entry.vertex_end ? r.new_vertex[v - entry.vertex_begin] : -1U);
+			//(simplification only removes vertices, so a LOD only uses vertices its mesh uses)
+			if (n == -1U) throw std::runtime_error("LOD '" + name + "' uses vertices that its mesh doesn't; not supported.");
+			new_elements.emplace_back(n);
+		}
+		lod.element_end = uint32_t(new_elements.size());
+		new_index.emplace_back(lod);
+		BoundsEntry mesh_bounds = new_bounds[r.output]; //(copied before emplace_back can reallocate)
+		new_bounds.emplace_back(mesh_bounds);
+		if (stride == 20) {
+			Dequantize mesh_dequantize = new_dequantize[r.output];
+			new_dequantize.emplace_back(mesh_dequantize);
+		}
+
+		std::cout << "  '" << name << "': kept, " << (entry.element_end - entry.element_begin) / 3 << " triangles" << std::endl;
+	}
+
+	std::cout << "Overall (FIFO cache of " << cache_size << "): ACMR " << before_total.acmr() << " -> " << after_total.acmr()
+		<< ", ATVR " << before_total.atvr() << " -> " << after_total.atvr() << std::endl;
+
+	//write file: vertices, strings, index, elements, dequantization (compact only), bounds, and meshlets -- in the order MeshBuffer reads them --
+	// then any other chunks as they were (MeshBuffer leaves those to whoever reads the rest of the file):
+	std::ofstream file(out_file, std::ios::binary);
+	write_chunk(vertex_chunk->magic, new_vertices, &file);
+	write_chunk("str0", new_strings, &file);
+	write_chunk("idx1", as_bytes(new_index), &file);
+	write_chunk("ele0", as_bytes(new_elements), &file);
+	if (stride == 20) write_chunk("qnt0", as_bytes(new_dequantize), &file);
+	write_chunk("bnd0", as_bytes(new_bounds), &file);
+	//(old meshlets are dropped even without --meshlets, since triangle order has changed)
+	if (!new_meshlets.empty()) write_chunk("mlt0", as_bytes(new_meshlets), &file);
+	for (auto const &c : chunks) {
+		if (c.magic == vertex_chunk->magic || c.magic == "str0" || c.magic == "idx0" || c.magic == "idx1" || c.magic == "ele0" || c.magic == "qnt0" || c.magic == "bnd0" || c.magic == "mlt0") continue;
+		write_chunk(c.magic, c.data, &file);
+	}
+	if (!file) throw std::runtime_error("Failed to write '" + out_file + "'.");
+	std::cout << "Wrote " << file.tellp() << " bytes to '" << out_file << "'." << std::endl;
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
@@ -0,0 +1,139 @@
+//pack-assets: packs the game's data files (meshes, scenes, sounds, images) from a directory
+// into a single asset archive, which DataFile (see data_file.hpp) reads in place of the loose files.
+//
+//Each file is deflated (zlib) if that makes it meaningfully smaller; files that don't shrink
+// much (e.g., already-compressed .opus) are stored as-is, so they can be read straight out of
+// the mapped archive without a copy.
+//
+//Typical use, after exporting assets:
+//  ./scenes/pack-assets dist
+//(writes dist/assets.pak; the loose files can then be left out of a release)
+
+#include "data_file.hpp"
+#include "read_write_chunk.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//extensions of files loaded through data_path() (everything else -- readmes, executables, libraries -- stays loose):
+static bool is_asset(std::filesystem::path const &path) {
+	std::string ext = path.extension().string();
+	return ext == ".pnct" || ext == ".scene" || ext == ".wav" || ext == ".opus" || ext == ".png";
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	std::string in_dir, out_file;
+	int level = 9;
+	bool usage = false;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--level" && argi + 1 < argc) {
+			argi += 1;
+			level = std::stoi(argv[argi]);
+			if (level < 0 || level > 9) usage = true;
+		} else if (in_dir == "") {
+			in_dir = arg;
+		} else if (out_file == "") {
+			out_file = arg;
+		} else {
+			usage = true;
+		}
+	}
+	if (in_dir == "") usage = true;
+	if (usage) {
+		std::cerr << "Usage:\n\t./pack-assets <dir> [out.pak] [--level L]\n"
+			"Packs the meshes, scenes, sounds, and images under dir into one archive; writes to dir/assets.pak if out.pak is not given.\n"
+			"(L is the zlib compression level, 0-9; default 9. With 0, everything is stored uncompressed.)" << std::endl;
+		return 1;
+	}
+	if (out_file == "") out_file = (std::filesystem::path(in_dir) / "assets.pak").string();
+
+	//gather files (names relative to in_dir, '/'-separated, sorted -- the order DataFile searches):
+	std::vector< std::string > names;
+	for (auto const &item : std::filesystem::recursive_directory_iterator(in_dir)) {
+		if (!item.is_regular_file() || !is_asset(item.path())) continue;
+		names.emplace_back(std::filesystem::relative(item.path(), in_dir).generic_string());
+	}
+	std::sort(names.begin(), names.end());
+
+	std::vector< char > strings;
+	std::vector< PackEntry > entries;
+	std::vector< char > contents;
+
+	size_t total_size = 0;
+	for (auto const &name : names) {
+		std::string path = (std::filesystem::path(in_dir) / name).string();
+		std::ifstream file(path, std::ios::binary);
+		std::vector< char > bytes((std::istreambuf_iterator< char >(file)), std::istreambuf_iterator< char >());
+		if (!file.eof() && file.fail()) throw std::runtime_error("Failed to read '" + path + "'.");
+		if (bytes.size() > 0xffffffffu) throw std::runtime_error("'" + path + "' is too large to pack.");
+
+		PackEntry entry;
+		entry.name_begin = uint32_t(strings.size());
+		strings.insert(strings.end(), name.begin(), name.end());
+		entry.name_end = uint32_t(strings.size());
+		entry.size = uint32_t(bytes.size());
+		contents.resize((contents.size() + ChunkAlignment - 1) / ChunkAlignment * ChunkAlignment, '\0'); //(see PackEntry)
+		entry.offset = uint32_t(contents.size());
+
+		//deflate, but only keep the result if it saves at least an eighth (otherwise inflating on load isn't worth it):
+		std::vector< char > deflated;
+		if (level > 0 && !bytes.empty()) {
+			uLongf got = compressBound(uLong(bytes.size()));
+			deflated.resize(got);
+			if (compress2(reinterpret_cast< Bytef * >(deflated.data()), &got, reinterpret_cast< Bytef const * >(bytes.data()), uLong(bytes.size()), level) != Z_OK) {
+				throw std::runtime_error("Failed to deflate '" + path + "'.");
+			}
+			deflated.resize(got);
+		}
+		if (!deflated.empty() && deflated.size() <= bytes.size() - bytes.size() / 8) {
+			entry.method = PackDeflated;
+			entry.stored_size = uint32_t(deflated.size());
+			contents.insert(contents.end(), deflated.begin(), deflated.end());
+		} else {
+			entry.method = PackStored;
+			entry.stored_size = entry.size;
+			contents.insert(contents.end(), bytes.begin(), bytes.end());
+		}
+		entry.crc = chunk_crc(contents.data() + entry.offset, entry.stored_size);
+		if (contents.size() > 0xffffffffu) throw std::runtime_error("Assets are too large to pack into one archive.");
+		entries.emplace_back(entry);
+
+		total_size += bytes.size();
+		std::cout << "  " << name << ": " << entry.size << " bytes"
+			<< (entry.method == PackDeflated ? ", deflated to " + std::to_string(entry.stored_size) : std::string(", stored")) << std::endl;
+	}
+
+	std::ofstream out(out_file, std::ios::binary);
+	write_chunk("str0", strings, &out);
+	write_chunk("pak0", entries, &out);
+	write_chunk("dat0", contents, &out);
+	if (!out) throw std::runtime_error("Failed to write '" + out_file + "'.");
+
+	std::cout << "Packed " << entries.size() << " files (" << total_size << " bytes) into '" << out_file << "' (" << contents.size() << " bytes of contents)." << std::endl;
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
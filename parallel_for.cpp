@@ -0,0 +1,125 @@
+#include "parallel_for.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+	//one parallel_for call; lives on the caller's stack:
+	struct Job {
+		std::function< void(size_t) > const *fn;
+		size_t count;
+		std::atomic< size_t > next{0}; //next index to run
+		size_t helpers_wanted = 0; //pool threads that may join...
+		size_t helpers_joined = 0; //...that have joined... (guarded by Pool::mutex)
+		size_t helpers_done = 0; //...and that have finished (guarded by Pool::mutex)
+
+		std::mutex error_mutex;
+		std::exception_ptr error; //first exception thrown by fn (guarded by error_mutex)
+
+		void work() {
+			try {
+				for (size_t i = next++; i < count; i = next++) (*fn)(i);
+			} catch (...) {
+				//keep the first exception for the caller to rethrow, and stop handing out indices:
+				std::lock_guard< std::mutex > lock(error_mutex);
+				if (!error) error = std::current_exception();
+				next = count;
+			}
+		}
+	};
+
+	struct Pool {
+		std::mutex mutex;
+		std::condition_variable work_cv; //signaled when a job is added (or on shutdown)
+		std::condition_variable done_cv; //signaled when a helper finishes a job
+		std::vector< Job * > jobs; //jobs helpers may still join, oldest first (a vector, so adding one doesn't allocate once it has grown)
+		std::vector< std::thread > threads;
+		bool quit = false;
+
+		Pool() {
+			size_t cores = std::thread::hardware_concurrency();
+			for (size_t t = 1; t < cores; ++t) {
+				threads.emplace_back([this]() { run(); });
+			}
+		}
+		~Pool() {
+			{
+				std::lock_guard< std::mutex > lock(mutex);
+				quit = true;
+			}
+			work_cv.notify_all();
+			for (auto &t : threads) t.join();
+		}
+
+		void run() {
+			std::unique_lock< std::mutex > lock(mutex);
+			while (true) {
+				//find a job that wants help:
+				Job *job = nullptr;
+				work_cv.wait(lock, [&]() {
+					if (quit) return true;
+					for (Job *j : jobs) {
+						if (j->helpers_joined < j->helpers_wanted && j->next.load() < j->count) {
+							job = j;
+							return true;
+						}
+					}
+					return false;
+				});
+				if (quit) return;
+
+				job->helpers_joined += 1;
+				lock.unlock();
+				job->work();
+				lock.lock();
+				job->helpers_done += 1;
+				done_cv.notify_all();
+			}
+		}
+	};
+
+	Pool &get_pool() {
+		static Pool pool;
+		return pool;
+	}
+}
+
+size_t parallel_for_threads() {
+	return get_pool().threads.size() + 1;
+}
+
+void parallel_for(size_t count, std::function< void(size_t) > const &fn, size_t max_threads) {
+	Pool &pool = get_pool();
+	size_t helpers = std::min(std::min(max_threads, count), pool.threads.size() + 1);
+	if (helpers <= 1) {
+		for (size_t i = 0; i < count; ++i) fn(i);
+		return;
+	}
+
+	Job job;
+	job.fn = &fn;
+	job.count = count;
+	job.helpers_wanted = helpers - 1; //(the caller is one of the threads)
+
+	{
+		std::lock_guard< std::mutex > lock(pool.mutex);
+		pool.jobs.emplace_back(&job);
+	}
+	pool.work_cv.notify_all();
+
+	job.work();
+
+	//stop more helpers from joining, then wait for the ones that did:
+	std::unique_lock< std::mutex > lock(pool.mutex);
+	pool.jobs.erase(std::find(pool.jobs.begin(), pool.jobs.end(), &job));
+	pool.done_cv.wait(lock, [&]() { return job.helpers_done == job.helpers_joined; });
+	lock.unlock();
+
+	//pass on the first exception fn threw (on any thread):
+	if (job.error) std::rethrow_exception(job.error);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+/*
+ * Runs loop bodies on a process-wide pool of worker threads:
+ *
+ *  parallel_for(pieces.size(), [&](size_t i) { process(pieces[i]); });
+ *
+ * The pool (one thread per core, less the caller's) is started on first use
+ * and kept until exit, so calling this every frame doesn't create threads.
+ * The calling thread works on its own loop too, and parallel_for returns
+ * once every fn(i) has finished. Calls from several threads at once are fine.
+ *
+ * If fn throws (on any thread), the remaining indices are skipped and the
+ * first exception is rethrown from parallel_for once all threads have stopped.
+ */
+
+#include <cstddef>
+#include <functional>
+
+//run fn(i) for every i in [0,count), on at most 'max_threads' threads (counting the caller):
+// (with max_threads <= 1, or no pool threads, everything runs on the calling thread)
+void parallel_for(size_t count, std::function< void(size_t) > const &fn, size_t max_threads = size_t(-1));
+
+//number of threads a parallel_for can use (pool threads + the caller):
+size_t parallel_for_threads();
@@ -1,27 +1,71 @@
 #pragma once
 
+#include <zlib.h>
+
 #include <iostream>
 #include <vector>
+#include <span>
 #include <stdexcept>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
 
-//helper function that reads an array of structures preceded by a simple header:
-//Expected format:
+//Chunks are arrays of structures preceded by a simple header, in one of two formats:
+//v1:
 // |ma|gi|c.|..| <-- four byte "magic number"
 // |sz|sz|sz|sz| <-- four byte (native endian) size
 // |TT...TT| * (sz/sizeof(TT)) <-- enough T structures to make up sz bytes
+//v2 (what write_chunk writes):
+// |ma|gi|c.|..| <-- four byte "magic number"
+// |ff|ff|ff|ff| <-- marker (a v1 size no real chunk has)
+// |sz|sz|sz|sz| <-- four byte (native endian) size
+// |cr|cr|cr|cr| <-- CRC-32 of the TT structures (as computed by zlib's crc32())
+// |ve|ve|pa|pa| <-- two byte header version (2), two byte count of padding bytes
+// |00...00| <-- padding, so the TT structures start at a multiple of 16 bytes from the start of the file
+// |TT...TT| * (sz/sizeof(TT))
+//
+//Readers accept both, so old files keep loading; v2 chunks are checked against their CRC
+// (so corrupt files fail at load time) and their data is aligned (so mapped files can be used in place).
+
+struct ChunkHeader {
+	char magic[4] = {'\0', '\0', '\0', '\0'};
+	uint32_t size = 0;
+};
+static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+//rest of a v2 header (follows a ChunkHeader with size == ChunkV2Marker):
+struct ChunkHeader2 {
+	uint32_t size = 0;
+	uint32_t crc = 0;
+	uint16_t version = 2;
+	uint16_t padding = 0;
+};
+static_assert(sizeof(ChunkHeader2) == 12, "header is packed");
+
+constexpr uint32_t ChunkV2Marker = 0xffffffff;
+constexpr uint16_t ChunkVersion = 2; //newest header version readers understand
+constexpr size_t ChunkAlignment = 16; //v2 data alignment written by write_chunk
 
+//checksum used by v2 chunks:
+inline uint32_t chunk_crc(char const *data, size_t size) {
+	uLong crc = crc32(0L, Z_NULL, 0);
+	return uint32_t(crc32(crc, reinterpret_cast< Bytef const * >(data), uInt(size)));
+}
+
+//for chunks where checking the whole CRC up front is wasteful (e.g., the contents of the asset archive, which has per-entry checksums):
+enum class ChunkCRC {
+	Check,
+	Skip,
+};
+
+//helper function that reads an array of structures from a chunk (either format):
 template< typename T >
 void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *to_) {
 	assert(to_);
 	auto &to = *to_;
 
-	struct ChunkHeader {
-		char magic[4] = {'\0', '\0', '\0', '\0'};
-		uint32_t size = 0;
-	};
-	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
-
 	ChunkHeader header;
 	if (!from.read(reinterpret_cast< char * >(&header), sizeof(header))) {
 		throw std::runtime_error("Failed to read chunk header");
@@ -30,36 +74,166 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 		throw std::runtime_error("Unexpected magic number in chunk");
 	}
 
+	ChunkHeader2 header2;
+	bool v2 = (header.size == ChunkV2Marker);
+	if (v2) {
+		if (!from.read(reinterpret_cast< char * >(&header2), sizeof(header2))) {
+			throw std::runtime_error("Failed to read chunk header");
+		}
+		if (header2.version > ChunkVersion) {
+			throw std::runtime_error("Chunk '" + magic + "' has a newer header version (" + std::to_string(header2.version) + ") than this code reads");
+		}
+		if (!from.ignore(header2.padding)) {
+			throw std::runtime_error("Failed to read chunk header");
+		}
+		header.size = header2.size;
+	}
+
 	if (header.size % sizeof(T) != 0) {
 		throw std::runtime_error("Size of chunk not divisible by element size");
 	}
 
 	to.resize(header.size / sizeof(T));
-	if (!from.read(reinterpret_cast< char * >(&to[0]), to.size() * sizeof(T))) {
+	if (!from.read(reinterpret_cast< char * >(to.data()), to.size() * sizeof(T))) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+	if (v2 && chunk_crc(reinterpret_cast< char const * >(to.data()), header.size) != header2.crc) {
+		throw std::runtime_error("Chunk '" + magic + "' failed its CRC check (file is corrupt)");
+	}
+}
+
+//helper function that checks the header of a chunk (either format) stored in memory at [*at_, end),
+// returning the start of its data and advancing *at_ past the chunk:
+inline char const *skip_chunk(char const **at_, char const *end, std::string const &magic, size_t element_size, size_t *size_, ChunkCRC crc = ChunkCRC::Check) {
+	assert(at_);
+	auto &at = *at_;
+	assert(size_);
+	auto &size = *size_;
+
+	ChunkHeader header;
+	if (size_t(end - at) < sizeof(header)) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	std::memcpy(reinterpret_cast< char * >(&header), at, sizeof(header));
+	if (std::string(header.magic,4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+	char const *data = at + sizeof(header);
+
+	ChunkHeader2 header2;
+	bool v2 = (header.size == ChunkV2Marker);
+	if (v2) {
+		if (size_t(end - data) < sizeof(header2)) {
+			throw std::runtime_error("Failed to read chunk header");
+		}
+		std::memcpy(reinterpret_cast< char * >(&header2), data, sizeof(header2));
+		if (header2.version > ChunkVersion) {
+			throw std::runtime_error("Chunk '" + magic + "' has a newer header version (" + std::to_string(header2.version) + ") than this code reads");
+		}
+		if (size_t(end - data) - sizeof(header2) < header2.padding) {
+			throw std::runtime_error("Failed to read chunk header");
+		}
+		data += sizeof(header2) + header2.padding;
+		header.size = header2.size;
+	}
+
+	if (header.size % element_size != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+	if (size_t(end - data) < header.size) {
 		throw std::runtime_error("Failed to read chunk data.");
 	}
+	if (v2 && crc == ChunkCRC::Check && chunk_crc(data, header.size) != header2.crc) {
+		throw std::runtime_error("Chunk '" + magic + "' failed its CRC check (file is corrupt)");
+	}
+
+	size = header.size;
+	at = data + header.size;
+	return data;
 }
 
 
-//helper function to write a chunk of data in the same format as read_chunk:
+//read-only view of an array of structures stored in memory (e.g., in a MappedFile):
+// (v1 chunks aren't padded, so elements may not be aligned; operator[] copies them out)
+template< typename T >
+struct ChunkView {
+	using value_type = T;
+
+	char const *bytes = nullptr;
+	size_t count = 0;
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	T operator[](size_t i) const {
+		assert(i < count);
+		T ret;
+		std::memcpy(reinterpret_cast< char * >(&ret), bytes + i * sizeof(T), sizeof(T));
+		return ret;
+	}
+};
+
+//helper function that checks a chunk in the same format as read_chunk stored in memory at [*at_, end),
+// and returns a view of its contents (no copy), advancing *at_ past the chunk:
+template< typename T >
+ChunkView< T > view_chunk(char const **at_, char const *end, std::string const &magic, ChunkCRC crc = ChunkCRC::Check) {
+	size_t size = 0;
+	ChunkView< T > ret;
+	ret.bytes = skip_chunk(at_, end, magic, sizeof(T), &size, crc);
+	ret.count = size / sizeof(T);
+	return ret;
+}
+
+//helper function that checks a chunk in the same format as read_chunk stored in memory at [*at_, end),
+// and returns its contents as a span, advancing *at_ past the chunk:
+// - if the data is suitably aligned for T (always the case for v2 chunks in a mapped file or a DataFile), the span points into memory (no copy);
+// - otherwise (e.g., an unaligned v1 chunk) the data is copied to *copy and the span points there.
+template< typename T >
+std::span< T const > read_chunk_view(char const **at_, char const *end, std::string const &magic, std::vector< T > *copy, ChunkCRC crc = ChunkCRC::Check) {
+	static_assert(std::is_trivially_copyable_v< T >, "chunk data is used in place, so must be trivially copyable");
+	assert(copy);
+	size_t size = 0;
+	char const *data = skip_chunk(at_, end, magic, sizeof(T), &size, crc);
+	if (size == 0) return std::span< T const >();
+	if (reinterpret_cast< uintptr_t >(data) % alignof(T) == 0) {
+		return std::span< T const >(reinterpret_cast< T const * >(data), size / sizeof(T));
+	}
+	copy->resize(size / sizeof(T));
+	std::memcpy(reinterpret_cast< char * >(copy->data()), data, size);
+	return std::span< T const >(copy->data(), copy->size());
+}
+
+
+//helper function to write a chunk of data in the (v2) format read by read_chunk:
+// (padding is measured from the start of the stream, which should be the start of the file)
 template< typename T >
 void write_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to_) {
 	assert(magic.size() == 4);
 	assert(to_);
 	auto &to = *to_;
 
-	struct ChunkHeader {
-		char magic[4] = {'\0', '\0', '\0', '\0'};
-		uint32_t size = 0;
-	};
-	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
 	ChunkHeader header;
 	header.magic[0] = magic[0];
 	header.magic[1] = magic[1];
 	header.magic[2] = magic[2];
 	header.magic[3] = magic[3];
-	header.size = uint32_t(from.size() * sizeof(T));
+	header.size = ChunkV2Marker;
+
+	size_t bytes = from.size() * sizeof(T);
+	if (bytes >= ChunkV2Marker) {
+		throw std::runtime_error("Chunk '" + magic + "' is too large to write");
+	}
+	ChunkHeader2 header2;
+	header2.size = uint32_t(bytes);
+	header2.crc = chunk_crc(reinterpret_cast< const char * >(from.data()), bytes);
+	header2.version = ChunkVersion;
+	std::streamoff offset = to.tellp();
+	if (offset < 0) offset = 0; //(not seekable; assume we're at the start)
+	size_t data_offset = size_t(offset) + sizeof(header) + sizeof(header2);
+	header2.padding = uint16_t((ChunkAlignment - data_offset % ChunkAlignment) % ChunkAlignment);
 
+	static char const zeros[ChunkAlignment] = {};
 	to.write(reinterpret_cast< const char * >(&header), sizeof(header));
-	to.write(reinterpret_cast< const char * >(from.data()), from.size() * sizeof(T));
+	to.write(reinterpret_cast< const char * >(&header2), sizeof(header2));
+	to.write(zeros, header2.padding);
+	to.write(reinterpret_cast< const char * >(from.data()), bytes);
 }
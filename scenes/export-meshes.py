@@ -14,8 +14,13 @@ for i in range(0,len(sys.argv)):
 	if sys.argv[i] == '--':
 		args = sys.argv[i+1:]
 
+compact = False
+if len(args) == 3 and args[2] == '--compact':
+	compact = True
+	args = args[0:2]
+
 if len(args) != 2:
-	print("\n\nUsage:\nblender --background --python export-meshes.py -- <infile.blend[:collection]> <outfile.pnct>\nExports the meshes referenced by all objects in the specified collection(s) (default: all objects) to a binary blob.\n")
+	print("\n\nUsage:\nblender --background --python export-meshes.py -- <infile.blend[:collection]> <outfile.pnct> [--compact]\nExports the meshes referenced by all objects in the specified collection(s) (default: all objects) to a binary blob.\n --compact stores vertices in the 20-byte quantized format (int16 positions, 10:10:10 normals, half-float texcoords).\n")
 	exit(1)
 
 import bpy
@@ -38,6 +43,8 @@ else:
 print(" of '" + infile + "' to '" + outfile + "'.")
 
 import struct
+import zlib
+import math
 
 bpy.ops.wm.open_mainfile(filepath=infile)
 
@@ -94,10 +101,31 @@ data = []
 #strings contains the mesh names:
 strings = b''
 
-#index gives offsets into the data (and names) for each mesh:
+#index gives offsets into the data, elements, and names for each mesh:
 index = b''
 
+#elements are (absolute) indices of welded vertices, three per triangle:
+elements = []
+
+#(compact only) per-mesh position dequantization (scale, offset):
+dequantize = b''
+
+#per-mesh bounds (box min, max; sphere center, radius) so the game doesn't need to scan vertices:
+bounds = b''
+
+#convert a packed 'pnct' vertex to the compact format, given the mesh's position bounds:
+def quantize_vertex(vertex, center, half):
+	values = struct.unpack('3f3f4B2f', vertex)
+	position = values[0:3]
+	normal = values[3:6]
+	color = values[6:10]
+	uv = values[10:12]
+	q = [max(-32767, min(32767, round((position[i] - center[i]) / half[i] * 32767))) for i in range(0,3)]
+	n = [max(-511, min(511, round(normal[i] * 511))) & 0x3ff for i in range(0,3)]
+	return struct.pack('4hI4B2e', q[0], q[1], q[2], 0, n[0] | (n[1] << 10) | (n[2] << 20), *color, uv[0], uv[1])
+
 vertex_count = 0
+corner_count = 0
 for obj in bpy.data.objects:
 	if obj.data in to_write:
 		to_write.remove(obj.data)
@@ -138,7 +166,7 @@ for obj in bpy.data.objects:
 	index += struct.pack('I', name_end)
 
 	index += struct.pack('I', vertex_count) #vertex_begin
-	#...count will be written below
+	#...end (and element range) will be written below
 
 	colors = None
 	if len(obj.data.color_attributes) == 0:
@@ -156,7 +184,10 @@ for obj in bpy.data.objects:
 		if len(obj.data.uv_layers) != 1:
 			print("WARNING: object '" + name + "' has multiple texture coordinate layers; only exporting '" + obj.data.uv_layers.active.name + "'")
 
-	local_data = b''
+	#weld: corners with identical (packed) vertex data share one vertex:
+	welded = dict()
+	element_begin = len(elements)
+	data_begin = len(data)
 
 	#write the mesh triangles:
 	for poly in mesh.polygons:
@@ -165,6 +196,7 @@ for obj in bpy.data.objects:
 			assert(mesh.loops[poly.loop_indices[i]].vertex_index == poly.vertices[i])
 			loop = mesh.loops[poly.loop_indices[i]]
 			vertex = mesh.vertices[loop.vertex_index]
+			local_data = b''
 			for x in vertex.co:
 				local_data += struct.pack('f', x)
 			for x in loop.normal:
@@ -184,35 +216,69 @@ for obj in bpy.data.objects:
 				local_data += struct.pack('ff', uv.x, uv.y)
 			else:
 				local_data += struct.pack('ff', 0, 0)
-		if len(local_data) > 1000:
-			data.append(local_data)
-			local_data = b''
-	vertex_count += len(mesh.polygons) * 3
 
-	data.append(local_data)
+			if local_data not in welded:
+				welded[local_data] = vertex_count + len(welded)
+				data.append(local_data)
+			elements.append(welded[local_data])
+	vertex_count += len(welded)
+	corner_count += len(mesh.polygons) * 3
+
+	positions = [struct.unpack_from('3f', v) for v in data[data_begin:]]
+	lo = [min([p[i] for p in positions], default=0.0) for i in range(0,3)]
+	hi = [max([p[i] for p in positions], default=0.0) for i in range(0,3)]
+	center = [0.5 * (lo[i] + hi[i]) for i in range(0,3)]
+	radius = max([math.dist(p, center) for p in positions], default=-1.0)
+	if len(positions) == 0:
+		lo = [float('inf')] * 3
+		hi = [float('-inf')] * 3
+	bounds += struct.pack('3f3f3ff', *lo, *hi, *center, radius)
+
+	if compact:
+		half = [(0.5 * (hi[i] - lo[i]) if hi[i] > lo[i] else 1.0) for i in range(0,3)]
+		data[data_begin:] = [quantize_vertex(v, center, half) for v in data[data_begin:]]
+		dequantize += struct.pack('3f3f', *[h / 32767 for h in half], *center)
 
 	index += struct.pack('I', vertex_count) #vertex_end
+	index += struct.pack('I', element_begin) #element_begin
+	index += struct.pack('I', len(elements)) #element_end
 
 data = b''.join(data)
 
 #check that code created as much data as anticipated:
-assert(vertex_count * (4*3+4*3+1*4+4*2) == len(data))
+if compact:
+	assert(vertex_count * (2*4+4+1*4+2*2) == len(data))
+else:
+	assert(vertex_count * (4*3+4*3+1*4+4*2) == len(data))
+assert(corner_count == len(elements))
+
+print("Welded " + str(corner_count) + " triangle corners into " + str(vertex_count) + " vertices.")
+
+elements = struct.pack(str(len(elements)) + 'I', *elements)
 
 #write the data chunk and index chunk to an output blob:
 blob = open(outfile, 'wb')
+def write_chunk(magic, data):
+	#v2 chunk header (see read_write_chunk.hpp): magic, 0xffffffff marker, size, CRC-32, version, padding to a 16-byte boundary
+	padding = (16 - (blob.tell() + 20) % 16) % 16
+	blob.write(struct.pack('4sIIIHH', magic, 0xffffffff, len(data), zlib.crc32(data), 2, padding))
+	blob.write(b'\0' * padding)
+	blob.write(data)
 #first chunk: the data
-blob.write(struct.pack('4s',b'pnct')) #type
-blob.write(struct.pack('I', len(data))) #length
-blob.write(data)
+write_chunk(b'pnq0' if compact else b'pnct', data)
 #second chunk: the strings
-blob.write(struct.pack('4s',b'str0')) #type
-blob.write(struct.pack('I', len(strings))) #length
-blob.write(strings)
+write_chunk(b'str0', strings)
 #third chunk: the index
-blob.write(struct.pack('4s',b'idx0')) #type
-blob.write(struct.pack('I', len(index))) #length
-blob.write(index)
+# ('idx1' entries are name begin/end, vertex begin/end, element begin/end; older 'idx0' files lack elements)
+write_chunk(b'idx1', index)
+#fourth chunk: the elements
+write_chunk(b'ele0', elements)
+#(compact only) fifth chunk: position dequantization for each index entry
+if compact:
+	write_chunk(b'qnt0', dequantize)
+#last chunk: the bounds
+write_chunk(b'bnd0', bounds)
 wrote = blob.tell()
 blob.close()
 
-print("Wrote " + str(wrote) + " bytes [== " + str(len(data)+8) + " bytes of data + " + str(len(strings)+8) + " bytes of strings + " + str(len(index)+8) + " bytes of index] to '" + outfile + "'")
+print("Wrote " + str(wrote) + " bytes [== " + str(len(data)+8) + " bytes of data + " + str(len(strings)+8) + " bytes of strings + " + str(len(index)+8) + " bytes of index + " + str(len(elements)+8) + " bytes of elements] to '" + outfile + "'")
@@ -5,7 +5,7 @@
 #Note: Script meant to be executed from within blender 4.x, as per:
 #blender --background --python export-scene.py -- [...see below...]
 
-import sys,re
+import sys,re,os
 
 args = []
 for i in range(0,len(sys.argv)):
@@ -38,6 +38,9 @@ import mathutils
 import struct
 import math
 
+sys.path.append(os.path.dirname(os.path.abspath(__file__)))
+import scene_file
+
 #---------------------------------------------------------------------
 #Export scene:
 
@@ -51,16 +54,25 @@ if collection_name:
 else:
 	collection = bpy.context.scene.collection
 
-#Scene file format:
+#Scene file format (v2):
+# toc0 len < char*4 uint uint > * [table of contents: magic, file offset of chunk header, size of chunk data -- for each chunk below]
 # str0 len < char > * [strings chunk]
 # xfh0 len < ... > * [transform hierarchy]
 # msh0 len < uint uint uint > [hierarchy point + mesh name]
 # cam0 len < uint params > [heirarchy point + camera params]
-# lig0 len < uint params > [hierarchy point + light params]
+# lmp0 len < uint params > [hierarchy point + light params]
+# bnd0 len < float*3*4 > [per msh0 entry: object-space min, max; world-space min, max]
+# bvh0 len < float*3*2 uint uint > [bounding volume hierarchy over the bnd0 world boxes: min, max, first, count]
+# bvl0 len < uint > [msh0 indices in the order of the bvh0 leaves]
+#
+#(bnd0, bvh0, and bvl0 are optional; the game uses them so it doesn't recompute bounds or an index at load time)
+#(v1 files are just str0 through lmp0, in that order, with no table of contents)
+#(chunks are written with v2 chunk headers -- see read_write_chunk.hpp -- though the loader still reads v1 chunk headers)
 
 strings_data = b""
 xfh_data = b""
 mesh_data = b""
+mesh_bounds = [] #(object min, object max, world min, world max) per mesh entry
 camera_data = b""
 lamp_data = b""
 
@@ -119,6 +131,14 @@ def write_xfh(obj):
 
 	return ref
 
+#world matrix of an object, including any collection instances it is being visited through:
+# (matches how the game composes the exported hierarchy)
+def instanced_matrix_world(obj):
+	m = mathutils.Matrix()
+	for par in instance_parents:
+		m = m @ par.matrix_world
+	return m @ obj.matrix_world
+
 #write_mesh will add an object to the mesh section:
 def write_mesh(obj):
 	global mesh_data
@@ -127,6 +147,14 @@ def write_mesh(obj):
 	mesh_data += write_string(obj.data.name) #mesh name
 	print("mesh: " + parent_names() + obj.name + " / " + obj.data.name)
 
+	#bounds (object space, from blender's bounding box, and world space, of the transformed box):
+	corners = [mathutils.Vector(c) for c in obj.bound_box]
+	lo = [min(c[i] for c in corners) for i in range(0,3)]
+	hi = [max(c[i] for c in corners) for i in range(0,3)]
+	world = instanced_matrix_world(obj)
+	(world_lo, world_hi) = scene_file.transform_bounds(lambda p: tuple(world @ mathutils.Vector(p)), lo, hi)
+	mesh_bounds.append((lo, hi, world_lo, world_hi))
+
 #write_camera will add an object to the camera section:
 def write_camera(obj):
 	global camera_data
@@ -213,18 +241,20 @@ def write_objects(from_collection):
 
 write_objects(collection)
 
-#write the strings chunk and scene chunk to an output blob:
-blob = open(outfile, 'wb')
-def write_chunk(magic, data):
-	blob.write(struct.pack('4s',magic)) #type
-	blob.write(struct.pack('I', len(data))) #length
-	blob.write(data)
-
-write_chunk(b'str0', strings_data)
-write_chunk(b'xfh0', xfh_data)
-write_chunk(b'msh0', mesh_data)
-write_chunk(b'cam0', camera_data)
-write_chunk(b'lmp0', lamp_data)
-
-print("Wrote " + str(blob.tell()) + " bytes to '" + outfile + "'")
-blob.close()
+bounds_data = b"".join(struct.pack('3f3f3f3f', *b[0], *b[1], *b[2], *b[3]) for b in mesh_bounds)
+(bvh_data, leaf_data) = scene_file.build_index([(b[2], b[3]) for b in mesh_bounds])
+
+chunks = [
+	(b'str0', strings_data),
+	(b'xfh0', xfh_data),
+	(b'msh0', mesh_data),
+	(b'cam0', camera_data),
+	(b'lmp0', lamp_data),
+	(b'bnd0', bounds_data),
+	(b'bvh0', bvh_data),
+	(b'bvl0', leaf_data),
+]
+
+#write the table of contents and chunks:
+size = scene_file.write_scene(outfile, chunks)
+print("Wrote " + str(size) + " bytes to '" + outfile + "'")
@@ -0,0 +1,74 @@
+#Helpers shared by export-scene.py and upgrade-scene.py for writing v2 scene files.
+#(see export-scene.py for the format)
+
+import struct
+import zlib
+
+#build the optional spatial index over per-mesh world-space bounds (a list of (min, max) pairs, in msh0 order):
+# returns (bvh0 data, bvl0 data)
+# bvh0 nodes are (min, max, first, count), root first: count == 0 means children are nodes first and first+1,
+# otherwise the node is a leaf holding bvl0 entries [first, first+count). bvl0 lists msh0 indices in leaf order.
+# (median split along the longest axis of the box centers; leaves hold up to LEAF_SIZE meshes)
+LEAF_SIZE = 4
+def build_index(world_bounds):
+	nodes = []
+	leaves = []
+	if len(world_bounds) > 0:
+		nodes.append(None)
+		todo = [(0, list(range(0, len(world_bounds))))]
+		while len(todo) > 0:
+			(index, entries) = todo.pop()
+			lo = [min(world_bounds[e][0][i] for e in entries) for i in range(0,3)]
+			hi = [max(world_bounds[e][1][i] for e in entries) for i in range(0,3)]
+			if len(entries) <= LEAF_SIZE:
+				nodes[index] = (lo, hi, len(leaves), len(entries))
+				leaves += entries
+				continue
+			def center(e, axis): return 0.5 * (world_bounds[e][0][axis] + world_bounds[e][1][axis])
+			extent = [max(center(e,i) for e in entries) - min(center(e,i) for e in entries) for i in range(0,3)]
+			axis = extent.index(max(extent))
+			entries = sorted(entries, key=lambda e: center(e, axis))
+			mid = len(entries) // 2
+			first = len(nodes)
+			nodes += [None, None]
+			nodes[index] = (lo, hi, first, 0)
+			todo.append((first+1, entries[mid:]))
+			todo.append((first, entries[:mid]))
+	bvh_data = b"".join(struct.pack('3f3fII', *n[0], *n[1], n[2], n[3]) for n in nodes)
+	leaf_data = b"".join(struct.pack('I', e) for e in leaves)
+	return (bvh_data, leaf_data)
+
+#world-space bounds of the object-space box [lo, hi] under 'transform' (a function from a 3-tuple to a 3-tuple):
+def transform_bounds(transform, lo, hi):
+	corners = [transform((hi[0] if c & 1 else lo[0], hi[1] if c & 2 else lo[1], hi[2] if c & 4 else lo[2])) for c in range(0,8)]
+	return ([min(c[i] for c in corners) for i in range(0,3)], [max(c[i] for c in corners) for i in range(0,3)])
+
+#write a table of contents and then the chunks (a list of (magic, data) pairs) to 'outfile'; returns the size written:
+def write_scene(outfile, chunks):
+	blob = open(outfile, 'wb')
+
+	#v2 chunk header (see read_write_chunk.hpp): magic, 0xffffffff marker, size, CRC-32, version, padding to a 16-byte boundary
+	def chunk_padding(offset):
+		return (16 - (offset + 20) % 16) % 16
+
+	def write_chunk(magic, data):
+		padding = chunk_padding(blob.tell())
+		blob.write(struct.pack('4sIIIHH', magic, 0xffffffff, len(data), zlib.crc32(data), 2, padding))
+		blob.write(b'\0' * padding)
+		blob.write(data)
+
+	toc_size = 12 * len(chunks)
+	offset = 20 + chunk_padding(0) + toc_size #(chunks start after the toc0 chunk)
+	toc_data = b""
+	for (magic, data) in chunks:
+		toc_data += struct.pack('4sII', magic, offset, len(data))
+		offset += 20 + chunk_padding(offset) + len(data)
+	assert(len(toc_data) == toc_size)
+
+	write_chunk(b'toc0', toc_data)
+	for (magic, data) in chunks:
+		write_chunk(magic, data)
+
+	size = blob.tell()
+	blob.close()
+	return size
@@ -0,0 +1,136 @@
+#!/usr/bin/env python
+
+#Rewrites a v1 scene file (as written by older versions of export-scene.py) in the v2 format, without needing blender:
+#
+#python upgrade-scene.py <infile.scene> <outfile.scene> [meshes.pnct]
+#
+#If a mesh file is given, the bounds of each mesh are written as a 'bnd0' chunk, along with a spatial
+# index over them ('bvh0' and 'bvl0'). Bounds come from the mesh file's own 'bnd0' chunk (as written by
+# optimize-meshes) or, for plain 'pnct' + 'str0' + 'idx0' files (as written by export-meshes.py), from its vertices.
+#(see export-scene.py for the format; infile and outfile may be the same file)
+
+import sys
+import os
+import struct
+import zlib
+
+sys.path.append(os.path.dirname(os.path.abspath(__file__)))
+import scene_file
+
+if len(sys.argv) not in [3, 4]:
+	print("\n\nUsage:\npython upgrade-scene.py <infile.scene> <outfile.scene> [meshes.pnct]\nRewrites a scene file in the v2 (table of contents) format, with mesh bounds and a spatial index if a mesh file is given.\n")
+	exit(1)
+
+infile = sys.argv[1]
+outfile = sys.argv[2]
+meshfile = sys.argv[3] if len(sys.argv) == 4 else None
+
+#read all chunks from a file, accepting both v1 and v2 chunk headers (see read_write_chunk.hpp):
+def read_chunks(filename):
+	data = open(filename, 'rb').read()
+	chunks = []
+	at = 0
+	while at < len(data):
+		if at + 8 > len(data):
+			print("ERROR: '" + filename + "' has a truncated chunk header.")
+			exit(1)
+		(magic, size) = struct.unpack('4sI', data[at:at+8])
+		at += 8
+		if size == 0xffffffff:
+			(size, crc, version, padding) = struct.unpack('IIHH', data[at:at+12])
+			at += 12 + padding
+			if zlib.crc32(data[at:at+size]) != crc:
+				print("ERROR: chunk '" + magic.decode('utf8') + "' of '" + filename + "' fails its CRC check.")
+				exit(1)
+		if at + size > len(data):
+			print("ERROR: chunk '" + magic.decode('utf8') + "' of '" + filename + "' runs past the end of the file.")
+			exit(1)
+		chunks.append((magic, data[at:at+size]))
+		at += size
+	return chunks
+
+chunks = read_chunks(infile)
+magics = [c[0] for c in chunks]
+
+if b'toc0' in magics:
+	print("'" + infile + "' is already a v2 scene file; rewriting it anyway.")
+	chunks = [c for c in chunks if c[0] not in [b'toc0', b'bnd0', b'bvh0', b'bvl0']]
+	magics = [c[0] for c in chunks]
+
+if magics[0:5] != [b'str0', b'xfh0', b'msh0', b'cam0', b'lmp0']:
+	print("ERROR: '" + infile + "' doesn't start with the str0, xfh0, msh0, cam0, lmp0 chunks of a scene file.")
+	exit(1)
+if len(chunks) > 5:
+	print("ERROR: '" + infile + "' has extra data after its lmp0 chunk, which a v2 file can't carry.")
+	exit(1)
+
+chunks = chunks[0:5]
+scene_strings = chunks[0][1]
+mesh_data = chunks[2][1]
+
+if meshfile:
+	#mesh name -> (min, max) from the mesh file:
+	mesh_chunks = read_chunks(meshfile)
+	mesh_magics = [c[0] for c in mesh_chunks]
+	mesh_chunks = dict(mesh_chunks)
+	index_magic = b'idx1' if b'idx1' in mesh_chunks else b'idx0'
+	if not (b'str0' in mesh_chunks and index_magic in mesh_chunks):
+		print("ERROR: '" + meshfile + "' doesn't have the str0 and index chunks of a mesh file.")
+		exit(1)
+	mesh_strings = mesh_chunks[b'str0']
+	index = [e[0:4] for e in struct.iter_unpack('IIIIII' if index_magic == b'idx1' else 'IIII', mesh_chunks[index_magic])]
+	mesh_bounds = dict()
+	if b'bnd0' in mesh_chunks:
+		#(box min, max, sphere center, radius per index entry)
+		for ((name_begin, name_end, vertex_begin, vertex_end), b) in zip(index, struct.iter_unpack('3f3f3ff', mesh_chunks[b'bnd0'])):
+			mesh_bounds[mesh_strings[name_begin:name_end]] = (b[0:3], b[3:6])
+	elif mesh_magics[0] == b'pnct':
+		vertices = mesh_chunks[b'pnct']
+		STRIDE = 3*4 + 3*4 + 4 + 2*4 #position, normal, color, texcoord
+		for (name_begin, name_end, vertex_begin, vertex_end) in index:
+			positions = [struct.unpack_from('3f', vertices, v * STRIDE) for v in range(vertex_begin, vertex_end)]
+			if len(positions) == 0: continue
+			lo = [min(p[i] for p in positions) for i in range(0,3)]
+			hi = [max(p[i] for p in positions) for i in range(0,3)]
+			mesh_bounds[mesh_strings[name_begin:name_end]] = (lo, hi)
+	else:
+		print("ERROR: '" + meshfile + "' has neither a bnd0 chunk nor plain pnct vertices to compute bounds from.")
+		exit(1)
+
+	#world matrix (as a function from points to points) of each hierarchy entry, composed the way the game does:
+	# (entries are parent, name begin, name end, position, rotation (x,y,z,w), scale; parents come before children)
+	def compose(parent, position, rotation, scale):
+		(x, y, z, w) = rotation
+		R = [
+			[1 - 2*(y*y + z*z), 2*(x*y - z*w), 2*(x*z + y*w)],
+			[2*(x*y + z*w), 1 - 2*(x*x + z*z), 2*(y*z - x*w)],
+			[2*(x*z - y*w), 2*(y*z + x*w), 1 - 2*(x*x + y*y)],
+		]
+		def local(p):
+			s = [p[i] * scale[i] for i in range(0,3)]
+			return tuple(sum(R[r][c] * s[c] for c in range(0,3)) + position[r] for r in range(0,3))
+		if parent is None: return local
+		return lambda p: parent(local(p))
+	world_from_local = []
+	for e in struct.iter_unpack('iII3f4f3f', chunks[1][1]):
+		parent = world_from_local[e[0]] if e[0] >= 0 else None
+		world_from_local.append(compose(parent, e[3:6], e[6:10], e[10:13]))
+
+	bounds = []
+	for (transform, name_begin, name_end) in struct.iter_unpack('III', mesh_data):
+		name = scene_strings[name_begin:name_end]
+		if name not in mesh_bounds:
+			print("ERROR: scene mesh '" + name.decode('utf8') + "' isn't in '" + meshfile + "'.")
+			exit(1)
+		(lo, hi) = mesh_bounds[name]
+		(world_lo, world_hi) = scene_file.transform_bounds(world_from_local[transform], lo, hi)
+		bounds.append((lo, hi, world_lo, world_hi))
+
+	(bvh_data, leaf_data) = scene_file.build_index([(b[2], b[3]) for b in bounds])
+	chunks.append((b'bnd0', b"".join(struct.pack('3f3f3f3f', *b[0], *b[1], *b[2], *b[3]) for b in bounds)))
+	chunks.append((b'bvh0', bvh_data))
+	chunks.append((b'bvl0', leaf_data))
+
+#write the table of contents and chunks:
+size = scene_file.write_scene(outfile, chunks)
+print("Wrote " + str(size) + " bytes (" + ", ".join(c[0].decode('utf8') for c in chunks) + ") to '" + outfile + "'")
@@ -2,6 +2,7 @@
 #include "ShowMeshesMode.hpp"
 #include "Load.hpp"
 #include "GL.hpp"
+#include "gl_state.hpp"
 #include "load_save_png.hpp"
 
 #include <SDL3/SDL.h>
@@ -177,6 +178,9 @@ int main(int argc, char **argv) {
 			Mode::current->draw(drawable_size);
 		}
 
+		//finish counting redundant GL calls skipped this frame:
+		gl_state_end_frame();
+
 		//Wait until the recently-drawn frame is shown before doing it all again:
 		SDL_GL_SwapWindow(Mode::window);
 	}
@@ -2,6 +2,7 @@
 #include "ShowSceneMode.hpp"
 #include "Load.hpp"
 #include "GL.hpp"
+#include "gl_state.hpp"
 #include "load_save_png.hpp"
 #include "ShowSceneProgram.hpp"
 
@@ -110,20 +111,29 @@ int main(int argc, char **argv) {
 	if (scene_file != "") {
 		try {
 			scene = new Scene();
-			scene->load(scene_file, [&buffer,&buffer_vao](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
+			scene->load_batched(scene_file, [&buffer,&buffer_vao](Scene &scene, std::vector< Scene::MeshRef > const &refs){
 				if (!buffer_vao) return;
-				Mesh const &mesh = buffer->lookup(mesh_name);
-
-				scene.drawables.emplace_back(transform);
-				Scene::Drawable &drawable = scene.drawables.back();
-
-				drawable.pipeline = show_scene_program_pipeline;
-
-				drawable.pipeline.vao = buffer_vao;
-				drawable.pipeline.type = mesh.type;
-				drawable.pipeline.start = mesh.start;
-				drawable.pipeline.count = mesh.count;
-
+				for (auto const &ref : refs) {
+					MeshId id = buffer->lookup_id(ref.mesh_name);
+					Mesh const &mesh = (*buffer)[id];
+
+					scene.drawables.emplace_back(ref.transform);
+					Scene::Drawable &drawable = scene.drawables.back();
+
+					drawable.pipeline = show_scene_program_pipeline;
+					drawable.pipeline.edit().vao = buffer_vao;
+					drawable.set_mesh(mesh);
+
+					//simplified versions, for when the drawable is small on screen:
+					for (uint32_t l = 0; l < Scene::Drawable::MaxLODs; ++l) {
+						MeshId lod = buffer->find_lod(id, l + 1);
+						if (!lod.valid()) break;
+						drawable.lods[l].start = (*buffer)[lod].start;
+						drawable.lods[l].count = (*buffer)[lod].count;
+						drawable.lods[l].max_screen_size = Scene::Drawable::default_lod_screen_size(l + 1);
+						drawable.lod_count = l + 1;
+					}
+				}
 			});
 		} catch (std::exception &e) {
 			std::cerr << "ERROR loading scene '" << scene_file << "': " << e.what() << std::endl;
@@ -219,6 +229,9 @@ int main(int argc, char **argv) {
 			Mode::current->draw(drawable_size);
 		}
 
+		//finish counting redundant GL calls skipped this frame:
+		gl_state_end_frame();
+
 		//Wait until the recently-drawn frame is shown before doing it all again:
 		SDL_GL_SwapWindow(Mode::window);
 	}
@@ -0,0 +1,28 @@
+#include "string_intern.hpp"
+
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+namespace {
+	//hash that accepts std::string_view, so lookups don't need to build a std::string:
+	struct TransparentHash {
+		using is_transparent = void;
+		size_t operator()(std::string_view str) const { return std::hash< std::string_view >()(str); }
+	};
+}
+
+InternedString intern_string(std::string_view str) {
+	if (str.empty()) return InternedString();
+
+	//(set elements are nodes, so the stored strings never move)
+	static std::unordered_set< std::string, TransparentHash, std::equal_to<> > strings;
+	static std::mutex strings_mutex;
+
+	std::lock_guard< std::mutex > lock(strings_mutex);
+	auto f = strings.find(str);
+	if (f == strings.end()) {
+		f = strings.emplace(str).first;
+	}
+	return InternedString(std::string_view(*f));
+}
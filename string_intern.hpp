@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+ * Process-wide string interning:
+ *
+ *  InternedString name = intern_string("lever.001");
+ *  std::string_view view = name; //(or name.view())
+ *
+ * Equal strings always intern to the same characters, and interned strings
+ * are never freed, so the returned handles stay valid until exit and are
+ * cheap to copy around.
+ */
+
+#include <string_view>
+
+//handle to an interned string; only intern_string() makes non-empty ones, so a handle can't dangle:
+struct InternedString {
+	InternedString() = default; //the empty string
+
+	std::string_view view() const { return str; }
+	operator std::string_view() const { return str; }
+	bool empty() const { return str.empty(); }
+
+	//equal strings intern to the same characters, so comparing pointers is enough:
+	bool operator==(InternedString const &other) const { return str.data() == other.str.data(); }
+
+private:
+	explicit InternedString(std::string_view str_) : str(str_) { }
+	friend InternedString intern_string(std::string_view str);
+	std::string_view str;
+};
+
+//returns a handle to the stored copy of 'str' (storing it first, if needed):
+// (the empty string interns to the empty handle)
+InternedString intern_string(std::string_view str);
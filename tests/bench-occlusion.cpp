@@ -0,0 +1,112 @@
+//bench-occlusion: times a frame of software occlusion culling (Occlusion.hpp) -- drawing occluders, then testing boxes against them.
+//
+//Usage: bench-occlusion [frames [occluders [boxes]]]
+// (defaults to 200 frames of 64 box-shaped occluders and 4096 test boxes, in a random city-like layout; no window or OpenGL needed)
+
+#include "../Occlusion.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+//a unit cube, [-1,1]^3:
+static Occluder make_cube() {
+	Occluder cube;
+	for (uint32_t c = 0; c < 8; ++c) {
+		cube.positions.emplace_back((c & 1) ? 1.0f : -1.0f, (c & 2) ? 1.0f : -1.0f, (c & 4) ? 1.0f : -1.0f);
+	}
+	cube.triangles = {
+		0,2,1, 1,2,3, //-z
+		4,5,6, 5,7,6, //+z
+		0,1,4, 1,5,4, //-y
+		2,6,3, 3,6,7, //+y
+		0,4,2, 2,4,6, //-x
+		1,3,5, 3,7,5, //+x
+	};
+	return cube;
+}
+
+int main(int argc, char **argv) {
+	uint32_t frames = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 200);
+	uint32_t occluder_count = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 64);
+	uint32_t box_count = (argc > 3 ? uint32_t(std::stoul(argv[3])) : 4096);
+
+	//buildings (occluders) and smaller things (boxes) scattered in front of a camera at the origin looking down -z:
+	std::mt19937 mt(0x0cc1);
+	std::uniform_real_distribution< float > across(-60.0f, 60.0f);
+	std::uniform_real_distribution< float > along(-120.0f, -8.0f);
+	std::uniform_real_distribution< float > size(0.5f, 6.0f);
+
+	Occluder cube = make_cube();
+	std::vector< glm::mat4 > world_from_occluders;
+	for (uint32_t i = 0; i < occluder_count; ++i) {
+		glm::vec3 scale = glm::vec3(size(mt), 2.0f * size(mt), size(mt));
+		glm::mat4 world_from_occluder = glm::mat4(
+			glm::vec4(scale.x, 0.0f, 0.0f, 0.0f),
+			glm::vec4(0.0f, scale.y, 0.0f, 0.0f),
+			glm::vec4(0.0f, 0.0f, scale.z, 0.0f),
+			glm::vec4(across(mt), scale.y - 2.0f, along(mt), 1.0f) //(standing on y = -2)
+		);
+		world_from_occluders.emplace_back(world_from_occluder);
+	}
+	struct Box { glm::vec3 min, max; };
+	std::vector< Box > boxes;
+	for (uint32_t i = 0; i < box_count; ++i) {
+		glm::vec3 center = glm::vec3(across(mt), 0.0f, along(mt));
+		float half = 0.1f * size(mt);
+		boxes.emplace_back(Box{ center - glm::vec3(half), center + glm::vec3(half) });
+	}
+
+	OcclusionBuffer occlusion;
+	std::cout << "Occlusion buffer: " << occlusion.width << "x" << occlusion.height << " pixels, " << occlusion.threads << " thread(s); "
+		<< occluder_count << " occluders, " << box_count << " boxes." << std::endl;
+
+	using Clock = std::chrono::high_resolution_clock;
+	auto ms = [](Clock::time_point a, Clock::time_point b) { return std::chrono::duration< double, std::milli >(b - a).count(); };
+	double draw_total = 0.0, draw_fastest = std::numeric_limits< double >::infinity();
+	double test_total = 0.0, test_fastest = std::numeric_limits< double >::infinity();
+	uint32_t hidden = 0;
+
+	for (uint32_t f = 0; f < frames; ++f) {
+		//(the camera turns a little each frame, so frames aren't all the same)
+		float angle = 0.2f * std::sin(0.05f * float(f));
+		glm::mat4 view_from_world = glm::mat4(
+			glm::vec4(std::cos(angle), 0.0f, -std::sin(angle), 0.0f),
+			glm::vec4(0.0f, 1.0f, 0.0f, 0.0f),
+			glm::vec4(std::sin(angle), 0.0f, std::cos(angle), 0.0f),
+			glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)
+		);
+		glm::mat4 clip_from_world = glm::infinitePerspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f) * view_from_world;
+
+		auto before = Clock::now();
+		occlusion.clear();
+		for (auto const &world_from_occluder : world_from_occluders) {
+			occlusion.add(clip_from_world * world_from_occluder, cube);
+		}
+		occlusion.finish();
+		auto drawn = Clock::now();
+		hidden = 0;
+		for (auto const &box : boxes) {
+			if (!occlusion.visible(clip_from_world, box.min, box.max)) hidden += 1;
+		}
+		auto tested = Clock::now();
+
+		draw_total += ms(before, drawn);
+		draw_fastest = std::min(draw_fastest, ms(before, drawn));
+		test_total += ms(drawn, tested);
+		test_fastest = std::min(test_fastest, ms(drawn, tested));
+	}
+
+	std::cout << "Drawing occluders (clear + add + finish): " << (frames ? draw_total / frames : 0.0) << " ms average, " << draw_fastest << " ms fastest." << std::endl;
+	std::cout << "Testing boxes: " << (frames ? test_total / frames : 0.0) << " ms average, " << test_fastest << " ms fastest"
+		<< " (" << hidden << " of " << box_count << " hidden in the last frame)." << std::endl;
+	std::cout << "Over " << frames << " frames." << std::endl;
+	return 0;
+}
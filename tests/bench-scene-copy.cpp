@@ -0,0 +1,60 @@
+//bench-scene-copy: times copying a loaded scene, which is most of what restarting the game (making a new PlayMode) costs.
+//
+//Usage: bench-scene-copy [file.scene [copies]]
+// (defaults to the game's level, oil_rig.scene, copied 200 times; no window or OpenGL needed)
+// (built into dist/, so the level is found next to it -- loose or in assets.pak -- like the game finds it)
+
+#include "../Scene.hpp"
+#include "../data_path.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <string>
+
+int main(int argc, char **argv) {
+	std::string filename = (argc > 1 ? argv[1] : data_path("oil_rig.scene"));
+	uint32_t copies = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 200);
+
+	//a drawable per mesh reference, with a pipeline like the game's (its GL names are never used):
+	Scene::Drawable::Pipeline pipeline;
+	pipeline.program = 1;
+	pipeline.vao = 1;
+	pipeline.object_block = true;
+	pipeline.count = 3;
+	pipeline.set_uniforms = [](){ };
+
+	Scene scene;
+	try {
+		scene.load_batched(filename, [&](Scene &scene, std::vector< Scene::MeshRef > const &refs) {
+			for (auto const &ref : refs) {
+				scene.drawables.emplace_back(ref.transform);
+				scene.drawables.back().pipeline = pipeline;
+			}
+		});
+	} catch (std::exception &e) {
+		std::cerr << "Failed to load '" << filename << "': " << e.what() << std::endl;
+		return 1;
+	}
+	std::cout << "'" << filename << "': " << scene.transforms.size() << " transforms, " << scene.drawables.size() << " drawables, "
+		<< scene.cameras.size() << " cameras, " << scene.lights.size() << " lights." << std::endl;
+
+	using Clock = std::chrono::high_resolution_clock;
+	double fastest = std::numeric_limits< double >::infinity();
+	double total = 0.0;
+	for (uint32_t i = 0; i < copies; ++i) {
+		auto before = Clock::now();
+		Scene copy(scene);
+		auto after = Clock::now();
+		double ms = std::chrono::duration< double, std::milli >(after - before).count();
+		fastest = std::min(fastest, ms);
+		total += ms;
+		if (copy.drawables.size() != scene.drawables.size()) {
+			std::cerr << "Copy has " << copy.drawables.size() << " drawables, expected " << scene.drawables.size() << "." << std::endl;
+			return 1;
+		}
+	}
+
+	std::cout << "Scene copy: " << (copies ? total / copies : 0.0) << " ms average, " << fastest << " ms fastest over " << copies << " copies." << std::endl;
+	return 0;
+}
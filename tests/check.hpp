@@ -0,0 +1,43 @@
+#pragma once
+
+/*
+ * The little harness shared by the headless tests in this directory:
+ *
+ *  check(box_visible(...), "box in front of the wall is visible"); //prints "FAILED: ..." if false
+ *  ...
+ *  return report("test-occlusion"); //(at the end of main)
+ *
+ * Tests are run with no arguments; each prints its failed checks as they happen, then a
+ *  summary line, and exits with a nonzero status if there were any failures.
+ */
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+inline uint32_t checks = 0;
+inline uint32_t failures = 0;
+
+inline void check(bool ok, std::string const &what) {
+	checks += 1;
+	if (!ok) {
+		failures += 1;
+		std::cerr << "FAILED: " << what << std::endl;
+	}
+}
+
+//print how many checks passed; returns the exit status for main():
+inline int report(std::string const &test) {
+	std::cout << test << ": " << (checks - failures) << " of " << checks << " checks passed." << std::endl;
+	return failures == 0 ? 0 : 1;
+}
+
+//the tests' camera -- at the origin, looking down -z, with a 60 degree vertical fov:
+inline float const TestCameraFovy = glm::radians(60.0f);
+inline float const TestCameraNear = 0.1f;
+inline glm::mat4 make_clip_from_world(float aspect = 1.0f) {
+	return glm::infinitePerspective(TestCameraFovy, aspect, TestCameraNear);
+}
@@ -0,0 +1,183 @@
+//test-frustum: checks the view-frustum culling helpers in Frustum.hpp (no window or OpenGL needed; see check.hpp).
+
+#include "check.hpp"
+
+#include "../Frustum.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+//is the world-space [min,max] box outside one of the frustum's planes? (checking all eight corners -- slow, but obviously right)
+static bool outside_by_corners(Frustum const &frustum, glm::vec3 const &min, glm::vec3 const &max) {
+	for (auto const &plane : frustum.planes) {
+		bool all_outside = true;
+		for (uint32_t c = 0; c < 8; ++c) {
+			glm::vec3 p = glm::vec3((c & 1) ? max.x : min.x, (c & 2) ? max.y : min.y, (c & 4) ? max.z : min.z);
+			if (glm::dot(glm::vec3(plane), p) + plane.w >= 0.0f) all_outside = false;
+		}
+		if (all_outside) return true;
+	}
+	return false;
+}
+
+//how far the box is from being on the other side of any plane (small values are too close to call):
+static float margin_by_corners(Frustum const &frustum, glm::vec3 const &min, glm::vec3 const &max) {
+	float margin = std::numeric_limits< float >::infinity();
+	for (auto const &plane : frustum.planes) {
+		float scale = glm::length(glm::vec3(plane));
+		if (scale == 0.0f) continue;
+		for (uint32_t c = 0; c < 8; ++c) {
+			glm::vec3 p = glm::vec3((c & 1) ? max.x : min.x, (c & 2) ? max.y : min.y, (c & 4) ? max.z : min.z);
+			margin = std::min(margin, std::abs(glm::dot(glm::vec3(plane), p) + plane.w) / scale);
+		}
+	}
+	return margin;
+}
+
+static void test_boxes() {
+	Frustum frustum = Frustum::from_clip(make_clip_from_world());
+	glm::mat4x3 identity = glm::mat4x3(1.0f);
+
+	BoxList boxes;
+	boxes.push(identity, glm::vec3(-1.0f, -1.0f, -11.0f), glm::vec3(1.0f, 1.0f, -9.0f)); //0: straight ahead
+	boxes.push(identity, glm::vec3(-1.0f, -1.0f, 9.0f), glm::vec3(1.0f, 1.0f, 11.0f)); //1: behind
+	boxes.push(identity, glm::vec3(-101.0f, -1.0f, -11.0f), glm::vec3(-99.0f, 1.0f, -9.0f)); //2: far to the left
+	boxes.push(identity, glm::vec3(-1.0f, 99.0f, -11.0f), glm::vec3(1.0f, 101.0f, -9.0f)); //3: far above
+	boxes.push(identity, glm::vec3(-1.0f, -1.0f, -1.0f), glm::vec3(1.0f, 1.0f, 1.0f)); //4: around the camera
+	boxes.push(identity, glm::vec3(1.0f), glm::vec3(-1.0f)); //5: empty (bounds unknown)
+	boxes.push(identity, glm::vec3(-1.0f, -1.0f, -1e6f), glm::vec3(1.0f, 1.0f, -1e6f + 1.0f)); //6: very far ahead (no far plane)
+	//7: behind the camera, but turned around to be in front by its transform:
+	glm::mat4x3 turned = glm::mat4x3(glm::mat3_cast(glm::angleAxis(glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f))));
+	boxes.push(turned, glm::vec3(-1.0f, -1.0f, 9.0f), glm::vec3(1.0f, 1.0f, 11.0f));
+	//8: straddling the left side plane:
+	boxes.push(identity, glm::vec3(-7.0f, -1.0f, -11.0f), glm::vec3(-5.0f, 1.0f, -9.0f));
+
+	std::vector< uint8_t > expected = { 1, 0, 0, 0, 1, 1, 1, 1, 1 };
+
+	std::vector< uint8_t > visible;
+	uint32_t count = cull_boxes(frustum, boxes, &visible);
+
+	check(visible.size() == expected.size(), "cull_boxes returns one result per box");
+	uint32_t expected_count = 0;
+	for (size_t i = 0; i < expected.size() && i < visible.size(); ++i) {
+		check(visible[i] == expected[i], "box " + std::to_string(i) + " is " + (expected[i] ? "visible" : "culled"));
+		expected_count += expected[i];
+	}
+	check(count == expected_count, "cull_boxes returns the number of visible boxes");
+
+	//culling again reuses the list:
+	boxes.clear();
+	check(boxes.size() == 0, "BoxList::clear empties the list");
+	count = cull_boxes(frustum, boxes, &visible);
+	check(count == 0 && visible.empty(), "culling no boxes");
+}
+
+static void test_random_boxes() {
+	//random boxes under random transforms, against a brute-force check of their corners:
+	// (1003 boxes, so both the four-at-a-time path and the leftovers get used)
+	std::mt19937 mt(0x5eed);
+	auto uniform = [&](float lo, float hi) { return std::uniform_real_distribution< float >(lo, hi)(mt); };
+
+	Frustum frustum = Frustum::from_clip(make_clip_from_world());
+	BoxList boxes;
+	std::vector< glm::vec3 > world_min, world_max;
+	for (uint32_t i = 0; i < 1003; ++i) {
+		glm::quat rotation = glm::normalize(glm::quat(uniform(-1.0f, 1.0f), uniform(-1.0f, 1.0f), uniform(-1.0f, 1.0f), uniform(-1.0f, 1.0f)));
+		glm::mat3 basis = glm::mat3_cast(rotation);
+		glm::mat4x3 world_from_local = glm::mat4x3(basis[0] * uniform(0.5f, 2.0f), basis[1] * uniform(0.5f, 2.0f), basis[2] * uniform(0.5f, 2.0f), glm::vec3(uniform(-40.0f, 40.0f), uniform(-40.0f, 40.0f), uniform(-60.0f, 20.0f)));
+		glm::vec3 min = glm::vec3(uniform(-3.0f, 0.0f), uniform(-3.0f, 0.0f), uniform(-3.0f, 0.0f));
+		glm::vec3 max = min + glm::vec3(uniform(0.0f, 3.0f), uniform(0.0f, 3.0f), uniform(0.0f, 3.0f));
+		boxes.push(world_from_local, min, max);
+
+		//the world-space bounds of the transformed box, which is what BoxList::push stores:
+		glm::vec3 lo = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 hi = glm::vec3(-std::numeric_limits< float >::infinity());
+		for (uint32_t c = 0; c < 8; ++c) {
+			glm::vec3 p = world_from_local * glm::vec4((c & 1) ? max.x : min.x, (c & 2) ? max.y : min.y, (c & 4) ? max.z : min.z, 1.0f);
+			lo = glm::min(lo, p);
+			hi = glm::max(hi, p);
+		}
+		world_min.emplace_back(lo);
+		world_max.emplace_back(hi);
+	}
+
+	std::vector< uint8_t > visible;
+	uint32_t count = cull_boxes(frustum, boxes, &visible);
+
+	uint32_t culled = 0, disagree = 0, listed = 0;
+	for (size_t i = 0; i < world_min.size(); ++i) {
+		listed += visible[i];
+		bool outside = outside_by_corners(frustum, world_min[i], world_max[i]);
+		if (outside) culled += 1;
+		if (bool(visible[i]) == !outside) continue;
+		if (margin_by_corners(frustum, world_min[i], world_max[i]) < 1e-3f) continue; //(too close to call in floating point)
+		disagree += 1;
+	}
+	check(disagree == 0, std::to_string(disagree) + " random boxes culled differently than a corner-by-corner check");
+	check(count == listed, "cull_boxes count matches its per-box results");
+	check(culled > 100 && culled < 900, "random boxes are a mix of visible and culled (" + std::to_string(culled) + " culled)");
+}
+
+static void test_meshlets() {
+	glm::mat4 clip_from_world = make_clip_from_world();
+	Frustum frustum = Frustum::from_clip(clip_from_world);
+	glm::vec3 eye = glm::vec3(0.0f);
+
+	auto meshlet = [](uint32_t start, uint32_t count, glm::vec3 center, float radius, glm::vec3 axis, float cone_cos) {
+		Meshlet m;
+		m.start = start;
+		m.count = count;
+		m.center = center;
+		m.radius = radius;
+		m.cone_axis = axis;
+		m.cone_cos = cone_cos;
+		return m;
+	};
+	std::vector< Meshlet > meshlets = {
+		meshlet(0, 30, glm::vec3(0.0f, 0.0f, -10.0f), 1.0f, glm::vec3(0.0f, 0.0f, 1.0f), 0.9f), //facing the camera
+		meshlet(30, 30, glm::vec3(0.0f, 0.0f, -10.0f), 1.0f, glm::vec3(0.0f, 0.0f, -1.0f), 0.9f), //facing away
+		meshlet(60, 30, glm::vec3(0.0f, 0.0f, 10.0f), 1.0f, glm::vec3(0.0f, 0.0f, 1.0f), 0.9f), //behind the camera
+		meshlet(90, 30, glm::vec3(0.0f, 0.0f, -10.0f), 1.0f, glm::vec3(0.0f, 0.0f, -1.0f), -1.0f), //no cone (never back-face culled)
+		meshlet(120, 30, glm::vec3(2.0f, 0.0f, -10.0f), 1.0f, glm::vec3(0.0f, 0.0f, 1.0f), 0.0f), //also no cone
+	};
+
+	std::vector< glm::uvec2 > ranges;
+	uint32_t drawn = cull_meshlets(frustum, eye, false, meshlets.data(), uint32_t(meshlets.size()), &ranges);
+	check(drawn == 4, "meshlets in front of the camera are kept (without back-face tests)");
+	check(ranges.size() == 2 && ranges[0] == glm::uvec2(0, 60) && ranges[1] == glm::uvec2(90, 60), "touching meshlet ranges are merged");
+
+	ranges.clear();
+	drawn = cull_meshlets(frustum, eye, true, meshlets.data(), uint32_t(meshlets.size()), &ranges);
+	check(drawn == 3, "meshlets facing away are skipped (with back-face tests)");
+	check(ranges.size() == 2 && ranges[0] == glm::uvec2(0, 30) && ranges[1] == glm::uvec2(90, 60), "ranges skip back-facing meshlets");
+
+	//a meshlet seen edge-on (the eye within its cone's spread) is kept:
+	Meshlet edge_on = meshlet(0, 30, glm::vec3(0.0f, 0.0f, -10.0f), 1.0f, glm::normalize(glm::vec3(1.0f, 0.0f, -0.2f)), 0.9f);
+	ranges.clear();
+	check(cull_meshlets(frustum, eye, true, &edge_on, 1, &ranges) == 1, "edge-on meshlet is kept");
+
+	//'keep' can reject meshlets that pass the other tests (e.g., occluded ones):
+	uint32_t rejected_start = 30;
+	auto not_at = [](void const *context, Meshlet const &meshlet) {
+		return meshlet.start != *static_cast< uint32_t const * >(context);
+	};
+	ranges.clear();
+	drawn = cull_meshlets(frustum, eye, false, meshlets.data(), uint32_t(meshlets.size()), &ranges, not_at, &rejected_start);
+	check(drawn == 3, "meshlets rejected by 'keep' are skipped");
+	check(ranges.size() == 2 && ranges[0] == glm::uvec2(0, 30) && ranges[1] == glm::uvec2(90, 60), "ranges skip meshlets rejected by 'keep'");
+}
+
+int main(int argc, char **argv) {
+	test_boxes();
+	test_random_boxes();
+	test_meshlets();
+
+	return report("test-frustum");
+}
@@ -0,0 +1,255 @@
+//test-light-clusters: checks the light binning in LightClusters::build (no window or OpenGL needed; see check.hpp).
+
+#include "check.hpp"
+
+#include "../LightClusters.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+//a 1600x900 viewport, so each of the default 16x9 tiles is 100x100 pixels:
+static glm::uvec2 const DrawableSize = glm::uvec2(1600, 900);
+
+//the test camera, moved to 'position' and turned by 'rotation':
+static Scene::Camera &add_camera(Scene &scene, glm::vec3 const &position = glm::vec3(0.0f), glm::quat const &rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f)) {
+	scene.transforms.emplace_back();
+	Scene::Transform *transform = &scene.transforms.back();
+	transform->position = position;
+	transform->rotation = rotation;
+	scene.cameras.emplace_back(transform);
+	Scene::Camera &camera = scene.cameras.back();
+	camera.fovy = TestCameraFovy;
+	camera.aspect = float(DrawableSize.x) / float(DrawableSize.y);
+	camera.near = TestCameraNear;
+	return camera;
+}
+
+static Scene::Light &add_light(Scene &scene, Scene::Light::Type type, glm::vec3 const &position, glm::vec3 const &energy = glm::vec3(1.0f), float distance = 0.0f) {
+	scene.transforms.emplace_back();
+	Scene::Transform *transform = &scene.transforms.back();
+	transform->position = position;
+	scene.lights.emplace_back(transform);
+	Scene::Light &light = scene.lights.back();
+	light.type = type;
+	light.energy = energy;
+	light.distance = distance;
+	return light;
+}
+
+//the cluster the shader would look up for a fragment at world position 'at' (as in LitColorTextureProgram's CLUSTERED path):
+// (returns false if 'at' isn't on screen)
+static bool cluster_at(LightClusters const &clusters, Scene::Camera const &camera, glm::vec3 const &at, uint32_t *index) {
+	glm::vec4 clip = camera.make_projection() * glm::mat4(camera.transform->make_local_from_world()) * glm::vec4(at, 1.0f);
+	if (!(clip.w > camera.near)) return false;
+	glm::vec2 ndc = glm::vec2(clip) / clip.w;
+	if (ndc.x <= -1.0f || ndc.x >= 1.0f || ndc.y <= -1.0f || ndc.y >= 1.0f) return false;
+	glm::vec2 frag_coord = (0.5f * ndc + 0.5f) * glm::vec2(DrawableSize);
+
+	float depth = glm::dot(glm::vec3(clusters.block.VIEW_DEPTH), at) + clusters.block.VIEW_DEPTH.w;
+	glm::ivec3 cell = glm::ivec3(
+		int(frag_coord.x * clusters.block.CLUSTER_SCALE.x),
+		int(frag_coord.y * clusters.block.CLUSTER_SCALE.y),
+		int(std::floor(std::log(std::max(depth, 1e-6f)) * clusters.block.CLUSTER_SCALE.z + clusters.block.CLUSTER_SCALE.w))
+	);
+	cell = glm::clamp(cell, glm::ivec3(0), glm::ivec3(clusters.block.CLUSTER_COUNTS) - 1);
+	*index = clusters.cluster(cell.x, cell.y, cell.z);
+	return true;
+}
+
+static bool cluster_has(LightClusters const &clusters, uint32_t index, uint32_t light) {
+	glm::uvec2 range = clusters.cluster_data[index];
+	for (uint32_t i = 0; i < range.y; ++i) {
+		if (clusters.index_data[range.x + i] == light) return true;
+	}
+	return false;
+}
+
+//clusters that list 'light':
+static uint32_t clusters_with(LightClusters const &clusters, uint32_t light) {
+	uint32_t count = 0;
+	for (uint32_t c = 0; c < clusters.cluster_data.size(); ++c) {
+		if (cluster_has(clusters, c, light)) count += 1;
+	}
+	return count;
+}
+
+//every on-screen point within 'radius' of 'center' should be in a cluster that lists 'light'; returns how many points were tested:
+static uint32_t check_coverage(LightClusters const &clusters, Scene::Camera const &camera, uint32_t light, glm::vec3 const &center, float radius, std::string const &what) {
+	uint32_t tested = 0, missed = 0;
+	uint32_t const Steps = 12;
+	for (uint32_t z = 0; z <= Steps; ++z) {
+		for (uint32_t y = 0; y <= Steps; ++y) {
+			for (uint32_t x = 0; x <= Steps; ++x) {
+				glm::vec3 offset = radius * (2.0f * glm::vec3(x, y, z) / float(Steps) - 1.0f);
+				if (glm::dot(offset, offset) > radius * radius) continue;
+				uint32_t index;
+				if (!cluster_at(clusters, camera, center + offset, &index)) continue;
+				tested += 1;
+				if (!cluster_has(clusters, index, light)) missed += 1;
+			}
+		}
+	}
+	check(missed == 0, what + " reaches every cluster it lights (" + std::to_string(missed) + " of " + std::to_string(tested) + " points missed)");
+	return tested;
+}
+
+//cluster ranges tile index_data exactly, and the statistics agree with them:
+static void check_layout(LightClusters const &clusters, std::string const &what) {
+	uint32_t lights = uint32_t(clusters.light_data.size() / LightClusters::LightTexels);
+	bool in_order = true, valid_indices = true;
+	uint32_t next = 0, most = 0;
+	for (auto const &range : clusters.cluster_data) {
+		if (range.x != next) in_order = false;
+		next = range.x + range.y;
+		most = std::max(most, range.y);
+		for (uint32_t i = 0; i < range.y && range.x + i < clusters.index_data.size(); ++i) {
+			uint32_t light = clusters.index_data[range.x + i];
+			if (light < clusters.global_lights || light >= lights) valid_indices = false;
+		}
+	}
+	check(clusters.cluster_data.size() == clusters.tiles_x * clusters.tiles_y * clusters.slices, what + ": one range per cluster");
+	check(clusters.light_data.size() % LightClusters::LightTexels == 0, what + ": whole lights in light_data");
+	check(in_order && next == clusters.index_data.size(), what + ": cluster ranges cover index_data in order");
+	check(valid_indices, what + ": clusters only list clustered lights");
+	check(most == clusters.max_cluster_lights, what + ": max_cluster_lights is the largest cluster");
+	check(lights == clusters.global_lights + clusters.clustered_lights, what + ": light_data holds the global and clustered lights");
+	check(clusters.block.CLUSTER_COUNTS == glm::ivec4(clusters.tiles_x, clusters.tiles_y, clusters.slices, clusters.global_lights), what + ": CLUSTER_COUNTS matches");
+}
+
+static void test_empty() {
+	Scene scene;
+	Scene::Camera &camera = add_camera(scene);
+	LightClusters clusters;
+	clusters.build(scene, camera, DrawableSize);
+	check(clusters.light_data.empty() && clusters.index_data.empty(), "no lights, nothing listed");
+	check(clusters.global_lights == 0 && clusters.clustered_lights == 0 && clusters.max_cluster_lights == 0, "no lights, zero statistics");
+	check_layout(clusters, "empty scene");
+	check(clusters.block.CLUSTER_SCALE.x == 16.0f / 1600.0f && clusters.block.CLUSTER_SCALE.y == 9.0f / 900.0f, "CLUSTER_SCALE maps pixels to tiles");
+}
+
+static void test_global() {
+	Scene scene;
+	Scene::Camera &camera = add_camera(scene);
+	add_light(scene, Scene::Light::Point, glm::vec3(1.0f, 0.0f, -10.0f));
+	add_light(scene, Scene::Light::Hemisphere, glm::vec3(0.0f, 5.0f, 0.0f), glm::vec3(0.5f));
+	add_light(scene, Scene::Light::Directional, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(2.0f, 1.0f, 0.5f));
+
+	LightClusters clusters;
+	clusters.build(scene, camera, DrawableSize);
+	check_layout(clusters, "global lights");
+	check(clusters.global_lights == 2 && clusters.clustered_lights == 1, "hemisphere and directional lights are global, the point light is clustered");
+	check(clusters.light_data.size() == 3 * LightClusters::LightTexels, "three lights in light_data");
+	if (clusters.light_data.size() != 3 * LightClusters::LightTexels) return;
+	check(clusters.light_data[0].w == 1.0f && clusters.light_data[3].w == 3.0f, "global lights come first, in scene order (hemisphere, then directional)");
+	check(clusters.light_data[0 + 2] == glm::vec4(0.5f, 0.5f, 0.5f, 0.0f), "hemisphere energy, no range");
+	check(clusters.light_data[3 + 1].x == 0.0f && clusters.light_data[3 + 1].y == 0.0f && clusters.light_data[3 + 1].z == -1.0f, "directional light points down its -z axis");
+	check(clusters.light_data[6] == glm::vec4(1.0f, 0.0f, -10.0f, 0.0f), "point light after the global lights, with its position");
+	check(clusters.light_data[6 + 2].w == 16.0f, "unlimited point light's range is where it fades below the threshold");
+	check(clusters_with(clusters, 0) == 0 && clusters_with(clusters, 1) == 0, "global lights aren't binned");
+	check(clusters_with(clusters, 2) > 0, "point light is binned");
+}
+
+static void test_point() {
+	Scene scene;
+	Scene::Camera &camera = add_camera(scene);
+	glm::vec3 center = glm::vec3(2.0f, -1.0f, -12.0f);
+	add_light(scene, Scene::Light::Point, center, glm::vec3(10.0f), 1.5f);
+
+	LightClusters clusters;
+	clusters.build(scene, camera, DrawableSize);
+	check_layout(clusters, "one point light");
+	check(clusters.clustered_lights == 1 && clusters.max_cluster_lights == 1, "point light in front of the camera is binned");
+	check(clusters.light_data.size() == LightClusters::LightTexels && clusters.light_data[2].w == 1.5f, "point light's range is its distance limit");
+
+	uint32_t index;
+	check(cluster_at(clusters, camera, center, &index) && cluster_has(clusters, index, 0), "point light is listed in its own cluster");
+	check_coverage(clusters, camera, 0, center, 1.5f, "point light");
+	check(clusters_with(clusters, 0) < 64, "point light isn't listed far from where it reaches");
+	check(!cluster_has(clusters, clusters.cluster(0, 0, 0), 0) && !cluster_has(clusters, clusters.cluster(15, 8, 23), 0), "point light isn't in far-away clusters");
+
+	//the same light, seen from a camera that has moved and turned (looking down -x from (5,0,0) to (-7,-1,-2)):
+	Scene::Camera &turned = add_camera(scene, glm::vec3(5.0f, 0.0f, 0.0f), glm::quat(std::cos(glm::radians(45.0f)), 0.0f, std::sin(glm::radians(45.0f)), 0.0f));
+	scene.lights.back().transform->position = glm::vec3(-7.0f, -1.0f, -2.0f);
+	LightClusters turned_clusters;
+	turned_clusters.build(scene, turned, DrawableSize);
+	check(turned_clusters.cluster_data == clusters.cluster_data && turned_clusters.index_data == clusters.index_data, "moving the camera and light together bins the same way");
+	check_coverage(turned_clusters, turned, 0, glm::vec3(-7.0f, -1.0f, -2.0f), 1.5f, "point light (turned camera)");
+}
+
+static void test_culled() {
+	Scene scene;
+	Scene::Camera &camera = add_camera(scene);
+	add_light(scene, Scene::Light::Point, glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(1.0f), 2.0f); //behind the camera
+	add_light(scene, Scene::Light::Point, glm::vec3(50.0f, 0.0f, -10.0f), glm::vec3(1.0f), 2.0f); //off to the right
+	add_light(scene, Scene::Light::Point, glm::vec3(0.0f, -30.0f, -10.0f), glm::vec3(1.0f), 2.0f); //below
+	add_light(scene, Scene::Light::Point, glm::vec3(0.0f, 0.0f, -10.0f), glm::vec3(0.0f)); //dark
+	add_light(scene, Scene::Light::Spot, glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(1.0f), 2.9f); //just behind the near plane
+
+	LightClusters clusters;
+	clusters.build(scene, camera, DrawableSize);
+	check_layout(clusters, "culled lights");
+	check(clusters.clustered_lights == 0 && clusters.light_data.empty() && clusters.index_data.empty(), "lights that can't reach the view aren't binned");
+
+	//...but one that reaches past the near plane is:
+	scene.lights.back().distance = 3.5f;
+	clusters.build(scene, camera, DrawableSize);
+	check_layout(clusters, "light crossing the near plane");
+	check(clusters.clustered_lights == 1 && clusters.light_data.size() == LightClusters::LightTexels, "light reaching past the near plane is binned");
+	if (clusters.light_data.size() != LightClusters::LightTexels) return;
+	check(clusters.light_data[0].w == 2.0f, "spot light type");
+	check(std::abs(clusters.light_data[1].w - std::cos(glm::radians(22.5f))) < 1e-6f, "spot light cutoff is the cosine of half its cone");
+	uint32_t index;
+	check(cluster_at(clusters, camera, glm::vec3(0.0f, 0.0f, -0.2f), &index) && cluster_has(clusters, index, 0), "light reaching past the near plane is in the nearest slice");
+}
+
+static void test_many() {
+	//lots of lights scattered in front of the camera (and some behind it), binned into a non-default grid:
+	Scene scene;
+	Scene::Camera &camera = add_camera(scene);
+	std::mt19937 mt(0x11c5);
+	std::uniform_real_distribution< float > across(-30.0f, 30.0f);
+	std::uniform_real_distribution< float > along(-80.0f, 5.0f);
+	std::uniform_real_distribution< float > reach(0.5f, 6.0f);
+	for (uint32_t i = 0; i < 200; ++i) {
+		add_light(scene, (i % 4 == 0 ? Scene::Light::Spot : Scene::Light::Point), glm::vec3(across(mt), 0.3f * across(mt), along(mt)), glm::vec3(5.0f), reach(mt));
+	}
+	add_light(scene, Scene::Light::Hemisphere, glm::vec3(0.0f));
+
+	LightClusters clusters(8, 6, 16);
+	clusters.slice_far = 60.0f;
+	clusters.build(scene, camera, DrawableSize);
+	check_layout(clusters, "many lights");
+	check(clusters.global_lights == 1 && clusters.clustered_lights > 50 && clusters.clustered_lights < 200, "many lights: some culled, most binned");
+	check(clusters.max_cluster_lights < clusters.clustered_lights, "many lights: no cluster lists every light");
+
+	//every binned light reaches all the clusters it should:
+	uint32_t tested = 0;
+	for (uint32_t light = clusters.global_lights; light < clusters.light_data.size() / LightClusters::LightTexels; ++light) {
+		glm::vec4 const *texels = &clusters.light_data[light * LightClusters::LightTexels];
+		tested += check_coverage(clusters, camera, light, glm::vec3(texels[0]), texels[2].w, "light " + std::to_string(light));
+	}
+	check(tested > 1000, "many lights: coverage checked at plenty of points");
+
+	//building again gives the same result:
+	std::vector< glm::uvec2 > cluster_data = clusters.cluster_data;
+	std::vector< uint32_t > index_data = clusters.index_data;
+	clusters.build(scene, camera, DrawableSize);
+	check(clusters.cluster_data == cluster_data && clusters.index_data == index_data, "many lights: rebuilding is repeatable");
+}
+
+int main(int argc, char **argv) {
+	test_empty();
+	test_global();
+	test_point();
+	test_culled();
+	test_many();
+
+	return report("test-light-clusters");
+}
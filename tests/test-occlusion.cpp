@@ -0,0 +1,131 @@
+//test-occlusion: checks the software occlusion buffer in Occlusion.hpp (no window or OpenGL needed; see check.hpp).
+
+#include "check.hpp"
+
+#include "../Occlusion.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//the test camera with a 16:9 viewport:
+static float const Aspect = 16.0f / 9.0f;
+
+//object-to-world translation by 'by':
+static glm::mat4 translation(glm::vec3 const &by) {
+	glm::mat4 ret(1.0f);
+	ret[3] = glm::vec4(by, 1.0f);
+	return ret;
+}
+
+//a wall facing +z at depth z, covering [-half,half] in x and y, split into n x n quads (so there are plenty of triangles):
+static Occluder make_wall(float z, float half, uint32_t n, bool flip_winding = false) {
+	Occluder wall;
+	for (uint32_t y = 0; y <= n; ++y) {
+		for (uint32_t x = 0; x <= n; ++x) {
+			wall.positions.emplace_back(-half + 2.0f * half * float(x) / float(n), -half + 2.0f * half * float(y) / float(n), z);
+		}
+	}
+	for (uint32_t y = 0; y < n; ++y) {
+		for (uint32_t x = 0; x < n; ++x) {
+			uint32_t a = y * (n + 1) + x;
+			uint32_t b = a + 1;
+			uint32_t c = a + (n + 1);
+			uint32_t d = c + 1;
+			if (flip_winding) wall.triangles.insert(wall.triangles.end(), { a, c, b, b, c, d });
+			else wall.triangles.insert(wall.triangles.end(), { a, b, c, b, d, c });
+		}
+	}
+	return wall;
+}
+
+//is the box of the given half-size around 'center' visible?
+static bool box_visible(OcclusionBuffer const &occlusion, glm::mat4 const &clip_from_world, glm::vec3 const &center, float half) {
+	return occlusion.visible(clip_from_world, center - glm::vec3(half), center + glm::vec3(half));
+}
+
+static void test_empty() {
+	glm::mat4 clip_from_world = make_clip_from_world(Aspect);
+	OcclusionBuffer occlusion;
+	occlusion.clear();
+	occlusion.finish();
+	check(occlusion.triangles == 0, "an empty buffer has no triangles");
+	check(box_visible(occlusion, clip_from_world, glm::vec3(0.0f, 0.0f, -20.0f), 1.0f), "boxes are visible with no occluders");
+}
+
+static void test_wall(bool flip_winding) {
+	std::string winding = (flip_winding ? " (clockwise wall)" : "");
+	glm::mat4 clip_from_world = make_clip_from_world(Aspect);
+	OcclusionBuffer occlusion;
+	occlusion.clear();
+	//(covering about the middle half of the screen horizontally, and most of it vertically)
+	occlusion.add(clip_from_world, make_wall(-10.0f, 5.0f, 10, flip_winding));
+	occlusion.finish();
+	check(occlusion.triangles > 0, "wall is rasterized" + winding);
+
+	check(!box_visible(occlusion, clip_from_world, glm::vec3(0.0f, 0.0f, -20.0f), 1.0f), "box behind the wall is occluded" + winding);
+	check(!box_visible(occlusion, clip_from_world, glm::vec3(3.0f, -2.0f, -50.0f), 4.0f), "big box far behind the wall is occluded" + winding);
+	check(box_visible(occlusion, clip_from_world, glm::vec3(0.0f, 0.0f, -5.0f), 1.0f), "box in front of the wall is visible" + winding);
+	check(box_visible(occlusion, clip_from_world, glm::vec3(0.0f, 0.0f, -10.0f), 1.0f), "box through the wall is visible" + winding);
+	check(box_visible(occlusion, clip_from_world, glm::vec3(0.0f, 0.0f, 0.0f), 1.0f), "box around the camera (crossing the near plane) is visible" + winding);
+	check(box_visible(occlusion, clip_from_world, glm::vec3(30.0f, 0.0f, -40.0f), 2.0f), "box behind the wall but past its edge is visible" + winding);
+	check(box_visible(occlusion, clip_from_world, glm::vec3(10.0f, 0.0f, -20.0f), 3.0f), "box behind the wall but straddling its edge is visible" + winding);
+	check(box_visible(occlusion, clip_from_world, glm::vec3(0.0f, 0.0f, -20.0f), -1.0f), "empty boxes are visible" + winding);
+}
+
+static void test_occluder_transform() {
+	//the same wall, made in object space and moved behind a box with clip_from_object:
+	glm::mat4 clip_from_world = make_clip_from_world(Aspect);
+	glm::mat4 world_from_object = translation(glm::vec3(0.0f, 0.0f, -10.0f));
+	OcclusionBuffer occlusion;
+	occlusion.clear();
+	occlusion.add(clip_from_world * world_from_object, make_wall(0.0f, 20.0f, 4));
+	occlusion.finish();
+	check(!box_visible(occlusion, clip_from_world, glm::vec3(0.0f, 0.0f, -20.0f), 1.0f), "box behind a transformed wall is occluded");
+	check(box_visible(occlusion, clip_from_world, glm::vec3(0.0f, 0.0f, -5.0f), 1.0f), "box in front of a transformed wall is visible");
+
+	//walls behind the camera hide nothing:
+	occlusion.clear();
+	occlusion.add(clip_from_world, make_wall(10.0f, 20.0f, 4));
+	occlusion.finish();
+	check(occlusion.triangles == 0, "wall behind the camera is clipped away");
+	check(box_visible(occlusion, clip_from_world, glm::vec3(0.0f, 0.0f, -20.0f), 1.0f), "wall behind the camera hides nothing");
+}
+
+static void test_threads() {
+	//one band or several, the result is the same (each tile sees its triangles in the same order):
+	glm::mat4 clip_from_world = make_clip_from_world(Aspect);
+	OcclusionBuffer one(256, 144, 1);
+	OcclusionBuffer four(256, 144, 4);
+	for (OcclusionBuffer *occlusion : { &one, &four }) {
+		occlusion->clear();
+		occlusion->add(clip_from_world, make_wall(-10.0f, 8.0f, 12));
+		occlusion->add(clip_from_world * translation(glm::vec3(6.0f, 3.0f, -5.0f)), make_wall(0.0f, 5.0f, 12, true));
+		occlusion->finish();
+	}
+	check(one.triangles >= 64 && one.triangles == four.triangles, "both buffers rasterize the same (many) triangles");
+	bool same = one.tiles.size() == four.tiles.size() && std::memcmp(one.tiles.data(), four.tiles.data(), one.tiles.size() * sizeof(OcclusionBuffer::Tile)) == 0;
+	check(same, "tiles are the same with one band or four");
+	check(one.block_depth == four.block_depth, "hierarchical depth is the same with one band or four");
+
+	//finishing a second frame reuses everything and gives the same answer:
+	four.clear();
+	four.add(clip_from_world, make_wall(-10.0f, 8.0f, 12));
+	four.add(clip_from_world * translation(glm::vec3(6.0f, 3.0f, -5.0f)), make_wall(0.0f, 5.0f, 12, true));
+	four.finish();
+	check(std::memcmp(one.tiles.data(), four.tiles.data(), one.tiles.size() * sizeof(OcclusionBuffer::Tile)) == 0, "a second frame gives the same tiles");
+}
+
+int main(int argc, char **argv) {
+	test_empty();
+	test_wall(false);
+	test_wall(true);
+	test_occluder_transform();
+	test_threads();
+
+	return report("test-occlusion");
+}
@@ -0,0 +1,255 @@
+//test-scene-versions: checks that v1 and v2 scene files load the same scene, and that v2 files' precomputed bounds and spatial index are right (no window or OpenGL needed; see check.hpp).
+//
+//Each of the game's scene files (v2) is rewritten as a v1 file -- the same str0, xfh0, msh0, cam0, and lmp0 chunks, with v1 headers and no table of contents -- then both are loaded and compared.
+// (built into dist/, next to the scene files; pass scene file names to check others)
+
+#include "check.hpp"
+
+#include "../Scene.hpp"
+#include "../data_path.hpp"
+#include "../read_write_chunk.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//a scene as loaded, with its mesh references copied out of the load callback:
+struct Loaded {
+	Scene scene;
+	struct Ref {
+		Scene::Transform *transform;
+		std::string mesh_name;
+		glm::vec3 min, max;
+	};
+	std::vector< Ref > refs;
+};
+
+static void load(std::string const &filename, Loaded *loaded) {
+	loaded->scene.load_batched(filename, [&](Scene &, std::vector< Scene::MeshRef > const &refs) {
+		for (auto const &ref : refs) {
+			loaded->refs.emplace_back(Loaded::Ref{ ref.transform, std::string(ref.mesh_name), ref.min, ref.max });
+		}
+	});
+}
+
+//write the required chunks of v2 scene file 'data' to 'v1_filename' as a v1 file:
+static void write_v1(std::vector< char > const &data, std::string const &v1_filename) {
+	struct TocEntry {
+		char magic[4];
+		uint32_t offset, size;
+	};
+	char const *at = data.data();
+	ChunkView< TocEntry > toc = view_chunk< TocEntry >(&at, data.data() + data.size(), "toc0");
+
+	std::ofstream out(v1_filename, std::ios::binary);
+	for (std::string magic : { "str0", "xfh0", "msh0", "cam0", "lmp0" }) {
+		for (size_t i = 0; i < toc.size(); ++i) {
+			TocEntry entry = toc[i];
+			if (std::string(entry.magic, 4) != magic) continue;
+			char const *chunk = data.data() + entry.offset;
+			size_t size = 0;
+			char const *contents = skip_chunk(&chunk, data.data() + data.size(), magic, 1, &size);
+			ChunkHeader header;
+			std::memcpy(header.magic, magic.data(), 4);
+			header.size = uint32_t(size);
+			out.write(reinterpret_cast< char const * >(&header), sizeof(header));
+			out.write(contents, size);
+		}
+	}
+	if (!out) throw std::runtime_error("Failed to write '" + v1_filename + "'.");
+}
+
+//index of each transform in its scene's list:
+static std::unordered_map< Scene::Transform const *, size_t > transform_indices(Scene const &scene) {
+	std::unordered_map< Scene::Transform const *, size_t > ret;
+	for (auto const &t : scene.transforms) ret.emplace(&t, ret.size());
+	ret.emplace(nullptr, size_t(-1));
+	return ret;
+}
+
+static void compare(Loaded const &v1, Loaded const &v2, std::string const &name) {
+	auto v1_index = transform_indices(v1.scene);
+	auto v2_index = transform_indices(v2.scene);
+
+	bool same_transforms = v1.scene.transforms.size() == v2.scene.transforms.size();
+	for (auto a = v1.scene.transforms.begin(), b = v2.scene.transforms.begin(); same_transforms && a != v1.scene.transforms.end(); ++a, ++b) {
+		same_transforms = a->name.view() == b->name.view() && v1_index[a->parent] == v2_index[b->parent]
+			&& a->position == b->position && a->rotation == b->rotation && a->scale == b->scale;
+	}
+	check(same_transforms, name + ": v1 and v2 have the same transforms");
+
+	bool same_refs = v1.refs.size() == v2.refs.size();
+	for (size_t i = 0; same_refs && i < v1.refs.size(); ++i) {
+		same_refs = v1_index[v1.refs[i].transform] == v2_index[v2.refs[i].transform] && v1.refs[i].mesh_name == v2.refs[i].mesh_name;
+	}
+	check(same_refs, name + ": v1 and v2 have the same mesh references");
+
+	bool same_cameras = v1.scene.cameras.size() == v2.scene.cameras.size();
+	for (auto a = v1.scene.cameras.begin(), b = v2.scene.cameras.begin(); same_cameras && a != v1.scene.cameras.end(); ++a, ++b) {
+		same_cameras = v1_index[a->transform] == v2_index[b->transform] && a->fovy == b->fovy && a->aspect == b->aspect && a->near == b->near;
+	}
+	check(same_cameras, name + ": v1 and v2 have the same cameras");
+
+	bool same_lights = v1.scene.lights.size() == v2.scene.lights.size();
+	for (auto a = v1.scene.lights.begin(), b = v2.scene.lights.begin(); same_lights && a != v1.scene.lights.end(); ++a, ++b) {
+		same_lights = v1_index[a->transform] == v2_index[b->transform] && a->type == b->type && a->energy == b->energy
+			&& a->spot_fov == b->spot_fov && a->distance == b->distance;
+	}
+	check(same_lights, name + ": v1 and v2 have the same lights");
+
+	bool v1_unbounded = v1.scene.static_bounds.empty() && v1.scene.static_index.empty();
+	for (auto const &ref : v1.refs) {
+		if (ref.min.x <= ref.max.x) v1_unbounded = false;
+	}
+	check(v1_unbounded, name + ": v1 has no precomputed bounds");
+}
+
+//the v2 file's bounds and index agree with its transforms and with each other:
+static void check_bounds(Loaded const &v2, std::string const &name) {
+	Scene const &scene = v2.scene;
+	if (scene.static_bounds.empty()) {
+		std::cout << name << ": no precomputed bounds (so just checked v1 against v2)." << std::endl;
+		return;
+	}
+	check(scene.static_bounds.size() == v2.refs.size(), name + ": one static bounds entry per mesh reference");
+
+	//world bounds are the exported object bounds, moved by the (loaded) transform:
+	std::vector< bool > found(v2.refs.size(), false);
+	bool objects_match = true, worlds_match = true;
+	for (auto const &b : scene.static_bounds) {
+		auto ref = std::find_if(v2.refs.begin(), v2.refs.end(), [&](Loaded::Ref const &r) {
+			return r.transform == b.transform && !found[&r - &v2.refs[0]] && r.min == b.object_min && r.max == b.object_max;
+		});
+		if (ref == v2.refs.end()) {
+			objects_match = false;
+			continue;
+		}
+		found[ref - v2.refs.begin()] = true;
+
+		glm::mat4x3 world_from_local = b.transform->make_world_from_local();
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		for (uint32_t c = 0; c < 8; ++c) {
+			glm::vec3 corner = glm::vec3((c & 1) ? b.object_max.x : b.object_min.x, (c & 2) ? b.object_max.y : b.object_min.y, (c & 4) ? b.object_max.z : b.object_min.z);
+			glm::vec3 world = world_from_local * glm::vec4(corner, 1.0f);
+			min = glm::min(min, world);
+			max = glm::max(max, world);
+		}
+		float tolerance = 1e-4f * std::max(1.0f, glm::length(max - min) + glm::length(max + min));
+		for (uint32_t c = 0; c < 3; ++c) {
+			if (std::abs(min[c] - b.min[c]) > tolerance || std::abs(max[c] - b.max[c]) > tolerance) worlds_match = false;
+		}
+	}
+	check(objects_match, name + ": each static bounds entry is a mesh reference's bounds");
+	check(worlds_match, name + ": world bounds are the object bounds moved by the transform");
+
+	if (scene.static_index.empty()) return;
+
+	//every entry is in exactly one leaf, and nodes contain what's under them:
+	std::vector< uint32_t > leaf_count(scene.static_bounds.size(), 0);
+	bool contained = true;
+	auto inside = [](glm::vec3 const &min, glm::vec3 const &max, glm::vec3 const &outer_min, glm::vec3 const &outer_max) {
+		for (uint32_t c = 0; c < 3; ++c) {
+			if (min[c] < outer_min[c] || max[c] > outer_max[c]) return false;
+		}
+		return true;
+	};
+	std::vector< uint32_t > todo{ 0 };
+	while (!todo.empty()) {
+		Scene::StaticNode const &node = scene.static_index[todo.back()];
+		todo.pop_back();
+		if (node.count == 0) {
+			for (uint32_t child : { node.first, node.first + 1 }) {
+				Scene::StaticNode const &c = scene.static_index[child];
+				if (!inside(c.min, c.max, node.min, node.max)) contained = false;
+				todo.emplace_back(child);
+			}
+		} else {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				leaf_count[i] += 1;
+				if (!inside(scene.static_bounds[i].min, scene.static_bounds[i].max, node.min, node.max)) contained = false;
+			}
+		}
+	}
+	check(std::all_of(leaf_count.begin(), leaf_count.end(), [](uint32_t c) { return c == 1; }), name + ": every mesh is in exactly one index leaf");
+	check(contained, name + ": index nodes contain their children");
+
+	//queries through the index find the same meshes as checking every entry:
+	glm::vec3 scene_min = scene.static_index[0].min;
+	glm::vec3 scene_max = scene.static_index[0].max;
+	std::mt19937 mt(0x5ce9e);
+	std::uniform_real_distribution< float > unit(0.0f, 1.0f);
+	bool same_queries = true;
+	uint32_t found_any = 0;
+	for (uint32_t q = 0; q < 200; ++q) {
+		glm::vec3 a = scene_min + glm::vec3(unit(mt), unit(mt), unit(mt)) * (scene_max - scene_min);
+		glm::vec3 half = 0.25f * glm::vec3(unit(mt), unit(mt), unit(mt)) * (scene_max - scene_min);
+		std::vector< Scene::Transform * > indexed, expected;
+		scene.query_static(a - half, a + half, &indexed);
+		for (auto const &b : scene.static_bounds) {
+			bool overlaps = true;
+			for (uint32_t c = 0; c < 3; ++c) {
+				if (b.max[c] < a[c] - half[c] || a[c] + half[c] < b.min[c]) overlaps = false;
+			}
+			if (overlaps) expected.emplace_back(b.transform);
+		}
+		std::sort(indexed.begin(), indexed.end());
+		std::sort(expected.begin(), expected.end());
+		if (indexed != expected) same_queries = false;
+		if (!expected.empty()) found_any += 1;
+	}
+	check(same_queries && found_any > 0, name + ": query_static matches checking every entry");
+
+	//copies keep the bounds and index, pointing at their own transforms:
+	Scene copy(scene);
+	auto copy_index = transform_indices(copy);
+	auto scene_index = transform_indices(scene);
+	bool copied = copy.static_bounds.size() == scene.static_bounds.size() && copy.static_index.size() == scene.static_index.size();
+	for (size_t i = 0; copied && i < scene.static_bounds.size(); ++i) {
+		copied = copy_index.count(copy.static_bounds[i].transform) && copy_index[copy.static_bounds[i].transform] == scene_index[scene.static_bounds[i].transform]
+			&& copy.static_bounds[i].min == scene.static_bounds[i].min && copy.static_bounds[i].max == scene.static_bounds[i].max;
+	}
+	check(copied, name + ": copying the scene copies its bounds and index");
+}
+
+int main(int argc, char **argv) {
+	std::vector< std::string > filenames;
+	for (int i = 1; i < argc; ++i) filenames.emplace_back(argv[i]);
+	if (filenames.empty()) filenames = { data_path("hexapod.scene"), data_path("test.scene"), data_path("oil_rig.scene") };
+
+	for (auto const &filename : filenames) {
+		std::string name = std::filesystem::path(filename).filename().string();
+		try {
+			//(read directly, since v1 is made from the file's bytes)
+			std::ifstream in(filename, std::ios::binary);
+			std::vector< char > data((std::istreambuf_iterator< char >(in)), std::istreambuf_iterator< char >());
+			check(data.size() >= 4 && std::string(data.data(), 4) == "toc0", name + ": is a v2 file");
+			if (data.size() < 4 || std::string(data.data(), 4) != "toc0") continue;
+
+			std::string v1_filename = (std::filesystem::temp_directory_path() / ("test-scene-versions-v1-" + name)).string();
+			write_v1(data, v1_filename);
+
+			Loaded v1, v2;
+			load(v1_filename, &v1);
+			load(filename, &v2);
+			std::filesystem::remove(v1_filename);
+
+			compare(v1, v2, name);
+			check_bounds(v2, name);
+		} catch (std::exception &e) {
+			check(false, name + ": loads (" + e.what() + ")");
+		}
+	}
+
+	return report("test-scene-versions");
+}